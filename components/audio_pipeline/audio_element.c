@@ -24,12 +24,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "audio_element.h"
 #include "audio_mem.h"
 #include "audio_mutex.h"
@@ -101,6 +103,8 @@ struct audio_element {
 
     int                         buf_size;
     char                        *buf;
+    char                        *out_buf;
+    bool                        zero_copy;
 
     char                        *tag;
     int                         task_stack;
@@ -108,10 +112,13 @@ struct audio_element {
     int                         task_core;
     xSemaphoreHandle            lock;
     audio_element_info_t        info;
+    atomic_uint                 info_seq;
+    portMUX_TYPE                info_spinlock;
     audio_element_info_t        *report_info;
 
     bool                        stack_in_ext;
     audio_thread_t              audio_thread;
+    xSemaphoreHandle            host_wakeup;
 
     /* PrivateData */
     void                        *data;
@@ -123,6 +130,13 @@ struct audio_element {
     volatile bool               is_running;
     volatile bool               task_run;
     volatile bool               stopping;
+
+    /* Profiling */
+    volatile bool               profiling;
+    audio_element_profile_t     *profile;
+    int64_t                     profile_io_us;
+    volatile uint32_t           profile_reset_gen;  /* Bumped to ask the element task to clear the counters */
+    uint32_t                    profile_clear_gen;  /* Last reset applied, only touched by the element task */
 };
 
 const static int STOPPED_BIT = BIT0;
@@ -142,6 +156,55 @@ static esp_err_t audio_element_force_set_state(audio_element_handle_t el, audio_
     return ESP_OK;
 }
 
+/*
+ * `info` is a seqlock: the sequence is odd while a writer is inside, readers copy without any lock
+ * and retry if the sequence moved. Writers are serialized by a spinlock, they only store a few fields.
+ */
+static inline void audio_element_info_write_begin(audio_element_handle_t el)
+{
+    portENTER_CRITICAL(&el->info_spinlock);
+    atomic_store_explicit(&el->info_seq, atomic_load_explicit(&el->info_seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void audio_element_info_write_end(audio_element_handle_t el)
+{
+    atomic_store_explicit(&el->info_seq, atomic_load_explicit(&el->info_seq, memory_order_relaxed) + 1, memory_order_release);
+    portEXIT_CRITICAL(&el->info_spinlock);
+}
+
+static inline void audio_element_info_read(audio_element_handle_t el, audio_element_info_t *info)
+{
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&el->info_seq, memory_order_acquire);
+        memcpy(info, (const void *)&el->info, sizeof(audio_element_info_t));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&el->info_seq, memory_order_relaxed));
+}
+
+static inline void audio_element_format_read(audio_element_handle_t el, audio_element_format_t *fmt)
+{
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&el->info_seq, memory_order_acquire);
+        fmt->sample_rates = el->info.sample_rates;
+        fmt->channels = el->info.channels;
+        fmt->bits = el->info.bits;
+        fmt->codec_fmt = el->info.codec_fmt;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&el->info_seq, memory_order_relaxed));
+}
+
+/*
+ * Elements with their own task and hosted elements both take commands through the event queue,
+ * only a task-less element is driven directly by the caller.
+ */
+static inline bool audio_element_has_task(audio_element_handle_t el)
+{
+    return el->task_stack > 0 || el->host_wakeup != NULL;
+}
+
 static esp_err_t audio_element_cmd_send(audio_element_handle_t el, audio_element_msg_cmd_t cmd)
 {
     audio_event_iface_msg_t msg = {
@@ -150,17 +213,21 @@ static esp_err_t audio_element_cmd_send(audio_element_handle_t el, audio_element
         .cmd = cmd,
     };
     ESP_LOGV(TAG, "[%s]evt internal cmd = %d", el->tag, msg.cmd);
-    return audio_event_iface_cmd(el->iface_event, &msg);
+    esp_err_t ret = audio_event_iface_cmd(el->iface_event, &msg);
+    if (ret == ESP_OK && el->host_wakeup) {
+        xSemaphoreGive(el->host_wakeup);
+    }
+    return ret;
 }
 
-static esp_err_t audio_element_msg_sendout(audio_element_handle_t el, audio_event_iface_msg_t *msg)
+static esp_err_t audio_element_msg_sendout(audio_element_handle_t el, audio_event_iface_msg_t *msg, audio_event_coalesce_t coalesce)
 {
     msg->source = el;
     msg->source_type = AUDIO_ELEMENT_TYPE_ELEMENT;
     if (el->events_type == EVENTS_TYPE_CB && el->callback_event.cb) {
         return el->callback_event.cb(el, msg, el->callback_event.ctx);
     }
-    return audio_event_iface_sendout(el->iface_event, msg);
+    return audio_event_iface_sendout_coalesce(el->iface_event, msg, coalesce);
 }
 
 esp_err_t audio_element_process_init(audio_element_handle_t el)
@@ -327,13 +394,97 @@ static esp_err_t audio_element_on_cmd(audio_event_iface_msg_t *msg, void *contex
     return ret;
 }
 
+static void audio_element_profile_clear(audio_element_profile_t *profile)
+{
+    memset(profile, 0, sizeof(audio_element_profile_t));
+    profile->in_rb_fill_min = -1;
+}
+
+static void audio_element_profile_sample_rb(audio_element_handle_t el)
+{
+    audio_element_profile_t *profile = el->profile;
+    profile->rb_samples++;
+    if (el->read_type == IO_TYPE_RB && el->in.input_rb) {
+        int fill = rb_bytes_filled(el->in.input_rb);
+        profile->in_rb_fill_sum += fill;
+        if (profile->in_rb_fill_min < 0 || fill < profile->in_rb_fill_min) {
+            profile->in_rb_fill_min = fill;
+        }
+    }
+    if (el->write_type == IO_TYPE_RB && el->out.output_rb) {
+        int fill = rb_bytes_filled(el->out.output_rb);
+        profile->out_rb_fill_sum += fill;
+        if (fill > profile->out_rb_fill_max) {
+            profile->out_rb_fill_max = fill;
+        }
+    }
+}
+
+static void audio_element_profile_process(audio_element_handle_t el, int64_t elapsed_us)
+{
+    audio_element_profile_t *profile = el->profile;
+    uint32_t us = elapsed_us > 0 ? (uint32_t)elapsed_us : 0;
+    int bucket = 31 - __builtin_clz(us | 1);
+    if (bucket >= AEL_PROFILE_HIST_BUCKETS) {
+        bucket = AEL_PROFILE_HIST_BUCKETS - 1;
+    }
+    profile->process_hist[bucket]++;
+    profile->process_cnt++;
+    profile->process_us += us;
+    if (us > profile->process_max_us) {
+        profile->process_max_us = us;
+    }
+}
+
+static void audio_element_profile_io(audio_element_handle_t el, int len, int64_t start_us, bool input)
+{
+    audio_element_profile_t *profile = el->profile;
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    el->profile_io_us += elapsed_us;
+    if (input) {
+        profile->in_blocked_us += elapsed_us;
+        if (len > 0) {
+            profile->bytes_in += len;
+        } else if (len == AEL_IO_TIMEOUT) {
+            profile->in_timeout_cnt++;
+        }
+    } else {
+        profile->out_blocked_us += elapsed_us;
+        if (len > 0) {
+            profile->bytes_out += len;
+        } else if (len == AEL_IO_TIMEOUT) {
+            profile->out_timeout_cnt++;
+        }
+    }
+    if (len == AEL_IO_ABORT) {
+        profile->abort_cnt++;
+    }
+}
+
 static esp_err_t audio_element_process_running(audio_element_handle_t el)
 {
     int process_len = -1;
     if (el->state < AEL_STATE_RUNNING || !el->is_running) {
         return ESP_ERR_INVALID_STATE;
     }
+    // Latched once, `audio_element_profile_enable` may flip the flag from another task meanwhile
+    bool profiling = el->profiling;
+    int64_t start_us = 0;
+    if (profiling) {
+        // The counters are only written by this task, so a reset asked from another one is applied here
+        uint32_t reset_gen = el->profile_reset_gen;
+        if (reset_gen != el->profile_clear_gen) {
+            audio_element_profile_clear(el->profile);
+            el->profile_clear_gen = reset_gen;
+        }
+        audio_element_profile_sample_rb(el);
+        el->profile_io_us = 0;
+        start_us = esp_timer_get_time();
+    }
     process_len = el->process(el, el->buf, el->buf_size);
+    if (profiling) {
+        audio_element_profile_process(el, esp_timer_get_time() - start_us - el->profile_io_us);
+    }
     if (process_len <= 0) {
         switch (process_len) {
             case AEL_IO_ABORT:
@@ -370,9 +521,57 @@ static esp_err_t audio_element_process_running(audio_element_handle_t el)
     return ESP_OK;
 }
 
+static void audio_element_input_check(audio_element_handle_t el, int in_len)
+{
+    switch (in_len) {
+        case AEL_IO_ABORT:
+            ESP_LOGW(TAG, "IN-[%s] AEL_IO_ABORT", el->tag);
+            break;
+        case AEL_IO_DONE:
+        case AEL_IO_OK:
+            ESP_LOGI(TAG, "IN-[%s] AEL_IO_DONE,%d", el->tag, in_len);
+            break;
+        case AEL_IO_FAIL:
+            ESP_LOGE(TAG, "IN-[%s] AEL_STATUS_ERROR_INPUT", el->tag);
+            audio_element_report_status(el, AEL_STATUS_ERROR_INPUT);
+            break;
+        case AEL_IO_TIMEOUT:
+            // ESP_LOGD(TAG, "IN-[%s] AEL_IO_TIMEOUT", el->tag);
+            break;
+        default:
+            ESP_LOGE(TAG, "IN-[%s] Input return not support,ret:%d", el->tag, in_len);
+            break;
+    }
+}
+
+static void audio_element_output_check(audio_element_handle_t el, int output_len)
+{
+    switch (output_len) {
+        case AEL_IO_ABORT:
+            ESP_LOGW(TAG, "OUT-[%s] AEL_IO_ABORT", el->tag);
+            break;
+        case AEL_IO_DONE:
+        case AEL_IO_OK:
+            ESP_LOGI(TAG, "OUT-[%s] AEL_IO_DONE,%d", el->tag, output_len);
+            break;
+        case AEL_IO_FAIL:
+            ESP_LOGE(TAG, "OUT-[%s] AEL_STATUS_ERROR_OUTPUT", el->tag);
+            audio_element_report_status(el, AEL_STATUS_ERROR_OUTPUT);
+            break;
+        case AEL_IO_TIMEOUT:
+            ESP_LOGW(TAG, "OUT-[%s] AEL_IO_TIMEOUT", el->tag);
+            break;
+        default:
+            ESP_LOGE(TAG, "OUT-[%s] Output return not support,ret:%d", el->tag, output_len);
+            break;
+    }
+}
+
 audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer, int wanted_size)
 {
     int in_len = 0;
+    bool profiling = el->profiling;
+    int64_t start_us = profiling ? esp_timer_get_time() : 0;
     if (el->read_type == IO_TYPE_CB) {
         if (el->in.read_cb.cb == NULL) {
             ESP_LOGE(TAG, "[%s] Read IO Type callback but callback not set", el->tag);
@@ -390,26 +589,11 @@ audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer,
         ESP_LOGE(TAG, "[%s] Invalid read IO type", el->tag);
         return ESP_FAIL;
     }
+    if (profiling) {
+        audio_element_profile_io(el, in_len, start_us, true);
+    }
     if (in_len <= 0) {
-        switch (in_len) {
-            case AEL_IO_ABORT:
-                ESP_LOGW(TAG, "IN-[%s] AEL_IO_ABORT", el->tag);
-                break;
-            case AEL_IO_DONE:
-            case AEL_IO_OK:
-                ESP_LOGI(TAG, "IN-[%s] AEL_IO_DONE,%d", el->tag, in_len);
-                break;
-            case AEL_IO_FAIL:
-                ESP_LOGE(TAG, "IN-[%s] AEL_STATUS_ERROR_INPUT", el->tag);
-                audio_element_report_status(el, AEL_STATUS_ERROR_INPUT);
-                break;
-            case AEL_IO_TIMEOUT:
-                // ESP_LOGD(TAG, "IN-[%s] AEL_IO_TIMEOUT", el->tag);
-                break;
-            default:
-                ESP_LOGE(TAG, "IN-[%s] Input return not support,ret:%d", el->tag, in_len);
-                break;
-        }
+        audio_element_input_check(el, in_len);
     }
     return in_len;
 }
@@ -417,6 +601,8 @@ audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer,
 audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer, int write_size)
 {
     int output_len = 0;
+    bool profiling = el->profiling;
+    int64_t start_us = profiling ? esp_timer_get_time() : 0;
     if (el->write_type == IO_TYPE_CB) {
         if (el->out.write_cb.cb && write_size) {
             output_len = el->out.write_cb.cb(el, buffer, write_size, el->output_wait_time,
@@ -430,37 +616,107 @@ audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer
             }
         }
     }
+    if (profiling) {
+        audio_element_profile_io(el, output_len, start_us, false);
+    }
     if (output_len <= 0) {
-        switch (output_len) {
-            case AEL_IO_ABORT:
-                ESP_LOGW(TAG, "OUT-[%s] AEL_IO_ABORT", el->tag);
-                break;
-            case AEL_IO_DONE:
-            case AEL_IO_OK:
-                ESP_LOGI(TAG, "OUT-[%s] AEL_IO_DONE,%d", el->tag, output_len);
-                break;
-            case AEL_IO_FAIL:
-                ESP_LOGE(TAG, "OUT-[%s] AEL_STATUS_ERROR_OUTPUT", el->tag);
-                audio_element_report_status(el, AEL_STATUS_ERROR_OUTPUT);
-                break;
-            case AEL_IO_TIMEOUT:
-                ESP_LOGW(TAG, "OUT-[%s] AEL_IO_TIMEOUT", el->tag);
-                break;
-            default:
-                ESP_LOGE(TAG, "OUT-[%s] Output return not support,ret:%d", el->tag, output_len);
-                break;
-        }
+        audio_element_output_check(el, output_len);
     }
     return output_len;
 }
-void audio_element_task(void *pv)
+
+audio_element_err_t audio_element_input_acquire(audio_element_handle_t el, char **buffer, int wanted_size)
+{
+    int in_len = 0;
+    if (el->read_type == IO_TYPE_RB) {
+        if (el->in.input_rb == NULL) {
+            ESP_LOGE(TAG, "[%s] Read IO type ringbuf but ringbuf not set", el->tag);
+            return ESP_FAIL;
+        }
+        bool profiling = el->profiling;
+        int64_t start_us = profiling ? esp_timer_get_time() : 0;
+        in_len = rb_acquire_read(el->in.input_rb, buffer, wanted_size, el->input_wait_time);
+        if (profiling) {
+            audio_element_profile_io(el, in_len, start_us, true);
+        }
+        if (in_len <= 0) {
+            audio_element_input_check(el, in_len);
+        }
+        return in_len;
+    }
+    // Callback input has no ringbuffer to point into, fall back to reading into the element buffer
+    if (el->buf == NULL) {
+        ESP_LOGE(TAG, "[%s] No element buffer for callback input", el->tag);
+        return ESP_FAIL;
+    }
+    *buffer = el->buf;
+    return audio_element_input(el, el->buf, wanted_size > el->buf_size ? el->buf_size : wanted_size);
+}
+
+audio_element_err_t audio_element_input_release(audio_element_handle_t el, int len)
+{
+    if (el->read_type == IO_TYPE_RB && el->in.input_rb) {
+        return rb_release_read(el->in.input_rb, len);
+    }
+    return ESP_OK;
+}
+
+audio_element_err_t audio_element_output_acquire(audio_element_handle_t el, char **buffer, int wanted_size)
+{
+    int out_len = 0;
+    if (el->write_type == IO_TYPE_RB) {
+        if (el->out.output_rb == NULL) {
+            return ESP_FAIL;
+        }
+        bool profiling = el->profiling;
+        int64_t start_us = profiling ? esp_timer_get_time() : 0;
+        out_len = rb_acquire_write(el->out.output_rb, buffer, wanted_size, el->output_wait_time);
+        if (profiling) {
+            // Bytes are accounted on commit
+            audio_element_profile_io(el, out_len > 0 ? 0 : out_len, start_us, false);
+        }
+        if (out_len <= 0) {
+            audio_element_output_check(el, out_len);
+        }
+        return out_len;
+    }
+    // Callback output, stage the data in a private buffer and hand it to the callback on commit
+    if (el->out_buf == NULL) {
+        el->out_buf = audio_calloc(1, el->buf_size);
+        AUDIO_MEM_CHECK(TAG, el->out_buf, return ESP_FAIL);
+    }
+    *buffer = el->out_buf;
+    return wanted_size > el->buf_size ? el->buf_size : wanted_size;
+}
+
+audio_element_err_t audio_element_output_commit(audio_element_handle_t el, int len)
+{
+    if (el->write_type == IO_TYPE_RB) {
+        if (el->out.output_rb == NULL) {
+            return ESP_FAIL;
+        }
+        if (rb_commit_write(el->out.output_rb, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (el->profiling) {
+            el->profile->bytes_out += len;
+        }
+        if (rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) {
+            xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+        }
+        return len;
+    }
+    return audio_element_output(el, el->out_buf, len);
+}
+
+static void audio_element_task_init(audio_element_handle_t el)
 {
-    audio_element_handle_t el = (audio_element_handle_t)pv;
     el->task_run = true;
     xEventGroupSetBits(el->state_event, TASK_CREATED_BIT);
     audio_element_force_set_state(el, AEL_STATE_INIT);
     audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
-    if (el->buf_size > 0) {
+    // Zero-copy elements work on the ringbuffer spans, the element buffer is only needed for callback input
+    if (el->buf_size > 0 && (el->zero_copy == false || el->read_type == IO_TYPE_CB)) {
         el->buf = audio_calloc(1, el->buf_size);
         AUDIO_MEM_CHECK(TAG, el->buf, {
             el->task_run = false;
@@ -468,6 +724,32 @@ void audio_element_task(void *pv)
         });
     }
     xEventGroupClearBits(el->state_event, STOPPED_BIT);
+}
+
+static void audio_element_task_deinit(audio_element_handle_t el)
+{
+    if (el->is_open && el->close) {
+        ESP_LOGD(TAG, "[%s-%p] el closed", el->tag, el);
+        el->close(el);
+        audio_element_force_set_state(el, AEL_STATE_STOPPED);
+    }
+    el->is_open = false;
+    audio_free(el->buf);
+    el->buf = NULL;
+    audio_free(el->out_buf);
+    el->out_buf = NULL;
+    el->stopping = false;
+    el->task_run = false;
+    ESP_LOGD(TAG, "[%s-%p] el task deleted,%d", el->tag, el, uxTaskGetStackHighWaterMark(NULL));
+    xEventGroupSetBits(el->state_event, STOPPED_BIT);
+    xEventGroupSetBits(el->state_event, RESUMED_BIT);
+    xEventGroupSetBits(el->state_event, TASK_DESTROYED_BIT);
+}
+
+void audio_element_task(void *pv)
+{
+    audio_element_handle_t el = (audio_element_handle_t)pv;
+    audio_element_task_init(el);
     esp_err_t ret = ESP_OK;
     while (el->task_run) {
         if ((ret = audio_event_iface_waiting_cmd_msg(el->iface_event)) != ESP_OK) {
@@ -484,22 +766,49 @@ void audio_element_task(void *pv)
             // continue;
         }
     }
+    audio_element_task_deinit(el);
+    audio_thread_delete_task(&el->audio_thread);
+}
 
-    if (el->is_open && el->close) {
-        ESP_LOGD(TAG, "[%s-%p] el closed", el->tag, el);
-        el->close(el);
-        audio_element_force_set_state(el, AEL_STATE_STOPPED);
+esp_err_t audio_element_set_host(audio_element_handle_t el, SemaphoreHandle_t wakeup)
+{
+    AUDIO_NULL_CHECK(TAG, el, return ESP_ERR_INVALID_ARG);
+    if (el->task_run) {
+        ESP_LOGE(TAG, "[%s] Element is running, terminate it before changing host", el->tag);
+        return ESP_FAIL;
     }
-    el->is_open = false;
-    audio_free(el->buf);
-    el->buf = NULL;
-    el->stopping = false;
-    el->task_run = false;
-    ESP_LOGD(TAG, "[%s-%p] el task deleted,%d", el->tag, el, uxTaskGetStackHighWaterMark(NULL));
-    xEventGroupSetBits(el->state_event, STOPPED_BIT);
-    xEventGroupSetBits(el->state_event, RESUMED_BIT);
-    xEventGroupSetBits(el->state_event, TASK_DESTROYED_BIT);
-    audio_thread_delete_task(&el->audio_thread);
+    el->host_wakeup = wakeup;
+    return ESP_OK;
+}
+
+esp_err_t audio_element_host_step(audio_element_handle_t el, bool process)
+{
+    if (el->host_wakeup == NULL || el->task_run == false) {
+        return ESP_FAIL;
+    }
+    // The host serves several elements, so it never blocks on the command queue of one of them
+    audio_event_iface_set_cmd_waiting_timeout(el->iface_event, 0);
+    esp_err_t ret = audio_event_iface_waiting_cmd_msg(el->iface_event);
+    if (ret != ESP_OK) {
+        xEventGroupSetBits(el->state_event, STOPPED_BIT);
+        if (ret == AEL_IO_ABORT) {
+            audio_element_task_deinit(el);
+            return ESP_FAIL;
+        }
+    }
+    if (process) {
+        audio_element_process_running(el);
+    }
+    if (el->state < AEL_STATE_RUNNING || !el->is_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+bool audio_element_host_cmd_pending(audio_element_handle_t el)
+{
+    QueueHandle_t queue = audio_event_iface_get_msg_queue_handle(el->iface_event);
+    return queue && uxQueueMessagesWaiting(queue) > 0;
 }
 
 esp_err_t audio_element_reset_state(audio_element_handle_t el)
@@ -557,21 +866,20 @@ char *audio_element_get_tag(audio_element_handle_t el)
 
 esp_err_t audio_element_set_uri(audio_element_handle_t el, const char *uri)
 {
+    esp_err_t ret = ESP_OK;
     mutex_lock(el->lock);
-    if (el->info.uri) {
-        audio_free(el->info.uri);
-        el->info.uri = NULL;
-    }
-
+    char *new_uri = NULL;
     if (uri) {
-        el->info.uri = audio_strdup(uri);
-        AUDIO_MEM_CHECK(TAG, el->info.uri, {
-            mutex_unlock(el->lock);
-            return ESP_ERR_NO_MEM;
-        });
-    }
+        new_uri = audio_strdup(uri);
+        AUDIO_MEM_CHECK(TAG, new_uri, ret = ESP_ERR_NO_MEM);
+    }
+    audio_element_info_write_begin(el);
+    char *old_uri = el->info.uri;
+    el->info.uri = new_uri;
+    audio_element_info_write_end(el);
+    audio_free(old_uri);
     mutex_unlock(el->lock);
-    return ESP_OK;
+    return ret;
 }
 
 char *audio_element_get_uri(audio_element_handle_t el)
@@ -603,10 +911,9 @@ esp_err_t audio_element_msg_remove_listener(audio_element_handle_t el, audio_eve
 esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t *info)
 {
     if (info && el) {
-        //FIXME: We will got reset if lock mutex here
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         memcpy(&el->info, info, sizeof(audio_element_info_t));
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -615,9 +922,16 @@ esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t
 esp_err_t audio_element_getinfo(audio_element_handle_t el, audio_element_info_t *info)
 {
     if (info && el) {
-        mutex_lock(el->lock);
-        memcpy(info, &el->info, sizeof(audio_element_info_t));
-        mutex_unlock(el->lock);
+        audio_element_info_read(el, info);
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t audio_element_get_format(audio_element_handle_t el, audio_element_format_t *fmt)
+{
+    if (fmt && el) {
+        audio_element_format_read(el, fmt);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -630,7 +944,7 @@ esp_err_t audio_element_report_info(audio_element_handle_t el)
         msg.cmd = AEL_MSG_CMD_REPORT_MUSIC_INFO;
         msg.data = NULL;
         ESP_LOGD(TAG, "REPORT_INFO,[%s]evt out cmd:%d,", el->tag, msg.cmd);
-        audio_element_msg_sendout(el, &msg);
+        audio_element_msg_sendout(el, &msg, AUDIO_EVENT_COALESCE_NONE);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -643,7 +957,7 @@ esp_err_t audio_element_report_codec_fmt(audio_element_handle_t el)
         msg.cmd = AEL_MSG_CMD_REPORT_CODEC_FMT;
         msg.data = NULL;
         ESP_LOGD(TAG, "REPORT_FMT,[%s]evt out cmd:%d,", el->tag, msg.cmd);
-        audio_element_msg_sendout(el, &msg);
+        audio_element_msg_sendout(el, &msg, AUDIO_EVENT_COALESCE_NONE);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -657,7 +971,7 @@ esp_err_t audio_element_report_status(audio_element_handle_t el, audio_element_s
         msg.data = (void *)status;
         msg.data_len = sizeof(status);
         ESP_LOGD(TAG, "REPORT_STATUS,[%s]evt out cmd = %d,status:%d", el->tag, msg.cmd, status);
-        return audio_element_msg_sendout(el, &msg);
+        return audio_element_msg_sendout(el, &msg, AUDIO_EVENT_COALESCE_REPEAT);
     }
     return ESP_FAIL;
 }
@@ -676,7 +990,8 @@ esp_err_t audio_element_report_pos(audio_element_handle_t el)
         msg.data = el->report_info;
         msg.data_len = sizeof(audio_element_info_t);
         ESP_LOGD(TAG, "REPORT_POS,[%s]evt out cmd:%d,", el->tag, msg.cmd);
-        audio_element_msg_sendout(el, &msg);
+        // The listener reads `report_info` when it gets the message, a pending one already shows the latest position
+        audio_element_msg_sendout(el, &msg, AUDIO_EVENT_COALESCE_LATEST);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -684,7 +999,7 @@ esp_err_t audio_element_report_pos(audio_element_handle_t el)
 
 esp_err_t audio_element_finish_state(audio_element_handle_t el)
 {
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->state = AEL_STATE_FINISHED;
         audio_element_report_status(el, AEL_STATUS_STATE_FINISHED);
         el->is_running = false;
@@ -993,7 +1308,9 @@ audio_element_handle_t audio_element_init(audio_element_cfg_t *config)
 
     el->state = AEL_STATE_INIT;
     el->buf_size = config->buffer_len;
+    el->zero_copy = config->zero_copy;
 
+    el->info_spinlock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
     audio_element_info_t info = AUDIO_ELEMENT_INFO_DEFAULT();
     audio_element_setinfo(el, &info);
     audio_element_set_input_timeout(el, portMAX_DELAY);
@@ -1065,6 +1382,10 @@ esp_err_t audio_element_deinit(audio_element_handle_t el)
     if (el->report_info) {
         audio_free(el->report_info);
     }
+    if (el->profile) {
+        audio_free(el->profile);
+        el->profile = NULL;
+    }
     if (el->audio_thread) {
         audio_thread_cleanup(&el->audio_thread);
     }
@@ -1086,7 +1407,12 @@ esp_err_t audio_element_run(audio_element_handle_t el)
     snprintf(task_name, 32, "el-%s", el->tag);
     audio_event_iface_discard(el->iface_event);
     xEventGroupClearBits(el->state_event, TASK_CREATED_BIT);
-    if (el->task_stack > 0) {
+    if (el->host_wakeup) {
+        // Hosted, the element runs in the host task which drives it through `audio_element_host_step`
+        audio_element_task_init(el);
+        ret = el->task_run ? ESP_OK : ESP_FAIL;
+        xSemaphoreGive(el->host_wakeup);
+    } else if (el->task_stack > 0) {
         ret = audio_thread_create(&el->audio_thread, el->tag, audio_element_task, el, el->task_stack,
                                   el->task_prio, el->stack_in_ext, el->task_core);
         if (ret == ESP_FAIL) {
@@ -1135,7 +1461,7 @@ esp_err_t audio_element_terminate(audio_element_handle_t el)
         ESP_LOGW(TAG, "[%s] Element has not create when AUDIO_ELEMENT_TERMINATE", el->tag);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->task_run = false;
         el->is_running = false;
         return ESP_OK;
@@ -1149,7 +1475,7 @@ esp_err_t audio_element_terminate_with_ticks(audio_element_handle_t el, TickType
         ESP_LOGW(TAG, "[%s] Element has not create when AUDIO_ELEMENT_TERMINATE, tick:%d", el->tag, ticks_to_wait);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->task_run = false;
         el->is_running = false;
         return ESP_OK;
@@ -1169,7 +1495,7 @@ esp_err_t audio_element_pause(audio_element_handle_t el)
         return ESP_OK;
     }
     xEventGroupClearBits(el->state_event, PAUSED_BIT);
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->is_running = false;
         audio_element_force_set_state(el, AEL_STATE_PAUSED);
         return ESP_OK;
@@ -1198,7 +1524,7 @@ esp_err_t audio_element_resume(audio_element_handle_t el, float wait_for_rb_thre
                  el->tag, el->state, el->task_run, el->is_running);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->is_running = true;
         audio_element_force_set_state(el, AEL_STATE_RUNNING);
         audio_element_report_status(el, AEL_STATUS_STATE_RUNNING);
@@ -1255,7 +1581,7 @@ esp_err_t audio_element_stop(audio_element_handle_t el)
     if (el->state == AEL_STATE_RUNNING) {
         xEventGroupClearBits(el->state_event, STOPPED_BIT);
     }
-    if (el->task_stack <= 0) {
+    if (!audio_element_has_task(el)) {
         el->is_running = false;
         audio_element_force_set_state(el, AEL_STATE_STOPPED);
         xEventGroupSetBits(el->state_event, STOPPED_BIT);
@@ -1370,9 +1696,9 @@ bool audio_element_is_stopping(audio_element_handle_t el)
 esp_err_t audio_element_update_byte_pos(audio_element_handle_t el, int pos)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.byte_pos += pos;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1381,9 +1707,9 @@ esp_err_t audio_element_update_byte_pos(audio_element_handle_t el, int pos)
 esp_err_t audio_element_set_byte_pos(audio_element_handle_t el, int pos)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.byte_pos = pos;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1392,9 +1718,9 @@ esp_err_t audio_element_set_byte_pos(audio_element_handle_t el, int pos)
 esp_err_t audio_element_update_total_bytes(audio_element_handle_t el, int total_bytes)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.total_bytes += total_bytes;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1403,9 +1729,9 @@ esp_err_t audio_element_update_total_bytes(audio_element_handle_t el, int total_
 esp_err_t audio_element_set_total_bytes(audio_element_handle_t el, int total_bytes)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.total_bytes = total_bytes;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1414,9 +1740,9 @@ esp_err_t audio_element_set_total_bytes(audio_element_handle_t el, int total_byt
 esp_err_t audio_element_set_bps(audio_element_handle_t el, int bit_rate)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.bps = bit_rate;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1425,9 +1751,9 @@ esp_err_t audio_element_set_bps(audio_element_handle_t el, int bit_rate)
 esp_err_t audio_element_set_codec_fmt(audio_element_handle_t el, int format)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.codec_fmt = format;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1436,11 +1762,11 @@ esp_err_t audio_element_set_codec_fmt(audio_element_handle_t el, int format)
 esp_err_t audio_element_set_music_info(audio_element_handle_t el, int sample_rates, int channels, int bits)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.sample_rates = sample_rates;
         el->info.channels = channels;
         el->info.bits = bits;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1449,9 +1775,9 @@ esp_err_t audio_element_set_music_info(audio_element_handle_t el, int sample_rat
 esp_err_t audio_element_set_duration(audio_element_handle_t el, int duration)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.duration = duration;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1460,9 +1786,9 @@ esp_err_t audio_element_set_duration(audio_element_handle_t el, int duration)
 esp_err_t audio_element_set_reserve_user0(audio_element_handle_t el, int user_data0)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.reserve_data.user_data_0 = user_data0;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1471,9 +1797,9 @@ esp_err_t audio_element_set_reserve_user0(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user1(audio_element_handle_t el, int user_data1)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.reserve_data.user_data_1 = user_data1;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1482,9 +1808,9 @@ esp_err_t audio_element_set_reserve_user1(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user2(audio_element_handle_t el, int user_data2)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.reserve_data.user_data_2 = user_data2;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1494,9 +1820,9 @@ esp_err_t audio_element_set_reserve_user2(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user3(audio_element_handle_t el, int user_data3)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.reserve_data.user_data_3 = user_data3;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1505,10 +1831,50 @@ esp_err_t audio_element_set_reserve_user3(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user4(audio_element_handle_t el, int user_data4)
 {
     if (el) {
-        mutex_lock(el->lock);
+        audio_element_info_write_begin(el);
         el->info.reserve_data.user_data_4 = user_data4;
-        mutex_unlock(el->lock);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
 }
+
+esp_err_t audio_element_profile_enable(audio_element_handle_t el, bool enable)
+{
+    AUDIO_NULL_CHECK(TAG, el, return ESP_FAIL);
+    if (enable == false) {
+        // Keep the counters allocated, the element task may be using them right now
+        el->profiling = false;
+        return ESP_OK;
+    }
+    if (el->profile == NULL) {
+        el->profile = audio_calloc(1, sizeof(audio_element_profile_t));
+        AUDIO_MEM_CHECK(TAG, el->profile, return ESP_ERR_NO_MEM);
+    }
+    audio_element_profile_reset(el);
+    el->profiling = true;
+    return ESP_OK;
+}
+
+esp_err_t audio_element_profile_get(audio_element_handle_t el, audio_element_profile_t *profile)
+{
+    if (el == NULL || profile == NULL || el->profile == NULL) {
+        return ESP_FAIL;
+    }
+    if (el->profile_reset_gen != el->profile_clear_gen) {
+        // Reset asked but not applied by the element task yet
+        audio_element_profile_clear(profile);
+        return ESP_OK;
+    }
+    memcpy(profile, el->profile, sizeof(audio_element_profile_t));
+    return ESP_OK;
+}
+
+esp_err_t audio_element_profile_reset(audio_element_handle_t el)
+{
+    if (el == NULL || el->profile == NULL) {
+        return ESP_FAIL;
+    }
+    el->profile_reset_gen++;
+    return ESP_OK;
+}
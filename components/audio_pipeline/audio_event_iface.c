@@ -22,6 +22,8 @@
  *
  */
 
+#include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -35,33 +37,294 @@
 
 static const char *TAG = "AUDIO_EVT";
 
+#define DEFAULT_AUDIO_EVENT_BUS_SIZE    (32)
 
-typedef struct audio_event_iface_item {
-    STAILQ_ENTRY(audio_event_iface_item)    next;
-    QueueHandle_t                           queue;
-    int                                     queue_size;
-    int                                     mark_to_remove;
-} audio_event_iface_item_t;
+/*
+ * A subscription of one listener to one emitter. It is owned by the listener, the emitter only links it,
+ * so the messages it queued can always find it back until the listener has read them.
+ */
+typedef struct audio_event_iface_sub {
+    STAILQ_ENTRY(audio_event_iface_sub)     listener_next;
+    struct audio_event_iface_sub            *_Atomic emitter_next;
+    audio_event_iface_handle_t              emitter;
+    audio_event_iface_handle_t              listener;
+    bool                                    internal;       /* Copies of the commands instead of the events */
+    atomic_bool                             active;
+    atomic_int                              queued;         /* Messages of this subscription in the listener bus */
+    atomic_uint                             topics;
+    atomic_uint                             latest_pending; /* Topics with a `AUDIO_EVENT_COALESCE_LATEST` message queued */
+    atomic_uint                             repeat_key;     /* Last `AUDIO_EVENT_COALESCE_REPEAT` message queued */
+} audio_event_iface_sub_t;
+
+typedef STAILQ_HEAD(audio_event_iface_sub_list, audio_event_iface_sub) audio_event_iface_sub_list_t;
+
+typedef struct {
+    atomic_uint                 seq;
+    audio_event_iface_msg_t     msg;
+    audio_event_iface_sub_t     *sub;
+    audio_event_coalesce_t      coalesce;
+    unsigned                    key;
+} audio_event_bus_cell_t;
 
-typedef STAILQ_HEAD(audio_event_iface_list, audio_event_iface_item) audio_event_iface_list_t;
+/*
+ * Bounded multi-producer single-consumer ring of the listener, each cell carries a sequence number:
+ * a producer claims a position with a CAS on `head` and publishes the cell by bumping its sequence,
+ * so producers never wait for each other and the reader never takes a lock.
+ */
+typedef struct {
+    audio_event_bus_cell_t      *cells;
+    unsigned                    mask;
+    atomic_uint                 head;
+    unsigned                    tail;
+    SemaphoreHandle_t           ready;
+} audio_event_bus_t;
 
 /**
  * Audio event structure
  */
 struct audio_event_iface {
-    QueueHandle_t               internal_queue;
-    QueueHandle_t               external_queue;
-    QueueSetHandle_t            queue_set;
-    int                         internal_queue_size;
-    int                         external_queue_size;
-    int                         queue_set_size;
-    audio_event_iface_list_t    listening_queues;
-    void                        *context;
-    on_event_iface_func         on_cmd;
-    int                         wait_time;
-    int                         type;
+    QueueHandle_t                   internal_queue;
+    QueueHandle_t                   external_queue;
+    audio_event_bus_t               *bus;
+    int                             internal_queue_size;
+    int                             external_queue_size;
+    int                             queue_set_size;
+    audio_event_iface_sub_list_t    subscriptions;  /* As a listener */
+    audio_event_iface_sub_t         *_Atomic subscribers; /* As an emitter */
+    atomic_int                      publishing;     /* Producers walking `subscribers` */
+    void                            *context;
+    on_event_iface_func             on_cmd;
+    int                             wait_time;
+    int                             type;
 };
 
+static audio_event_bus_t *audio_event_bus_create(int size)
+{
+    int cap = 1;
+    while (cap < size) {
+        cap <<= 1;
+    }
+    audio_event_bus_t *bus = audio_calloc(1, sizeof(audio_event_bus_t));
+    AUDIO_MEM_CHECK(TAG, bus, return NULL);
+    bus->cells = audio_calloc(cap, sizeof(audio_event_bus_cell_t));
+    bus->ready = xSemaphoreCreateBinary();
+    AUDIO_MEM_CHECK(TAG, (bus->cells && bus->ready), {
+        audio_free(bus->cells);
+        if (bus->ready) {
+            vSemaphoreDelete(bus->ready);
+        }
+        audio_free(bus);
+        return NULL;
+    });
+    for (int i = 0; i < cap; i++) {
+        atomic_init(&bus->cells[i].seq, i);
+    }
+    bus->mask = cap - 1;
+    atomic_init(&bus->head, 0);
+    return bus;
+}
+
+static void audio_event_bus_destroy(audio_event_bus_t *bus)
+{
+    vSemaphoreDelete(bus->ready);
+    audio_free(bus->cells);
+    audio_free(bus);
+}
+
+static bool audio_event_bus_push(audio_event_bus_t *bus, audio_event_iface_msg_t *msg, audio_event_iface_sub_t *sub,
+                                 audio_event_coalesce_t coalesce, unsigned key)
+{
+    unsigned pos = atomic_load_explicit(&bus->head, memory_order_relaxed);
+    audio_event_bus_cell_t *cell;
+    for (;;) {
+        cell = &bus->cells[pos & bus->mask];
+        int diff = (int)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&bus->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&bus->head, memory_order_relaxed);
+        }
+    }
+    cell->msg = *msg;
+    cell->sub = sub;
+    cell->coalesce = coalesce;
+    cell->key = key;
+    atomic_fetch_add(&sub->queued, 1);
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    xSemaphoreGive(bus->ready);
+    return true;
+}
+
+static bool audio_event_bus_pop(audio_event_bus_t *bus, audio_event_iface_msg_t *msg, bool *stale)
+{
+    audio_event_bus_cell_t *cell = &bus->cells[bus->tail & bus->mask];
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != bus->tail + 1) {
+        return false;
+    }
+    *msg = cell->msg;
+    audio_event_iface_sub_t *sub = cell->sub;
+    *stale = !atomic_load(&sub->active);
+    if (cell->coalesce == AUDIO_EVENT_COALESCE_LATEST) {
+        atomic_fetch_and(&sub->latest_pending, ~AUDIO_EVENT_IFACE_TOPIC(msg->cmd));
+    } else if (cell->coalesce == AUDIO_EVENT_COALESCE_REPEAT) {
+        unsigned key = cell->key;
+        atomic_compare_exchange_strong(&sub->repeat_key, &key, 0);
+    }
+    atomic_fetch_sub(&sub->queued, 1);
+    atomic_store_explicit(&cell->seq, bus->tail + bus->mask + 1, memory_order_release);
+    bus->tail++;
+    return true;
+}
+
+static esp_err_t audio_event_bus_deliver(audio_event_iface_sub_t *sub, audio_event_iface_msg_t *msg, audio_event_coalesce_t coalesce)
+{
+    unsigned topic = AUDIO_EVENT_IFACE_TOPIC(msg->cmd);
+    if (!(atomic_load(&sub->topics) & topic)) {
+        return ESP_OK;
+    }
+    unsigned key = 0;
+    if (coalesce == AUDIO_EVENT_COALESCE_LATEST) {
+        // The data of such message points to a buffer the emitter keeps current, one queued is enough
+        if (atomic_fetch_or(&sub->latest_pending, topic) & topic) {
+            return ESP_OK;
+        }
+    } else if (coalesce == AUDIO_EVENT_COALESCE_REPEAT) {
+        key = 0x80000000 | ((unsigned)(msg->cmd & 0x7FFF) << 16) | ((unsigned)(uintptr_t)msg->data & 0xFFFF);
+        if (atomic_exchange(&sub->repeat_key, key) == key) {
+            return ESP_OK;
+        }
+    }
+    if (!audio_event_bus_push(sub->listener->bus, msg, sub, coalesce, key)) {
+        if (coalesce == AUDIO_EVENT_COALESCE_LATEST) {
+            atomic_fetch_and(&sub->latest_pending, ~topic);
+        } else if (coalesce == AUDIO_EVENT_COALESCE_REPEAT) {
+            atomic_compare_exchange_strong(&sub->repeat_key, &key, 0);
+        }
+        ESP_LOGW(TAG, "There is no space in listener bus,%p", sub->listener);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Delivers the message to every active subscription of the given kind, `delivered` tells if there was any.
+ */
+static esp_err_t audio_event_iface_publish(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg,
+                                           audio_event_coalesce_t coalesce, bool internal, bool *delivered)
+{
+    esp_err_t ret = ESP_OK;
+    *delivered = false;
+    atomic_fetch_add(&evt->publishing, 1);
+    for (audio_event_iface_sub_t *sub = atomic_load(&evt->subscribers); sub; sub = atomic_load(&sub->emitter_next)) {
+        if (sub->internal != internal || !atomic_load(&sub->active)) {
+            continue;
+        }
+        *delivered = true;
+        ret |= audio_event_bus_deliver(sub, msg, coalesce);
+        if (msg->need_free_data) {
+            // Only one listener may own the data
+            break;
+        }
+    }
+    atomic_fetch_sub(&evt->publishing, 1);
+    return ret;
+}
+
+/*
+ * Waits for the producers that may still see an old state of the subscriber list of the emitter.
+ */
+static void audio_event_iface_wait_publishing(audio_event_iface_handle_t evt)
+{
+    while (atomic_load(&evt->publishing)) {
+        vTaskDelay(1);
+    }
+}
+
+/*
+ * Stops the emitter from delivering to the subscription. It stays linked to be reused by the next
+ * `audio_event_iface_set_listener`, so no producer can ever walk on a freed one.
+ */
+static void audio_event_iface_sub_deactivate(audio_event_iface_sub_t *sub)
+{
+    audio_event_iface_handle_t evt = sub->emitter;
+    if (evt == NULL) {
+        return;
+    }
+    atomic_store(&sub->active, false);
+    audio_event_iface_wait_publishing(evt);
+}
+
+static void audio_event_iface_sub_unlink(audio_event_iface_sub_t *sub)
+{
+    audio_event_iface_handle_t evt = sub->emitter;
+    if (evt == NULL) {
+        return;
+    }
+    audio_event_iface_sub_deactivate(sub);
+    audio_event_iface_sub_t *cur = atomic_load(&evt->subscribers);
+    if (cur == sub) {
+        atomic_store(&evt->subscribers, atomic_load(&sub->emitter_next));
+    } else {
+        while (cur && atomic_load(&cur->emitter_next) != sub) {
+            cur = atomic_load(&cur->emitter_next);
+        }
+        if (cur) {
+            atomic_store(&cur->emitter_next, atomic_load(&sub->emitter_next));
+        }
+    }
+    audio_event_iface_wait_publishing(evt);
+    sub->emitter = NULL;
+}
+
+/*
+ * Frees the subscriptions of a destroyed emitter once no queued message refers to them anymore.
+ */
+static void audio_event_iface_sub_reclaim(audio_event_iface_handle_t listener)
+{
+    audio_event_iface_sub_t *sub, *tmp;
+    STAILQ_FOREACH_SAFE(sub, &listener->subscriptions, listener_next, tmp) {
+        if (sub->emitter == NULL && atomic_load(&sub->queued) == 0) {
+            STAILQ_REMOVE(&listener->subscriptions, sub, audio_event_iface_sub, listener_next);
+            audio_free(sub);
+        }
+    }
+}
+
+static esp_err_t audio_event_iface_subscribe(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener, bool internal)
+{
+    audio_event_iface_sub_t *sub;
+    audio_event_iface_sub_reclaim(listener);
+    STAILQ_FOREACH(sub, &listener->subscriptions, listener_next) {
+        if (sub->emitter == evt && sub->internal == internal) {
+            atomic_store(&sub->active, true);
+            return ESP_OK;
+        }
+    }
+    if (listener->bus == NULL) {
+        listener->bus = audio_event_bus_create(DEFAULT_AUDIO_EVENT_BUS_SIZE);
+        AUDIO_MEM_CHECK(TAG, listener->bus, return ESP_ERR_NO_MEM);
+    }
+    sub = audio_calloc(1, sizeof(audio_event_iface_sub_t));
+    AUDIO_MEM_CHECK(TAG, sub, return ESP_ERR_NO_MEM);
+    sub->emitter = evt;
+    sub->listener = listener;
+    sub->internal = internal;
+    atomic_init(&sub->queued, 0);
+    atomic_init(&sub->topics, AUDIO_EVENT_IFACE_TOPIC_ALL);
+    atomic_init(&sub->latest_pending, 0);
+    atomic_init(&sub->repeat_key, 0);
+    atomic_init(&sub->active, true);
+    atomic_init(&sub->emitter_next, atomic_load(&evt->subscribers));
+    STAILQ_INSERT_TAIL(&listener->subscriptions, sub, listener_next);
+    // Linked fully initialized, the producers may walk the list at any time
+    atomic_store(&evt->subscribers, sub);
+    return ESP_OK;
+}
+
 audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *config)
 {
     audio_event_iface_handle_t evt = audio_calloc(1, sizeof(struct audio_event_iface));
@@ -72,8 +335,11 @@ audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *confi
     evt->context = config->context;
     evt->on_cmd = config->on_cmd;
     evt->type = config->type;
+    atomic_init(&evt->subscribers, NULL);
+    atomic_init(&evt->publishing, 0);
     if (evt->queue_set_size) {
-        evt->queue_set = xQueueCreateSet(evt->queue_set_size);
+        evt->bus = audio_event_bus_create(evt->queue_set_size > DEFAULT_AUDIO_EVENT_BUS_SIZE ? evt->queue_set_size : DEFAULT_AUDIO_EVENT_BUS_SIZE);
+        AUDIO_MEM_CHECK(TAG, evt->bus, goto _event_iface_init_failed);
     }
     if (evt->internal_queue_size) {
         evt->internal_queue = xQueueCreate(evt->internal_queue_size, sizeof(audio_event_iface_msg_t));
@@ -86,81 +352,66 @@ audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *confi
         ESP_LOGD(TAG, "This emiiter have no queue set,%p", evt);
     }
 
-    STAILQ_INIT(&evt->listening_queues);
+    STAILQ_INIT(&evt->subscriptions);
     return evt;
 _event_iface_init_failed:
+    if (evt->bus) {
+        audio_event_bus_destroy(evt->bus);
+    }
     if (evt->internal_queue) {
         vQueueDelete(evt->internal_queue);
     }
     if (evt->external_queue) {
         vQueueDelete(evt->external_queue);
     }
+    audio_free(evt);
     return NULL;
 }
 
-static esp_err_t audio_event_iface_cleanup_listener(audio_event_iface_handle_t listen)
-{
-    audio_event_iface_item_t *item, *tmp;
-    audio_event_iface_discard(listen);
-    STAILQ_FOREACH_SAFE(item, &listen->listening_queues, next, tmp) {
-        audio_event_iface_msg_t dummy;
-        while (audio_event_iface_read(listen, &dummy, 0) == ESP_OK);
-        while (listen->queue_set && (xQueueRemoveFromSet(item->queue, listen->queue_set) != pdPASS)) {
-            ESP_LOGW(TAG, "Error remove listener,%p", item->queue);
-            while (audio_event_iface_read(listen, &dummy, 0) == ESP_OK);
-        }
-    }
-    if (listen->queue_set) {
-        vQueueDelete(listen->queue_set);
-        listen->queue_set = NULL;
-    }
-    return ESP_OK;
-}
-
-static esp_err_t audio_event_iface_update_listener(audio_event_iface_handle_t listen)
-{
-    audio_event_iface_item_t *item;
-    int queue_size = 0;
-    STAILQ_FOREACH(item, &listen->listening_queues, next) {
-        queue_size += item->queue_size;
-    }
-    if (queue_size) {
-        listen->queue_set = xQueueCreateSet(queue_size);
-    }
-    STAILQ_FOREACH(item, &listen->listening_queues, next) {
-        if (item->queue) {
-            audio_event_iface_msg_t dummy;
-            while (xQueueReceive(item->queue, &dummy, 0) == pdTRUE);
-        }
-        if (listen->queue_set && item->queue && xQueueAddToSet(item->queue, listen->queue_set) != pdPASS) {
-            ESP_LOGE(TAG, "Error add queue items to queue set");
-            return ESP_FAIL;
-        }
-    }
-    return ESP_OK;
-}
-
 esp_err_t audio_event_iface_read(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, TickType_t wait_time)
 {
-    if (evt->queue_set) {
-        QueueSetMemberHandle_t active_queue;
-        active_queue = xQueueSelectFromSet(evt->queue_set, wait_time);
-        if (active_queue) {
-            if (xQueueReceive(active_queue, msg, 0) == pdTRUE) {
+    audio_event_bus_t *bus = evt->bus;
+    if (bus == NULL) {
+        return ESP_FAIL;
+    }
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        bool stale;
+        if (audio_event_bus_pop(bus, msg, &stale)) {
+            if (!stale) {
                 return ESP_OK;
             }
+            // Sent before its emitter got removed from the listener
+            continue;
         }
+        TickType_t remain = portMAX_DELAY;
+        if (wait_time != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= wait_time) {
+                return ESP_FAIL;
+            }
+            remain = wait_time - elapsed;
+        }
+        xSemaphoreTake(bus->ready, remain);
     }
-    return ESP_FAIL;
 }
 
 esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt)
 {
-    audio_event_iface_cleanup_listener(evt);
-    audio_event_iface_item_t *item, *tmp;
-    STAILQ_FOREACH_SAFE(item, &evt->listening_queues, next, tmp) {
-        STAILQ_REMOVE(&evt->listening_queues, item, audio_event_iface_item, next);
-        audio_free(item);
+    audio_event_iface_sub_t *sub, *tmp;
+    // As an emitter, no listener can reach it anymore
+    while ((sub = atomic_load(&evt->subscribers)) != NULL) {
+        audio_event_iface_sub_unlink(sub);
+    }
+    // As a listener, stop the emitters first, then nothing refers to the bus
+    STAILQ_FOREACH(sub, &evt->subscriptions, listener_next) {
+        audio_event_iface_sub_unlink(sub);
+    }
+    STAILQ_FOREACH_SAFE(sub, &evt->subscriptions, listener_next, tmp) {
+        audio_free(sub);
+    }
+    if (evt->bus) {
+        audio_event_bus_destroy(evt->bus);
     }
     if (evt->internal_queue) {
         audio_event_iface_set_cmd_waiting_timeout(evt, 0);
@@ -169,9 +420,6 @@ esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt)
     if (evt->external_queue) {
         vQueueDelete(evt->external_queue);
     }
-    if (evt->queue_set) {
-        vQueueDelete(evt->queue_set);
-    }
     audio_free(evt);
     return ESP_OK;
 }
@@ -182,17 +430,7 @@ esp_err_t audio_event_iface_set_listener(audio_event_iface_handle_t evt, audio_e
         || (0 == evt->external_queue_size)) {
         return ESP_ERR_INVALID_ARG;
     }
-    audio_event_iface_item_t *item = audio_calloc(1, sizeof(audio_event_iface_item_t));
-    AUDIO_MEM_CHECK(TAG, item, return ESP_ERR_NO_MEM);
-
-    if (audio_event_iface_cleanup_listener(listener) != ESP_OK) {
-        AUDIO_ERROR(TAG, "Error cleanup listener");
-        return ESP_FAIL;
-    }
-    item->queue = evt->external_queue;
-    item->queue_size = evt->external_queue_size;
-    STAILQ_INSERT_TAIL(&listener->listening_queues, item, next);
-    return audio_event_iface_update_listener(listener);
+    return audio_event_iface_subscribe(evt, listener, false);
 }
 
 esp_err_t audio_event_iface_set_msg_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener)
@@ -201,16 +439,20 @@ esp_err_t audio_event_iface_set_msg_listener(audio_event_iface_handle_t evt, aud
         || (0 == evt->internal_queue_size)) {
         return ESP_ERR_INVALID_ARG;
     }
-    audio_event_iface_item_t *item = audio_calloc(1, sizeof(audio_event_iface_item_t));
-    AUDIO_MEM_CHECK(TAG, item, return ESP_ERR_NO_MEM);
-    if (audio_event_iface_cleanup_listener(listener) != ESP_OK) {
-        AUDIO_ERROR(TAG, "Error cleanup listener");
-        return ESP_FAIL;
+    return audio_event_iface_subscribe(evt, listener, true);
+}
+
+esp_err_t audio_event_iface_set_listener_topics(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener, uint32_t topics)
+{
+    AUDIO_NULL_CHECK(TAG, (evt && listener), return ESP_ERR_INVALID_ARG);
+    audio_event_iface_sub_t *sub;
+    STAILQ_FOREACH(sub, &listener->subscriptions, listener_next) {
+        if (sub->emitter == evt && !sub->internal) {
+            atomic_store(&sub->topics, topics);
+            return ESP_OK;
+        }
     }
-    item->queue = evt->internal_queue;
-    item->queue_size = evt->internal_queue_size;
-    STAILQ_INSERT_TAIL(&listener->listening_queues, item, next);
-    return audio_event_iface_update_listener(listener);
+    return ESP_FAIL;
 }
 
 esp_err_t audio_event_iface_remove_listener(audio_event_iface_handle_t listen, audio_event_iface_handle_t evt)
@@ -219,17 +461,15 @@ esp_err_t audio_event_iface_remove_listener(audio_event_iface_handle_t listen, a
         || (0 == evt->external_queue_size)) {
         return ESP_ERR_INVALID_ARG;
     }
-    audio_event_iface_item_t *item, *tmp;
-    if (audio_event_iface_cleanup_listener(listen) != ESP_OK) {
-        return ESP_FAIL;
-    }
-    STAILQ_FOREACH_SAFE(item, &listen->listening_queues, next, tmp) {
-        if (evt->external_queue == item->queue) {
-            STAILQ_REMOVE(&listen->listening_queues, item, audio_event_iface_item, next);
-            audio_free(item);
+    audio_event_iface_sub_t *sub;
+    STAILQ_FOREACH(sub, &listen->subscriptions, listener_next) {
+        if (sub->emitter == evt && !sub->internal) {
+            audio_event_iface_sub_deactivate(sub);
+            break;
         }
     }
-    return audio_event_iface_update_listener(listen);
+    audio_event_iface_sub_reclaim(listen);
+    return ESP_OK;
 }
 
 esp_err_t audio_event_iface_set_cmd_waiting_timeout(audio_event_iface_handle_t evt, TickType_t wait_time)
@@ -251,7 +491,16 @@ esp_err_t audio_event_iface_waiting_cmd_msg(audio_event_iface_handle_t evt)
 
 esp_err_t audio_event_iface_cmd(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
 {
-    if (evt->internal_queue && (xQueueSend(evt->internal_queue, (void *)msg, 0) != pdPASS)) {
+    if (evt->internal_queue == NULL) {
+        return ESP_OK;
+    }
+    bool delivered;
+    // A message listener takes the commands over, as it did reading the internal queue
+    esp_err_t ret = audio_event_iface_publish(evt, msg, AUDIO_EVENT_COALESCE_NONE, true, &delivered);
+    if (delivered) {
+        return ret;
+    }
+    if (xQueueSend(evt->internal_queue, (void *)msg, 0) != pdPASS) {
         ESP_LOGW(TAG, "There are no space to dispatch queue");
         return ESP_FAIL;
     }
@@ -266,17 +515,29 @@ esp_err_t audio_event_iface_cmd_from_isr(audio_event_iface_handle_t evt, audio_e
     return ESP_OK;
 }
 
-esp_err_t audio_event_iface_sendout(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
+esp_err_t audio_event_iface_sendout_coalesce(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, audio_event_coalesce_t coalesce)
 {
-    if (evt->external_queue) {
-        if (xQueueSend(evt->external_queue, (void *)msg, 0) != pdPASS) {
-            ESP_LOGW(TAG, "There is no space in external queue");
-            return ESP_FAIL;
-        }
+    if (evt->external_queue == NULL) {
+        return ESP_OK;
+    }
+    bool delivered;
+    esp_err_t ret = audio_event_iface_publish(evt, msg, coalesce, false, &delivered);
+    if (delivered) {
+        return ret;
+    }
+    // Nobody listens, keep it for the readers of `audio_event_iface_get_queue_handle`
+    if (xQueueSend(evt->external_queue, (void *)msg, 0) != pdPASS) {
+        ESP_LOGW(TAG, "There is no space in external queue");
+        return ESP_FAIL;
     }
     return ESP_OK;
 }
 
+esp_err_t audio_event_iface_sendout(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
+{
+    return audio_event_iface_sendout_coalesce(evt, msg, AUDIO_EVENT_COALESCE_NONE);
+}
+
 esp_err_t audio_event_iface_discard(audio_event_iface_handle_t evt)
 {
     audio_event_iface_msg_t msg;
@@ -286,8 +547,10 @@ esp_err_t audio_event_iface_discard(audio_event_iface_handle_t evt)
     if (evt->internal_queue && evt->internal_queue_size) {
         while (xQueueReceive(evt->internal_queue, &msg, 0) == pdTRUE);
     }
-    if (evt->queue_set && evt->queue_set_size) {
-        while (audio_event_iface_read(evt, &msg, 0) == ESP_OK);
+    if (evt->bus) {
+        bool stale;
+        while (audio_event_bus_pop(evt->bus, &msg, &stale));
+        audio_event_iface_sub_reclaim(evt);
     }
     return ESP_OK;
 }
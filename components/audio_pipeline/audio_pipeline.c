@@ -23,6 +23,7 @@
  */
 
 #include <string.h>
+#include <stdarg.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -35,6 +36,7 @@
 #include "audio_event_iface.h"
 #include "audio_mem.h"
 #include "audio_mutex.h"
+#include "audio_thread.h"
 #include "ringbuf.h"
 #include "audio_error.h"
 
@@ -42,6 +44,12 @@ static const char *TAG = "AUDIO_PIPELINE";
 
 #define PIPELINE_DEBUG(x) debug_pipeline_lists(x, __LINE__, __func__)
 
+#define EXECUTOR_WAKEUP_MAX         (64)
+#define EXECUTOR_EDGE_ALIGN         (512)
+#define EXECUTOR_CMD_DRAIN          (5)     /* Depth of the element command queue */
+
+const static int EXECUTOR_STOPPED_BIT = BIT0;
+
 typedef struct ringbuf_item {
     STAILQ_ENTRY(ringbuf_item)  next;
     ringbuf_handle_t            rb;
@@ -62,15 +70,56 @@ typedef struct audio_element_item {
 
 typedef STAILQ_HEAD(audio_element_list, audio_element_item) audio_element_list_t;
 
+typedef struct audio_pipeline_executor audio_pipeline_executor_t;
+
+/*
+ * Replaces the ringbuffer between two executor stages, `down` pulls by running `up` until it has what it asked for.
+ * Only the executor task touches it, so there is no locking.
+ */
+typedef struct audio_pipeline_edge {
+    audio_pipeline_executor_t   *exec;
+    audio_element_handle_t      up;
+    audio_element_handle_t      down;
+    char                        *buf;
+    int                         size;
+    int                         rpos;
+    int                         wpos;
+    bool                        done;
+    bool                        aborted;
+} audio_pipeline_edge_t;
+
+struct audio_pipeline_executor {
+    audio_pipeline_executor_cfg_t   cfg;
+    char                            **tags;
+    int                             stage_num;
+    audio_element_handle_t          *stages;    /* Dataflow order once bound */
+    audio_pipeline_edge_t           *edges;     /* edges[i] is between stages[i] and stages[i + 1] */
+    bool                            bound;
+    xSemaphoreHandle                wakeup;
+    EventGroupHandle_t              state_event;
+    audio_thread_t                  thread;
+    volatile bool                   task_run;
+};
+
 struct audio_pipeline {
     audio_element_list_t        el_list;
     ringbuf_list_t              rb_list;
     audio_element_state_t       state;
     xSemaphoreHandle            lock;
     bool                        linked;
+    bool                        rb_spsc;
     audio_event_iface_handle_t  listener;
+    audio_pipeline_executor_t   *executor;
 };
 
+static ringbuf_handle_t audio_pipeline_rb_create(audio_pipeline_handle_t pipeline, int size)
+{
+    if (pipeline->rb_spsc) {
+        return rb_create_spsc(size, 1);
+    }
+    return rb_create(size, 1);
+}
+
 static audio_element_item_t *audio_pipeline_get_el_item_by_tag(audio_pipeline_handle_t pipeline, const char *tag)
 {
     audio_element_item_t *item;
@@ -154,6 +203,342 @@ static void debug_pipeline_lists(audio_pipeline_handle_t pipeline, int line, con
     }
 }
 
+static int audio_pipeline_edge_write(audio_element_handle_t el, char *buf, int len, TickType_t ticks_to_wait, void *ctx)
+{
+    audio_pipeline_edge_t *edge = (audio_pipeline_edge_t *)ctx;
+    if (edge->size - edge->wpos < len) {
+        if (edge->rpos > 0) {
+            memmove(edge->buf, edge->buf + edge->rpos, edge->wpos - edge->rpos);
+            edge->wpos -= edge->rpos;
+            edge->rpos = 0;
+        }
+        if (edge->size - edge->wpos < len) {
+            int size = (edge->wpos + len + EXECUTOR_EDGE_ALIGN - 1) & ~(EXECUTOR_EDGE_ALIGN - 1);
+            char *buffer = audio_realloc(edge->buf, size);
+            AUDIO_MEM_CHECK(TAG, buffer, return AEL_IO_FAIL);
+            edge->buf = buffer;
+            edge->size = size;
+        }
+    }
+    memcpy(edge->buf + edge->wpos, buf, len);
+    edge->wpos += len;
+    return len;
+}
+
+/*
+ * The stages after the edge are nested in the `process` of one another, down to the last one.
+ * Their commands can only be handled once the read returns to the executor task.
+ */
+static bool audio_pipeline_edge_cmd_pending(audio_pipeline_edge_t *edge)
+{
+    audio_pipeline_executor_t *exec = edge->exec;
+    for (int i = edge - exec->edges + 1; i < exec->stage_num; i++) {
+        if (audio_element_host_cmd_pending(exec->stages[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Blocks like `rb_read` does, by running the stage before until there is `len` bytes,
+ * it finishes or stops, or `ticks_to_wait` runs out. Stopping the reading stage aborts
+ * the read, as `audio_element_stop` aborts the input ringbuffer of a normal element.
+ * A command sent to the reading stage or to one after it ends the read as a timeout,
+ * so that the executor gets to handle it.
+ */
+static int audio_pipeline_edge_read(audio_element_handle_t el, char *buf, int len, TickType_t ticks_to_wait, void *ctx)
+{
+    audio_pipeline_edge_t *edge = (audio_pipeline_edge_t *)ctx;
+    TickType_t start = xTaskGetTickCount();
+    bool timeout = false;
+    while ((edge->wpos - edge->rpos < len) && !edge->done && !edge->aborted && !timeout) {
+        if (audio_element_is_stopping(el)) {
+            return AEL_IO_ABORT;
+        }
+        if (audio_pipeline_edge_cmd_pending(edge)) {
+            break;
+        }
+        esp_err_t ret = audio_element_host_step(edge->up, true);
+        TickType_t remain = portMAX_DELAY;
+        if (ticks_to_wait != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            remain = (elapsed < ticks_to_wait) ? (ticks_to_wait - elapsed) : 0;
+            timeout = (remain == 0);
+        }
+        if (ret == ESP_FAIL) {
+            edge->aborted = true;
+        } else if (ret == ESP_ERR_INVALID_STATE) {
+            audio_element_state_t state = audio_element_get_state(edge->up);
+            if (state == AEL_STATE_FINISHED) {
+                edge->done = true;
+            } else if (state == AEL_STATE_STOPPED || state == AEL_STATE_ERROR) {
+                edge->aborted = true;
+            } else if (!timeout) {
+                // Not started or paused, sleep until a command comes in
+                xSemaphoreTake(edge->exec->wakeup, remain);
+            }
+        }
+    }
+    if (edge->aborted) {
+        return AEL_IO_ABORT;
+    }
+    int avail = edge->wpos - edge->rpos;
+    if (avail == 0) {
+        return edge->done ? AEL_IO_DONE : AEL_IO_TIMEOUT;
+    }
+    if (len > avail) {
+        len = avail;
+    }
+    memcpy(buf, edge->buf + edge->rpos, len);
+    edge->rpos += len;
+    if (edge->rpos == edge->wpos) {
+        edge->rpos = 0;
+        edge->wpos = 0;
+    }
+    return len;
+}
+
+static bool audio_pipeline_executor_stage_idle(audio_element_handle_t el)
+{
+    audio_element_state_t state = audio_element_get_state(el);
+    return (state == AEL_STATE_INIT) || (state == AEL_STATE_STOPPED)
+           || (state == AEL_STATE_FINISHED) || (state == AEL_STATE_ERROR);
+}
+
+static void audio_pipeline_executor_task(void *pv)
+{
+    audio_pipeline_executor_t *exec = (audio_pipeline_executor_t *)pv;
+    audio_element_handle_t last = exec->stages[exec->stage_num - 1];
+    while (exec->task_run) {
+        /*
+         * Drain the commands of all the stages first, a wakeup may have been taken by a stage waiting
+         * for its input meanwhile. The stages before the last one only run when pulled by the one after.
+         */
+        for (int i = 0; i < exec->stage_num; i++) {
+            for (int j = 0; j < EXECUTOR_CMD_DRAIN; j++) {
+                audio_element_host_step(exec->stages[i], false);
+            }
+        }
+        esp_err_t ret = audio_element_host_step(last, true);
+        for (int i = 0; i < exec->stage_num - 1; i++) {
+            audio_pipeline_edge_t *edge = &exec->edges[i];
+            if (audio_pipeline_executor_stage_idle(edge->up) && audio_pipeline_executor_stage_idle(edge->down)) {
+                edge->rpos = 0;
+                edge->wpos = 0;
+                edge->done = false;
+                edge->aborted = false;
+            }
+        }
+        if (ret != ESP_OK) {
+            xSemaphoreTake(exec->wakeup, portMAX_DELAY);
+        }
+    }
+    ESP_LOGD(TAG, "Executor task deleted,%d", uxTaskGetStackHighWaterMark(NULL));
+    xEventGroupSetBits(exec->state_event, EXECUTOR_STOPPED_BIT);
+    audio_thread_delete_task(&exec->thread);
+}
+
+static esp_err_t audio_pipeline_executor_start(audio_pipeline_executor_t *exec)
+{
+    if (exec->task_run) {
+        return ESP_OK;
+    }
+    exec->task_run = true;
+    xEventGroupClearBits(exec->state_event, EXECUTOR_STOPPED_BIT);
+    if (audio_thread_create(&exec->thread, "pipeline_exec", audio_pipeline_executor_task, exec, exec->cfg.task_stack,
+                            exec->cfg.task_prio, exec->cfg.stack_in_ext, exec->cfg.task_core) != ESP_OK) {
+        ESP_LOGE(TAG, "Create executor task failed");
+        exec->task_run = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t audio_pipeline_executor_bind(audio_pipeline_handle_t pipeline)
+{
+    audio_pipeline_executor_t *exec = pipeline->executor;
+    int num = exec->stage_num;
+    esp_err_t ret = ESP_FAIL;
+    audio_element_handle_t *els = audio_calloc(num, sizeof(audio_element_handle_t));
+    int *next = audio_calloc(num, sizeof(int));
+    AUDIO_MEM_CHECK(TAG, (els && next), {
+        ret = ESP_ERR_NO_MEM;
+        goto _bind_exit;
+    });
+    for (int i = 0; i < num; i++) {
+        audio_element_item_t *item = audio_pipeline_get_el_item_by_tag(pipeline, exec->tags[i]);
+        if (item == NULL || item->linked == false) {
+            ESP_LOGE(TAG, "Executor stage %s is not linked", exec->tags[i]);
+            goto _bind_exit;
+        }
+        els[i] = item->el;
+    }
+    // Chain the stages through the ringbuffers the link created between them
+    int head = -1;
+    for (int i = 0; i < num; i++) {
+        ringbuf_handle_t rb = audio_element_get_output_ringbuf(els[i]);
+        next[i] = -1;
+        for (int j = 0; rb && j < num; j++) {
+            if (audio_element_get_input_ringbuf(els[j]) == rb) {
+                next[i] = j;
+            }
+        }
+    }
+    for (int i = 0; i < num && head < 0; i++) {
+        head = i;
+        for (int j = 0; j < num; j++) {
+            if (next[j] == i) {
+                head = -1;
+            }
+        }
+    }
+    int cnt = 0;
+    for (int i = head; i >= 0 && cnt < num; i = next[i]) {
+        exec->stages[cnt++] = els[i];
+    }
+    if (head < 0 || cnt != num) {
+        ESP_LOGE(TAG, "Executor stages must be consecutive in the link");
+        goto _bind_exit;
+    }
+    if (num > 1) {
+        exec->edges = audio_calloc(num - 1, sizeof(audio_pipeline_edge_t));
+        AUDIO_MEM_CHECK(TAG, exec->edges, {
+            ret = ESP_ERR_NO_MEM;
+            goto _bind_exit;
+        });
+    }
+    for (int i = 0; i < num; i++) {
+        if (audio_element_set_host(exec->stages[i], exec->wakeup) != ESP_OK) {
+            while (i--) {
+                audio_element_set_host(exec->stages[i], NULL);
+            }
+            audio_free(exec->edges);
+            exec->edges = NULL;
+            goto _bind_exit;
+        }
+    }
+    for (int i = 0; i < num - 1; i++) {
+        audio_pipeline_edge_t *edge = &exec->edges[i];
+        edge->exec = exec;
+        edge->up = exec->stages[i];
+        edge->down = exec->stages[i + 1];
+        ringbuf_handle_t rb = audio_element_get_output_ringbuf(edge->up);
+        ringbuf_item_t *rb_item, *tmp;
+        STAILQ_FOREACH_SAFE(rb_item, &pipeline->rb_list, next, tmp) {
+            if (rb_item->rb == rb) {
+                STAILQ_REMOVE(&pipeline->rb_list, rb_item, ringbuf_item, next);
+                audio_free(rb_item);
+            }
+        }
+        audio_element_set_output_ringbuf(edge->up, NULL);
+        audio_element_set_input_ringbuf(edge->down, NULL);
+        rb_destroy(rb);
+        audio_element_set_write_cb(edge->up, audio_pipeline_edge_write, edge);
+        audio_element_set_read_cb(edge->down, audio_pipeline_edge_read, edge);
+    }
+    exec->bound = true;
+    ESP_LOGI(TAG, "Executor bound %d stages, %s first", num, audio_element_get_tag(exec->stages[0]));
+    ret = ESP_OK;
+_bind_exit:
+    audio_free(els);
+    audio_free(next);
+    return ret;
+}
+
+static void audio_pipeline_executor_unbind(audio_pipeline_handle_t pipeline)
+{
+    audio_pipeline_executor_t *exec = pipeline->executor;
+    if (exec == NULL || exec->bound == false) {
+        return;
+    }
+    if (exec->task_run) {
+        // Hosted stages can only be terminated by the executor, do it before it goes away
+        for (int i = 0; i < exec->stage_num; i++) {
+            audio_element_terminate(exec->stages[i]);
+        }
+        exec->task_run = false;
+        xSemaphoreGive(exec->wakeup);
+        xEventGroupWaitBits(exec->state_event, EXECUTOR_STOPPED_BIT, false, true, portMAX_DELAY);
+        audio_thread_cleanup(&exec->thread);
+    }
+    for (int i = 0; i < exec->stage_num; i++) {
+        audio_element_set_host(exec->stages[i], NULL);
+    }
+    for (int i = 0; i < exec->stage_num - 1; i++) {
+        audio_pipeline_edge_t *edge = &exec->edges[i];
+        audio_element_set_write_cb(edge->up, NULL, NULL);
+        audio_element_set_read_cb(edge->down, NULL, NULL);
+        audio_free(edge->buf);
+    }
+    audio_free(exec->edges);
+    exec->edges = NULL;
+    exec->bound = false;
+}
+
+static void audio_pipeline_executor_destroy(audio_pipeline_executor_t *exec)
+{
+    if (exec == NULL) {
+        return;
+    }
+    if (exec->tags) {
+        for (int i = 0; i < exec->stage_num; i++) {
+            audio_free(exec->tags[i]);
+        }
+        audio_free(exec->tags);
+    }
+    audio_free(exec->stages);
+    if (exec->wakeup) {
+        vSemaphoreDelete(exec->wakeup);
+    }
+    if (exec->state_event) {
+        vEventGroupDelete(exec->state_event);
+    }
+    audio_free(exec);
+}
+
+esp_err_t audio_pipeline_set_executor(audio_pipeline_handle_t pipeline, audio_pipeline_executor_cfg_t *config, const char *stage_tag[], int stage_num)
+{
+    AUDIO_NULL_CHECK(TAG, pipeline, return ESP_ERR_INVALID_ARG);
+    if (pipeline->linked) {
+        ESP_LOGE(TAG, "Set the executor before the pipeline is linked");
+        return ESP_FAIL;
+    }
+    audio_pipeline_executor_destroy(pipeline->executor);
+    pipeline->executor = NULL;
+    if (stage_num <= 0) {
+        return ESP_OK;
+    }
+    AUDIO_NULL_CHECK(TAG, stage_tag, return ESP_ERR_INVALID_ARG);
+    audio_pipeline_executor_t *exec = audio_calloc(1, sizeof(audio_pipeline_executor_t));
+    AUDIO_MEM_CHECK(TAG, exec, return ESP_ERR_NO_MEM);
+    if (config) {
+        exec->cfg = *config;
+    } else {
+        audio_pipeline_executor_cfg_t cfg = DEFAULT_AUDIO_PIPELINE_EXECUTOR_CONFIG();
+        exec->cfg = cfg;
+    }
+    bool _success =
+        (
+            (exec->tags         = audio_calloc(stage_num, sizeof(char *)))                  &&
+            (exec->stages       = audio_calloc(stage_num, sizeof(audio_element_handle_t)))  &&
+            (exec->wakeup       = xSemaphoreCreateCounting(EXECUTOR_WAKEUP_MAX, 0))         &&
+            (exec->state_event  = xEventGroupCreate())
+        );
+    AUDIO_MEM_CHECK(TAG, _success, goto _executor_failed);
+    exec->stage_num = stage_num;
+    for (int i = 0; i < stage_num; i++) {
+        exec->tags[i] = audio_strdup(stage_tag[i]);
+        AUDIO_MEM_CHECK(TAG, exec->tags[i], goto _executor_failed);
+    }
+    pipeline->executor = exec;
+    return ESP_OK;
+
+_executor_failed:
+    audio_pipeline_executor_destroy(exec);
+    return ESP_ERR_NO_MEM;
+}
+
 audio_element_handle_t audio_pipeline_get_el_by_tag(audio_pipeline_handle_t pipeline, const char *tag)
 {
     if (tag == NULL || pipeline == NULL) {
@@ -257,6 +642,7 @@ audio_pipeline_handle_t audio_pipeline_init(audio_pipeline_cfg_t *config)
     STAILQ_INIT(&pipeline->rb_list);
 
     pipeline->state = AEL_STATE_INIT;
+    pipeline->rb_spsc = config->rb_spsc;
     return pipeline;
 }
 
@@ -270,6 +656,7 @@ esp_err_t audio_pipeline_deinit(audio_pipeline_handle_t pipeline)
         audio_element_deinit(el_item->el);
         audio_pipeline_unregister(pipeline, el_item->el);
     }
+    audio_pipeline_executor_destroy(pipeline->executor);
     mutex_destroy(pipeline->lock);
     audio_free(pipeline);
     return ESP_OK;
@@ -346,6 +733,11 @@ esp_err_t audio_pipeline_run(audio_pipeline_handle_t pipeline)
         ESP_LOGW(TAG, "Pipeline already started, state:%d", pipeline->state);
         return ESP_OK;
     }
+    if (pipeline->executor && pipeline->executor->bound
+        && audio_pipeline_executor_start(pipeline->executor) != ESP_OK) {
+        audio_pipeline_change_state(pipeline, AEL_STATE_ERROR);
+        return ESP_FAIL;
+    }
     STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
         ESP_LOGD(TAG, "start el[%16s], linked:%d, state:%d,[%p], ", audio_element_get_tag(el_item->el), el_item->linked,  audio_element_get_state(el_item->el), el_item->el);
         if (el_item->linked
@@ -470,7 +862,7 @@ static esp_err_t _pipeline_rb_linked(audio_pipeline_handle_t pipeline, audio_ele
         }
         bool _success = (
                             (rb_item = audio_calloc(1, sizeof(ringbuf_item_t))) &&
-                            (rb = rb_create(audio_element_get_output_ringbuf_size(el), 1))
+                            (rb = audio_pipeline_rb_create(pipeline, audio_element_get_output_ringbuf_size(el)))
                         );
 
         AUDIO_MEM_CHECK(TAG, _success, {
@@ -513,8 +905,11 @@ esp_err_t audio_pipeline_link(audio_pipeline_handle_t pipeline, const char *link
         }
     }
     pipeline->linked = true;
+    if (pipeline->executor) {
+        ret = audio_pipeline_executor_bind(pipeline);
+    }
     PIPELINE_DEBUG(pipeline);
-    return ESP_OK;
+    return ret;
 }
 
 esp_err_t audio_pipeline_unlink(audio_pipeline_handle_t pipeline)
@@ -524,6 +919,7 @@ esp_err_t audio_pipeline_unlink(audio_pipeline_handle_t pipeline)
     if (!pipeline->linked) {
         return ESP_OK;
     }
+    audio_pipeline_executor_unbind(pipeline);
     audio_pipeline_remove_listener(pipeline);
     STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
         if (el_item->linked) {
@@ -608,7 +1004,10 @@ esp_err_t audio_pipeline_link_more(audio_pipeline_handle_t pipeline, audio_eleme
     }
     pipeline->linked = true;
     va_end(args);
-    return ESP_OK;
+    if (pipeline->executor) {
+        ret = audio_pipeline_executor_bind(pipeline);
+    }
+    return ret;
 }
 
 esp_err_t audio_pipeline_link_insert(audio_pipeline_handle_t pipeline, bool first, audio_element_handle_t prev, ringbuf_handle_t conect_rb, audio_element_handle_t next)
@@ -785,6 +1184,7 @@ esp_err_t audio_pipeline_breakup_elements(audio_pipeline_handle_t pipeline, audi
         ESP_LOGE(TAG, "%s have invalid args, %p", __func__, pipeline);
         return ESP_ERR_INVALID_ARG;
     }
+    audio_pipeline_executor_unbind(pipeline);
     audio_pipeline_remove_listener(pipeline);
     audio_element_item_t *el_item, *el_tmp;
     ringbuf_item_t *rb_item, *tmp;
@@ -905,7 +1305,7 @@ static esp_err_t audio_pipeline_el_item_link(audio_pipeline_handle_t pipeline,
         ringbuf_handle_t tmp_rb = NULL;
         bool _success = (
                             (cur_rb_item = audio_calloc(1, sizeof(ringbuf_item_t))) &&
-                            (tmp_rb = rb_create(audio_element_get_output_ringbuf_size(el), 1))
+                            (tmp_rb = audio_pipeline_rb_create(pipeline, audio_element_get_output_ringbuf_size(el)))
                         );
 
         AUDIO_MEM_CHECK(TAG, _success, {
@@ -974,6 +1374,9 @@ esp_err_t audio_pipeline_relink(audio_pipeline_handle_t pipeline, const char *li
         audio_pipeline_el_item_link(pipeline, src_el_item, el, first, last);
     }
     pipeline->linked = true;
+    if (pipeline->executor) {
+        ret = audio_pipeline_executor_bind(pipeline);
+    }
     PIPELINE_DEBUG(pipeline);
 relink_err:
     return ret;
@@ -1016,7 +1419,90 @@ esp_err_t audio_pipeline_relink_more(audio_pipeline_handle_t pipeline, audio_ele
         audio_pipeline_el_item_link(pipeline, src_el_item, el, first, last);
     }
     pipeline->linked = true;
+    va_end(args);
+    esp_err_t ret = ESP_OK;
+    if (pipeline->executor) {
+        ret = audio_pipeline_executor_bind(pipeline);
+    }
     PIPELINE_DEBUG(pipeline);
+    return ret;
+}
+
+esp_err_t audio_pipeline_profile_enable(audio_pipeline_handle_t pipeline, bool enable)
+{
+    AUDIO_NULL_CHECK(TAG, pipeline, return ESP_FAIL);
+    audio_element_item_t *el_item;
+    esp_err_t ret = ESP_OK;
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        ret |= audio_element_profile_enable(el_item->el, enable);
+    }
+    return ret;
+}
+
+static int audio_pipeline_profile_printf(char *buf, int buf_size, int offset, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int remain = buf_size - offset;
+    int len = vsnprintf((remain > 0) ? buf + offset : NULL, (remain > 0) ? remain : 0, fmt, args);
     va_end(args);
-    return ESP_OK;
+    return offset + (len > 0 ? len : 0);
+}
+
+int audio_pipeline_dump_profile(audio_pipeline_handle_t pipeline, audio_pipeline_profile_fmt_t fmt, char *buf, int buf_size)
+{
+    AUDIO_NULL_CHECK(TAG, pipeline, return ESP_FAIL);
+    if (buf == NULL) {
+        buf_size = 0;
+    }
+    if (buf_size > 0) {
+        buf[0] = '\0';
+    }
+    bool json = (fmt == AUDIO_PIPELINE_PROFILE_JSON);
+    int len = 0;
+    int idx = 0;
+    if (json) {
+        len = audio_pipeline_profile_printf(buf, buf_size, len, "{\"elements\":[");
+    } else {
+        len = audio_pipeline_profile_printf(buf, buf_size, len,
+                                            "tag,process_cnt,process_us,process_max_us,bytes_in,bytes_out,"
+                                            "in_timeout_cnt,out_timeout_cnt,abort_cnt,in_blocked_us,out_blocked_us,"
+                                            "in_rb_fill_avg,in_rb_fill_min,out_rb_fill_avg,out_rb_fill_max");
+        for (int i = 0; i < AEL_PROFILE_HIST_BUCKETS; i++) {
+            len = audio_pipeline_profile_printf(buf, buf_size, len, ",hist_%d", i);
+        }
+        len = audio_pipeline_profile_printf(buf, buf_size, len, "\n");
+    }
+    audio_element_item_t *el_item;
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        audio_element_profile_t profile;
+        if (audio_element_profile_get(el_item->el, &profile) != ESP_OK) {
+            continue;
+        }
+        char *tag = audio_element_get_tag(el_item->el);
+        unsigned long long in_fill_avg = profile.rb_samples ? profile.in_rb_fill_sum / profile.rb_samples : 0;
+        unsigned long long out_fill_avg = profile.rb_samples ? profile.out_rb_fill_sum / profile.rb_samples : 0;
+        len = audio_pipeline_profile_printf(buf, buf_size, len,
+                                            json ? "%s{\"tag\":\"%s\",\"process_cnt\":%u,\"process_us\":%llu,\"process_max_us\":%u,"
+                                            "\"bytes_in\":%llu,\"bytes_out\":%llu,\"in_timeout_cnt\":%u,\"out_timeout_cnt\":%u,"
+                                            "\"abort_cnt\":%u,\"in_blocked_us\":%llu,\"out_blocked_us\":%llu,"
+                                            "\"in_rb_fill_avg\":%llu,\"in_rb_fill_min\":%d,\"out_rb_fill_avg\":%llu,\"out_rb_fill_max\":%d,"
+                                            "\"process_hist\":["
+                                            : "%s%s,%u,%llu,%u,%llu,%llu,%u,%u,%u,%llu,%llu,%llu,%d,%llu,%d",
+                                            (json && idx) ? "," : "", tag ? tag : "unknown",
+                                            profile.process_cnt, (unsigned long long)profile.process_us, profile.process_max_us,
+                                            (unsigned long long)profile.bytes_in, (unsigned long long)profile.bytes_out,
+                                            profile.in_timeout_cnt, profile.out_timeout_cnt, profile.abort_cnt,
+                                            (unsigned long long)profile.in_blocked_us, (unsigned long long)profile.out_blocked_us,
+                                            in_fill_avg, profile.in_rb_fill_min, out_fill_avg, profile.out_rb_fill_max);
+        for (int i = 0; i < AEL_PROFILE_HIST_BUCKETS; i++) {
+            len = audio_pipeline_profile_printf(buf, buf_size, len, (json && i == 0) ? "%u" : ",%u", profile.process_hist[i]);
+        }
+        len = audio_pipeline_profile_printf(buf, buf_size, len, json ? "]}" : "\n");
+        idx++;
+    }
+    if (json) {
+        len = audio_pipeline_profile_printf(buf, buf_size, len, "]}");
+    }
+    return len;
 }
@@ -26,6 +26,8 @@
 #define _AUDIO_ELEMENT_H_
 
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "audio_event_iface.h"
 #include "ringbuf.h"
 #include "audio_common.h"
@@ -128,6 +130,16 @@ typedef struct {
     audio_element_reserve_data_t reserve_data;  /*!< This value is reserved for user use (optional) */
 } audio_element_info_t;
 
+/**
+ * @brief Audio Element format, a snapshot of the format fields of `audio_element_info_t`
+ */
+typedef struct {
+    int sample_rates;                           /*!< Sample rates in Hz */
+    int channels;                               /*!< Number of audio channel, mono is 1, stereo is 2 */
+    int bits;                                   /*!< Bit wide (8, 16, 24, 32 bits) */
+    esp_codec_type_t codec_fmt;                 /*!< Music format */
+} audio_element_format_t;
+
 #define AUDIO_ELEMENT_INFO_DEFAULT()    { \
     .sample_rates = 44100,                \
     .channels = 2,                        \
@@ -140,6 +152,34 @@ typedef struct {
     .codec_fmt = ESP_CODEC_TYPE_UNKNOW    \
 }
 
+#define AEL_PROFILE_HIST_BUCKETS    (16)
+
+/**
+ * @brief Audio Element profiling counters, collected only after `audio_element_profile_enable`
+ *
+ *        Process durations exclude the time blocked in the input and output, so they measure the element's own work.
+ *        They are accumulated in a log2 histogram: bucket 0 counts calls shorter than 2us,
+ *        bucket `i` counts calls in [2^i, 2^(i+1)) us, and the last bucket counts everything longer.
+ */
+typedef struct {
+    uint32_t    process_cnt;                                /*!< Number of `process` calls */
+    uint32_t    process_hist[AEL_PROFILE_HIST_BUCKETS];     /*!< Histogram of `process` call durations */
+    uint64_t    process_us;                                 /*!< Total time spent in `process` (in microseconds) */
+    uint32_t    process_max_us;                             /*!< Longest `process` call (in microseconds) */
+    uint64_t    bytes_in;                                   /*!< Bytes got from the input */
+    uint64_t    bytes_out;                                  /*!< Bytes sent to the output */
+    uint32_t    in_timeout_cnt;                             /*!< Number of input timeouts */
+    uint32_t    out_timeout_cnt;                            /*!< Number of output timeouts */
+    uint32_t    abort_cnt;                                  /*!< Number of aborted input or output */
+    uint64_t    in_blocked_us;                              /*!< Time spent blocked in the input, ringbuffer or read callback (in microseconds) */
+    uint64_t    out_blocked_us;                             /*!< Time spent blocked in the output, ringbuffer or write callback (in microseconds) */
+    uint32_t    rb_samples;                                 /*!< Number of ringbuffer fill level samples, one per `process` call */
+    uint64_t    in_rb_fill_sum;                             /*!< Sum of input ringbuffer fill level samples (in bytes) */
+    int         in_rb_fill_min;                             /*!< Minimum input ringbuffer fill level seen (in bytes), -1 if never sampled */
+    uint64_t    out_rb_fill_sum;                            /*!< Sum of output ringbuffer fill level samples (in bytes) */
+    int         out_rb_fill_max;                            /*!< Maximum output ringbuffer fill level seen (in bytes) */
+} audio_element_profile_t;
+
 typedef esp_err_t (*el_io_func)(audio_element_handle_t self);
 typedef audio_element_err_t (*process_func)(audio_element_handle_t self, char *el_buffer, int el_buf_len);
 typedef audio_element_err_t (*stream_func)(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait,
@@ -172,6 +212,8 @@ typedef struct {
     bool                stack_in_ext;     /*!< Try to allocate stack in external memory */
     int                 multi_in_rb_num;  /*!< The number of multiple input ringbuffer */
     int                 multi_out_rb_num; /*!< The number of multiple output ringbuffer */
+    bool                zero_copy;        /*!< Process works in place on ringbuffer spans through `audio_element_input_acquire` and
+                                               `audio_element_output_acquire`, the element buffer passed to `process` is NULL unless the input is a callback */
 } audio_element_cfg_t;
 
 #define DEFAULT_ELEMENT_RINGBUF_SIZE    (8*1024)
@@ -269,6 +311,8 @@ esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t
 /**
  * @brief      Get audio element infomation.
  *
+ * @note       It takes no lock, it can be called from the I/O callbacks of every buffer.
+ *
  * @param[in]  el    The audio element handle
  * @param      info  The information pointer
  *
@@ -278,6 +322,21 @@ esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t
  */
 esp_err_t audio_element_getinfo(audio_element_handle_t el, audio_element_info_t *info);
 
+/**
+ * @brief      Get the current format of audio element, without copying the whole information
+ *
+ * @note       Like `audio_element_getinfo` it takes no lock, the format fields are copied consistently
+ *             even while another task changes them.
+ *
+ * @param[in]  el    The audio element handle
+ * @param      fmt   The format to fill
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_get_format(audio_element_handle_t el, audio_element_format_t *fmt);
+
 /**
  * @brief      Set audio element URI.
  *
@@ -539,6 +598,8 @@ esp_err_t audio_element_wait_for_buffer(audio_element_handle_t el, int size_expe
 /**
  * @brief      Element will sendout event (status) to event by this function.
  *
+ * @note       A status repeating the one still pending in a listener is not queued again.
+ *
  * @param[in]  el      The audio element handle
  * @param[in]  status  The status
  *
@@ -573,6 +634,8 @@ esp_err_t audio_element_report_codec_fmt(audio_element_handle_t el);
 /**
  * @brief      Element will sendout event with a duplicate information by this function.
  *
+ * @note       While a position is pending in a listener, no other is queued, the pending one points to the latest information.
+ *
  * @param[in]  el    The audio element handle
  *
  * @return
@@ -680,6 +743,61 @@ audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer,
  */
 audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer, int write_size);
 
+/**
+ * @brief      Get a span of input data without copying it, for elements configured with `zero_copy`.
+ *             With ringbuffer input, the span points directly into the input ringbuffer and may be shorter than `wanted_size`
+ *             when the data wraps around. With callback input, the data is read into the element buffer.
+ *             Each successful call must be followed by `audio_element_input_release`.
+ *
+ * @param[in]  el            The audio element handle
+ * @param[out] buffer        Pointer to the start of the span
+ * @param[in]  wanted_size   The maximum span length wanted
+ *
+ * @return
+ *        - > 0 Length of the span
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_input_acquire(audio_element_handle_t el, char **buffer, int wanted_size);
+
+/**
+ * @brief      Release `len` bytes of the span returned by `audio_element_input_acquire`
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  len   Number of bytes consumed
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+audio_element_err_t audio_element_input_release(audio_element_handle_t el, int len);
+
+/**
+ * @brief      Get a span of output space to produce data into, for elements configured with `zero_copy`.
+ *             With ringbuffer output, the span points directly into the output ringbuffer.
+ *             With callback output, the span is a private staging buffer handed to the write callback on commit.
+ *
+ * @param[in]  el            The audio element handle
+ * @param[out] buffer        Pointer to the start of the span
+ * @param[in]  wanted_size   The maximum span length wanted
+ *
+ * @return
+ *        - > 0 Length of the span
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_acquire(audio_element_handle_t el, char **buffer, int wanted_size);
+
+/**
+ * @brief      Commit `len` bytes produced into the span returned by `audio_element_output_acquire`
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  len   Number of bytes produced
+ *
+ * @return
+ *        - > 0 number of bytes committed
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_commit(audio_element_handle_t el, int len);
+
 /**
  * @brief     This API allows the application to set a read callback for the first audio_element in the pipeline for
  *            allowing the pipeline to interface with other systems. The callback is invoked every time the audio
@@ -892,6 +1010,45 @@ esp_err_t audio_element_process_init(audio_element_handle_t el);
  */
 esp_err_t audio_element_process_deinit(audio_element_handle_t el);
 
+/**
+ * @brief      Let another task host the element instead of the element task
+ *
+ * @note       A hosted element keeps the whole command and state handling of a normal element,
+ *             `audio_element_run` creates no task and every command gives `wakeup`, the host task
+ *             then drives the element with `audio_element_host_step`. Used by the audio_pipeline executor.
+ *             The element must not be running.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  wakeup   Counting semaphore given on every command sent to the element, NULL to run in the element task again
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, the element is running
+ */
+esp_err_t audio_element_set_host(audio_element_handle_t el, SemaphoreHandle_t wakeup);
+
+/**
+ * @brief      Handle one pending command of a hosted element and optionally run its `process` once, never blocks on commands
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  process  Run `process` if the element is running
+ *
+ * @return
+ *     - ESP_OK, the element is running
+ *     - ESP_ERR_INVALID_STATE, the element is not running
+ *     - ESP_FAIL, the element is not hosted or has been terminated
+ */
+esp_err_t audio_element_host_step(audio_element_handle_t el, bool process);
+
+/**
+ * @brief      Check whether a hosted element has a command waiting for `audio_element_host_step`
+ *
+ * @param[in]  el       The audio element handle
+ *
+ * @return     true if a command is pending
+ */
+bool audio_element_host_cmd_pending(audio_element_handle_t el);
+
 /**
  * @brief      Call element's `seek`
  *
@@ -1076,6 +1233,48 @@ esp_err_t audio_element_set_reserve_user3(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user4(audio_element_handle_t el, int user_data4);
 
 
+/**
+ * @brief      Enable or disable the profiling counters of the element.
+ *             Enabling allocates the counters on first use and resets them. Disabling only stops the collection,
+ *             the counters can still be read and stay allocated until `audio_element_deinit`.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  enable   true to enable, false to disable
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t audio_element_profile_enable(audio_element_handle_t el, bool enable);
+
+/**
+ * @brief      Get a copy of the profiling counters of the element.
+ *             The counters are updated by the element task without lock, a copy taken while running may be slightly inconsistent.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[out] profile  The profiling counters
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, profiling has never been enabled
+ */
+esp_err_t audio_element_profile_get(audio_element_handle_t el, audio_element_profile_t *profile);
+
+/**
+ * @brief      Clear the profiling counters of the element
+ *
+ * @note       The element task clears them before its next profiled `process` call, so the clear never races with
+ *             the counters being updated. Meanwhile `audio_element_profile_get` returns cleared counters.
+ *
+ * @param[in]  el       The audio element handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, profiling has never been enabled
+ */
+esp_err_t audio_element_profile_reset(audio_element_handle_t el);
+
 #ifdef __cplusplus
 }
 #endif
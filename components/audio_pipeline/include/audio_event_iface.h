@@ -54,7 +54,7 @@ typedef struct audio_event_iface *audio_event_iface_handle_t;
 typedef struct {
     int                 internal_queue_size;        /*!< It's optional, Queue size for event `internal_queue` */
     int                 external_queue_size;        /*!< It's optional, Queue size for event `external_queue` */
-    int                 queue_set_size;             /*!< It's optional, QueueSet size for event `queue_set`*/
+    int                 queue_set_size;             /*!< It's optional, size of the listener bus receiving the events of the emitters listened to, rounded up to a power of 2 */
     on_event_iface_func on_cmd;                     /*!< Function callback for listener when any event arrived */
     void                *context;                   /*!< Context will pass to callback function */
     TickType_t          wait_time;                  /*!< Timeout to check for event queue */
@@ -64,6 +64,21 @@ typedef struct {
 
 #define DEFAULT_AUDIO_EVENT_IFACE_SIZE  (5)
 
+/**
+ * @brief Topic mask of a command for `audio_event_iface_set_listener_topics`, the commands from 31 share the last bit
+ */
+#define AUDIO_EVENT_IFACE_TOPIC(cmd)    (((cmd) >= 0 && (cmd) < 31) ? (1u << (cmd)) : (1u << 31))
+#define AUDIO_EVENT_IFACE_TOPIC_ALL     (0xFFFFFFFFu)
+
+/**
+ * How a message may be merged with the one of the same listener still waiting to be read
+ */
+typedef enum {
+    AUDIO_EVENT_COALESCE_NONE = 0,  /*!< Every message is delivered */
+    AUDIO_EVENT_COALESCE_LATEST,    /*!< The data is kept current by the emitter, one pending message per command is enough */
+    AUDIO_EVENT_COALESCE_REPEAT,    /*!< Drop the message when it repeats the command and data of the last one still pending */
+} audio_event_coalesce_t;
+
 #define AUDIO_EVENT_IFACE_DEFAULT_CFG() {                   \
     .internal_queue_size = DEFAULT_AUDIO_EVENT_IFACE_SIZE,  \
     .external_queue_size = DEFAULT_AUDIO_EVENT_IFACE_SIZE,  \
@@ -120,6 +135,21 @@ esp_err_t audio_event_iface_set_listener(audio_event_iface_handle_t evt, audio_e
  */
 esp_err_t audio_event_iface_remove_listener(audio_event_iface_handle_t listener, audio_event_iface_handle_t evt);
 
+/**
+ * @brief      Choose the commands of `evt` delivered to the listener, the others are dropped by the emitter
+ *             without touching the listener bus. All of them are delivered by default.
+ *
+ * @param      evt        The event already added to the listener
+ * @param      listener   The listener
+ * @param[in]  topics     Mask of `AUDIO_EVENT_IFACE_TOPIC(cmd)`
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, `evt` is not listened by `listener`
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_event_iface_set_listener_topics(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener, uint32_t topics);
+
 /**
  * @brief      Set current queue wait time for the event
  *
@@ -179,6 +209,22 @@ esp_err_t audio_event_iface_cmd_from_isr(audio_event_iface_handle_t evt, audio_e
  */
 esp_err_t audio_event_iface_sendout(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg);
 
+/**
+ * @brief      It's same with `audio_event_iface_sendout`, but the message may be merged with a pending one
+ *
+ * @note       Each listener has its own copy of the message. It goes to the external queue only when
+ *             no listener is added, for the users of `audio_event_iface_get_queue_handle`.
+ *
+ * @param      evt        The event
+ * @param      msg        The message
+ * @param[in]  coalesce   How the message is merged with the pending ones
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, a listener bus or the external queue is full
+ */
+esp_err_t audio_event_iface_sendout_coalesce(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, audio_event_coalesce_t coalesce);
+
 /**
  * @brief      Discard all ongoing event message
  *
@@ -213,7 +259,7 @@ esp_err_t audio_event_iface_listen(audio_event_iface_handle_t evt, audio_event_i
 QueueHandle_t audio_event_iface_get_queue_handle(audio_event_iface_handle_t evt);
 
 /**
- * @brief      Read the event from all the registered event emitters in the queue set of the interface
+ * @brief      Read the event from all the registered event emitters in the bus of the interface
  *
  * @param[in]  evt  The event interface
  * @param[out] msg  The pointer to structure in which event is to be received
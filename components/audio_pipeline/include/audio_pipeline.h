@@ -38,12 +38,43 @@ typedef struct audio_pipeline *audio_pipeline_handle_t;
  */
 typedef struct audio_pipeline_cfg {
     int rb_size;        /*!< Audio Pipeline ringbuffer size */
+    bool rb_spsc;       /*!< Link elements with lock-free single-producer/single-consumer ringbuffers, see `rb_create_spsc` */
 } audio_pipeline_cfg_t;
 
 #define DEFAULT_PIPELINE_RINGBUF_SIZE    (8*1024)
 
+/**
+ * @brief Audio Pipeline profile dump format
+ */
+typedef enum {
+    AUDIO_PIPELINE_PROFILE_JSON = 0,    /*!< One JSON object with an array of elements */
+    AUDIO_PIPELINE_PROFILE_CSV  = 1,    /*!< A header line, then one line per element */
+} audio_pipeline_profile_fmt_t;
+
 #define DEFAULT_AUDIO_PIPELINE_CONFIG() {\
     .rb_size            = DEFAULT_PIPELINE_RINGBUF_SIZE,\
+    .rb_spsc            = false,\
+}
+
+/**
+ * @brief Audio Pipeline executor configurations, the task that runs the executor stages
+ */
+typedef struct audio_pipeline_executor_cfg {
+    int task_stack;     /*!< Executor task stack size, it runs the `process` of all the stages nested in each other */
+    int task_prio;      /*!< Executor task priority (based on freeRTOS priority) */
+    int task_core;      /*!< Executor task running in core (0 or 1) */
+    bool stack_in_ext;  /*!< Try to allocate the executor task stack in external memory */
+} audio_pipeline_executor_cfg_t;
+
+#define DEFAULT_PIPELINE_EXECUTOR_TASK_STACK    (8 * 1024)
+#define DEFAULT_PIPELINE_EXECUTOR_TASK_PRIO     (5)
+#define DEFAULT_PIPELINE_EXECUTOR_TASK_CORE     (0)
+
+#define DEFAULT_AUDIO_PIPELINE_EXECUTOR_CONFIG() {\
+    .task_stack         = DEFAULT_PIPELINE_EXECUTOR_TASK_STACK,\
+    .task_prio          = DEFAULT_PIPELINE_EXECUTOR_TASK_PRIO,\
+    .task_core          = DEFAULT_PIPELINE_EXECUTOR_TASK_CORE,\
+    .stack_in_ext       = false,\
 }
 
 /**
@@ -234,6 +265,31 @@ esp_err_t audio_pipeline_link(audio_pipeline_handle_t pipeline, const char *link
  */
 esp_err_t audio_pipeline_unlink(audio_pipeline_handle_t pipeline);
 
+/**
+ * @brief      Run the given elements as stages of one executor task instead of one task per element
+ *
+ * @note       The stages must be consecutive in the link, they take effect at the next `audio_pipeline_link`,
+ *             `audio_pipeline_link_more` or relink. Between two stages there is no ringbuffer, the executor calls
+ *             the `process` of the last stage and each stage pulls its input by running the `process` of the stage
+ *             before it, through a small buffer that grows to the largest chunk handed over.
+ *             The elements themselves are unchanged. Reading from the stage before blocks like `rb_read`, a stage only
+ *             sees `AEL_IO_TIMEOUT` on input when its input timeout, set by `audio_element_set_input_timeout`, runs out
+ *             with nothing produced, or when a command is pending for it or a stage after it.
+ *             Commands, events and states of the stages work as for normal elements. The executor task lives from
+ *             the first `audio_pipeline_run` to the unlink, stages can not be kept by `audio_pipeline_breakup_elements`.
+ *
+ * @param[in]  pipeline     The Audio Pipeline Handle
+ * @param[in]  config       The executor task configuration, NULL for the default
+ * @param[in]  stage_tag    Tags of the elements to run in the executor
+ * @param[in]  stage_num    Number of stages, 0 to remove the executor at the next link
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL, the pipeline is linked
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t audio_pipeline_set_executor(audio_pipeline_handle_t pipeline, audio_pipeline_executor_cfg_t *config, const char *stage_tag[], int stage_num);
+
 /**
  * @brief      Find un-kept element from registered pipeline by tag
  *
@@ -479,6 +535,34 @@ esp_err_t audio_pipeline_relink_more(audio_pipeline_handle_t pipeline, audio_ele
  */
 esp_err_t audio_pipeline_change_state(audio_pipeline_handle_t pipeline, audio_element_state_t new_state);
 
+/**
+ * @brief      Enable or disable the profiling counters of all the elements registered to the pipeline
+ *
+ * @param[in]  pipeline     The Audio Pipeline Handle
+ * @param[in]  enable       true to enable, false to disable
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_pipeline_profile_enable(audio_pipeline_handle_t pipeline, bool enable);
+
+/**
+ * @brief      Dump the profiling counters of all the profiled elements in the pipeline, in JSON or CSV format.
+ *             Like `snprintf`, the output is truncated to `buf_size` and the full length is returned,
+ *             so calling it with `buf` = NULL gives the size of the buffer to allocate.
+ *
+ * @param[in]  pipeline     The Audio Pipeline Handle
+ * @param[in]  fmt          The output format
+ * @param[out] buf          The output buffer, can be NULL if `buf_size` is 0
+ * @param[in]  buf_size     The output buffer size
+ *
+ * @return
+ *     - >= 0   Length of the full dump, excluding the null terminator
+ *     - ESP_FAIL
+ */
+int audio_pipeline_dump_profile(audio_pipeline_handle_t pipeline, audio_pipeline_profile_fmt_t fmt, char *buf, int buf_size);
+
 
 #ifdef __cplusplus
 }
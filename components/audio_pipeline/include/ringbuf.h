@@ -53,6 +53,23 @@ typedef struct ringbuf *ringbuf_handle_t;
  */
 ringbuf_handle_t rb_create(int block_size, int n_blocks);
 
+/**
+ * @brief      Create a lock-free single-producer/single-consumer ringbuffer with total size = block_size * n_blocks
+ *
+ *             The read and write positions are tracked with atomic counters, so `rb_read` and `rb_write` never take a mutex
+ *             and only block on a semaphore when the ringbuffer is empty or full.
+ *             All the other `rb_*` APIs (abort, done, unblock, reset) keep the same semantics as `rb_create`.
+ *
+ * @note       Only one task may call `rb_read` and only one task may call `rb_write` at a time,
+ *             which is the case for a ringbuffer linking two elements of an audio pipeline.
+ *
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_spsc(int block_size, int n_blocks);
+
 /**
  * @brief      Cleanup and free all memory created by ringbuf_handle_t
  *
@@ -140,6 +157,67 @@ int rb_read(ringbuf_handle_t rb, char *buf, int len, TickType_t ticks_to_wait);
  */
 int rb_write(ringbuf_handle_t rb, char *buf, int len, TickType_t ticks_to_wait);
 
+/**
+ * @brief      Acquire a contiguous span of readable data directly inside the ringbuffer, without copying.
+ *             Wait `ticks_to_wait` ticks until at least one byte is available.
+ *             The span stops at the physical end of the ringbuffer, so data that wraps around is returned
+ *             by two consecutive acquire/release rounds.
+ *
+ * @note       The span stays valid until `rb_release_read` is called, the writer can't overwrite it.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] ptr            Pointer to the start of the span
+ * @param[in]  len            The maximum span length wanted
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 Length of the span
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT, RB_FAIL
+ */
+int rb_acquire_read(ringbuf_handle_t rb, char **ptr, int len, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Release `len` bytes of the span acquired by `rb_acquire_read`, making the space writable again
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   Number of bytes consumed, must not exceed the acquired span
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_release_read(ringbuf_handle_t rb, int len);
+
+/**
+ * @brief      Acquire a contiguous span of free space directly inside the ringbuffer, without copying.
+ *             Wait `ticks_to_wait` ticks until at least one byte is free.
+ *             The span stops at the physical end of the ringbuffer.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] ptr            Pointer to the start of the span
+ * @param[in]  len            The maximum span length wanted
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 Length of the span
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT, RB_FAIL
+ */
+int rb_acquire_write(ringbuf_handle_t rb, char **ptr, int len, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Commit `len` bytes written into the span acquired by `rb_acquire_write`, making them readable
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   Number of bytes produced, must not exceed the acquired span
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_commit_write(ringbuf_handle_t rb, int len);
+
 /**
  * @brief      Set status of writing to ringbuffer is done
  *
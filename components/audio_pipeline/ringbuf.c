@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -43,17 +44,36 @@ struct ringbuf {
     SemaphoreHandle_t can_read;
     SemaphoreHandle_t can_write;
     SemaphoreHandle_t lock;
-    bool abort_read;
-    bool abort_write;
-    bool is_done_write;         /**< To signal that we are done writing */
+    atomic_bool abort_read;
+    atomic_bool abort_write;
+    atomic_bool is_done_write;  /**< To signal that we are done writing */
     bool unblock_reader_flag;   /**< To unblock instantly from rb_read */
+    bool spsc;                  /**< Lock-free single-producer/single-consumer mode */
+    atomic_uint wr_cnt;         /**< Total bytes written, owned by the producer (SPSC mode only) */
+    atomic_uint rd_cnt;         /**< Total bytes read, owned by the consumer (SPSC mode only) */
+    atomic_bool reader_waiting; /**< Reader is about to block on `can_read` (SPSC mode only) */
+    atomic_bool writer_waiting; /**< Writer is about to block on `can_write` (SPSC mode only) */
 };
 
 static esp_err_t rb_abort_read(ringbuf_handle_t rb);
 static esp_err_t rb_abort_write(ringbuf_handle_t rb);
+
+/**
+ * The end-of-stream and abort flags are published with release and observed with acquire,
+ * so a reader seeing `is_done_write` also sees every `wr_cnt` update made before `rb_done_write`.
+ */
+static inline bool rb_flag_get(atomic_bool *flag)
+{
+    return atomic_load_explicit(flag, memory_order_acquire);
+}
+
+static inline void rb_flag_set(atomic_bool *flag, bool value)
+{
+    atomic_store_explicit(flag, value, memory_order_release);
+}
 static void rb_release(SemaphoreHandle_t handle);
 
-ringbuf_handle_t rb_create(int block_size, int n_blocks)
+static ringbuf_handle_t _rb_create(int block_size, int n_blocks, bool spsc)
 {
     if (block_size < 2) {
         ESP_LOGE(TAG, "Invalid size");
@@ -67,7 +87,7 @@ ringbuf_handle_t rb_create(int block_size, int n_blocks)
             (rb             = audio_calloc(1, sizeof(struct ringbuf))) &&
             (buf            = audio_calloc(n_blocks, block_size))   &&
             (rb->can_read   = xSemaphoreCreateBinary())             &&
-            (rb->lock       = xSemaphoreCreateMutex())              &&
+            (spsc || (rb->lock = xSemaphoreCreateMutex()))          &&
             (rb->can_write  = xSemaphoreCreateBinary())
         );
 
@@ -76,16 +96,31 @@ ringbuf_handle_t rb_create(int block_size, int n_blocks)
     rb->p_o = rb->p_r = rb->p_w = buf;
     rb->fill_cnt = 0;
     rb->size = block_size * n_blocks;
-    rb->is_done_write = false;
+    rb->spsc = spsc;
+    atomic_init(&rb->wr_cnt, 0);
+    atomic_init(&rb->rd_cnt, 0);
+    atomic_init(&rb->reader_waiting, false);
+    atomic_init(&rb->writer_waiting, false);
+    atomic_init(&rb->is_done_write, false);
     rb->unblock_reader_flag = false;
-    rb->abort_read = false;
-    rb->abort_write = false;
+    atomic_init(&rb->abort_read, false);
+    atomic_init(&rb->abort_write, false);
     return rb;
 _rb_init_failed:
     rb_destroy(rb);
     return NULL;
 }
 
+ringbuf_handle_t rb_create(int block_size, int n_blocks)
+{
+    return _rb_create(block_size, n_blocks, false);
+}
+
+ringbuf_handle_t rb_create_spsc(int block_size, int n_blocks)
+{
+    return _rb_create(block_size, n_blocks, true);
+}
+
 esp_err_t rb_destroy(ringbuf_handle_t rb)
 {
     if (rb == NULL) {
@@ -119,22 +154,38 @@ esp_err_t rb_reset(ringbuf_handle_t rb)
     }
     rb->p_r = rb->p_w = rb->p_o;
     rb->fill_cnt = 0;
-    rb->is_done_write = false;
+    atomic_store(&rb->wr_cnt, 0);
+    atomic_store(&rb->rd_cnt, 0);
+    atomic_store(&rb->reader_waiting, false);
+    atomic_store(&rb->writer_waiting, false);
+    rb_flag_set(&rb->is_done_write, false);
 
     rb->unblock_reader_flag = false;
-    rb->abort_read = false;
-    rb->abort_write = false;
+    rb_flag_set(&rb->abort_read, false);
+    rb_flag_set(&rb->abort_write, false);
     return ESP_OK;
 }
 
+static inline int rb_spsc_filled(ringbuf_handle_t rb)
+{
+    // Both counters are free running, the unsigned difference stays correct across wrap-around
+    return (int)(atomic_load(&rb->wr_cnt) - atomic_load(&rb->rd_cnt));
+}
+
 int rb_bytes_available(ringbuf_handle_t rb)
 {
+    if (rb->spsc) {
+        return (rb->size - rb_spsc_filled(rb));
+    }
     return (rb->size - rb->fill_cnt);
 }
 
 int rb_bytes_filled(ringbuf_handle_t rb)
 {
     if (rb) {
+        if (rb->spsc) {
+            return rb_spsc_filled(rb);
+        }
         return rb->fill_cnt;
     }
     return ESP_FAIL;
@@ -147,6 +198,158 @@ static void rb_release(SemaphoreHandle_t handle)
 
 #define rb_block(handle, time) xSemaphoreTake(handle, time)
 
+/**
+ * Wake up the peer only if it has announced that it is going to block.
+ * The waiting flag is set before the peer re-checks the counters, so either the peer
+ * sees the new counter value or we see the flag here, a wakeup can't be lost.
+ */
+static inline void rb_spsc_wake(atomic_bool *waiting, SemaphoreHandle_t handle)
+{
+    if (atomic_load(waiting) && atomic_exchange(waiting, false)) {
+        rb_release(handle);
+    }
+}
+
+static int rb_spsc_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int read_size = 0;
+    int total_read_size = 0;
+    int ret_val = 0;
+    int filled = 0;
+
+    while (buf_len) {
+        filled = rb_spsc_filled(rb);
+        if (filled < buf_len) {
+            // Same multiple of 4 workaround as the locked mode, see `rb_read`
+            read_size = filled & 0xfffffffc;
+            if ((read_size == 0) && rb_flag_get(&rb->is_done_write)) {
+                // The writer may have committed its tail after `filled` was sampled, reload it
+                filled = rb_spsc_filled(rb);
+                read_size = (filled < buf_len) ? filled : buf_len;
+                if (read_size == 0) {
+                    ret_val = RB_DONE;
+                    goto read_err;
+                }
+            }
+        } else {
+            read_size = buf_len;
+        }
+
+        if (read_size == 0) {
+            if (rb_flag_get(&rb->abort_read)) {
+                ret_val = RB_ABORT;
+                goto read_err;
+            }
+            if (rb->unblock_reader_flag) {
+                ret_val = RB_TIMEOUT;
+                goto read_err;
+            }
+            atomic_store(&rb->reader_waiting, true);
+            if (rb_spsc_filled(rb) != filled) {
+                atomic_store(&rb->reader_waiting, false);
+                continue;
+            }
+            if (rb_block(rb->can_read, ticks_to_wait) != pdTRUE) {
+                atomic_store(&rb->reader_waiting, false);
+                ret_val = RB_TIMEOUT;
+                goto read_err;
+            }
+            continue;
+        }
+
+        if ((rb->p_r + read_size) > (rb->p_o + rb->size)) {
+            int rlen1 = rb->p_o + rb->size - rb->p_r;
+            int rlen2 = read_size - rlen1;
+            if (buf) {
+                memcpy(buf, rb->p_r, rlen1);
+                memcpy(buf + rlen1, rb->p_o, rlen2);
+            }
+            rb->p_r = rb->p_o + rlen2;
+        } else {
+            if (buf) {
+                memcpy(buf, rb->p_r, read_size);
+            }
+            rb->p_r = rb->p_r + read_size;
+        }
+        // Publish the freed space only after the data has been copied out
+        atomic_store(&rb->rd_cnt, atomic_load_explicit(&rb->rd_cnt, memory_order_relaxed) + read_size);
+        rb_spsc_wake(&rb->writer_waiting, rb->can_write);
+
+        buf_len -= read_size;
+        total_read_size += read_size;
+        if (buf) {
+            buf += read_size;
+        }
+    }
+read_err:
+    if (ret_val == RB_ABORT) {
+        total_read_size = ret_val;
+    }
+    rb->unblock_reader_flag = false;
+    return total_read_size > 0 ? total_read_size : ret_val;
+}
+
+static int rb_spsc_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int write_size;
+    int total_write_size = 0;
+    int ret_val = 0;
+    int filled = 0;
+
+    while (buf_len) {
+        filled = rb_spsc_filled(rb);
+        write_size = rb->size - filled;
+        if (buf_len < write_size) {
+            write_size = buf_len;
+        }
+
+        if (write_size == 0) {
+            if (rb_flag_get(&rb->is_done_write)) {
+                ret_val = RB_DONE;
+                goto write_err;
+            }
+            if (rb_flag_get(&rb->abort_write)) {
+                ret_val = RB_ABORT;
+                goto write_err;
+            }
+            atomic_store(&rb->writer_waiting, true);
+            if (rb_spsc_filled(rb) != filled) {
+                atomic_store(&rb->writer_waiting, false);
+                continue;
+            }
+            if (rb_block(rb->can_write, ticks_to_wait) != pdTRUE) {
+                atomic_store(&rb->writer_waiting, false);
+                ret_val = RB_TIMEOUT;
+                goto write_err;
+            }
+            continue;
+        }
+
+        if ((rb->p_w + write_size) > (rb->p_o + rb->size)) {
+            int wlen1 = rb->p_o + rb->size - rb->p_w;
+            int wlen2 = write_size - wlen1;
+            memcpy(rb->p_w, buf, wlen1);
+            memcpy(rb->p_o, buf + wlen1, wlen2);
+            rb->p_w = rb->p_o + wlen2;
+        } else {
+            memcpy(rb->p_w, buf, write_size);
+            rb->p_w = rb->p_w + write_size;
+        }
+        // Publish the data only after it has been copied in
+        atomic_store(&rb->wr_cnt, atomic_load_explicit(&rb->wr_cnt, memory_order_relaxed) + write_size);
+        rb_spsc_wake(&rb->reader_waiting, rb->can_read);
+
+        buf_len -= write_size;
+        total_write_size += write_size;
+        buf += write_size;
+    }
+write_err:
+    if (ret_val == RB_ABORT) {
+        total_write_size = ret_val;
+    }
+    return total_write_size > 0 ? total_write_size : ret_val;
+}
+
 int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
 {
     int read_size = 0;
@@ -156,6 +359,9 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
     if (rb == NULL) {
         return RB_FAIL;
     }
+    if (rb->spsc) {
+        return rb_spsc_read(rb, buf, buf_len, ticks_to_wait);
+    }
 
     while (buf_len) {
         //take buffer lock
@@ -172,7 +378,7 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
              * Note that, when we have buf_len bytes available in rb, we still read those irrespective of if it's multiple of 4.
              */
             read_size = read_size & 0xfffffffc;
-            if ((read_size == 0) && rb->is_done_write) {
+            if ((read_size == 0) && rb_flag_get(&rb->is_done_write)) {
                 read_size = rb->fill_cnt;
             }
         } else {
@@ -182,12 +388,12 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
         if (read_size == 0) {
             //no data to read, release thread block to allow other threads to write data
 
-            if (rb->is_done_write) {
+            if (rb_flag_get(&rb->is_done_write)) {
                 ret_val = RB_DONE;
                 rb_release(rb->lock);
                 goto read_err;
             }
-            if (rb->abort_read) {
+            if (rb_flag_get(&rb->abort_read)) {
                 ret_val = RB_ABORT;
                 rb_release(rb->lock);
                 goto read_err;
@@ -254,6 +460,9 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wa
     if (rb == NULL || buf == NULL) {
         return RB_FAIL;
     }
+    if (rb->spsc) {
+        return rb_spsc_write(rb, buf, buf_len, ticks_to_wait);
+    }
 
     while (buf_len) {
         //take buffer lock
@@ -269,12 +478,12 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wa
 
         if (write_size == 0) {
             //no space to write, release thread block to allow other to read data
-            if (rb->is_done_write) {
+            if (rb_flag_get(&rb->is_done_write)) {
                 ret_val = RB_DONE;
                 rb_release(rb->lock);
                 goto write_err;
             }
-            if (rb->abort_write) {
+            if (rb_flag_get(&rb->abort_write)) {
                 ret_val = RB_ABORT;
                 rb_release(rb->lock);
                 goto write_err;
@@ -321,12 +530,213 @@ write_err:
     return total_write_size > 0 ? total_write_size : ret_val;
 }
 
+static inline void rb_lock(ringbuf_handle_t rb)
+{
+    if (!rb->spsc) {
+        rb_block(rb->lock, portMAX_DELAY);
+    }
+}
+
+static inline void rb_unlock(ringbuf_handle_t rb)
+{
+    if (!rb->spsc) {
+        rb_release(rb->lock);
+    }
+}
+
+/**
+ * Wait until at least one byte can be read, returns with the lock held on success.
+ */
+static int rb_wait_for_data(ringbuf_handle_t rb, TickType_t ticks_to_wait)
+{
+    int filled = 0;
+    while (1) {
+        rb_lock(rb);
+        filled = rb_bytes_filled(rb);
+        if (filled > 0) {
+            return filled;
+        }
+        int ret_val = 0;
+        if (rb_flag_get(&rb->is_done_write)) {
+            // Same reload as `rb_spsc_read`, the tail may land right before the done flag
+            filled = rb_bytes_filled(rb);
+            if (filled > 0) {
+                return filled;
+            }
+            ret_val = RB_DONE;
+        } else if (rb_flag_get(&rb->abort_read)) {
+            ret_val = RB_ABORT;
+        } else if (rb->unblock_reader_flag) {
+            rb->unblock_reader_flag = false;
+            ret_val = RB_TIMEOUT;
+        }
+        if (ret_val) {
+            rb_unlock(rb);
+            return ret_val;
+        }
+        if (rb->spsc) {
+            atomic_store(&rb->reader_waiting, true);
+            if (rb_spsc_filled(rb) != filled) {
+                atomic_store(&rb->reader_waiting, false);
+                continue;
+            }
+        } else {
+            rb_release(rb->lock);
+            rb_release(rb->can_write);
+        }
+        if (rb_block(rb->can_read, ticks_to_wait) != pdTRUE) {
+            atomic_store(&rb->reader_waiting, false);
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+/**
+ * Wait until at least one byte can be written, returns with the lock held on success.
+ */
+static int rb_wait_for_space(ringbuf_handle_t rb, TickType_t ticks_to_wait)
+{
+    int available = 0;
+    while (1) {
+        rb_lock(rb);
+        available = rb_bytes_available(rb);
+        if (available > 0) {
+            return available;
+        }
+        int ret_val = 0;
+        if (rb_flag_get(&rb->is_done_write)) {
+            ret_val = RB_DONE;
+        } else if (rb_flag_get(&rb->abort_write)) {
+            ret_val = RB_ABORT;
+        }
+        if (ret_val) {
+            rb_unlock(rb);
+            return ret_val;
+        }
+        if (rb->spsc) {
+            atomic_store(&rb->writer_waiting, true);
+            if (rb_bytes_available(rb) != available) {
+                atomic_store(&rb->writer_waiting, false);
+                continue;
+            }
+        } else {
+            rb_release(rb->lock);
+            rb_release(rb->can_read);
+        }
+        if (rb_block(rb->can_write, ticks_to_wait) != pdTRUE) {
+            atomic_store(&rb->writer_waiting, false);
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+int rb_acquire_read(ringbuf_handle_t rb, char **ptr, int len, TickType_t ticks_to_wait)
+{
+    if (rb == NULL || ptr == NULL || len <= 0) {
+        return RB_FAIL;
+    }
+    int filled = rb_wait_for_data(rb, ticks_to_wait);
+    if (filled <= 0) {
+        return filled;
+    }
+    // The read pointer is left at the end of the buffer after a read that ends exactly there
+    if (rb->p_r == rb->p_o + rb->size) {
+        rb->p_r = rb->p_o;
+    }
+    int span = rb->p_o + rb->size - rb->p_r;
+    if (span > filled) {
+        span = filled;
+    }
+    if (span > len) {
+        span = len;
+    }
+    *ptr = rb->p_r;
+    rb_unlock(rb);
+    return span;
+}
+
+esp_err_t rb_release_read(ringbuf_handle_t rb, int len)
+{
+    if (rb == NULL || len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    rb_lock(rb);
+    if ((len > rb_bytes_filled(rb)) || (rb->p_r + len > rb->p_o + rb->size)) {
+        ESP_LOGE(TAG, "Release %d bytes more than acquired", len);
+        rb_unlock(rb);
+        return ESP_FAIL;
+    }
+    rb->p_r += len;
+    if (rb->spsc) {
+        atomic_store(&rb->rd_cnt, atomic_load_explicit(&rb->rd_cnt, memory_order_relaxed) + len);
+        rb_spsc_wake(&rb->writer_waiting, rb->can_write);
+    } else {
+        rb->fill_cnt -= len;
+        rb_release(rb->lock);
+        rb_release(rb->can_write);
+    }
+    return ESP_OK;
+}
+
+int rb_acquire_write(ringbuf_handle_t rb, char **ptr, int len, TickType_t ticks_to_wait)
+{
+    if (rb == NULL || ptr == NULL || len <= 0) {
+        return RB_FAIL;
+    }
+    int available = rb_wait_for_space(rb, ticks_to_wait);
+    if (available <= 0) {
+        return available;
+    }
+    if (rb->p_w == rb->p_o + rb->size) {
+        rb->p_w = rb->p_o;
+    }
+    int span = rb->p_o + rb->size - rb->p_w;
+    if (span > available) {
+        span = available;
+    }
+    if (span > len) {
+        span = len;
+    }
+    *ptr = rb->p_w;
+    rb_unlock(rb);
+    return span;
+}
+
+esp_err_t rb_commit_write(ringbuf_handle_t rb, int len)
+{
+    if (rb == NULL || len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    rb_lock(rb);
+    if ((len > rb_bytes_available(rb)) || (rb->p_w + len > rb->p_o + rb->size)) {
+        ESP_LOGE(TAG, "Commit %d bytes more than acquired", len);
+        rb_unlock(rb);
+        return ESP_FAIL;
+    }
+    rb->p_w += len;
+    if (rb->spsc) {
+        atomic_store(&rb->wr_cnt, atomic_load_explicit(&rb->wr_cnt, memory_order_relaxed) + len);
+        rb_spsc_wake(&rb->reader_waiting, rb->can_read);
+    } else {
+        rb->fill_cnt += len;
+        rb_release(rb->lock);
+        rb_release(rb->can_read);
+    }
+    return ESP_OK;
+}
+
 static esp_err_t rb_abort_read(ringbuf_handle_t rb)
 {
     if (rb == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    rb->abort_read = true;
+    rb_flag_set(&rb->abort_read, true);
     xSemaphoreGive(rb->can_read);
     return ESP_OK;
 }
@@ -336,7 +746,7 @@ static esp_err_t rb_abort_write(ringbuf_handle_t rb)
     if (rb == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    rb->abort_write = true;
+    rb_flag_set(&rb->abort_write, true);
     xSemaphoreGive(rb->can_write);
     return ESP_OK;
 }
@@ -356,7 +766,7 @@ bool rb_is_full(ringbuf_handle_t rb)
     if (rb == NULL) {
         return false;
     }
-    return (rb->size == rb->fill_cnt);
+    return (rb->size == rb_bytes_filled(rb));
 }
 
 esp_err_t rb_done_write(ringbuf_handle_t rb)
@@ -364,7 +774,7 @@ esp_err_t rb_done_write(ringbuf_handle_t rb)
     if (rb == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    rb->is_done_write = true;
+    rb_flag_set(&rb->is_done_write, true);
     rb_release(rb->can_read);
     return ESP_OK;
 }
@@ -384,7 +794,7 @@ bool rb_is_done_write(ringbuf_handle_t rb)
     if (rb == NULL) {
         return false;
     }
-    return (rb->is_done_write);
+    return (rb_flag_get(&rb->is_done_write));
 }
 
 int rb_get_size(ringbuf_handle_t rb)
@@ -195,3 +195,36 @@ TEST_CASE("audio_element_input_output_rb", "esp-adf")
     vRingbufferDelete(input_rb);
     vRingbufferDelete(output_rb);
 }
+
+TEST_CASE("audio_element_info_format", "esp-adf")
+{
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    audio_element_handle_t el = audio_element_init(&cfg);
+    TEST_ASSERT_NOT_NULL(el);
+
+    audio_element_format_t fmt;
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_get_format(el, &fmt));
+    TEST_ASSERT_EQUAL(44100, fmt.sample_rates);
+    TEST_ASSERT_EQUAL(2, fmt.channels);
+    TEST_ASSERT_EQUAL(16, fmt.bits);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_music_info(el, 16000, 1, 32));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_update_byte_pos(el, 100));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_update_byte_pos(el, 28));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_total_bytes(el, 4096));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_uri(el, "file://sdcard/test.wav"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_get_format(el, &fmt));
+    TEST_ASSERT_EQUAL(16000, fmt.sample_rates);
+    TEST_ASSERT_EQUAL(1, fmt.channels);
+    TEST_ASSERT_EQUAL(32, fmt.bits);
+
+    audio_element_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_getinfo(el, &info));
+    TEST_ASSERT_EQUAL(16000, info.sample_rates);
+    TEST_ASSERT_EQUAL(128, (int)info.byte_pos);
+    TEST_ASSERT_EQUAL(4096, (int)info.total_bytes);
+    TEST_ASSERT_EQUAL_STRING("file://sdcard/test.wav", info.uri);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(el));
+}
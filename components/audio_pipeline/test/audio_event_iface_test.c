@@ -137,3 +137,53 @@ TEST_CASE("audio_event_iface", "esp-adf")
     audio_event_iface_destroy(evt2);
     audio_event_iface_destroy(evt3);
 }
+
+TEST_CASE("audio_event_iface bus coalesce and topics", "esp-adf")
+{
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    cfg.queue_set_size = 0;
+    audio_event_iface_handle_t emitter = audio_event_iface_init(&cfg);
+    TEST_ASSERT_NOT_NULL(emitter);
+    cfg.queue_set_size = 10;
+    audio_event_iface_handle_t listener = audio_event_iface_init(&cfg);
+    TEST_ASSERT_NOT_NULL(listener);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_set_listener(emitter, listener));
+
+    audio_event_iface_msg_t msg = { 0 };
+    int i;
+    ESP_LOGI(TAG, "[✓] 5 positions and 5 same status make 2 messages");
+    msg.source = emitter;
+    for (i = 0; i < 5; i++) {
+        msg.cmd = 1;
+        TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_sendout_coalesce(emitter, &msg, AUDIO_EVENT_COALESCE_LATEST));
+        msg.cmd = 2;
+        msg.data = (void *)3;
+        TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_sendout_coalesce(emitter, &msg, AUDIO_EVENT_COALESCE_REPEAT));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_listen(listener, &msg, 0));
+    TEST_ASSERT_EQUAL(1, msg.cmd);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_listen(listener, &msg, 0));
+    TEST_ASSERT_EQUAL(2, msg.cmd);
+    TEST_ASSERT_EQUAL(ESP_FAIL, audio_event_iface_listen(listener, &msg, 0));
+
+    ESP_LOGI(TAG, "[✓] only the commands of the topics reach the listener");
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_set_listener_topics(emitter, listener, AUDIO_EVENT_IFACE_TOPIC(5)));
+    for (i = 4; i < 7; i++) {
+        msg.cmd = i;
+        TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_sendout(emitter, &msg));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_listen(listener, &msg, 0));
+    TEST_ASSERT_EQUAL(5, msg.cmd);
+    TEST_ASSERT_EQUAL(ESP_FAIL, audio_event_iface_listen(listener, &msg, 0));
+
+    ESP_LOGI(TAG, "[✓] removed emitter falls back to its external queue");
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_remove_listener(listener, emitter));
+    msg.cmd = 8;
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_sendout(emitter, &msg));
+    TEST_ASSERT_EQUAL(ESP_FAIL, audio_event_iface_listen(listener, &msg, 0));
+    TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(audio_event_iface_get_queue_handle(emitter), &msg, 0));
+    TEST_ASSERT_EQUAL(8, msg.cmd);
+
+    audio_event_iface_destroy(listener);
+    audio_event_iface_destroy(emitter);
+}
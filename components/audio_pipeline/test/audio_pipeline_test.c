@@ -117,3 +117,201 @@ TEST_CASE("audio_pipeline", "esp-adf")
     TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(last_el));
 
 }
+
+#define EXECUTOR_TEST_TOTAL_BYTES   (64 * 1024)
+
+static int executor_read_pos;
+static int executor_write_pos;
+static int executor_mismatch;
+static bool executor_slow_read;
+
+static int _exec_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    if (executor_read_pos >= EXECUTOR_TEST_TOTAL_BYTES) {
+        return AEL_IO_DONE;
+    }
+    if (len > EXECUTOR_TEST_TOTAL_BYTES - executor_read_pos) {
+        len = EXECUTOR_TEST_TOTAL_BYTES - executor_read_pos;
+    }
+    if (executor_slow_read) {
+        vTaskDelay(10 / portTICK_RATE_MS);
+    }
+    for (int i = 0; i < len; i++) {
+        buffer[i] = (char)(executor_read_pos + i);
+    }
+    executor_read_pos += len;
+    return len;
+}
+
+static int _exec_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    for (int i = 0; i < len; i++) {
+        if (buffer[i] != (char)(executor_write_pos + i)) {
+            executor_mismatch++;
+        }
+    }
+    executor_write_pos += len;
+    return len;
+}
+
+static int _exec_process(audio_element_handle_t self, char *buffer, int len)
+{
+    int r_size = audio_element_input(self, buffer, len);
+    if (r_size > 0) {
+        r_size = audio_element_output(self, buffer, r_size);
+    }
+    return r_size;
+}
+
+static int executor_timeout_cnt;
+static bool executor_stall;
+
+static int _exec_stall_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    if (executor_stall) {
+        vTaskDelay(5 / portTICK_RATE_MS);
+        return AEL_IO_TIMEOUT;
+    }
+    return _exec_read(self, buffer, len, ticks_to_wait, context);
+}
+
+static int _exec_count_process(audio_element_handle_t self, char *buffer, int len)
+{
+    int r_size = audio_element_input(self, buffer, len);
+    if (r_size == AEL_IO_TIMEOUT) {
+        executor_timeout_cnt++;
+    } else if (r_size > 0) {
+        r_size = audio_element_output(self, buffer, r_size);
+    }
+    return r_size;
+}
+
+TEST_CASE("audio_pipeline executor", "esp-adf")
+{
+    audio_element_handle_t first_el, mid_el, last_el;
+    audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    el_cfg.open = _el_open;
+    el_cfg.process = _exec_process;
+    el_cfg.close = _el_close;
+    el_cfg.buffer_len = 1000;
+    first_el = audio_element_init(&el_cfg);
+    el_cfg.buffer_len = 512;
+    mid_el = audio_element_init(&el_cfg);
+    el_cfg.buffer_len = 777;
+    last_el = audio_element_init(&el_cfg);
+    TEST_ASSERT_NOT_NULL(first_el);
+    TEST_ASSERT_NOT_NULL(mid_el);
+    TEST_ASSERT_NOT_NULL(last_el);
+    audio_element_set_read_cb(first_el, _exec_read, NULL);
+    audio_element_set_write_cb(last_el, _exec_write, NULL);
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    TEST_ASSERT_NOT_NULL(pipeline);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, first_el, "first"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, mid_el, "mid"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, last_el, "last"));
+
+    audio_pipeline_executor_cfg_t exec_cfg = DEFAULT_AUDIO_PIPELINE_EXECUTOR_CONFIG();
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_set_executor(pipeline, &exec_cfg, (const char *[]){"mid", "last"}, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_link(pipeline, (const char *[]){"first", "mid", "last"}, 3));
+    TEST_ASSERT_NULL(audio_element_get_output_ringbuf(mid_el));
+    // Block the nested read of the last stage, pausing it must not wait for the paused mid stage
+    audio_element_set_input_timeout(last_el, portMAX_DELAY);
+
+    for (int i = 0; i < 3; i++) {
+        executor_read_pos = 0;
+        executor_write_pos = 0;
+        executor_slow_read = (i == 2);
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pipeline));
+        if (i == 2) {
+            vTaskDelay(50 / portTICK_RATE_MS);
+            TEST_ASSERT_EQUAL(ESP_OK, audio_element_pause(mid_el));
+            // Let the last stage drain what is left and block on the paused mid stage
+            vTaskDelay(50 / portTICK_RATE_MS);
+            TEST_ASSERT_EQUAL(ESP_OK, audio_element_pause(last_el));
+            TEST_ASSERT_EQUAL(AEL_STATE_PAUSED, audio_element_get_state(last_el));
+            TEST_ASSERT_EQUAL(ESP_OK, audio_element_resume(mid_el, 0, 2000 / portTICK_RATE_MS));
+            int write_pos = executor_write_pos;
+            vTaskDelay(100 / portTICK_RATE_MS);
+            TEST_ASSERT_EQUAL(write_pos, executor_write_pos);
+            TEST_ASSERT_EQUAL(ESP_OK, audio_element_resume(last_el, 0, 2000 / portTICK_RATE_MS));
+        }
+        for (int ms = 0; ms < 5000 && audio_element_get_state(last_el) != AEL_STATE_FINISHED; ms += 10) {
+            vTaskDelay(10 / portTICK_RATE_MS);
+        }
+        TEST_ASSERT_EQUAL(AEL_STATE_FINISHED, audio_element_get_state(last_el));
+        TEST_ASSERT_EQUAL(EXECUTOR_TEST_TOTAL_BYTES, executor_write_pos);
+        TEST_ASSERT_EQUAL(0, executor_mismatch);
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_wait_for_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_ringbuffer(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_elements(pipeline));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_terminate(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unlink(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
+}
+
+TEST_CASE("audio_pipeline executor edge timeout", "esp-adf")
+{
+    audio_element_handle_t first_el, last_el;
+    audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    el_cfg.open = _el_open;
+    el_cfg.process = _exec_process;
+    el_cfg.close = _el_close;
+    el_cfg.buffer_len = 1000;
+    first_el = audio_element_init(&el_cfg);
+    el_cfg.process = _exec_count_process;
+    el_cfg.buffer_len = 777;
+    last_el = audio_element_init(&el_cfg);
+    TEST_ASSERT_NOT_NULL(first_el);
+    TEST_ASSERT_NOT_NULL(last_el);
+    audio_element_set_read_cb(first_el, _exec_stall_read, NULL);
+    audio_element_set_write_cb(last_el, _exec_write, NULL);
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    TEST_ASSERT_NOT_NULL(pipeline);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, first_el, "first"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, last_el, "last"));
+
+    audio_pipeline_executor_cfg_t exec_cfg = DEFAULT_AUDIO_PIPELINE_EXECUTOR_CONFIG();
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_set_executor(pipeline, &exec_cfg, (const char *[]){"first", "last"}, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_link(pipeline, (const char *[]){"first", "last"}, 2));
+
+    for (int i = 0; i < 2; i++) {
+        // A finite input timeout ends the edge read as AEL_IO_TIMEOUT, an infinite one keeps it blocked
+        audio_element_set_input_timeout(last_el, (i == 0) ? (20 / portTICK_RATE_MS) : portMAX_DELAY);
+        executor_read_pos = 0;
+        executor_write_pos = 0;
+        executor_slow_read = false;
+        executor_timeout_cnt = 0;
+        executor_stall = true;
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pipeline));
+        vTaskDelay(200 / portTICK_RATE_MS);
+        if (i == 0) {
+            TEST_ASSERT_TRUE(executor_timeout_cnt >= 3);
+        } else {
+            TEST_ASSERT_EQUAL(0, executor_timeout_cnt);
+        }
+        TEST_ASSERT_EQUAL(0, executor_write_pos);
+        TEST_ASSERT_EQUAL(AEL_STATE_RUNNING, audio_element_get_state(last_el));
+        executor_stall = false;
+        for (int ms = 0; ms < 5000 && audio_element_get_state(last_el) != AEL_STATE_FINISHED; ms += 10) {
+            vTaskDelay(10 / portTICK_RATE_MS);
+        }
+        TEST_ASSERT_EQUAL(AEL_STATE_FINISHED, audio_element_get_state(last_el));
+        TEST_ASSERT_EQUAL(EXECUTOR_TEST_TOTAL_BYTES, executor_write_pos);
+        TEST_ASSERT_EQUAL(0, executor_mismatch);
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_wait_for_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_ringbuffer(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_elements(pipeline));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_terminate(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unlink(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
+}
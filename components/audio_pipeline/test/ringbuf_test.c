@@ -0,0 +1,179 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "ringbuf.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+static const char *TAG = "RINGBUF_TEST";
+
+#define RB_TEST_SIZE        (8 * 1024)
+#define RB_TEST_CHUNK       (512)
+#define RB_TEST_TOTAL       (4 * 1024 * 1024)
+
+typedef struct {
+    ringbuf_handle_t    rb;
+    SemaphoreHandle_t   done;
+} rb_test_ctx_t;
+
+static void rb_test_writer_task(void *pv)
+{
+    rb_test_ctx_t *ctx = (rb_test_ctx_t *)pv;
+    char buf[RB_TEST_CHUNK];
+    uint8_t cnt = 0;
+    for (int sent = 0; sent < RB_TEST_TOTAL; sent += RB_TEST_CHUNK) {
+        for (int i = 0; i < RB_TEST_CHUNK; i++) {
+            buf[i] = cnt++;
+        }
+        if (rb_write(ctx->rb, buf, RB_TEST_CHUNK, portMAX_DELAY) != RB_TEST_CHUNK) {
+            break;
+        }
+    }
+    rb_done_write(ctx->rb);
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static int64_t rb_test_throughput(ringbuf_handle_t rb)
+{
+    rb_test_ctx_t ctx = {
+        .rb = rb,
+        .done = xSemaphoreCreateBinary(),
+    };
+    TEST_ASSERT_NOT_NULL(ctx.done);
+    char buf[RB_TEST_CHUNK];
+    uint8_t cnt = 0;
+    int total = 0;
+    int ret = 0;
+
+    int64_t start = esp_timer_get_time();
+    // The writer runs on the other core when there is one, so both sides really run concurrently
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(rb_test_writer_task, "rb_writer", 3 * 1024, &ctx, 5, NULL, portNUM_PROCESSORS - 1));
+    while ((ret = rb_read(rb, buf, RB_TEST_CHUNK, portMAX_DELAY)) > 0) {
+        for (int i = 0; i < ret; i++) {
+            TEST_ASSERT_EQUAL_UINT8(cnt++, (uint8_t)buf[i]);
+        }
+        total += ret;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    xSemaphoreTake(ctx.done, portMAX_DELAY);
+    vSemaphoreDelete(ctx.done);
+
+    TEST_ASSERT_EQUAL(RB_DONE, ret);
+    TEST_ASSERT_EQUAL(RB_TEST_TOTAL, total);
+    return elapsed;
+}
+
+TEST_CASE("ringbuf spsc timeout, abort and done", "esp-adf")
+{
+    char buf[16] = { 0 };
+    ringbuf_handle_t rb = rb_create_spsc(RB_TEST_SIZE, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+
+    TEST_ASSERT_EQUAL(RB_TIMEOUT, rb_read(rb, buf, sizeof(buf), 10 / portTICK_RATE_MS));
+    TEST_ASSERT_EQUAL(sizeof(buf), rb_write(rb, buf, sizeof(buf), 0));
+    TEST_ASSERT_EQUAL(sizeof(buf), rb_bytes_filled(rb));
+    TEST_ASSERT_EQUAL(RB_TEST_SIZE - sizeof(buf), rb_bytes_available(rb));
+    TEST_ASSERT_EQUAL(sizeof(buf), rb_read(rb, buf, sizeof(buf), 0));
+
+    rb_abort(rb);
+    TEST_ASSERT_EQUAL(RB_ABORT, rb_read(rb, buf, sizeof(buf), portMAX_DELAY));
+
+    rb_reset(rb);
+    TEST_ASSERT_EQUAL(0, rb_bytes_filled(rb));
+    TEST_ASSERT_EQUAL(3, rb_write(rb, buf, 3, 0));
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(3, rb_read(rb, buf, sizeof(buf), portMAX_DELAY));
+    TEST_ASSERT_EQUAL(RB_DONE, rb_read(rb, buf, sizeof(buf), portMAX_DELAY));
+    rb_destroy(rb);
+}
+
+TEST_CASE("ringbuf throughput, locked vs spsc", "esp-adf")
+{
+    ringbuf_handle_t rb = rb_create(RB_TEST_SIZE, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    int64_t locked_us = rb_test_throughput(rb);
+    rb_destroy(rb);
+
+    rb = rb_create_spsc(RB_TEST_SIZE, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    int64_t spsc_us = rb_test_throughput(rb);
+    rb_destroy(rb);
+
+    ESP_LOGI(TAG, "%d bytes in %d-byte chunks, locked: %lld us (%lld KB/s), spsc: %lld us (%lld KB/s)",
+             RB_TEST_TOTAL, RB_TEST_CHUNK,
+             locked_us, (int64_t)RB_TEST_TOTAL * 1000000 / 1024 / locked_us,
+             spsc_us, (int64_t)RB_TEST_TOTAL * 1000000 / 1024 / spsc_us);
+}
+
+static void rb_test_zero_copy_wrap(ringbuf_handle_t rb)
+{
+    char src[48];
+    char *span = NULL;
+    for (int i = 0; i < sizeof(src); i++) {
+        src[i] = i;
+    }
+    // Move the positions near the end so the next 48 bytes wrap around
+    TEST_ASSERT_EQUAL(40, rb_write(rb, src, 40, 0));
+    TEST_ASSERT_EQUAL(40, rb_read(rb, NULL, 40, 0));
+
+    TEST_ASSERT_EQUAL(24, rb_acquire_write(rb, &span, sizeof(src), 0));
+    memcpy(span, src, 24);
+    TEST_ASSERT_EQUAL(ESP_OK, rb_commit_write(rb, 24));
+    TEST_ASSERT_EQUAL(24, rb_acquire_write(rb, &span, sizeof(src) - 24, 0));
+    memcpy(span, src + 24, 24);
+    TEST_ASSERT_EQUAL(ESP_OK, rb_commit_write(rb, 24));
+    TEST_ASSERT_EQUAL(sizeof(src), rb_bytes_filled(rb));
+
+    TEST_ASSERT_EQUAL(24, rb_acquire_read(rb, &span, sizeof(src), 0));
+    TEST_ASSERT_EQUAL_INT8_ARRAY(src, span, 24);
+    TEST_ASSERT_EQUAL(ESP_OK, rb_release_read(rb, 24));
+    TEST_ASSERT_EQUAL(24, rb_acquire_read(rb, &span, sizeof(src), 0));
+    TEST_ASSERT_EQUAL_INT8_ARRAY(src + 24, span, 24);
+    TEST_ASSERT_EQUAL(ESP_FAIL, rb_release_read(rb, 25));
+    TEST_ASSERT_EQUAL(ESP_OK, rb_release_read(rb, 24));
+
+    TEST_ASSERT_EQUAL(RB_TIMEOUT, rb_acquire_read(rb, &span, sizeof(src), 0));
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(RB_DONE, rb_acquire_read(rb, &span, sizeof(src), 0));
+}
+
+TEST_CASE("ringbuf zero-copy acquire and release across wrap-around", "esp-adf")
+{
+    ringbuf_handle_t rb = rb_create(64, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    rb_test_zero_copy_wrap(rb);
+    rb_destroy(rb);
+
+    rb = rb_create_spsc(64, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    rb_test_zero_copy_wrap(rb);
+    rb_destroy(rb);
+}
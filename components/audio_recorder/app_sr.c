@@ -17,6 +17,7 @@
 #include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "nvs.h"
 #include "app_sr.h"
 
 #include "esp_mn_speech_commands.h"
@@ -31,6 +32,11 @@
 
 static const char *TAG = "app_sr";
 
+#define APP_SR_CMD_HASH_SIZE        (256) /* must be a power of 2 */
+#define APP_SR_CMD_NVS_KEY          "cmd_table"
+#define APP_SR_CMD_BLOB_MAGIC       (0x53524344) /* "SRCD" */
+#define APP_SR_CMD_BLOB_VERSION     (1)
+
 typedef struct {
     sr_language_t lang;
     model_iface_data_t *model_data;
@@ -39,8 +45,18 @@ typedef struct {
     esp_afe_sr_data_t *afe_data;
     int16_t *afe_in_buffer;
     int16_t *afe_out_buffer;
-    SLIST_HEAD(sr_cmd_list_t, sr_cmd_t) cmd_list;
-    uint8_t cmd_num;
+    sr_cmd_t *cmds;             /* command table, the id of a command is its index */
+    uint32_t *cmd_hash;         /* phoneme hash of each command */
+    int16_t *hash_next;         /* next id in the same phoneme bucket */
+    int16_t *user_next;         /* next id mapped to the same sr_user_cmd_t */
+    int16_t hash_head[APP_SR_CMD_HASH_SIZE];
+    int16_t hash_tail[APP_SR_CMD_HASH_SIZE];
+    int16_t user_head[SR_CMD_MAX + 1];
+    int16_t user_tail[SR_CMD_MAX + 1];
+    uint16_t cmd_num;
+    bool index_dirty;           /* hash and user_cmd index need a rebuild */
+    bool mn_dirty;              /* MultiNet command list needs a full reload */
+    bool mn_changed;            /* MultiNet command list differs from the compiled one */
     TaskHandle_t feed_task;
     TaskHandle_t detect_task;
     TaskHandle_t handle_task;
@@ -63,75 +79,164 @@ static sr_data_t *g_sr_data = NULL;
  */
 static const sr_cmd_t g_default_cmd_info[] = {
     // English
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Turn On the Light", "TkN nN jc LiT", {NULL}},
-    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Switch On the Light", "SWgp nN jc LiT", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Switch Off the Light", "SWgp eF jc LiT", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Turn Off the Light", "TkN eF jc LiT", {NULL}},
-    {SR_CMD_SET_RED, SR_LANG_EN, 0, "Turn Red", "TkN RfD", {NULL}},
-    {SR_CMD_SET_GREEN, SR_LANG_EN, 0, "Turn Green", "TkN GRmN", {NULL}},
-    {SR_CMD_SET_BLUE, SR_LANG_EN, 0, "Turn Blue", "TkN BLo", {NULL}},
-    {SR_CMD_CUSTOMIZE_COLOR, SR_LANG_EN, 0, "Customize Color", "KcSTcMiZ KcLk", {NULL}},
-    {SR_CMD_PLAY, SR_LANG_EN, 0, "Sing a song", "Sgl c Sel", {NULL}},
-    {SR_CMD_PLAY, SR_LANG_EN, 0, "Play Music", "PLd MYoZgK", {NULL}},
-    {SR_CMD_NEXT, SR_LANG_EN, 0, "Next Song", "NfKST Sel", {NULL}},
-    {SR_CMD_PAUSE, SR_LANG_EN, 0, "Pause Playing", "PeZ PLdgl", {NULL}},
+    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Turn On the Light", "TkN nN jc LiT"},
+    {SR_CMD_LIGHT_ON, SR_LANG_EN, 0, "Switch On the Light", "SWgp nN jc LiT"},
+    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Switch Off the Light", "SWgp eF jc LiT"},
+    {SR_CMD_LIGHT_OFF, SR_LANG_EN, 0, "Turn Off the Light", "TkN eF jc LiT"},
+    {SR_CMD_SET_RED, SR_LANG_EN, 0, "Turn Red", "TkN RfD"},
+    {SR_CMD_SET_GREEN, SR_LANG_EN, 0, "Turn Green", "TkN GRmN"},
+    {SR_CMD_SET_BLUE, SR_LANG_EN, 0, "Turn Blue", "TkN BLo"},
+    {SR_CMD_CUSTOMIZE_COLOR, SR_LANG_EN, 0, "Customize Color", "KcSTcMiZ KcLk"},
+    {SR_CMD_PLAY, SR_LANG_EN, 0, "Sing a song", "Sgl c Sel"},
+    {SR_CMD_PLAY, SR_LANG_EN, 0, "Play Music", "PLd MYoZgK"},
+    {SR_CMD_NEXT, SR_LANG_EN, 0, "Next Song", "NfKST Sel"},
+    {SR_CMD_PAUSE, SR_LANG_EN, 0, "Pause Playing", "PeZ PLdgl"},
 
     // Chinese
-    {SR_CMD_LIGHT_ON, SR_LANG_CN, 0, "打开电灯", "da kai dian deng", {NULL}},
-    {SR_CMD_LIGHT_OFF, SR_LANG_CN, 0, "关闭电灯", "guan bi dian deng", {NULL}},
-
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开空调", "da kai kong tiao", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭空调", "guan bi kong tiao", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "舒适模式", "shu shi mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "制冷模式", "zhi leng mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "制热模式", "zhi re mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "加热模式", "jia re mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "除湿模式", "chu shi mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "送风模式", "song feng mo shi", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "升高温度", "sheng gao wen du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "降低温度", "jiang di wen du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "温度调到最高", "wen du tiao dao zui gao", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "温度调到最低", "wen du tiao dao zui di", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "太热了", "tai re le", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "太冷了", "tai leng le", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "十六度", "shi liu du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "十七度", "shi qi du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "十八度", "shi ba du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "十九度", "shi jiu du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十度", "er shi du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十一度", "er shi yi du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十二度", "er shi er du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十三度", "er shi san du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十四度", "er shi si du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十五度", "er shi wu du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十六度", "er shi liu du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十七度", "er shi qi du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十八度", "er shi ba du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "二十九度", "er shi jiu du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "三十度", "san shi du", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "增大风速", "zeng da feng su", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "减小风速", "jian xiao feng su", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "高速风", "gao su feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "中速风", "zhong su feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "低速风", "di su feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "自动风", "zi dong feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开左右摆风", "da kai zuo you bai feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开上下摆风", "da kai shang xia bai feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭左右摆风", "guan bi zuo you bai feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭上下摆风", "guan bi shang xia bai feng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开辅热", "da kai fu re", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭辅热", "guan bi fu re", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开自清洁", "da kai zi qing jie", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭自清洁", "guan bi zi qing jie", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开静音", "da kai jing yin", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭静音", "guan bi jing yin", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开卧室灯", "da kai wo shi deng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭卧室灯", "guan bi wo shi deng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "打开客厅灯", "da kai ke ting deng", {NULL}},
-    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭客厅灯", "guan bi ke ting deng", {NULL}},
+    {SR_CMD_LIGHT_ON, SR_LANG_CN, 0, "打开电灯", "da kai dian deng"},
+    {SR_CMD_LIGHT_OFF, SR_LANG_CN, 0, "关闭电灯", "guan bi dian deng"},
+
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开空调", "da kai kong tiao"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭空调", "guan bi kong tiao"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "舒适模式", "shu shi mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "制冷模式", "zhi leng mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "制热模式", "zhi re mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "加热模式", "jia re mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "除湿模式", "chu shi mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "送风模式", "song feng mo shi"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "升高温度", "sheng gao wen du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "降低温度", "jiang di wen du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "温度调到最高", "wen du tiao dao zui gao"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "温度调到最低", "wen du tiao dao zui di"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "太热了", "tai re le"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "太冷了", "tai leng le"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "十六度", "shi liu du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "十七度", "shi qi du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "十八度", "shi ba du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "十九度", "shi jiu du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十度", "er shi du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十一度", "er shi yi du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十二度", "er shi er du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十三度", "er shi san du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十四度", "er shi si du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十五度", "er shi wu du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十六度", "er shi liu du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十七度", "er shi qi du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十八度", "er shi ba du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "二十九度", "er shi jiu du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "三十度", "san shi du"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "增大风速", "zeng da feng su"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "减小风速", "jian xiao feng su"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "高速风", "gao su feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "中速风", "zhong su feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "低速风", "di su feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "自动风", "zi dong feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开左右摆风", "da kai zuo you bai feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开上下摆风", "da kai shang xia bai feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭左右摆风", "guan bi zuo you bai feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭上下摆风", "guan bi shang xia bai feng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开辅热", "da kai fu re"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭辅热", "guan bi fu re"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开自清洁", "da kai zi qing jie"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭自清洁", "guan bi zi qing jie"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开静音", "da kai jing yin"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭静音", "guan bi jing yin"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开卧室灯", "da kai wo shi deng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭卧室灯", "guan bi wo shi deng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "打开客厅灯", "da kai ke ting deng"},
+    {SR_CMD_MAX, SR_LANG_CN, 0, "关闭客厅灯", "guan bi ke ting deng"},
 
 };
 
+static uint32_t app_sr_phoneme_hash(const char *phoneme)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    while (*phoneme) {
+        hash ^= (uint8_t)*phoneme++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void app_sr_cmd_index_link(uint16_t id)
+{
+    int bucket = g_sr_data->cmd_hash[id] & (APP_SR_CMD_HASH_SIZE - 1);
+    g_sr_data->hash_next[id] = -1;
+    if (g_sr_data->hash_head[bucket] < 0) {
+        g_sr_data->hash_head[bucket] = id;
+    } else {
+        g_sr_data->hash_next[g_sr_data->hash_tail[bucket]] = id;
+    }
+    g_sr_data->hash_tail[bucket] = id;
+
+    unsigned user = g_sr_data->cmds[id].cmd;
+    g_sr_data->user_next[id] = -1;
+    if (user > SR_CMD_MAX) {
+        return;
+    }
+    if (g_sr_data->user_head[user] < 0) {
+        g_sr_data->user_head[user] = id;
+    } else {
+        g_sr_data->user_next[g_sr_data->user_tail[user]] = id;
+    }
+    g_sr_data->user_tail[user] = id;
+}
+
+static void app_sr_cmd_index_rebuild(void)
+{
+    memset(g_sr_data->hash_head, 0xff, sizeof(g_sr_data->hash_head));
+    memset(g_sr_data->user_head, 0xff, sizeof(g_sr_data->user_head));
+    for (uint16_t id = 0; id < g_sr_data->cmd_num; id++) {
+        app_sr_cmd_index_link(id);
+    }
+    g_sr_data->index_dirty = false;
+}
+
+static esp_err_t app_sr_cmd_append(const sr_cmd_t *cmd)
+{
+    ESP_RETURN_ON_FALSE(cmd->lang == g_sr_data->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
+    ESP_RETURN_ON_FALSE(ESP_MN_MAX_PHRASE_NUM > g_sr_data->cmd_num, ESP_ERR_INVALID_STATE, TAG, "cmd is full");
+
+    uint16_t id = g_sr_data->cmd_num;
+    sr_cmd_t *item = &g_sr_data->cmds[id];
+    memcpy(item, cmd, sizeof(sr_cmd_t));
+    item->id = id;
+    item->str[SR_CMD_STR_LEN_MAX - 1] = '\0';
+    item->phoneme[SR_CMD_PHONEME_LEN_MAX - 1] = '\0';
+    g_sr_data->cmd_hash[id] = app_sr_phoneme_hash(item->phoneme);
+    g_sr_data->cmd_num++;
+    g_sr_data->mn_changed = true;
+    if (!g_sr_data->index_dirty) {
+        app_sr_cmd_index_link(id);
+    }
+    if (!g_sr_data->mn_dirty) {
+        esp_mn_commands_add(id, item->phoneme);
+    }
+    return ESP_OK;
+}
+
+/* Drop the commands flagged in `removed` and renumber the rest in one pass */
+static void app_sr_cmd_compact(const uint8_t *removed)
+{
+    uint16_t num = 0;
+    for (uint16_t id = 0; id < g_sr_data->cmd_num; id++) {
+        if (removed[id >> 3] & (1 << (id & 7))) {
+            continue;
+        }
+        if (num != id) {
+            memcpy(&g_sr_data->cmds[num], &g_sr_data->cmds[id], sizeof(sr_cmd_t));
+            g_sr_data->cmd_hash[num] = g_sr_data->cmd_hash[id];
+        }
+        g_sr_data->cmds[num].id = num;
+        num++;
+    }
+    g_sr_data->mn_changed |= num != g_sr_data->cmd_num;
+    g_sr_data->cmd_num = num;
+    g_sr_data->index_dirty = true;
+    g_sr_data->mn_dirty = true;
+}
+
 esp_err_t app_sr_init_cmd(const esp_mn_iface_t *multinet,  model_iface_data_t *model_data)
 {
     #if defined CONFIG_SR_MN_CN_MULTINET6_QUANT || defined CONFIG_SR_MN_EN_MULTINET6_QUANT
@@ -144,7 +249,22 @@ esp_err_t app_sr_init_cmd(const esp_mn_iface_t *multinet,  model_iface_data_t *m
     g_sr_data->result_que = xQueueCreate(3, sizeof(sr_result_t));
     g_sr_data->event_group = xEventGroupCreate();
 
-    SLIST_INIT(&g_sr_data->cmd_list);
+    /* One PSRAM block holds the whole table and its index links */
+    size_t entry_size = sizeof(sr_cmd_t) + sizeof(uint32_t) + 2 * sizeof(int16_t);
+    uint8_t *table = heap_caps_calloc(ESP_MN_MAX_PHRASE_NUM, entry_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (NULL == table) {
+        ESP_LOGE(TAG, "memory for sr cmd table is not enough");
+        vQueueDelete(g_sr_data->result_que);
+        vEventGroupDelete(g_sr_data->event_group);
+        heap_caps_free(g_sr_data);
+        g_sr_data = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    g_sr_data->cmds = (sr_cmd_t *)table;
+    g_sr_data->cmd_hash = (uint32_t *)(table + ESP_MN_MAX_PHRASE_NUM * sizeof(sr_cmd_t));
+    g_sr_data->hash_next = (int16_t *)(g_sr_data->cmd_hash + ESP_MN_MAX_PHRASE_NUM);
+    g_sr_data->user_next = g_sr_data->hash_next + ESP_MN_MAX_PHRASE_NUM;
+    app_sr_cmd_index_rebuild();
 
     ESP_LOGI(TAG, "update cmd, %p, %p", multinet, model_data);
     g_sr_data->multinet = multinet;
@@ -154,11 +274,15 @@ esp_err_t app_sr_init_cmd(const esp_mn_iface_t *multinet,  model_iface_data_t *m
     esp_mn_commands_alloc();
     g_sr_data->cmd_num = 0;
 
+    if (app_sr_load_cmds(APP_SR_CMD_NVS_NAMESPACE) == ESP_OK) {
+        return ESP_OK;
+    }
+
     uint8_t cmd_number = 0;
     // count command number
     for (size_t i = 0; i < sizeof(g_default_cmd_info) / sizeof(sr_cmd_t); i++) {
         if (g_default_cmd_info[i].lang == SR_LANG_CN) {
-            app_sr_add_cmd(&g_default_cmd_info[i]);
+            app_sr_cmd_append(&g_default_cmd_info[i]);
             cmd_number++;
         }
     }
@@ -200,11 +324,8 @@ esp_err_t app_sr_stop(void)
         g_sr_data->afe_handle->destroy(g_sr_data->afe_data);
     }
 
-    sr_cmd_t *it;
-    while (!SLIST_EMPTY(&g_sr_data->cmd_list)) {
-        it = SLIST_FIRST(&g_sr_data->cmd_list);
-        SLIST_REMOVE_HEAD(&g_sr_data->cmd_list, next);
-        heap_caps_free(it);
+    if (g_sr_data->cmds) {
+        heap_caps_free(g_sr_data->cmds);
     }
 
     if (g_sr_data->afe_in_buffer) {
@@ -232,30 +353,29 @@ esp_err_t app_sr_add_cmd(const sr_cmd_t *cmd)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
     ESP_RETURN_ON_FALSE(NULL != cmd, ESP_ERR_INVALID_ARG, TAG, "pointer of cmd is invaild");
-    ESP_RETURN_ON_FALSE(cmd->lang == g_sr_data->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
-    ESP_RETURN_ON_FALSE(ESP_MN_MAX_PHRASE_NUM >= g_sr_data->cmd_num, ESP_ERR_INVALID_STATE, TAG, "cmd is full");
+    return app_sr_cmd_append(cmd);
+}
 
-    sr_cmd_t *item = (sr_cmd_t *)heap_caps_calloc(1, sizeof(sr_cmd_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    ESP_RETURN_ON_FALSE(NULL != item, ESP_ERR_NO_MEM, TAG, "memory for sr cmd is not enough");
-    memcpy(item, cmd, sizeof(sr_cmd_t));
-    item->next.sle_next = NULL;
-#if 1 // insert after
-    sr_cmd_t *last = SLIST_FIRST(&g_sr_data->cmd_list);
-    if (last == NULL) {
-        SLIST_INSERT_HEAD(&g_sr_data->cmd_list, item, next);
-    } else {
-        sr_cmd_t *it;
-        while ((it = SLIST_NEXT(last, next)) != NULL) {
-            last = it;
+esp_err_t app_sr_add_cmds(const sr_cmd_t *cmds, uint16_t num)
+{
+    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(NULL != cmds || num == 0, ESP_ERR_INVALID_ARG, TAG, "pointer of cmds is invaild");
+    ESP_RETURN_ON_FALSE(ESP_MN_MAX_PHRASE_NUM - g_sr_data->cmd_num >= num, ESP_ERR_INVALID_STATE, TAG, "cmd is full");
+
+    uint16_t old_num = g_sr_data->cmd_num;
+    bool old_changed = g_sr_data->mn_changed;
+    for (uint16_t i = 0; i < num; i++) {
+        esp_err_t ret = app_sr_cmd_append(&cmds[i]);
+        if (ret != ESP_OK) {
+            /* All or nothing, drop what has been added by this call and leave the pending changes as they were */
+            g_sr_data->cmd_num = old_num;
+            g_sr_data->mn_changed = old_changed;
+            g_sr_data->index_dirty = true;
+            g_sr_data->mn_dirty = true;
+            return ret;
         }
-        SLIST_INSERT_AFTER(last, item, next);
     }
-#else  // insert head
-    SLIST_INSERT_HEAD(&g_sr_data->cmd_list, it, next);
-#endif
-    esp_mn_commands_add(g_sr_data->cmd_num, (char *)cmd->phoneme);
-    g_sr_data->cmd_num++;
-    return ESP_OK;
+    return app_sr_update_cmds();
 }
 
 esp_err_t app_sr_modify_cmd(uint32_t id, const sr_cmd_t *cmd)
@@ -265,47 +385,50 @@ esp_err_t app_sr_modify_cmd(uint32_t id, const sr_cmd_t *cmd)
     ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
     ESP_RETURN_ON_FALSE(cmd->lang == g_sr_data->lang, ESP_ERR_INVALID_ARG, TAG, "cmd lang error");
 
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (it->id == id) {
-            ESP_LOGI(TAG, "modify cmd [%d] from %s to %s", id, it->str, cmd->str);
-            esp_mn_commands_modify(it->phoneme, (char *)cmd->phoneme);
-            memcpy(it, cmd, sizeof(sr_cmd_t));
-            break;
-        }
+    sr_cmd_t *it = &g_sr_data->cmds[id];
+    ESP_LOGI(TAG, "modify cmd [%d] from %s to %s", id, it->str, cmd->str);
+    if (strcmp(it->phoneme, cmd->phoneme) != 0) {
+        g_sr_data->mn_changed = true;
+    }
+    if (!g_sr_data->mn_dirty) {
+        esp_mn_commands_modify(it->phoneme, (char *)cmd->phoneme);
     }
-    ESP_RETURN_ON_FALSE(NULL != it, ESP_ERR_NOT_FOUND, TAG, "can't find cmd id:%d", cmd->id);
+    memcpy(it, cmd, sizeof(sr_cmd_t));
+    it->id = id;
+    it->str[SR_CMD_STR_LEN_MAX - 1] = '\0';
+    it->phoneme[SR_CMD_PHONEME_LEN_MAX - 1] = '\0';
+    g_sr_data->cmd_hash[id] = app_sr_phoneme_hash(it->phoneme);
+    g_sr_data->index_dirty = true;
     return ESP_OK;
 }
 
 esp_err_t app_sr_remove_cmd(uint32_t id)
+{
+    return app_sr_remove_cmds(&id, 1);
+}
+
+esp_err_t app_sr_remove_cmds(const uint32_t *id_list, uint16_t num)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (it->id == id) {
-            ESP_LOGI(TAG, "remove cmd id [%d]", it->id);
-            SLIST_REMOVE(&g_sr_data->cmd_list, it, sr_cmd_t, next);
-            heap_caps_free(it);
-            g_sr_data->cmd_num--;
-            break;
-        }
+    ESP_RETURN_ON_FALSE(NULL != id_list || num == 0, ESP_ERR_INVALID_ARG, TAG, "pointer of id_list is invaild");
+
+    uint8_t removed[(ESP_MN_MAX_PHRASE_NUM + 7) / 8] = { 0 };
+    for (uint16_t i = 0; i < num; i++) {
+        ESP_RETURN_ON_FALSE(id_list[i] < g_sr_data->cmd_num, ESP_ERR_INVALID_ARG, TAG, "cmd id out of range");
+        removed[id_list[i] >> 3] |= 1 << (id_list[i] & 7);
+        ESP_LOGI(TAG, "remove cmd id [%d]", id_list[i]);
     }
-    ESP_RETURN_ON_FALSE(NULL != it, ESP_ERR_NOT_FOUND, TAG, "can't find cmd id:%d", id);
+    app_sr_cmd_compact(removed);
     return ESP_OK;
 }
 
 esp_err_t app_sr_remove_all_cmd(void)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    sr_cmd_t *it;
-    while (!SLIST_EMPTY(&g_sr_data->cmd_list)) {
-        it = SLIST_FIRST(&g_sr_data->cmd_list);
-        SLIST_REMOVE_HEAD(&g_sr_data->cmd_list, next);
-        heap_caps_free(it);
-    }
-    SLIST_INIT(&g_sr_data->cmd_list);
+    g_sr_data->mn_changed |= g_sr_data->cmd_num != 0;
+    g_sr_data->cmd_num = 0;
+    g_sr_data->index_dirty = true;
+    g_sr_data->mn_dirty = true;
     return ESP_OK;
 }
 
@@ -313,25 +436,31 @@ esp_err_t app_sr_update_cmds(void)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
 
-    uint32_t count = 0;
-    sr_cmd_t *it;
-
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        it->id = count++;
+    if (g_sr_data->index_dirty) {
+        app_sr_cmd_index_rebuild();
+    }
+    if (!g_sr_data->mn_changed) {
+        ESP_LOGI(TAG, "cmds unchanged, skip the update");
+        return ESP_OK;
+    }
+    if (g_sr_data->mn_dirty) {
+        /* Ids have moved since the last update, reload the whole list */
+        esp_mn_commands_clear();
+        for (uint16_t id = 0; id < g_sr_data->cmd_num; id++) {
+            esp_mn_commands_add(id, g_sr_data->cmds[id].phoneme);
+        }
+        g_sr_data->mn_dirty = false;
     }
 
-    ESP_LOGI(TAG, "app_sr_update_cmds 2, %p, %p", g_sr_data->multinet, g_sr_data->model_data);
+    ESP_LOGI(TAG, "app_sr_update_cmds %d cmds, %p, %p", g_sr_data->cmd_num, g_sr_data->multinet, g_sr_data->model_data);
 
     esp_mn_error_t *err_id = esp_mn_commands_update(g_sr_data->multinet, g_sr_data->model_data);
-    if(err_id){
+    if (err_id) {
         for (int i = 0; i < err_id->num; i++) {
             ESP_LOGE(TAG, "err cmd id:%d", err_id->phrase_idx[i]);
         }
-    } else{
-        for (int i = 0; i < err_id->num; i++) {
-            ESP_LOGI(TAG, "err cmd id:%d", err_id->phrase_idx[i]);
-        }
     }
+    g_sr_data->mn_changed = false;
     esp_mn_commands_print();
 
     return ESP_OK;
@@ -340,18 +469,19 @@ esp_err_t app_sr_update_cmds(void)
 uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list, uint16_t max_len)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, 0, TAG, "SR is not running");
+    if ((unsigned)user_cmd > SR_CMD_MAX) {
+        return 0;
+    }
+    if (g_sr_data->index_dirty) {
+        app_sr_cmd_index_rebuild();
+    }
 
     uint8_t cmd_num = 0;
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (user_cmd == it->cmd) {
-            if (id_list) {
-                id_list[cmd_num] = it->id;
-            }
-            if (++cmd_num >= max_len) {
-                break;
-            }
+    for (int16_t id = g_sr_data->user_head[user_cmd]; id >= 0 && cmd_num < max_len; id = g_sr_data->user_next[id]) {
+        if (id_list) {
+            id_list[cmd_num] = id;
         }
+        cmd_num++;
     }
     return cmd_num;
 }
@@ -359,17 +489,20 @@ uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list
 uint8_t app_sr_search_cmd_from_phoneme(const char *phoneme, uint8_t *id_list, uint16_t max_len)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, 0, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(NULL != phoneme, 0, TAG, "pointer of phoneme is invaild");
+    if (g_sr_data->index_dirty) {
+        app_sr_cmd_index_rebuild();
+    }
 
+    uint32_t hash = app_sr_phoneme_hash(phoneme);
     uint8_t cmd_num = 0;
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (0 == strcmp(phoneme, it->phoneme)) {
+    int16_t id = g_sr_data->hash_head[hash & (APP_SR_CMD_HASH_SIZE - 1)];
+    for (; id >= 0 && cmd_num < max_len; id = g_sr_data->hash_next[id]) {
+        if (g_sr_data->cmd_hash[id] == hash && 0 == strcmp(phoneme, g_sr_data->cmds[id].phoneme)) {
             if (id_list) {
-                id_list[cmd_num] = it->id;
-            }
-            if (++cmd_num >= max_len) {
-                break;
+                id_list[cmd_num] = id;
             }
+            cmd_num++;
         }
     }
     return cmd_num;
@@ -379,13 +512,140 @@ const sr_cmd_t *app_sr_get_cmd_from_id(uint32_t id)
 {
     ESP_RETURN_ON_FALSE(NULL != g_sr_data, NULL, TAG, "SR is not running");
     ESP_RETURN_ON_FALSE(id < g_sr_data->cmd_num, NULL, TAG, "cmd id out of range");
+    return &g_sr_data->cmds[id];
+}
+
+/*
+ * Flash layout: app_sr_cmd_blob_t, then for each command
+ * [cmd][str_len][phoneme_len][str][phoneme] without the terminating '\0'.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t lang;
+    uint8_t reserved;
+    uint16_t cmd_num;
+    uint16_t data_len;
+} app_sr_cmd_blob_t;
+
+esp_err_t app_sr_save_cmds(const char *nvs_namespace)
+{
+    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(NULL != nvs_namespace, ESP_ERR_INVALID_ARG, TAG, "nvs namespace is invaild");
 
-    sr_cmd_t *it;
-    SLIST_FOREACH(it, &g_sr_data->cmd_list, next) {
-        if (id == it->id) {
-            return it;
+    size_t size = sizeof(app_sr_cmd_blob_t);
+    for (uint16_t id = 0; id < g_sr_data->cmd_num; id++) {
+        size += 3 + strlen(g_sr_data->cmds[id].str) + strlen(g_sr_data->cmds[id].phoneme);
+    }
+    uint8_t *blob = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != blob, ESP_ERR_NO_MEM, TAG, "memory for cmd blob is not enough");
+
+    app_sr_cmd_blob_t *head = (app_sr_cmd_blob_t *)blob;
+    head->magic = APP_SR_CMD_BLOB_MAGIC;
+    head->version = APP_SR_CMD_BLOB_VERSION;
+    head->lang = g_sr_data->lang;
+    head->reserved = 0;
+    head->cmd_num = g_sr_data->cmd_num;
+    head->data_len = size - sizeof(app_sr_cmd_blob_t);
+    uint8_t *pos = blob + sizeof(app_sr_cmd_blob_t);
+    for (uint16_t id = 0; id < g_sr_data->cmd_num; id++) {
+        const sr_cmd_t *it = &g_sr_data->cmds[id];
+        uint8_t str_len = strlen(it->str);
+        uint8_t phoneme_len = strlen(it->phoneme);
+        *pos++ = it->cmd;
+        *pos++ = str_len;
+        *pos++ = phoneme_len;
+        memcpy(pos, it->str, str_len);
+        pos += str_len;
+        memcpy(pos, it->phoneme, phoneme_len);
+        pos += phoneme_len;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(nvs_namespace, NVS_READWRITE, &nvs);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(nvs, APP_SR_CMD_NVS_KEY, blob, size);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs);
         }
+        nvs_close(nvs);
     }
-    ESP_RETURN_ON_FALSE(NULL != it, NULL, TAG, "can't find cmd id:%d", id);
-    return NULL;
+    heap_caps_free(blob);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save %d cmds, %s", g_sr_data->cmd_num, esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Saved %d cmds, %d bytes", g_sr_data->cmd_num, (int)size);
+    return ESP_OK;
+}
+
+esp_err_t app_sr_load_cmds(const char *nvs_namespace)
+{
+    ESP_RETURN_ON_FALSE(NULL != g_sr_data, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
+    ESP_RETURN_ON_FALSE(NULL != nvs_namespace, ESP_ERR_INVALID_ARG, TAG, "nvs namespace is invaild");
+
+    nvs_handle_t nvs;
+    size_t size = 0;
+    esp_err_t ret = nvs_open(nvs_namespace, NVS_READONLY, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_get_blob(nvs, APP_SR_CMD_NVS_KEY, NULL, &size);
+    if (ret != ESP_OK || size < sizeof(app_sr_cmd_blob_t)) {
+        nvs_close(nvs);
+        ESP_LOGI(TAG, "No cmd table in nvs namespace %s", nvs_namespace);
+        return ret != ESP_OK ? ret : ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *blob = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (NULL == blob) {
+        nvs_close(nvs);
+        ESP_LOGE(TAG, "memory for cmd blob is not enough");
+        return ESP_ERR_NO_MEM;
+    }
+    ret = nvs_get_blob(nvs, APP_SR_CMD_NVS_KEY, blob, &size);
+    nvs_close(nvs);
+    if (ret != ESP_OK) {
+        goto _exit;
+    }
+
+    /* Validate the whole blob before touching the table */
+    const app_sr_cmd_blob_t *head = (const app_sr_cmd_blob_t *)blob;
+    const uint8_t *end = blob + size;
+    const uint8_t *pos = blob + sizeof(app_sr_cmd_blob_t);
+    ret = ESP_ERR_INVALID_CRC;
+    if (head->magic != APP_SR_CMD_BLOB_MAGIC || head->version != APP_SR_CMD_BLOB_VERSION
+        || head->lang != g_sr_data->lang || head->cmd_num > ESP_MN_MAX_PHRASE_NUM
+        || head->data_len != size - sizeof(app_sr_cmd_blob_t)) {
+        ESP_LOGW(TAG, "Cmd table in nvs is invalid, ignored");
+        goto _exit;
+    }
+    for (uint16_t i = 0; i < head->cmd_num; i++) {
+        if (end - pos < 3 || pos[0] > SR_CMD_MAX || pos[1] >= SR_CMD_STR_LEN_MAX
+            || pos[2] >= SR_CMD_PHONEME_LEN_MAX || end - pos - 3 < pos[1] + pos[2]) {
+            ESP_LOGW(TAG, "Cmd table in nvs is corrupted at %d, ignored", i);
+            goto _exit;
+        }
+        pos += 3 + pos[1] + pos[2];
+    }
+
+    g_sr_data->cmd_num = 0;
+    g_sr_data->index_dirty = true;
+    g_sr_data->mn_dirty = true;
+    sr_cmd_t cmd = { .lang = g_sr_data->lang };
+    pos = blob + sizeof(app_sr_cmd_blob_t);
+    for (uint16_t i = 0; i < head->cmd_num; i++) {
+        cmd.cmd = pos[0];
+        memcpy(cmd.str, pos + 3, pos[1]);
+        cmd.str[pos[1]] = '\0';
+        memcpy(cmd.phoneme, pos + 3 + pos[1], pos[2]);
+        cmd.phoneme[pos[2]] = '\0';
+        pos += 3 + pos[1] + pos[2];
+        app_sr_cmd_append(&cmd);
+    }
+    ESP_LOGI(TAG, "Loaded %d cmds from nvs", g_sr_data->cmd_num);
+    ret = app_sr_update_cmds();
+
+_exit:
+    heap_caps_free(blob);
+    return ret;
 }
@@ -7,7 +7,6 @@
 #pragma once
 
 #include <stdbool.h>
-#include <sys/queue.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
@@ -29,6 +28,7 @@ extern "C" {
 
 #define SR_CMD_STR_LEN_MAX 64
 #define SR_CMD_PHONEME_LEN_MAX 64
+#define APP_SR_CMD_NVS_NAMESPACE "app_sr" /**< Namespace the command table is loaded from at boot */
 
 typedef struct {
     wakenet_state_t wakenet_mode;
@@ -59,13 +59,15 @@ typedef enum {
     SR_LANG_MAX,
 } sr_language_t;
 
+/**
+ * @brief Speech command, the `id` is its index in the command table
+ */
 typedef struct sr_cmd_t {
     sr_user_cmd_t cmd;
     sr_language_t lang;
     uint32_t id;
     char str[SR_CMD_STR_LEN_MAX];
     char phoneme[SR_CMD_PHONEME_LEN_MAX];
-    SLIST_ENTRY(sr_cmd_t) next;
 } sr_cmd_t;
 
 esp_err_t app_sr_start(bool record_en);
@@ -81,6 +83,61 @@ uint8_t app_sr_search_cmd_from_user_cmd(sr_user_cmd_t user_cmd, uint8_t *id_list
 uint8_t app_sr_search_cmd_from_phoneme(const char *phoneme, uint8_t *id_list, uint16_t max_len);
 esp_err_t app_sr_init_cmd(const esp_mn_iface_t *multinet,  model_iface_data_t *model_data);
 
+/**
+ * @brief Append a batch of commands and rebuild MultiNet once
+ *
+ * @note The batch is all or nothing, if one of them is rejected no command is kept and MultiNet is not rebuilt
+ *
+ * @param cmds  Commands to append, their `id` field is ignored
+ * @param num   Number of commands
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG    wrong language
+ *     - ESP_ERR_INVALID_STATE  SR not running or table full
+ */
+esp_err_t app_sr_add_cmds(const sr_cmd_t *cmds, uint16_t num);
+
+/**
+ * @brief Remove a batch of commands in one pass
+ *
+ * @note The remaining commands are renumbered right away, so ids and pointers got before
+ *       are invalid afterwards. Call `app_sr_update_cmds` to apply the change to MultiNet.
+ *
+ * @param id_list  Ids of the commands to remove
+ * @param num      Number of ids
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG    id out of range, nothing is removed
+ *     - ESP_ERR_INVALID_STATE  SR not running
+ */
+esp_err_t app_sr_remove_cmds(const uint32_t *id_list, uint16_t num);
+
+/**
+ * @brief Save the command table to NVS, `app_sr_init_cmd` loads it from `APP_SR_CMD_NVS_NAMESPACE`
+ *
+ * @param nvs_namespace  NVS namespace
+ *
+ * @return
+ *     - ESP_OK
+ *     - Others  NVS error
+ */
+esp_err_t app_sr_save_cmds(const char *nvs_namespace);
+
+/**
+ * @brief Replace the command table by the one saved in NVS and update MultiNet
+ *
+ * @param nvs_namespace  NVS namespace
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NVS_NOT_FOUND  No table saved
+ *     - ESP_ERR_INVALID_CRC    The saved table is invalid, the current table is kept
+ *     - Others                 NVS error
+ */
+esp_err_t app_sr_load_cmds(const char *nvs_namespace);
+
 #ifdef __cplusplus
 }
 #endif
@@ -96,6 +96,11 @@ typedef struct __audio_recorder {
     int                       wakeup_end;
     void                      *encoder_handle;
     recorder_encoder_iface_t  *encoder_iface;
+    int                       preroll_time;
+    recorder_frame_pool_handle_t frame_pool;
+    uint32_t                  replay_floor;
+    uint32_t                  wakeup_stamp;
+    recorder_arbiter_handle_t arbiter;
     audio_thread_t            task_handle;
     EventGroupHandle_t        sync_evt;
     QueueHandle_t             cmd_queue;
@@ -216,9 +221,16 @@ static esp_err_t audio_recorder_afe_monitor(recorder_sr_result_t result, void *u
 
 static esp_err_t audio_recorder_mn_monitor(recorder_sr_result_t result, void *user_ctx)
 {
+    AUDIO_NULL_CHECK(TAG, user_ctx, return ESP_FAIL);
+    audio_recorder_t *recorder = (audio_recorder_t *)user_ctx;
     if (result >= 0) {
         ESP_LOGI(TAG, "result : %d", result);
-        return audio_recorder_send_msg(user_ctx, RECORDER_CMD_MN_DECT, (void *)result, 0);
+        // The confidence is only valid inside this callback, pass it along in permille
+        float prob = 1.0f;
+        if (recorder->sr_iface->get_mn_prob) {
+            recorder->sr_iface->get_mn_prob(recorder->sr_handle, &prob);
+        }
+        return audio_recorder_send_msg(recorder, RECORDER_CMD_MN_DECT, (void *)result, (int)(prob * 1000));
     } else {
         return ESP_FAIL;
     }
@@ -232,6 +244,33 @@ static esp_err_t audio_recorder_encoder_enable(audio_recorder_t *recorder, bool
     return ESP_OK;
 }
 
+static inline uint32_t audio_recorder_time_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void audio_recorder_vad_start(audio_recorder_t *recorder)
+{
+    if (recorder->frame_pool && recorder->preroll_time > 0) {
+        // Let the readers start `preroll_time` before now, so the first syllables are not clipped,
+        // but not earlier than the wake word or the previous speech
+        uint32_t since = audio_recorder_time_ms() - recorder->preroll_time;
+        if ((int32_t)(since - recorder->replay_floor) < 0) {
+            since = recorder->replay_floor;
+        }
+        recorder_frame_pool_set_replay_point(recorder->frame_pool, since);
+    }
+    audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_START);
+    audio_recorder_encoder_enable(recorder, true);
+}
+
+static void audio_recorder_vad_end(audio_recorder_t *recorder)
+{
+    recorder->replay_floor = audio_recorder_time_ms();
+    audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_END);
+    audio_recorder_encoder_enable(recorder, false);
+}
+
 static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
 {
     AUDIO_NULL_CHECK(TAG, recorder, return );
@@ -248,6 +287,11 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
     switch (recorder->state) {
         case RECORDER_ST_IDLE: {
             if (event == RECORDER_EVENT_WWE_DECT) {
+                recorder->wakeup_stamp = audio_recorder_time_ms();
+                recorder->replay_floor = recorder->wakeup_stamp;
+                if (recorder->arbiter) {
+                    recorder_arbiter_session_start(recorder->arbiter);
+                }
                 recorder_sr_state_t sr_st = { 0 };
                 if (recorder->sr_handle) {
                     recorder->sr_iface->base.get_state(recorder->sr_handle, &sr_st);
@@ -260,8 +304,7 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
                 } else {
                     recorder->state = RECORDER_ST_SPEECHING;
                     audio_recorder_update_state_2_user(recorder, AUDIO_REC_WAKEUP_START);
-                    audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_START);
-                    audio_recorder_encoder_enable(recorder, true);
+                    audio_recorder_vad_start(recorder);
                 }
             }
             break;
@@ -273,8 +316,7 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
                     audio_recorder_vad_timer_start(recorder, recorder->state);
                 } else {
                     recorder->state = RECORDER_ST_SPEECHING;
-                    audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_START);
-                    audio_recorder_encoder_enable(recorder, true);
+                    audio_recorder_vad_start(recorder);
                 }
             } else if (event == RECORDER_EVENT_WAKEUP_TIMER_EXPIRED) {
                 recorder->state = RECORDER_ST_IDLE;
@@ -289,8 +331,7 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
             } else if (event == RECORDER_EVENT_VAD_TIMER_EXPIRED) {
                 recorder->state = RECORDER_ST_SPEECHING;
                 esp_timer_stop(recorder->wakeup_timer);
-                audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_START);
-                audio_recorder_encoder_enable(recorder, true);
+                audio_recorder_vad_start(recorder);
             } else if (event == RECORDER_EVENT_WAKEUP_TIMER_EXPIRED) {
                 recorder->state = RECORDER_ST_IDLE;
                 esp_timer_stop(recorder->vad_timer);
@@ -306,8 +347,7 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
                 } else {
                     recorder->state = RECORDER_ST_WAIT_FOR_SLEEP;
                     audio_recorder_wakeup_timer_start(recorder, recorder->state);
-                    audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_END);
-                    audio_recorder_encoder_enable(recorder, false);
+                    audio_recorder_vad_end(recorder);
                 }
             }
             break;
@@ -319,8 +359,7 @@ static void audio_recorder_update_state(audio_recorder_t *recorder, int event)
             } else if (event == RECORDER_EVENT_VAD_TIMER_EXPIRED) {
                 recorder->state = RECORDER_ST_WAIT_FOR_SLEEP;
                 audio_recorder_wakeup_timer_start(recorder, recorder->state);
-                audio_recorder_update_state_2_user(recorder, AUDIO_REC_VAD_END);
-                audio_recorder_encoder_enable(recorder, false);
+                audio_recorder_vad_end(recorder);
             }
             break;
         }
@@ -382,6 +421,9 @@ static void audio_recorder_task(void *parameters)
                     recorder->event_cb(AUDIO_REC_WAKEUP_END, recorder->user_data);
                 }
                 audio_recorder_reset(recorder);
+                if (recorder->arbiter) {
+                    recorder_arbiter_session_end(recorder->arbiter);
+                }
                 if (recorder->sr_handle && recorder->sr_iface) {
                     recorder_sr_state_t sr_st = { 0 };
                     recorder->sr_iface->base.get_state(recorder->sr_handle, &sr_st);
@@ -414,8 +456,12 @@ static void audio_recorder_task(void *parameters)
                 }
                 break;
             case RECORDER_CMD_MN_DECT:
-                ESP_LOGI(TAG, "RECORDER_CMD_MN_DECT : %d", (int)msg.data);
-                audio_recorder_update_state_2_user(recorder, (int)msg.data);
+                ESP_LOGI(TAG, "RECORDER_CMD_MN_DECT : %d, prob %d", (int)msg.data, msg.data_len);
+                if (recorder->arbiter) {
+                    recorder_arbiter_local_result(recorder->arbiter, (int)msg.data, msg.data_len / 1000.0f);
+                } else {
+                    audio_recorder_update_state_2_user(recorder, (int)msg.data);
+                }
                 break;
             default:
                 break;
@@ -480,6 +526,8 @@ audio_rec_handle_t audio_recorder_create(audio_rec_cfg_t *config)
     recorder->wakeup_end     = config->wakeup_end;
     recorder->encoder_handle = config->encoder_handle;
     recorder->encoder_iface  = config->encoder_iface;
+    recorder->preroll_time   = config->preroll_time;
+    recorder->arbiter        = config->arbiter;
 
     recorder->vad_check = true;
     recorder->sync_evt = xEventGroupCreate();
@@ -511,6 +559,9 @@ audio_rec_handle_t audio_recorder_create(audio_rec_cfg_t *config)
         sr_iface->set_mn_monitor(recorder->sr_handle, audio_recorder_mn_monitor, recorder);
         sr_iface->base.set_read_cb(recorder->sr_handle, recorder->read, NULL);
         sr_iface->base.enable(recorder->sr_handle, true);
+        if (sr_iface->get_frame_pool) {
+            sr_iface->get_frame_pool(recorder->sr_handle, &recorder->frame_pool);
+        }
     }
 
     if (recorder->encoder_handle) {
@@ -650,6 +701,27 @@ esp_err_t audio_recorder_vad_check_enable(audio_rec_handle_t handle, bool enable
     }
 }
 
+esp_err_t audio_recorder_replay(audio_rec_handle_t handle, audio_rec_replay_from_t from, int offset_ms)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    AUDIO_CHECK(TAG, recorder->frame_pool, return ESP_ERR_NOT_SUPPORTED, "No SR frame history");
+
+    uint32_t since = 0;
+    switch (from) {
+        case AUDIO_REC_REPLAY_FROM_WAKEUP_END:
+            since = recorder->wakeup_stamp;
+            break;
+        case AUDIO_REC_REPLAY_FROM_NOW:
+            since = audio_recorder_time_ms();
+            break;
+        default:
+            ESP_LOGE(TAG, "Unknown replay anchor %d", from);
+            return ESP_FAIL;
+    }
+    return recorder_frame_pool_set_replay_point(recorder->frame_pool, since + offset_ms);
+}
+
 int audio_recorder_data_read(audio_rec_handle_t handle, void *buffer, int length, TickType_t ticks)
 {
     AUDIO_NULL_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG);
@@ -673,6 +745,30 @@ int audio_recorder_data_read(audio_rec_handle_t handle, void *buffer, int length
     return ret;
 }
 
+recorder_frame_reader_handle_t audio_recorder_frame_reader_open(audio_rec_handle_t handle)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return NULL);
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    AUDIO_CHECK(TAG, recorder->sr_handle && recorder->sr_iface->get_frame_pool, return NULL, "No SR frame pool");
+
+    recorder_frame_pool_handle_t pool = NULL;
+    if (recorder->sr_iface->get_frame_pool(recorder->sr_handle, &pool) != ESP_OK) {
+        return NULL;
+    }
+    return recorder_frame_pool_open_reader(pool);
+}
+
+int audio_recorder_frame_acquire(audio_rec_handle_t handle, recorder_frame_reader_handle_t reader, const recorder_frame_t **frame, TickType_t ticks)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG);
+    audio_recorder_t *recorder = (audio_recorder_t *)handle;
+    if (recorder->state != RECORDER_ST_SPEECHING && recorder->state != RECORDER_ST_WAIT_FOR_SILENCE) {
+        ESP_LOGW(TAG, "Not in speeching, return 0");
+        return 0;
+    }
+    return recorder_frame_pool_acquire(reader, frame, ticks);
+}
+
 bool audio_recorder_get_wakeup_state(audio_rec_handle_t handle)
 {
     AUDIO_NULL_CHECK(TAG, handle, return false);
@@ -0,0 +1,181 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "ch_sort.h"
+
+static const char *TAG = "CH_SORT";
+
+/*
+ * Each kernel loads the whole input frame before storing the output frame, and an output frame is never
+ * larger than an input frame, so the sort can run in place.
+ * The channel number is a constant in the specialized kernels, so the compiler fully unrolls the frame.
+ */
+#define CH_SORT_KERNEL(name, type, SRC_CH)                                                  \
+static void name(const ch_sort_t *sort, const void *i_buf, void *o_buf, size_t frames)     \
+{                                                                                           \
+    const type *in = (const type *)i_buf;                                                   \
+    type *out = (type *)o_buf;                                                              \
+    const int dst_ch = sort->dst_ch;                                                        \
+    const int8_t *map = sort->map;                                                          \
+    type frame[SRC_CH];                                                                     \
+    for (size_t i = 0; i < frames; i++) {                                                   \
+        for (int c = 0; c < SRC_CH; c++) {                                                  \
+            frame[c] = in[c];                                                               \
+        }                                                                                   \
+        for (int c = 0; c < dst_ch; c++) {                                                  \
+            out[c] = frame[map[c]];                                                         \
+        }                                                                                   \
+        in += SRC_CH;                                                                       \
+        out += dst_ch;                                                                      \
+    }                                                                                       \
+}
+
+CH_SORT_KERNEL(ch_sort_16bit_2, int16_t, 2)
+CH_SORT_KERNEL(ch_sort_16bit_3, int16_t, 3)
+CH_SORT_KERNEL(ch_sort_16bit_4, int16_t, 4)
+CH_SORT_KERNEL(ch_sort_16bit_6, int16_t, 6)
+CH_SORT_KERNEL(ch_sort_16bit_8, int16_t, 8)
+CH_SORT_KERNEL(ch_sort_32bit_2, int32_t, 2)
+CH_SORT_KERNEL(ch_sort_32bit_3, int32_t, 3)
+CH_SORT_KERNEL(ch_sort_32bit_4, int32_t, 4)
+CH_SORT_KERNEL(ch_sort_32bit_6, int32_t, 6)
+CH_SORT_KERNEL(ch_sort_32bit_8, int32_t, 8)
+CH_SORT_KERNEL(ch_sort_16bit_any, int16_t, CH_SORT_MAX_CH)
+CH_SORT_KERNEL(ch_sort_32bit_any, int32_t, CH_SORT_MAX_CH)
+
+static void ch_sort_copy(const ch_sort_t *sort, const void *i_buf, void *o_buf, size_t frames)
+{
+    if (i_buf != o_buf) {
+        memcpy(o_buf, i_buf, frames * sort->src_ch * sort->bytes);
+    }
+}
+
+/* Swap the two channels of a 16 bit stereo frame with a single 32 bit rotate */
+static void ch_sort_16bit_2_swap(const ch_sort_t *sort, const void *i_buf, void *o_buf, size_t frames)
+{
+    const uint32_t *in = (const uint32_t *)i_buf;
+    uint32_t *out = (uint32_t *)o_buf;
+    for (size_t i = 0; i < frames; i++) {
+        uint32_t v = in[i];
+        out[i] = (v >> 16) | (v << 16);
+    }
+}
+
+static ch_sort_kernel_t ch_sort_select_kernel(const ch_sort_t *sort)
+{
+    bool identity = (sort->dst_ch == sort->src_ch);
+    for (int i = 0; i < sort->dst_ch && identity; i++) {
+        identity = (sort->map[i] == i);
+    }
+    if (identity) {
+        return ch_sort_copy;
+    }
+    if (sort->bytes == 2 && sort->src_ch == 2 && sort->dst_ch == 2) {
+        return ch_sort_16bit_2_swap;
+    }
+    switch (sort->src_ch) {
+        case 2:
+            return sort->bytes == 2 ? ch_sort_16bit_2 : ch_sort_32bit_2;
+        case 3:
+            return sort->bytes == 2 ? ch_sort_16bit_3 : ch_sort_32bit_3;
+        case 4:
+            return sort->bytes == 2 ? ch_sort_16bit_4 : ch_sort_32bit_4;
+        case 6:
+            return sort->bytes == 2 ? ch_sort_16bit_6 : ch_sort_32bit_6;
+        case 8:
+            return sort->bytes == 2 ? ch_sort_16bit_8 : ch_sort_32bit_8;
+        default:
+            return NULL;
+    }
+}
+
+/* Fallback for the channel numbers without a specialized kernel */
+static void ch_sort_any(const ch_sort_t *sort, const void *i_buf, void *o_buf, size_t frames)
+{
+    // The `any` kernels load CH_SORT_MAX_CH samples per frame, so only feed them one frame at a time
+    const char *in = (const char *)i_buf;
+    char *out = (char *)o_buf;
+    char frame[CH_SORT_MAX_CH * sizeof(int32_t)];
+    int in_size = sort->src_ch * sort->bytes;
+    int out_size = sort->dst_ch * sort->bytes;
+    for (size_t i = 0; i < frames; i++) {
+        memcpy(frame, in, in_size);
+        if (sort->bytes == 2) {
+            ch_sort_16bit_any(sort, frame, out, 1);
+        } else {
+            ch_sort_32bit_any(sort, frame, out, 1);
+        }
+        in += in_size;
+        out += out_size;
+    }
+}
+
+esp_err_t ch_sort_init(ch_sort_t *sort, const int8_t *src_order, int src_ch, int bits)
+{
+    if (sort == NULL || src_order == NULL || src_ch <= 0 || src_ch > CH_SORT_MAX_CH || (bits != 16 && bits != 32)) {
+        ESP_LOGE(TAG, "Invalid args, src_ch %d, bits %d", src_ch, bits);
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(sort, 0, sizeof(ch_sort_t));
+    sort->src_ch = src_ch;
+    sort->bytes = bits >> 3;
+    for (int i = 0; i < src_ch; i++) {
+        if (src_order[i] != DAT_CH_IDLE) {
+            sort->dst_ch++;
+        }
+    }
+    // Output channels must be DAT_CH_0 ... DAT_CH_(n - 1), each appearing once
+    for (int c = 0; c < sort->dst_ch; c++) {
+        int found = 0;
+        for (int i = 0; i < src_ch; i++) {
+            if (src_order[i] == c) {
+                sort->map[c] = i;
+                found++;
+            }
+        }
+        if (found != 1) {
+            ESP_LOGE(TAG, "Channel %d found %d times in source order", c, found);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (sort->dst_ch == 0) {
+        ESP_LOGE(TAG, "No channel in source order");
+        return ESP_ERR_INVALID_ARG;
+    }
+    sort->kernel = ch_sort_select_kernel(sort);
+    if (sort->kernel == NULL) {
+        sort->kernel = ch_sort_any;
+    }
+    return ESP_OK;
+}
+
+int ch_sort_process(const ch_sort_t *sort, const void *i_buf, void *o_buf, int len)
+{
+    size_t frames = len / (sort->src_ch * sort->bytes);
+    sort->kernel(sort, i_buf, o_buf, frames);
+    return frames * sort->dst_ch * sort->bytes;
+}
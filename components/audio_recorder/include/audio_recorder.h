@@ -27,6 +27,7 @@
 
 #include "recorder_encoder_iface.h"
 #include "recorder_sr_iface.h"
+#include "recorder_arbiter.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +41,7 @@ extern "C" {
 #define AUDIO_REC_DEF_WAKEEND_TM      (900)   /*!< Duration after vad off (ms) */
 #define AUDIO_REC_VAD_START_SPEECH_MS (160)   /*!< Consecutive speech frame will be judged to vad start (ms) */
 #define AUDIO_REC_DEF_VAD_OFF_TM      (300)   /*!< Default vad off time (ms) */
+#define AUDIO_REC_DEF_PREROLL_TM      (300)   /*!< Default audio replayed from before vad start (ms) */
 
 /**
  * @brief Recorder event
@@ -53,6 +55,14 @@ typedef enum {
     /* DO NOT add items below this line */
 } audio_rec_evt_t;
 
+/**
+ * @brief Anchor of a replay requested by the application, see `audio_recorder_replay`
+ */
+typedef enum {
+    AUDIO_REC_REPLAY_FROM_WAKEUP_END, /*!< The last wake word detection or trigger start */
+    AUDIO_REC_REPLAY_FROM_NOW,        /*!< The time of the call */
+} audio_rec_replay_from_t;
+
 /**
  * @brief Event Notification
  */
@@ -76,6 +86,11 @@ typedef struct {
     int                       wakeup_end;      /*!< Unit:ms. When the silence time after AUDIO_REC_VAD_END state exceeds this value, it is determined as AUDIO_REC_WAKEUP_END */
     void                      *encoder_handle; /*!< Encoder handle */
     recorder_encoder_iface_t  *encoder_iface;  /*!< Encoder interface */
+    int                       preroll_time;    /*!< Unit:ms. Audio before AUDIO_REC_VAD_START replayed to the readers first, never earlier than the wake word end.
+                                                    Bounded by the history held by the SR processor, see `rb_size` of `recorder_sr_cfg_t`.
+                                                    0 disables it, the application can still replay with `audio_recorder_replay` */
+    recorder_arbiter_handle_t arbiter;         /*!< Arbiter of the local and cloud results (optional). When set, the speech commands are reported to it
+                                                    instead of `event_cb`, and its decision callback decides which result is acted on */
 } audio_rec_cfg_t;
 
 /**
@@ -99,6 +114,8 @@ typedef struct __audio_recorder *audio_rec_handle_t;
         .wakeup_end     = AUDIO_REC_DEF_WAKEEND_TM,      \
         .encoder_handle = NULL,                          \
         .encoder_iface  = NULL,                          \
+        .preroll_time   = AUDIO_REC_DEF_PREROLL_TM,      \
+        .arbiter        = NULL,                          \
     }
 
 /**
@@ -175,6 +192,24 @@ esp_err_t audio_recorder_multinet_enable(audio_rec_handle_t handle, bool enable)
  */
 esp_err_t audio_recorder_vad_check_enable(audio_rec_handle_t handle, bool enable);
 
+/**
+ * @brief Replay the audio history to the readers from a point chosen by the application
+ *
+ * @note On their next read, `audio_recorder_data_read`, the encoder and the frame readers restart from the oldest audio
+ *       still held at or after the anchor plus `offset_ms`, then go on with the live audio.
+ *       This replaces any replay pending from AUDIO_REC_VAD_START, the next VAD start replays again unless `preroll_time` is 0.
+ *       How far back it reaches is bounded by `rb_size` of `recorder_sr_cfg_t`.
+ *
+ * @param handle     Audio recorder handle
+ * @param from       Anchor of the replay point
+ * @param offset_ms  Offset from the anchor in ms, negative to go back before it
+ *
+ * @return ESP_OK
+ *         ESP_FAIL
+ *         ESP_ERR_NOT_SUPPORTED  the recorder has no SR frame history
+ */
+esp_err_t audio_recorder_replay(audio_rec_handle_t handle, audio_rec_replay_from_t from, int offset_ms);
+
 /**
  * @brief Read data from audio recorder
  *
@@ -188,6 +223,36 @@ esp_err_t audio_recorder_vad_check_enable(audio_rec_handle_t handle, bool enable
  */
 int audio_recorder_data_read(audio_rec_handle_t handle, void *buffer, int length, TickType_t ticks);
 
+/**
+ * @brief Open a reader on the frames produced by the SR processor
+ *
+ * @note Several readers can be opened, each of them gets every frame without copying.
+ *       Release the frames with `recorder_frame_pool_release` and close the reader with `recorder_frame_pool_close_reader`.
+ *
+ * @param handle  Audio recorder handle
+ *
+ * @return NULL    failed, or the recorder has no SR processor
+ *         Others  frame reader handle
+ */
+recorder_frame_reader_handle_t audio_recorder_frame_reader_open(audio_rec_handle_t handle);
+
+/**
+ * @brief Acquire the next SR output frame of `reader` without copying
+ *
+ * @note Like `audio_recorder_data_read`, this returns 0 when the recorder is not in speech.
+ *
+ * @param handle  Audio recorder handle
+ * @param reader  Frame reader opened by `audio_recorder_frame_reader_open`
+ * @param frame   The acquired frame, valid until `recorder_frame_pool_release`
+ * @param ticks   Timeout for waiting a frame
+ *
+ * @return Length of the frame
+ *         0 not in speech
+ *         RB_DONE, RB_TIMEOUT
+ *         ESP_ERR_INVALID_ARG
+ */
+int audio_recorder_frame_acquire(audio_rec_handle_t handle, recorder_frame_reader_handle_t reader, const recorder_frame_t **frame, TickType_t ticks);
+
 /**
  * @brief Destroy audio recorder and recycle all resource
  *
@@ -26,6 +26,7 @@
 #define __CHANNEL_SORT__
 
 #include <string.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -33,6 +34,7 @@ extern "C" {
 #endif
 
 #define DAT_CH_MAX (4)
+#define CH_SORT_MAX_CH (8)
 
 /**
  * @brief Channel definition used to show the source channel order.
@@ -126,6 +128,65 @@ inline esp_err_t ch_sort_16bit_4ch(int16_t *i_buf, int16_t *o_buf, size_t len, i
     return ESP_OK;
 }
 
+typedef struct ch_sort ch_sort_t;
+
+/**
+ * @brief Channel sort kernel, gather `frames` interleaved frames from `i_buf` into `o_buf`
+ */
+typedef void (*ch_sort_kernel_t)(const ch_sort_t *sort, const void *i_buf, void *o_buf, size_t frames);
+
+/**
+ * @brief Precomputed channel reorder plan, built once by `ch_sort_init`
+ */
+struct ch_sort {
+    int              src_ch;                /*!< Channel number of the interleaved input */
+    int              dst_ch;                /*!< Channel number of the output, the non `DAT_CH_IDLE` channels of the input */
+    int              bytes;                 /*!< Bytes per sample, 2 or 4 */
+    int8_t           map[CH_SORT_MAX_CH];   /*!< Input index of each output channel */
+    ch_sort_kernel_t kernel;                /*!< Kernel selected for this layout */
+};
+
+/**
+ * @brief Build the channel reorder plan for the given source order.
+ *        Output channel `n` is the input channel marked `DAT_CH_0 + n` in `src_order`,
+ *        the `DAT_CH_IDLE` channels are dropped.
+ *
+ * @param sort          the plan to initialize
+ * @param src_order     order of the channels, `src_ch` items
+ * @param src_ch        channel number of the interleaved input, 1 to `CH_SORT_MAX_CH`
+ * @param bits          bits per sample, 16 or 32
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t ch_sort_init(ch_sort_t *sort, const int8_t *src_order, int src_ch, int bits);
+
+/**
+ * @brief Sort the given interleaved data into output buffer in a single pass.
+ *        `i_buf` and `o_buf` can be the same buffer, the data is then sorted in place.
+ *
+ * @param sort      the plan built by `ch_sort_init`
+ * @param i_buf     input buffer
+ * @param o_buf     output buffer, at least `ch_sort_get_out_len(sort, len)` bytes
+ * @param len       length of `i_buf` in bytes, trailing bytes of an incomplete frame are ignored
+ *
+ * @return length of the output data in bytes
+ */
+int ch_sort_process(const ch_sort_t *sort, const void *i_buf, void *o_buf, int len);
+
+/**
+ * @brief Get the output length for an input of `len` bytes
+ *
+ * @param sort      the plan built by `ch_sort_init`
+ * @param len       length of the input in bytes
+ *
+ * @return length of the output data in bytes
+ */
+static inline int ch_sort_get_out_len(const ch_sort_t *sort, int len)
+{
+    return len / (sort->src_ch * sort->bytes) * sort->dst_ch * sort->bytes;
+}
+
 #ifdef __cplusplus
 }
 #endif
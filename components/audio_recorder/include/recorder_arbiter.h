@@ -0,0 +1,198 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __RECORDER_ARBITER_H__
+#define __RECORDER_ARBITER_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORDER_ARBITER_DEF_THRESHOLD   (0.0f)  /*!< Default confidence a local command needs to win at once */
+#define RECORDER_ARBITER_DEF_CLOUD_HOLD  (300)   /*!< Default time a cloud result waits for a local command (ms) */
+#define RECORDER_ARBITER_DEF_DEADLINE    (8000)  /*!< Default time from wake up to give up the session (ms) */
+
+/**
+ * @brief Arbiter handle
+ *
+ *        The arbiter decides, once per wake up session, whether the local speech command or the cloud result is acted on.
+ *        The cloud upload goes on speculatively while MultiNet runs:
+ *          - a local command with a confidence reaching its threshold wins at once and the upload is cancelled
+ *          - a cloud result is held up to `cloud_hold` ms for a local command, then committed
+ *          - a local command below its threshold is kept as a candidate, it wins over the cloud if its priority is higher
+ *          - when `deadline` ms pass without any decision, the best local candidate wins or the session times out
+ */
+typedef struct recorder_arbiter *recorder_arbiter_handle_t;
+
+/**
+ * @brief Decisions of the arbiter
+ */
+typedef enum {
+    RECORDER_ARBITER_LOCAL,   /*!< The local command wins, the cloud upload must be cancelled */
+    RECORDER_ARBITER_CLOUD,   /*!< The cloud result wins */
+    RECORDER_ARBITER_TIMEOUT, /*!< No result before the deadline, the cloud upload must be cancelled */
+} recorder_arbiter_decision_t;
+
+/**
+ * @brief Decision callback, invoked once per session, from the task reporting the result or from the timer task
+ *
+ * @note  The timeout and cloud hold decisions are taken in the esp_timer task, which runs every esp_timer callback
+ *        of the system. The callback must not block, post the decision to an application task to play or to act on it.
+ */
+typedef void (*recorder_arbiter_cb_t)(recorder_arbiter_decision_t decision, int command_id, void *user_ctx);
+
+/**
+ * @brief Arbitration rule of a local command
+ */
+typedef struct {
+    int   command_id; /*!< MultiNet command id */
+    float threshold;  /*!< Confidence needed to win without waiting for the cloud */
+    int   priority;   /*!< Priority against the cloud result when below the threshold */
+} recorder_arbiter_rule_t;
+
+/**
+ * @brief Arbiter configuration
+ */
+typedef struct {
+    const recorder_arbiter_rule_t *rules;             /*!< Rules of the commands, the other commands use the defaults below */
+    int                           rule_num;           /*!< Number of rules */
+    float                         default_threshold;  /*!< Threshold of the commands without rule */
+    int                           default_priority;   /*!< Priority of the commands without rule */
+    int                           cloud_priority;     /*!< Priority of the cloud result */
+    int                           cloud_hold;         /*!< Unit:ms. Time a cloud result waits for a local command */
+    int                           deadline;           /*!< Unit:ms. Time from the session start to give up */
+    recorder_arbiter_cb_t         decision_cb;        /*!< Decision callback */
+    void                          *user_ctx;          /*!< User context of the callback */
+} recorder_arbiter_cfg_t;
+
+#define RECORDER_ARBITER_DEFAULT_CFG()                        \
+    {                                                         \
+        .rules             = NULL,                            \
+        .rule_num          = 0,                               \
+        .default_threshold = RECORDER_ARBITER_DEF_THRESHOLD,  \
+        .default_priority  = 0,                               \
+        .cloud_priority    = 0,                               \
+        .cloud_hold        = RECORDER_ARBITER_DEF_CLOUD_HOLD, \
+        .deadline          = RECORDER_ARBITER_DEF_DEADLINE,   \
+        .decision_cb       = NULL,                            \
+        .user_ctx          = NULL,                            \
+    }
+
+/**
+ * @brief Arbiter statistics
+ */
+typedef struct {
+    uint32_t sessions;          /*!< Sessions started */
+    uint32_t local_wins;        /*!< Sessions won by a local command */
+    uint32_t cloud_wins;        /*!< Sessions won by the cloud */
+    uint32_t timeouts;          /*!< Sessions without any result before the deadline */
+    uint32_t late_results;      /*!< Results ignored because the session was already decided */
+    uint64_t local_latency_ms;  /*!< Sum of the time from session start to a local decision */
+    uint64_t cloud_latency_ms;  /*!< Sum of the time from session start to a cloud decision */
+} recorder_arbiter_stats_t;
+
+/**
+ * @brief Create an arbiter
+ *
+ * @param cfg   Configuration of the arbiter, the rules are copied
+ *
+ * @return NULL    failed
+ *         Others  arbiter handle
+ */
+recorder_arbiter_handle_t recorder_arbiter_create(const recorder_arbiter_cfg_t *cfg);
+
+/**
+ * @brief Destroy the arbiter
+ *
+ * @param arbiter   Arbiter handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_destroy(recorder_arbiter_handle_t arbiter);
+
+/**
+ * @brief Start a session, a running session is dropped without decision
+ *
+ * @param arbiter   Arbiter handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_session_start(recorder_arbiter_handle_t arbiter);
+
+/**
+ * @brief End the session early, it is decided at once with the results known so far
+ *
+ * @param arbiter   Arbiter handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_session_end(recorder_arbiter_handle_t arbiter);
+
+/**
+ * @brief Report a local speech command
+ *
+ * @param arbiter       Arbiter handle
+ * @param command_id    Command id
+ * @param prob          Confidence of the command
+ *
+ * @return ESP_OK                 taken into account
+ *         ESP_ERR_INVALID_STATE  no session, or already decided
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_local_result(recorder_arbiter_handle_t arbiter, int command_id, float prob);
+
+/**
+ * @brief Report that the cloud result is ready, it must not be acted on before the `RECORDER_ARBITER_CLOUD` decision
+ *
+ * @param arbiter   Arbiter handle
+ *
+ * @return ESP_OK                 taken into account, wait for the decision
+ *         ESP_FAIL               the session was already decided for the local command or timed out, drop the cloud result
+ *         ESP_ERR_INVALID_STATE  no session, the cloud result can be acted on directly
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_cloud_result(recorder_arbiter_handle_t arbiter);
+
+/**
+ * @brief Get the statistics of the arbiter
+ *
+ * @param arbiter   Arbiter handle
+ * @param stats     The statistics output
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_arbiter_get_stats(recorder_arbiter_handle_t arbiter, recorder_arbiter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORDER_ARBITER_H__ */
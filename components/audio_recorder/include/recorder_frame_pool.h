@@ -0,0 +1,228 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __RECORDER_FRAME_POOL_H__
+#define __RECORDER_FRAME_POOL_H__
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORDER_FRAME_POOL_MAX_READERS (8)
+
+/**
+ * @brief Frame pool handle
+ *
+ *        The pool is a broadcast ring of fixed-size, refcounted frames with one producer.
+ *        Every reader has its own cursor, so several consumers see the same frames without copying them.
+ *        A reader that falls more than `frame_num` frames behind skips the oldest frames, they are counted as dropped.
+ *        A frame still held by a reader is never overwritten, the producer drops the new frame instead and counts an overrun.
+ *        The frames are timestamped, so the pool also serves as a look-back history, see `recorder_frame_pool_set_replay_point`.
+ */
+typedef struct recorder_frame_pool *recorder_frame_pool_handle_t;
+
+/**
+ * @brief Frame pool reader handle
+ */
+typedef struct recorder_frame_reader *recorder_frame_reader_handle_t;
+
+/**
+ * @brief A frame of the pool, read only for the readers
+ */
+typedef struct {
+    void     *data; /*!< Frame data */
+    int      len;   /*!< Length of the frame data */
+    uint32_t seq;   /*!< Sequence number of the frame, increased by one for every frame pushed */
+    uint32_t time;  /*!< Time the frame was pushed, in ms since boot (wraps around after ~49 days) */
+} recorder_frame_t;
+
+/**
+ * @brief Frame pool statistics
+ */
+typedef struct {
+    uint32_t pushed;  /*!< Number of frames pushed into the pool */
+    uint32_t overrun; /*!< Number of frames dropped by the producer because the slot was held by a reader or another push */
+    uint32_t dropped; /*!< Number of frames skipped by the readers because they were overwritten before being read */
+} recorder_frame_pool_stats_t;
+
+/**
+ * @brief Create a frame pool
+ *
+ * @param frame_size    Maximum size of a frame
+ * @param frame_num     Number of frames in the pool, at least 2
+ *
+ * @return NULL    failed
+ *         Others  frame pool handle
+ */
+recorder_frame_pool_handle_t recorder_frame_pool_create(int frame_size, int frame_num);
+
+/**
+ * @brief Destroy the frame pool, all the readers must be closed before
+ *
+ * @param pool  Frame pool handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_destroy(recorder_frame_pool_handle_t pool);
+
+/**
+ * @brief Copy a frame into the pool and wake up the waiting readers, meant for one producer task,
+ *        a push racing another one on the same slot drops its frame as an overrun
+ *
+ * @param pool  Frame pool handle
+ * @param data  Frame data
+ * @param len   Length of the frame, no more than `frame_size`
+ *
+ * @return ESP_OK
+ *         ESP_FAIL             overrun, the frame is dropped
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_push(recorder_frame_pool_handle_t pool, const void *data, int len);
+
+/**
+ * @brief Mark the pool as done, the readers return `RB_DONE` once they have read all the frames
+ *
+ * @param pool  Frame pool handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_done(recorder_frame_pool_handle_t pool);
+
+/**
+ * @brief Discard the frames not read yet by the readers and clear the done state
+ *
+ * @param pool  Frame pool handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_reset(recorder_frame_pool_handle_t pool);
+
+/**
+ * @brief Make every reader replay the history from `since`
+ *
+ *        On its next acquire or read, each reader opened before this call restarts from the oldest frame
+ *        still in the pool pushed at or after `since`, then goes on with the live frames.
+ *        The history is drained as fast as the reader asks for it, there is no waiting until the live frames are reached.
+ *
+ * @param pool   Frame pool handle
+ * @param since  Start time of the replay, in ms since boot, same clock as `recorder_frame_t.time`
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_set_replay_point(recorder_frame_pool_handle_t pool, uint32_t since);
+
+/**
+ * @brief Get the statistics of the pool
+ *
+ * @param pool   Frame pool handle
+ * @param stats  The statistics output
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_get_stats(recorder_frame_pool_handle_t pool, recorder_frame_pool_stats_t *stats);
+
+/**
+ * @brief Open a reader on the pool, the reader starts from the next frame pushed
+ *
+ * @note Each reader must be used by one task at a time
+ *
+ * @param pool  Frame pool handle
+ *
+ * @return NULL    failed, or `RECORDER_FRAME_POOL_MAX_READERS` readers already opened
+ *         Others  reader handle
+ */
+recorder_frame_reader_handle_t recorder_frame_pool_open_reader(recorder_frame_pool_handle_t pool);
+
+/**
+ * @brief Close the reader, the frame acquired by the reader must be released before
+ *
+ * @param reader  Reader handle
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_close_reader(recorder_frame_reader_handle_t reader);
+
+/**
+ * @brief Acquire the next frame of the reader without copying, the frame stays valid until released
+ *
+ * @param reader  Reader handle
+ * @param frame   The acquired frame
+ * @param ticks   Timeout for waiting a new frame
+ *
+ * @return > 0         Length of the frame
+ *         RB_DONE, RB_TIMEOUT
+ *         ESP_ERR_INVALID_ARG
+ */
+int recorder_frame_pool_acquire(recorder_frame_reader_handle_t reader, const recorder_frame_t **frame, TickType_t ticks);
+
+/**
+ * @brief Release the frame acquired by `recorder_frame_pool_acquire`
+ *
+ * @param reader  Reader handle
+ * @param frame   The frame to release
+ *
+ * @return ESP_OK
+ *         ESP_ERR_INVALID_ARG
+ */
+esp_err_t recorder_frame_pool_release(recorder_frame_reader_handle_t reader, const recorder_frame_t *frame);
+
+/**
+ * @brief Copy the frames of the reader into `buf`, a frame may be split across several calls
+ *
+ * @param reader  Reader handle
+ * @param buf     The buffer to fill
+ * @param len     Size of the buffer
+ * @param ticks   Timeout for waiting a new frame
+ *
+ * @return > 0         Length of data read
+ *         RB_DONE, RB_TIMEOUT
+ *         ESP_ERR_INVALID_ARG
+ */
+int recorder_frame_pool_read(recorder_frame_reader_handle_t reader, void *buf, int len, TickType_t ticks);
+
+/**
+ * @brief Get the number of frames dropped by this reader
+ *
+ * @param reader  Reader handle
+ *
+ * @return Number of frames dropped
+ */
+uint32_t recorder_frame_pool_reader_dropped(recorder_frame_reader_handle_t reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORDER_FRAME_POOL_H__ */
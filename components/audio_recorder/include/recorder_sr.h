@@ -41,7 +41,7 @@ extern "C" {
 #define FETCH_TASK_PRIO          (5)
 #define FEED_TASK_PINNED_CORE    (1)
 #define FETCH_TASK_PINNED_CORE   (1)
-#define SR_OUTPUT_RB_SIZE        (6 * 1024)
+#define SR_OUTPUT_RB_SIZE        (12 * 1024)
 
 /**
  * @brief SR processor handle
@@ -61,9 +61,10 @@ typedef struct {
     int          fetch_task_core;                       /*!< Core id of fetch task */
     int          fetch_task_prio;                       /*!< Priority of fetch task */
     int          fetch_task_stack;                      /*!< Stack size of fetch task */
-    int          rb_size;                               /*!< Ringbuffer size of recorder sr */
+    int          rb_size;                               /*!< Size of the output frame history of recorder sr, it bounds the pre-roll of audio recorder */
     char         *partition_label;                      /*!< Partition label which stored the model data */
     char         *mn_language;                          /*!< Command language for multinet to load */
+    char         *mn_cmd_nvs_namespace;                 /*!< NVS namespace caching the commands set by `recorder_sr_reset_speech_cmd`, NULL to disable */
 } recorder_sr_cfg_t;
 
 #if CONFIG_AFE_MIC_NUM == (1)
@@ -99,6 +100,7 @@ typedef struct {
     .rb_size          = SR_OUTPUT_RB_SIZE,      \
     .partition_label  = "model",                \
     .mn_language      = ESP_MN_CHINESE,         \
+    .mn_cmd_nvs_namespace = NULL,               \
 };
 
 /**
@@ -125,6 +127,10 @@ esp_err_t recorder_sr_destroy(recorder_sr_handle_t handle);
 /**
  * @brief Reset the speech commands
  *
+ * @note Only the phrases that differ from the active commands are re-registered, and nothing is recompiled
+ *       if the commands are unchanged. With `mn_cmd_nvs_namespace` set, the commands are cached in NVS
+ *       for the loaded model and restored at the next boot instead of the sdkconfig ones.
+ *
  * @param handle        SR processor handle
  * @param command_str   String of the commands. more details on `https://github.com/espressif/esp-sr/blob/release/v1.0/docs/speech_command_recognition/README.md#2reset-api-on-the-fly`
  * @param err_phrase_id error string output
@@ -27,6 +27,7 @@
 
 #include "esp_err.h"
 #include "recorder_subproc_iface.h"
+#include "recorder_frame_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,6 +57,8 @@ typedef struct {
     bool wwe_enable : 1; /*!< Wake word detection state */
     bool mn_enable  : 1; /*!< Speech command recognition state */
     bool vad_enable : 1; /*!< Voice detection state */
+    uint32_t frame_overrun; /*!< Number of AFE frames dropped because the output frame was still held by a reader */
+    uint32_t frame_dropped; /*!< Number of output frames skipped by the readers which fell behind */
 } recorder_sr_state_t;
 
 /**
@@ -128,6 +131,29 @@ typedef struct {
      *          ESP_ERR_INVALID_ARG
      */
     esp_err_t (*mn_enable)(void *handle, bool enable);
+
+    /**
+     * @brief Get the frame pool holding the AFE output, open a reader on it to get the frames without copying
+     *
+     * @param handle    The handle of sr handle
+     * @param pool      The frame pool output
+     *
+     * @returns ESP_OK
+     *          ESP_ERR_INVALID_ARG
+     */
+    esp_err_t (*get_frame_pool)(void *handle, recorder_frame_pool_handle_t *pool);
+
+    /**
+     * @brief Get the confidence of the speech command being reported, only valid inside the multinet monitor callback
+     *
+     * @param handle    The handle of sr handle
+     * @param prob      The confidence output
+     *
+     * @returns ESP_OK
+     *          ESP_FAIL
+     *          ESP_ERR_INVALID_ARG
+     */
+    esp_err_t (*get_mn_prob)(void *handle, float *prob);
 } recorder_sr_iface_t;
 
 #ifdef __cplusplus
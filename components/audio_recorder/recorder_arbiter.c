@@ -0,0 +1,331 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "audio_error.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "recorder_arbiter.h"
+
+#define ARBITER_PENDING (-1)
+
+static const char *TAG = "REC_ARBITER";
+
+typedef enum {
+    ARBITER_ST_IDLE,
+    ARBITER_ST_ARBITRATING,
+    ARBITER_ST_DECIDED,
+} recorder_arbiter_state_t;
+
+struct recorder_arbiter {
+    recorder_arbiter_rule_t     *rules;
+    int                         rule_num;
+    float                       default_threshold;
+    int                         default_priority;
+    int                         cloud_priority;
+    int64_t                     cloud_hold_us;
+    int64_t                     deadline_us;
+    recorder_arbiter_cb_t       decision_cb;
+    void                        *user_ctx;
+    void                        *lock;
+    esp_timer_handle_t          timer;
+    recorder_arbiter_state_t    state;
+    recorder_arbiter_decision_t decision;
+    int64_t                     start_time;
+    int64_t                     deadline_time;
+    bool                        cloud_ready;
+    int64_t                     cloud_hold_time;
+    bool                        has_candidate;
+    int                         cand_id;
+    float                       cand_prob;
+    int                         cand_priority;
+    recorder_arbiter_stats_t    stats;
+};
+
+static void arbiter_get_rule(recorder_arbiter_handle_t arbiter, int command_id, float *threshold, int *priority)
+{
+    *threshold = arbiter->default_threshold;
+    *priority = arbiter->default_priority;
+    for (int i = 0; i < arbiter->rule_num; i++) {
+        if (arbiter->rules[i].command_id == command_id) {
+            *threshold = arbiter->rules[i].threshold;
+            *priority = arbiter->rules[i].priority;
+            break;
+        }
+    }
+}
+
+static int arbiter_decide(recorder_arbiter_handle_t arbiter, recorder_arbiter_decision_t decision, int command_id, int64_t now)
+{
+    uint64_t latency_ms = (now - arbiter->start_time) / 1000;
+    arbiter->state = ARBITER_ST_DECIDED;
+    arbiter->decision = decision;
+    switch (decision) {
+        case RECORDER_ARBITER_LOCAL:
+            arbiter->stats.local_wins++;
+            arbiter->stats.local_latency_ms += latency_ms;
+            break;
+        case RECORDER_ARBITER_CLOUD:
+            arbiter->stats.cloud_wins++;
+            arbiter->stats.cloud_latency_ms += latency_ms;
+            break;
+        default:
+            arbiter->stats.timeouts++;
+            break;
+    }
+    esp_timer_stop(arbiter->timer);
+    ESP_LOGI(TAG, "Decision %d, command %d, after %d ms", decision, command_id, (int)latency_ms);
+    return command_id;
+}
+
+/*
+ * Decide if possible, and return the command id (or -1 for a cloud or timeout decision) with `decided` set.
+ * Otherwise re-arm the timer to the next point a decision may be taken. Called with the lock held.
+ */
+static bool arbiter_evaluate(recorder_arbiter_handle_t arbiter, int64_t now, bool force, int *command_id)
+{
+    if (arbiter->state != ARBITER_ST_ARBITRATING) {
+        return false;
+    }
+    if (arbiter->cloud_ready) {
+        if (arbiter->has_candidate && arbiter->cand_priority > arbiter->cloud_priority) {
+            *command_id = arbiter_decide(arbiter, RECORDER_ARBITER_LOCAL, arbiter->cand_id, now);
+            return true;
+        }
+        if (force || now >= arbiter->cloud_hold_time || now >= arbiter->deadline_time) {
+            *command_id = arbiter_decide(arbiter, RECORDER_ARBITER_CLOUD, ARBITER_PENDING, now);
+            return true;
+        }
+    } else if (force || now >= arbiter->deadline_time) {
+        if (arbiter->has_candidate) {
+            *command_id = arbiter_decide(arbiter, RECORDER_ARBITER_LOCAL, arbiter->cand_id, now);
+        } else {
+            *command_id = arbiter_decide(arbiter, RECORDER_ARBITER_TIMEOUT, ARBITER_PENDING, now);
+        }
+        return true;
+    }
+
+    int64_t next = arbiter->deadline_time;
+    if (arbiter->cloud_ready && arbiter->cloud_hold_time < next) {
+        next = arbiter->cloud_hold_time;
+    }
+    esp_timer_stop(arbiter->timer);
+    esp_timer_start_once(arbiter->timer, next > now ? next - now : 1);
+    return false;
+}
+
+static void arbiter_notify(recorder_arbiter_handle_t arbiter, recorder_arbiter_decision_t decision, int command_id)
+{
+    if (arbiter->decision_cb) {
+        arbiter->decision_cb(decision, command_id, arbiter->user_ctx);
+    }
+}
+
+static void arbiter_timer_expired(void *arg)
+{
+    recorder_arbiter_handle_t arbiter = (recorder_arbiter_handle_t)arg;
+    int command_id = ARBITER_PENDING;
+
+    mutex_lock(arbiter->lock);
+    bool decided = arbiter_evaluate(arbiter, esp_timer_get_time(), false, &command_id);
+    recorder_arbiter_decision_t decision = arbiter->decision;
+    mutex_unlock(arbiter->lock);
+
+    if (decided) {
+        arbiter_notify(arbiter, decision, command_id);
+    }
+}
+
+recorder_arbiter_handle_t recorder_arbiter_create(const recorder_arbiter_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_CHECK(TAG, cfg->rule_num == 0 || cfg->rules, return NULL, "Rules are NULL");
+
+    recorder_arbiter_handle_t arbiter = audio_calloc(1, sizeof(struct recorder_arbiter));
+    AUDIO_MEM_CHECK(TAG, arbiter, return NULL);
+    if (cfg->rule_num > 0) {
+        arbiter->rules = audio_calloc(cfg->rule_num, sizeof(recorder_arbiter_rule_t));
+        AUDIO_MEM_CHECK(TAG, arbiter->rules, goto _failed);
+        memcpy(arbiter->rules, cfg->rules, cfg->rule_num * sizeof(recorder_arbiter_rule_t));
+        arbiter->rule_num = cfg->rule_num;
+    }
+    arbiter->default_threshold = cfg->default_threshold;
+    arbiter->default_priority  = cfg->default_priority;
+    arbiter->cloud_priority    = cfg->cloud_priority;
+    arbiter->cloud_hold_us     = (int64_t)cfg->cloud_hold * 1000;
+    arbiter->deadline_us       = (int64_t)cfg->deadline * 1000;
+    arbiter->decision_cb       = cfg->decision_cb;
+    arbiter->user_ctx          = cfg->user_ctx;
+    arbiter->state             = ARBITER_ST_IDLE;
+
+    arbiter->lock = mutex_create();
+    AUDIO_MEM_CHECK(TAG, arbiter->lock, goto _failed);
+    esp_timer_create_args_t timer_cfg = {
+        .callback = arbiter_timer_expired,
+        .arg = arbiter,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "arbiter_timer",
+    };
+    AUDIO_CHECK(TAG, esp_timer_create(&timer_cfg, &arbiter->timer) == ESP_OK, goto _failed, "Arbiter timer create failed");
+    return arbiter;
+
+_failed:
+    recorder_arbiter_destroy(arbiter);
+    return NULL;
+}
+
+esp_err_t recorder_arbiter_destroy(recorder_arbiter_handle_t arbiter)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    if (arbiter->timer) {
+        esp_timer_stop(arbiter->timer);
+        esp_timer_delete(arbiter->timer);
+    }
+    if (arbiter->lock) {
+        mutex_destroy(arbiter->lock);
+    }
+    audio_free(arbiter->rules);
+    audio_free(arbiter);
+    return ESP_OK;
+}
+
+esp_err_t recorder_arbiter_session_start(recorder_arbiter_handle_t arbiter)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    int command_id = ARBITER_PENDING;
+    int64_t now = esp_timer_get_time();
+
+    mutex_lock(arbiter->lock);
+    if (arbiter->state == ARBITER_ST_ARBITRATING) {
+        ESP_LOGW(TAG, "Session restarted before any decision");
+    }
+    arbiter->state = ARBITER_ST_ARBITRATING;
+    arbiter->start_time = now;
+    arbiter->deadline_time = now + arbiter->deadline_us;
+    arbiter->cloud_ready = false;
+    arbiter->has_candidate = false;
+    arbiter->stats.sessions++;
+    arbiter_evaluate(arbiter, now, false, &command_id);
+    mutex_unlock(arbiter->lock);
+    return ESP_OK;
+}
+
+esp_err_t recorder_arbiter_session_end(recorder_arbiter_handle_t arbiter)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    int command_id = ARBITER_PENDING;
+
+    mutex_lock(arbiter->lock);
+    bool decided = arbiter_evaluate(arbiter, esp_timer_get_time(), true, &command_id);
+    recorder_arbiter_decision_t decision = arbiter->decision;
+    mutex_unlock(arbiter->lock);
+
+    if (decided) {
+        arbiter_notify(arbiter, decision, command_id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_arbiter_local_result(recorder_arbiter_handle_t arbiter, int command_id, float prob)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    float threshold = 0;
+    int priority = 0;
+    int decided_id = ARBITER_PENDING;
+    bool decided = false;
+    int64_t now = esp_timer_get_time();
+
+    arbiter_get_rule(arbiter, command_id, &threshold, &priority);
+    mutex_lock(arbiter->lock);
+    if (arbiter->state != ARBITER_ST_ARBITRATING) {
+        if (arbiter->state == ARBITER_ST_DECIDED) {
+            arbiter->stats.late_results++;
+        }
+        mutex_unlock(arbiter->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (prob >= threshold) {
+        decided_id = arbiter_decide(arbiter, RECORDER_ARBITER_LOCAL, command_id, now);
+        decided = true;
+    } else {
+        if (!arbiter->has_candidate || priority > arbiter->cand_priority
+            || (priority == arbiter->cand_priority && prob > arbiter->cand_prob)) {
+            arbiter->has_candidate = true;
+            arbiter->cand_id = command_id;
+            arbiter->cand_prob = prob;
+            arbiter->cand_priority = priority;
+        }
+        decided = arbiter_evaluate(arbiter, now, false, &decided_id);
+    }
+    recorder_arbiter_decision_t decision = arbiter->decision;
+    mutex_unlock(arbiter->lock);
+
+    if (decided) {
+        arbiter_notify(arbiter, decision, decided_id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_arbiter_cloud_result(recorder_arbiter_handle_t arbiter)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    int command_id = ARBITER_PENDING;
+    int64_t now = esp_timer_get_time();
+
+    mutex_lock(arbiter->lock);
+    if (arbiter->state == ARBITER_ST_IDLE
+        || (arbiter->state == ARBITER_ST_DECIDED && arbiter->decision == RECORDER_ARBITER_CLOUD)) {
+        mutex_unlock(arbiter->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (arbiter->state == ARBITER_ST_DECIDED) {
+        arbiter->stats.late_results++;
+        mutex_unlock(arbiter->lock);
+        return ESP_FAIL;
+    }
+    arbiter->cloud_ready = true;
+    arbiter->cloud_hold_time = now + arbiter->cloud_hold_us;
+    bool decided = arbiter_evaluate(arbiter, now, false, &command_id);
+    recorder_arbiter_decision_t decision = arbiter->decision;
+    mutex_unlock(arbiter->lock);
+
+    if (decided) {
+        arbiter_notify(arbiter, decision, command_id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_arbiter_get_stats(recorder_arbiter_handle_t arbiter, recorder_arbiter_stats_t *stats)
+{
+    AUDIO_NULL_CHECK(TAG, arbiter, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, stats, return ESP_ERR_INVALID_ARG);
+    mutex_lock(arbiter->lock);
+    memcpy(stats, &arbiter->stats, sizeof(recorder_arbiter_stats_t));
+    mutex_unlock(arbiter->lock);
+    return ESP_OK;
+}
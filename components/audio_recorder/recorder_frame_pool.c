@@ -0,0 +1,378 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "audio_error.h"
+#include "audio_mem.h"
+#include "recorder_frame_pool.h"
+
+#define FRAME_SLOT_INVALID (UINT32_MAX)
+
+static const char *TAG = "FRAME_POOL";
+
+typedef struct {
+    recorder_frame_t frame; /* Must be the first member, the readers get a pointer to it */
+    atomic_uint      seq;   /* Sequence number of the frame in the slot, FRAME_SLOT_INVALID while being written */
+    atomic_int       ref;   /* Number of readers holding the slot */
+} recorder_frame_slot_t;
+
+struct recorder_frame_pool {
+    recorder_frame_slot_t *slots;
+    uint8_t               *mem;
+    int                   frame_size;
+    int                   frame_num;
+    atomic_uint           wr_seq;
+    atomic_uint           rd_floor;
+    atomic_bool           is_done;
+    atomic_uint           reader_mask;
+    atomic_uint           replay_gen;
+    atomic_uint           replay_since;
+    atomic_uint           overrun;
+    atomic_uint           dropped;
+    EventGroupHandle_t    events;
+};
+
+struct recorder_frame_reader {
+    recorder_frame_pool_handle_t pool;
+    EventBits_t                  bit;
+    uint32_t                     seq;
+    int                          offset;
+    uint32_t                     dropped;
+    uint32_t                     replay_gen;
+    uint32_t                     replay_since;
+    bool                         replaying;
+};
+
+static inline void frame_pool_skip(recorder_frame_reader_handle_t reader, uint32_t lost)
+{
+    reader->seq += lost;
+    reader->offset = 0;
+    reader->dropped += lost;
+    atomic_fetch_add(&reader->pool->dropped, lost);
+}
+
+/*
+ * Take a reference on the frame at the reader cursor, or return NULL if there is no new frame yet.
+ * The producer invalidates the slot sequence before checking the refcount and the reader takes the
+ * refcount before checking the slot sequence, so either the producer sees the reference and leaves
+ * the slot alone, or the reader sees the slot is being overwritten and skips the frame.
+ */
+static recorder_frame_slot_t *frame_pool_get(recorder_frame_reader_handle_t reader)
+{
+    recorder_frame_pool_handle_t pool = reader->pool;
+    for (;;) {
+        uint32_t wr_seq = atomic_load(&pool->wr_seq);
+        uint32_t floor = atomic_load(&pool->rd_floor);
+        uint32_t replay_gen = atomic_load(&pool->replay_gen);
+        if (replay_gen != reader->replay_gen) {
+            // Restart from the oldest frame kept, the frames older than the replay point are skipped below
+            uint32_t history = wr_seq - floor;
+            reader->replay_gen = replay_gen;
+            reader->replay_since = atomic_load(&pool->replay_since);
+            reader->replaying = true;
+            reader->seq = wr_seq - (history < (uint32_t)pool->frame_num ? history : (uint32_t)pool->frame_num);
+            reader->offset = 0;
+        }
+        if ((int32_t)(reader->seq - floor) < 0) {
+            reader->seq = floor;
+            reader->offset = 0;
+        }
+        if (wr_seq - reader->seq > (uint32_t)pool->frame_num) {
+            frame_pool_skip(reader, wr_seq - pool->frame_num - reader->seq);
+        }
+        if (reader->seq == wr_seq) {
+            return NULL;
+        }
+        recorder_frame_slot_t *slot = &pool->slots[reader->seq % pool->frame_num];
+        atomic_fetch_add(&slot->ref, 1);
+        if (atomic_load(&slot->seq) != reader->seq) {
+            atomic_fetch_sub(&slot->ref, 1);
+            frame_pool_skip(reader, 1);
+            continue;
+        }
+        if (reader->replaying) {
+            if ((int32_t)(slot->frame.time - reader->replay_since) < 0) {
+                atomic_fetch_sub(&slot->ref, 1);
+                reader->seq++;
+                continue;
+            }
+            reader->replaying = false;
+        }
+        return slot;
+    }
+}
+
+static int frame_pool_wait(recorder_frame_reader_handle_t reader, TickType_t ticks)
+{
+    if (atomic_load(&reader->pool->is_done)) {
+        return RB_DONE;
+    }
+    EventBits_t bits = xEventGroupWaitBits(reader->pool->events, reader->bit, pdTRUE, pdTRUE, ticks);
+    return (bits & reader->bit) ? ESP_OK : RB_TIMEOUT;
+}
+
+recorder_frame_pool_handle_t recorder_frame_pool_create(int frame_size, int frame_num)
+{
+    AUDIO_CHECK(TAG, frame_size > 0 && frame_num >= 2, return NULL, "Invalid frame size or number");
+
+    recorder_frame_pool_handle_t pool = audio_calloc(1, sizeof(struct recorder_frame_pool));
+    AUDIO_MEM_CHECK(TAG, pool, return NULL);
+    pool->slots = audio_calloc(frame_num, sizeof(recorder_frame_slot_t));
+    AUDIO_MEM_CHECK(TAG, pool->slots, goto _failed);
+    pool->mem = audio_calloc(frame_num, frame_size);
+    AUDIO_MEM_CHECK(TAG, pool->mem, goto _failed);
+    pool->events = xEventGroupCreate();
+    AUDIO_MEM_CHECK(TAG, pool->events, goto _failed);
+
+    pool->frame_size = frame_size;
+    pool->frame_num = frame_num;
+    for (int i = 0; i < frame_num; i++) {
+        pool->slots[i].frame.data = pool->mem + i * frame_size;
+        // A sequence older than any frame of the slot, and never FRAME_SLOT_INVALID which marks a slot claimed by a push
+        atomic_init(&pool->slots[i].seq, (uint32_t)(i - 2 * frame_num));
+        atomic_init(&pool->slots[i].ref, 0);
+    }
+    atomic_init(&pool->wr_seq, 0);
+    atomic_init(&pool->rd_floor, 0);
+    atomic_init(&pool->is_done, false);
+    atomic_init(&pool->reader_mask, 0);
+    atomic_init(&pool->replay_gen, 0);
+    atomic_init(&pool->replay_since, 0);
+    atomic_init(&pool->overrun, 0);
+    atomic_init(&pool->dropped, 0);
+    return pool;
+
+_failed:
+    recorder_frame_pool_destroy(pool);
+    return NULL;
+}
+
+esp_err_t recorder_frame_pool_destroy(recorder_frame_pool_handle_t pool)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    if (atomic_load(&pool->reader_mask)) {
+        ESP_LOGW(TAG, "Destroy the pool with readers opened, mask 0x%x", atomic_load(&pool->reader_mask));
+    }
+    if (pool->events) {
+        vEventGroupDelete(pool->events);
+    }
+    audio_free(pool->mem);
+    audio_free(pool->slots);
+    audio_free(pool);
+    return ESP_OK;
+}
+
+esp_err_t recorder_frame_pool_push(recorder_frame_pool_handle_t pool, const void *data, int len)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, data, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, len > 0 && len <= pool->frame_size, return ESP_ERR_INVALID_ARG, "Invalid frame length");
+
+    uint32_t seq = atomic_load(&pool->wr_seq);
+    recorder_frame_slot_t *slot = &pool->slots[seq % pool->frame_num];
+    /*
+     * Claim the slot with one exchange, so that of two racing pushes only one owns it and restores or
+     * publishes it. The other finds it claimed, or already holding `seq`, and drops its frame.
+     */
+    uint32_t old_seq = atomic_exchange(&slot->seq, FRAME_SLOT_INVALID);
+    if (old_seq == FRAME_SLOT_INVALID) {
+        atomic_fetch_add(&pool->overrun, 1);
+        return ESP_FAIL;
+    }
+    if ((int32_t)(old_seq - seq) >= 0) {
+        atomic_store(&slot->seq, old_seq);
+        atomic_fetch_add(&pool->overrun, 1);
+        return ESP_FAIL;
+    }
+    if (atomic_load(&slot->ref) != 0) {
+        // The oldest frame is still held by a reader, drop the new one rather than copy or wait
+        atomic_store(&slot->seq, old_seq);
+        atomic_fetch_add(&pool->overrun, 1);
+        return ESP_FAIL;
+    }
+    memcpy(slot->frame.data, data, len);
+    slot->frame.len = len;
+    slot->frame.seq = seq;
+    slot->frame.time = (uint32_t)(esp_timer_get_time() / 1000);
+    atomic_store(&slot->seq, seq);
+    atomic_store(&pool->wr_seq, seq + 1);
+
+    EventBits_t readers = atomic_load(&pool->reader_mask);
+    if (readers) {
+        xEventGroupSetBits(pool->events, readers);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_frame_pool_done(recorder_frame_pool_handle_t pool)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    atomic_store(&pool->is_done, true);
+    EventBits_t readers = atomic_load(&pool->reader_mask);
+    if (readers) {
+        xEventGroupSetBits(pool->events, readers);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_frame_pool_reset(recorder_frame_pool_handle_t pool)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    atomic_store(&pool->rd_floor, atomic_load(&pool->wr_seq));
+    atomic_store(&pool->is_done, false);
+    return ESP_OK;
+}
+
+esp_err_t recorder_frame_pool_set_replay_point(recorder_frame_pool_handle_t pool, uint32_t since)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    atomic_store(&pool->replay_since, since);
+    atomic_fetch_add(&pool->replay_gen, 1);
+    EventBits_t readers = atomic_load(&pool->reader_mask);
+    if (readers) {
+        xEventGroupSetBits(pool->events, readers);
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_frame_pool_get_stats(recorder_frame_pool_handle_t pool, recorder_frame_pool_stats_t *stats)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, stats, return ESP_ERR_INVALID_ARG);
+    stats->pushed = atomic_load(&pool->wr_seq);
+    stats->overrun = atomic_load(&pool->overrun);
+    stats->dropped = atomic_load(&pool->dropped);
+    return ESP_OK;
+}
+
+recorder_frame_reader_handle_t recorder_frame_pool_open_reader(recorder_frame_pool_handle_t pool)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return NULL);
+    recorder_frame_reader_handle_t reader = audio_calloc(1, sizeof(struct recorder_frame_reader));
+    AUDIO_MEM_CHECK(TAG, reader, return NULL);
+
+    unsigned int mask = atomic_load(&pool->reader_mask);
+    int id = 0;
+    do {
+        for (id = 0; id < RECORDER_FRAME_POOL_MAX_READERS; id++) {
+            if ((mask & (1 << id)) == 0) {
+                break;
+            }
+        }
+        if (id == RECORDER_FRAME_POOL_MAX_READERS) {
+            ESP_LOGE(TAG, "Too many readers, max %d", RECORDER_FRAME_POOL_MAX_READERS);
+            audio_free(reader);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak(&pool->reader_mask, &mask, mask | (1 << id)));
+
+    reader->pool = pool;
+    reader->bit = (1 << id);
+    reader->seq = atomic_load(&pool->wr_seq);
+    reader->replay_gen = atomic_load(&pool->replay_gen);
+    xEventGroupClearBits(pool->events, reader->bit);
+    return reader;
+}
+
+esp_err_t recorder_frame_pool_close_reader(recorder_frame_reader_handle_t reader)
+{
+    AUDIO_NULL_CHECK(TAG, reader, return ESP_ERR_INVALID_ARG);
+    atomic_fetch_and(&reader->pool->reader_mask, ~(unsigned int)reader->bit);
+    audio_free(reader);
+    return ESP_OK;
+}
+
+int recorder_frame_pool_acquire(recorder_frame_reader_handle_t reader, const recorder_frame_t **frame, TickType_t ticks)
+{
+    AUDIO_NULL_CHECK(TAG, reader, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, frame, return ESP_ERR_INVALID_ARG);
+
+    recorder_frame_slot_t *slot = NULL;
+    while ((slot = frame_pool_get(reader)) == NULL) {
+        int ret = frame_pool_wait(reader, ticks);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    reader->seq++;
+    reader->offset = 0;
+    *frame = &slot->frame;
+    return slot->frame.len;
+}
+
+esp_err_t recorder_frame_pool_release(recorder_frame_reader_handle_t reader, const recorder_frame_t *frame)
+{
+    AUDIO_NULL_CHECK(TAG, reader, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, frame, return ESP_ERR_INVALID_ARG);
+    recorder_frame_slot_t *slot = (recorder_frame_slot_t *)frame;
+    AUDIO_CHECK(TAG, slot >= reader->pool->slots && slot < reader->pool->slots + reader->pool->frame_num,
+                return ESP_ERR_INVALID_ARG, "Frame not from this pool");
+    atomic_fetch_sub(&slot->ref, 1);
+    return ESP_OK;
+}
+
+int recorder_frame_pool_read(recorder_frame_reader_handle_t reader, void *buf, int len, TickType_t ticks)
+{
+    AUDIO_NULL_CHECK(TAG, reader, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, buf, return ESP_ERR_INVALID_ARG);
+
+    int filled = 0;
+    while (filled < len) {
+        recorder_frame_slot_t *slot = frame_pool_get(reader);
+        if (slot == NULL) {
+            int ret = frame_pool_wait(reader, ticks);
+            if (ret != ESP_OK) {
+                return filled > 0 ? filled : ret;
+            }
+            continue;
+        }
+        int frame_len = slot->frame.len;
+        int copy = frame_len - reader->offset;
+        if (copy > len - filled) {
+            copy = len - filled;
+        }
+        memcpy((uint8_t *)buf + filled, (uint8_t *)slot->frame.data + reader->offset, copy);
+        atomic_fetch_sub(&slot->ref, 1);
+        filled += copy;
+        reader->offset += copy;
+        if (reader->offset >= frame_len) {
+            reader->seq++;
+            reader->offset = 0;
+        }
+    }
+    return filled;
+}
+
+uint32_t recorder_frame_pool_reader_dropped(recorder_frame_reader_handle_t reader)
+{
+    AUDIO_NULL_CHECK(TAG, reader, return 0);
+    return reader->dropped;
+}
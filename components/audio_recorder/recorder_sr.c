@@ -47,12 +47,16 @@
 #include "esp_mn_models.h"
 #include "esp_mn_speech_commands.h"
 #include "esp_process_sdkconfig.h"
+#include "nvs.h"
 #endif
 
 #include "recorder_sr.h"
 #include "ch_sort.h"
 #include "app_sr.h"
 
+#define MN_CMD_NVS_KEY     "mn_cmds"
+#define MN_CMD_BLOB_MAGIC  (0x4d4e4344) /* "MNCD" */
+
 #define FEED_TASK_DESTROY  (BIT(0))
 #define FETCH_TASK_DESTROY (BIT(1))
 #define FEED_TASK_RUNNING  (BIT(2))
@@ -78,7 +82,8 @@ typedef struct __recorder_sr {
     int                   fetch_task_core;
     int                   fetch_task_prio;
     int                   fetch_task_stack;
-    ringbuf_handle_t      out_rb;
+    recorder_frame_pool_handle_t   out_pool;
+    recorder_frame_reader_handle_t fetch_reader;
     int                   rb_size;
     EventGroupHandle_t    events;
     bool                  feed_running;
@@ -97,10 +102,15 @@ typedef struct __recorder_sr {
     model_iface_data_t    *mn_handle;
     recorder_sr_monitor_t mn_monitor;
     void                  *mn_monitor_ctx;
+    float                 mn_prob;
     bool                  mn_enable;
     char                  *mn_language;
+    char                  *mn_name;
+    char                  *mn_cmd_str;      /* Command string active in multinet, NULL for an unknown set */
+    char                  *mn_cmd_nvs;
 #endif /* CONFIG_USE_MULTINET */
     int8_t                input_order[DAT_CH_MAX];
+    ch_sort_t             ch_sort;
 } recorder_sr_t;
 
 static esp_err_t recorder_sr_output(recorder_sr_t *recorder_sr, void *buffer, int len);
@@ -195,6 +205,7 @@ static esp_err_t recorder_mn_detect(recorder_sr_t *recorder_sr, int16_t *buffer,
             }
 
             if (recorder_sr->mn_monitor) {
+                recorder_sr->mn_prob = mn_result->prob[0];
                 recorder_sr->mn_monitor(mn_result->command_id[0], recorder_sr->mn_monitor_ctx);
             }
 #if CONFIG_IDF_TARGET_ESP32
@@ -220,10 +231,9 @@ static void feed_task(void *parameters)
     recorder_sr_t *recorder_sr = (recorder_sr_t *)parameters;
     int chunksize = esp_afe->get_feed_chunksize(recorder_sr->afe_handle);
     int buf_size = chunksize * sizeof(int16_t) * RECORDER_CHANNEL_NUM;
-    int16_t *i_buf = audio_calloc(1, buf_size);
-    assert(i_buf);
-    int16_t *o_buf = audio_calloc(1, buf_size);;
-    assert(o_buf);
+    // Channels are sorted in place, the AFE is fed from the same buffer the data was read into
+    int16_t *buf = audio_calloc(1, buf_size);
+    assert(buf);
 
     int fill_cnt = 0;
 
@@ -232,23 +242,18 @@ static void feed_task(void *parameters)
     while (recorder_sr->feed_running) {
         xEventGroupWaitBits(recorder_sr->events, FEED_TASK_RUNNING, false, true, portMAX_DELAY);
 
-        int ret = recorder_sr->read((char *)i_buf + fill_cnt, buf_size - fill_cnt, recorder_sr->read_ctx, portMAX_DELAY);
+        int ret = recorder_sr->read((char *)buf + fill_cnt, buf_size - fill_cnt, recorder_sr->read_ctx, portMAX_DELAY);
         fill_cnt += ret;
         if (fill_cnt == buf_size) {
-#if RECORDER_CHANNEL_NUM == 2
-            ch_sort_16bit_2ch(i_buf, o_buf, fill_cnt, recorder_sr->input_order);
-#else /* RECORDER_CHANNEL_NUM == 2 */
-            ch_sort_16bit_4ch(i_buf, o_buf, fill_cnt, recorder_sr->input_order);
-#endif /* RECORDER_CHANNEL_NUM == 2 */
-            esp_afe->feed(recorder_sr->afe_handle, o_buf);
+            ch_sort_process(&recorder_sr->ch_sort, buf, buf, fill_cnt);
+            esp_afe->feed(recorder_sr->afe_handle, buf);
             fill_cnt -= buf_size;
         } else if (fill_cnt > buf_size) {
             ESP_LOGE(TAG, "fill cnt > buffer_size, there may be memory out of range");
             recorder_sr->feed_running = false;
         }
     }
-    audio_free(i_buf);
-    audio_free(o_buf);
+    audio_free(buf);
     xEventGroupClearBits(recorder_sr->events, FEED_TASK_RUNNING);
     xEventGroupSetBits(recorder_sr->events, FEED_TASK_DESTROY);
     vTaskDelete(NULL);
@@ -278,18 +283,24 @@ static void fetch_task(void *parameters)
 
 static esp_err_t recorder_sr_output(recorder_sr_t *recorder_sr, void *buffer, int len)
 {
-    if (rb_bytes_available(recorder_sr->out_rb) < len) {
-        rb_read(recorder_sr->out_rb, NULL, len, 0);
-    }
-    int ret = rb_write(recorder_sr->out_rb, buffer, len, 0);
-    return ret == len ? ESP_OK : ESP_FAIL;
+    // Readers lagging behind skip the oldest frames by themselves, so there is nothing to drop here
+    return recorder_frame_pool_push(recorder_sr->out_pool, buffer, len);
 }
 
 static int recorder_sr_fetch(void *handle, void *buf, int len, TickType_t ticks)
 {
     AUDIO_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG, "Handle is NULL");
     recorder_sr_t *recorder_sr = (recorder_sr_t *)handle;
-    return rb_read(recorder_sr->out_rb, buf, len, ticks);
+    return recorder_frame_pool_read(recorder_sr->fetch_reader, buf, len, ticks);
+}
+
+static esp_err_t recorder_sr_get_frame_pool(void *handle, recorder_frame_pool_handle_t *pool)
+{
+    AUDIO_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG, "Handle is NULL");
+    AUDIO_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG, "Pool is NULL");
+    recorder_sr_t *recorder_sr = (recorder_sr_t *)handle;
+    *pool = recorder_sr->out_pool;
+    return ESP_OK;
 }
 
 static esp_err_t recorder_sr_suspend(void *handle, bool suspend)
@@ -300,8 +311,8 @@ static esp_err_t recorder_sr_suspend(void *handle, bool suspend)
     if (suspend) {
         xEventGroupClearBits(recorder_sr->events, FEED_TASK_RUNNING);
         xEventGroupClearBits(recorder_sr->events, FETCH_TASK_RUNNING);
-        if (recorder_sr->out_rb) {
-            rb_done_write(recorder_sr->out_rb);
+        if (recorder_sr->out_pool) {
+            recorder_frame_pool_done(recorder_sr->out_pool);
         }
     } else {
         xEventGroupSetBits(recorder_sr->events, FEED_TASK_RUNNING);
@@ -338,8 +349,8 @@ static esp_err_t recorder_sr_enable(void *handle, bool enable)
         }
         recorder_sr_suspend(handle, !recorder_sr->wwe_enable);
 
-        if (recorder_sr->out_rb) {
-            rb_reset(recorder_sr->out_rb);
+        if (recorder_sr->out_pool) {
+            recorder_frame_pool_reset(recorder_sr->out_pool);
         }
     } else {
         recorder_sr_suspend(handle, false);
@@ -358,8 +369,8 @@ static esp_err_t recorder_sr_enable(void *handle, bool enable)
                 ESP_LOGI(TAG, "Feed task destroyed!");
             }
         }
-        if (recorder_sr->out_rb) {
-            rb_done_write(recorder_sr->out_rb);
+        if (recorder_sr->out_pool) {
+            recorder_frame_pool_done(recorder_sr->out_pool);
         }
     }
     return ret == ESP_OK ? ESP_OK : ESP_FAIL;
@@ -378,6 +389,10 @@ static esp_err_t recorder_sr_get_state(void *handle, void *state)
 #endif
     sr_state->wwe_enable = recorder_sr->wwe_enable;
     sr_state->vad_enable = recorder_sr->vad_enable;
+    recorder_frame_pool_stats_t stats = { 0 };
+    recorder_frame_pool_get_stats(recorder_sr->out_pool, &stats);
+    sr_state->frame_overrun = stats.overrun;
+    sr_state->frame_dropped = stats.dropped;
     if (!recorder_sr->feed_running || !recorder_sr->fetch_running) {
         sr_state->afe_state = DISABLED;
     } else if ((bits & (FEED_TASK_RUNNING | FETCH_TASK_RUNNING)) == (FEED_TASK_RUNNING | FETCH_TASK_RUNNING)) {
@@ -426,6 +441,21 @@ static esp_err_t recorder_sr_set_mn_monitor(void *handle, recorder_sr_monitor_t
 #endif
 }
 
+static esp_err_t recorder_sr_get_mn_prob(void *handle, float *prob)
+{
+#ifdef CONFIG_USE_MULTINET
+    AUDIO_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG, "Handle is NULL");
+    AUDIO_CHECK(TAG, prob, return ESP_ERR_INVALID_ARG, "Prob is NULL");
+    recorder_sr_t *recorder_sr = (recorder_sr_t *)handle;
+
+    *prob = recorder_sr->mn_prob;
+    return ESP_OK;
+#else
+    ESP_LOGW(TAG, "Multinet is not enabled in SDKCONFIG");
+    return ESP_FAIL;
+#endif
+}
+
 static esp_err_t recorder_sr_wwe_enable(void *handle, bool enable)
 {
     AUDIO_CHECK(TAG, handle, return ESP_ERR_INVALID_ARG, "Handle is NULL");
@@ -446,6 +476,235 @@ static esp_err_t recorder_sr_wwe_enable(void *handle, bool enable)
     return ret == 1 ? ESP_OK : ESP_FAIL;
 }
 
+#ifdef CONFIG_USE_MULTINET
+typedef struct {
+    uint32_t magic;
+    uint32_t model_hash;
+    uint32_t cmd_hash;
+    uint32_t cmd_len;
+} mn_cmd_blob_t;
+
+typedef struct {
+    int      id;
+    uint32_t hash;
+    char     *phrase;
+} mn_phrase_t;
+
+static uint32_t recorder_sr_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Split `str` in place, ';' separates the command ids and ',' the phrases of one command */
+static int recorder_sr_mn_parse(char *str, mn_phrase_t *list, int max)
+{
+    int num = 0;
+    int cmd_id = 0;
+    char *cmd_save = NULL;
+    char *phrase_save = NULL;
+    for (char *cmd = strtok_r(str, ";", &cmd_save); cmd; cmd = strtok_r(NULL, ";", &cmd_save)) {
+        for (char *p = strtok_r(cmd, ",", &phrase_save); p && num < max; p = strtok_r(NULL, ",", &phrase_save)) {
+            list[num].id = cmd_id;
+            list[num].hash = recorder_sr_hash(p);
+            list[num].phrase = p;
+            num++;
+        }
+        if (++cmd_id > ESP_MN_MAX_PHRASE_NUM) {
+            break;
+        }
+    }
+    return num;
+}
+
+static int recorder_sr_mn_phrase_count(const char *str)
+{
+    int num = 1;
+    while (*str) {
+        if (*str == ',' || *str == ';') {
+            num++;
+        }
+        str++;
+    }
+    return num;
+}
+
+static bool recorder_sr_mn_phrase_find(const mn_phrase_t *item, const mn_phrase_t *list, int num)
+{
+    for (int i = 0; i < num; i++) {
+        if (list[i].hash == item->hash && list[i].id == item->id && strcmp(list[i].phrase, item->phrase) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void recorder_sr_mn_save(recorder_sr_t *recorder_sr)
+{
+    if (recorder_sr->mn_cmd_nvs == NULL || recorder_sr->mn_name == NULL) {
+        return;
+    }
+    int cmd_len = strlen(recorder_sr->mn_cmd_str) + 1;
+    mn_cmd_blob_t *blob = audio_calloc(1, sizeof(mn_cmd_blob_t) + cmd_len);
+    AUDIO_NULL_CHECK(TAG, blob, return);
+    blob->magic = MN_CMD_BLOB_MAGIC;
+    blob->model_hash = recorder_sr_hash(recorder_sr->mn_name);
+    blob->cmd_hash = recorder_sr_hash(recorder_sr->mn_cmd_str);
+    blob->cmd_len = cmd_len;
+    memcpy(blob + 1, recorder_sr->mn_cmd_str, cmd_len);
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(recorder_sr->mn_cmd_nvs, NVS_READWRITE, &nvs);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(nvs, MN_CMD_NVS_KEY, blob, sizeof(mn_cmd_blob_t) + cmd_len);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to cache speech commands, %s", esp_err_to_name(ret));
+    }
+    audio_free(blob);
+}
+
+/* Return the command string cached for the current model, NULL if none */
+static char *recorder_sr_mn_load(recorder_sr_t *recorder_sr)
+{
+    if (recorder_sr->mn_cmd_nvs == NULL || recorder_sr->mn_name == NULL) {
+        return NULL;
+    }
+    nvs_handle_t nvs;
+    size_t size = 0;
+    if (nvs_open(recorder_sr->mn_cmd_nvs, NVS_READONLY, &nvs) != ESP_OK) {
+        return NULL;
+    }
+    mn_cmd_blob_t *blob = NULL;
+    if (nvs_get_blob(nvs, MN_CMD_NVS_KEY, NULL, &size) == ESP_OK && size > sizeof(mn_cmd_blob_t)) {
+        blob = audio_calloc(1, size + 1);
+        if (blob && nvs_get_blob(nvs, MN_CMD_NVS_KEY, blob, &size) != ESP_OK) {
+            audio_free(blob);
+            blob = NULL;
+        }
+    }
+    nvs_close(nvs);
+    if (blob == NULL) {
+        return NULL;
+    }
+    char *cmd_str = (char *)(blob + 1);
+    if (blob->magic != MN_CMD_BLOB_MAGIC || blob->cmd_len != size - sizeof(mn_cmd_blob_t)
+        || blob->model_hash != recorder_sr_hash(recorder_sr->mn_name) || blob->cmd_hash != recorder_sr_hash(cmd_str)) {
+        ESP_LOGI(TAG, "Cached speech commands don't match model %s, ignored", recorder_sr->mn_name);
+        audio_free(blob);
+        return NULL;
+    }
+    memmove(blob, cmd_str, blob->cmd_len);
+    return (char *)blob;
+}
+
+/*
+ * Bring the multinet command list to `command_str`. Only the phrases that differ from the active
+ * list are removed or added, and nothing is recompiled if the list is unchanged.
+ */
+static esp_err_t recorder_sr_mn_apply(recorder_sr_t *recorder_sr, const char *command_str, char *err_phrase_id)
+{
+    if (recorder_sr->mn_cmd_str && strcmp(recorder_sr->mn_cmd_str, command_str) == 0) {
+        ESP_LOGI(TAG, "Speech commands unchanged, skip the update");
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    char *new_str = audio_strdup(command_str);
+    char *old_str = recorder_sr->mn_cmd_str ? audio_strdup(recorder_sr->mn_cmd_str) : NULL;
+    int new_max = recorder_sr_mn_phrase_count(command_str);
+    int old_max = old_str ? recorder_sr_mn_phrase_count(old_str) : 0;
+    mn_phrase_t *list = audio_calloc(new_max + old_max, sizeof(mn_phrase_t));
+    if (new_str == NULL || list == NULL || (recorder_sr->mn_cmd_str && old_str == NULL)) {
+        ESP_LOGE(TAG, "No memory for speech commands");
+        ret = ESP_ERR_NO_MEM;
+        goto _exit;
+    }
+    mn_phrase_t *new_list = list;
+    mn_phrase_t *old_list = list + new_max;
+    int new_num = recorder_sr_mn_parse(new_str, new_list, new_max);
+    int old_num = old_str ? recorder_sr_mn_parse(old_str, old_list, old_max) : 0;
+
+    /* The active list is unknown from here until the update succeeds */
+    audio_free(recorder_sr->mn_cmd_str);
+    recorder_sr->mn_cmd_str = NULL;
+    if (old_str == NULL) {
+        esp_mn_commands_clear();
+    }
+    int changed = 0;
+    for (int i = 0; i < old_num; i++) {
+        if (!recorder_sr_mn_phrase_find(&old_list[i], new_list, new_num)) {
+            esp_mn_commands_remove(old_list[i].phrase);
+            changed++;
+        }
+    }
+    for (int i = 0; i < new_num; i++) {
+        if (old_str && recorder_sr_mn_phrase_find(&new_list[i], old_list, old_num)) {
+            continue;
+        }
+        ESP_LOGI(TAG, "cmd [%d : %s]", new_list[i].id, new_list[i].phrase);
+        ret = esp_mn_commands_add(new_list[i].id, new_list[i].phrase);
+        if (ret != ESP_OK) {
+            if (err_phrase_id) {
+                strcpy(err_phrase_id, new_list[i].phrase);
+            }
+            goto _exit;
+        }
+        changed++;
+    }
+    ESP_LOGI(TAG, "%d of %d phrases changed", changed, new_num);
+    esp_mn_commands_print();
+    esp_mn_error_t *mn_err = esp_mn_commands_update(multinet, recorder_sr->mn_handle);
+    if (mn_err != NULL) {
+        ret = ESP_FAIL;
+        goto _exit;
+    }
+    recorder_sr->mn_cmd_str = audio_strdup(command_str);
+    if (recorder_sr->mn_cmd_str) {
+        recorder_sr_mn_save(recorder_sr);
+    }
+    ret = ESP_OK;
+
+_exit:
+    audio_free(list);
+    audio_free(new_str);
+    audio_free(old_str);
+    return ret;
+}
+
+/* Load the cached command set of this model if any, otherwise the one from sdkconfig */
+static void recorder_sr_mn_init_cmds(recorder_sr_t *recorder_sr)
+{
+    char *cmd_str = recorder_sr_mn_load(recorder_sr);
+    if (cmd_str) {
+        esp_mn_commands_alloc();
+        if (recorder_sr_mn_apply(recorder_sr, cmd_str, NULL) == ESP_OK) {
+            ESP_LOGI(TAG, "Speech commands restored from nvs");
+            audio_free(cmd_str);
+            return;
+        }
+        audio_free(cmd_str);
+        esp_mn_commands_free();
+    }
+    esp_mn_commands_update_from_sdkconfig((esp_mn_iface_t *)multinet, recorder_sr->mn_handle);
+}
+
+static void recorder_sr_mn_deinit_cmds(recorder_sr_t *recorder_sr)
+{
+    esp_mn_commands_free();
+    audio_free(recorder_sr->mn_cmd_str);
+    recorder_sr->mn_cmd_str = NULL;
+}
+#endif /* CONFIG_USE_MULTINET */
+
 static esp_err_t recorder_sr_mn_enable(void *handle, bool enable)
 {
 #ifdef CONFIG_USE_MULTINET
@@ -455,16 +714,16 @@ static esp_err_t recorder_sr_mn_enable(void *handle, bool enable)
     recorder_sr->mn_enable = enable;
     if (!recorder_sr->mn_enable && recorder_sr->mn_handle) {
         multinet->destroy(recorder_sr->mn_handle);
-        esp_mn_commands_free();
+        recorder_sr_mn_deinit_cmds(recorder_sr);
         recorder_sr->mn_handle = NULL;
     }
 
     if (recorder_sr->mn_enable && !recorder_sr->mn_handle) {
-        char *mn_name = esp_srmodel_filter(recorder_sr->models, ESP_MN_PREFIX, recorder_sr->mn_language);
-        multinet = esp_mn_handle_from_name(mn_name);
-        recorder_sr->mn_handle = multinet->create(mn_name, 5760);
+        recorder_sr->mn_name = esp_srmodel_filter(recorder_sr->models, ESP_MN_PREFIX, recorder_sr->mn_language);
+        multinet = esp_mn_handle_from_name(recorder_sr->mn_name);
+        recorder_sr->mn_handle = multinet->create(recorder_sr->mn_name, 5760);
         AUDIO_NULL_CHECK(TAG, recorder_sr->mn_handle, return ESP_FAIL);
-        esp_mn_commands_update_from_sdkconfig((esp_mn_iface_t *)multinet, recorder_sr->mn_handle);
+        recorder_sr_mn_init_cmds(recorder_sr);
     }
     return ESP_OK;
 #else
@@ -484,6 +743,8 @@ static recorder_sr_iface_t recorder_sr_iface = {
     .set_mn_monitor = recorder_sr_set_mn_monitor,
     .wwe_enable = recorder_sr_wwe_enable,
     .mn_enable = recorder_sr_mn_enable,
+    .get_frame_pool = recorder_sr_get_frame_pool,
+    .get_mn_prob = recorder_sr_get_mn_prob,
 };
 
 static void recorder_sr_clear(void *handle)
@@ -498,16 +759,18 @@ static void recorder_sr_clear(void *handle)
 #ifdef CONFIG_USE_MULTINET
     if (recorder_sr->mn_handle) {
         multinet->destroy(recorder_sr->mn_handle);
-        esp_mn_commands_free();
+        recorder_sr_mn_deinit_cmds(recorder_sr);
         recorder_sr->mn_handle = NULL;
     }
 #endif
     if (recorder_sr->models) {
         esp_srmodel_deinit(recorder_sr->models);
     }
-    if (recorder_sr->out_rb) {
-        rb_reset(recorder_sr->out_rb);
-        rb_destroy(recorder_sr->out_rb);
+    if (recorder_sr->fetch_reader) {
+        recorder_frame_pool_close_reader(recorder_sr->fetch_reader);
+    }
+    if (recorder_sr->out_pool) {
+        recorder_frame_pool_destroy(recorder_sr->out_pool);
     }
     if (recorder_sr->events) {
         vEventGroupDelete(recorder_sr->events);
@@ -535,9 +798,12 @@ recorder_sr_handle_t recorder_sr_create(recorder_sr_cfg_t *cfg, recorder_sr_ifac
     recorder_sr->aec_enable       = cfg->afe_cfg.aec_init;
 #ifdef CONFIG_USE_MULTINET
     recorder_sr->mn_language      = cfg->mn_language;
+    recorder_sr->mn_cmd_nvs       = cfg->mn_cmd_nvs_namespace;
 #endif
 
     memcpy(recorder_sr->input_order, cfg->input_order, DAT_CH_MAX);
+    AUDIO_CHECK(TAG, ch_sort_init(&recorder_sr->ch_sort, recorder_sr->input_order, RECORDER_CHANNEL_NUM, 16) == ESP_OK,
+                goto _failed, "Invalid input order");
 
     recorder_sr->models = esp_srmodel_init(recorder_sr->partition_label);
     char *wn_name = esp_srmodel_filter(recorder_sr->models, ESP_WN_PREFIX, NULL);
@@ -559,11 +825,12 @@ recorder_sr_handle_t recorder_sr_create(recorder_sr_cfg_t *cfg, recorder_sr_ifac
         ESP_LOGI(TAG, "load multinet:%s,%d,%d", mn_name, sizeof(esp_mn_iface_t), sizeof(esp_mn_iface_t));
 
         AUDIO_NULL_CHECK(TAG, mn_name, goto _failed);
+        recorder_sr->mn_name = mn_name;
         multinet = esp_mn_handle_from_name(mn_name);
         recorder_sr->mn_handle = multinet->create(mn_name, 5760);
         AUDIO_NULL_CHECK(TAG, recorder_sr->mn_handle, goto _failed);
         recorder_sr->mn_enable = true;
-        esp_mn_commands_update_from_sdkconfig((esp_mn_iface_t *)multinet, recorder_sr->mn_handle);
+        recorder_sr_mn_init_cmds(recorder_sr);
         // esp_mn_commands_print();
     }
 #endif
@@ -574,8 +841,12 @@ recorder_sr_handle_t recorder_sr_create(recorder_sr_cfg_t *cfg, recorder_sr_ifac
     
     recorder_sr->events = xEventGroupCreate();
     AUDIO_NULL_CHECK(TAG, recorder_sr->events, goto _failed);
-    recorder_sr->out_rb = rb_create(recorder_sr->rb_size, 1);
-    AUDIO_NULL_CHECK(TAG, recorder_sr->out_rb, goto _failed);
+    int frame_size = esp_afe->get_fetch_chunksize(recorder_sr->afe_handle) * sizeof(int16_t);
+    int frame_num = recorder_sr->rb_size / frame_size;
+    recorder_sr->out_pool = recorder_frame_pool_create(frame_size, frame_num < 2 ? 2 : frame_num);
+    AUDIO_NULL_CHECK(TAG, recorder_sr->out_pool, goto _failed);
+    recorder_sr->fetch_reader = recorder_frame_pool_open_reader(recorder_sr->out_pool);
+    AUDIO_NULL_CHECK(TAG, recorder_sr->fetch_reader, goto _failed);
 
     *iface = &recorder_sr_iface;
 
@@ -604,39 +875,8 @@ esp_err_t recorder_sr_reset_speech_cmd(recorder_sr_handle_t handle, char *comman
     AUDIO_CHECK(TAG, command_str, return ESP_FAIL, "command_str is NULL");
 
     recorder_sr_t *recorder_sr = (recorder_sr_t *)handle;
-    esp_err_t err = ESP_OK;
-    char *buf = audio_calloc(1, strlen(command_str) + 1);
-    AUDIO_NULL_CHECK(TAG, buf, return ESP_ERR_NO_MEM);
-    char *tmp = buf;
-
-    esp_mn_commands_clear();
-
-    uint8_t cmd_id = 0;
-    char *cmd_str = NULL;
-    char *phrase = NULL;
-    strcpy(buf, command_str);
-    char *p = NULL;
-    while ((p = strtok_r(buf, ";", &cmd_str)) != NULL) {
-        buf = p;
-        while ((p = strtok_r(buf, ",", &phrase)) != NULL) {
-            buf = NULL;
-            ESP_LOGI(TAG, "cmd [%d : %s]", cmd_id, p);
-            err = esp_mn_commands_add(cmd_id, p);
-            if (err != ESP_OK) {
-                strcpy(err_phrase_id, p);
-                free(tmp);
-                return err;
-            }
-        }
-        buf = NULL;
-        if (++cmd_id > ESP_MN_MAX_PHRASE_NUM) {
-            break;
-        }
-    }
-    free(tmp);
-    esp_mn_commands_print();
-    esp_mn_error_t *mn_err = esp_mn_commands_update(multinet, recorder_sr->mn_handle);
-    return mn_err == NULL ? ESP_OK : ESP_FAIL;
+    AUDIO_CHECK(TAG, recorder_sr->mn_handle, return ESP_FAIL, "Multinet is not running");
+    return recorder_sr_mn_apply(recorder_sr, command_str, err_phrase_id);
 #else
     ESP_LOGW(TAG, "Multinet is not enabled");
     return ESP_FAIL;
@@ -36,10 +36,14 @@
 #include "amrwb_encoder.h"
 #include "filter_resample.h"
 
+#include "esp_timer.h"
+
 #include "audio_mem.h"
 #include "audio_recorder.h"
 #include "recorder_encoder.h"
 #include "recorder_sr.h"
+#include "ch_sort.h"
+#include "recorder_frame_pool.h"
 
 #include "model_path.h"
 
@@ -248,6 +252,35 @@ static esp_err_t recorder_event_cb(audio_rec_evt_t type, void *user_data)
     return ESP_OK;
 }
 
+/*
+ * Catch a frame reader up to the live frames, then check the next frame after a replay
+ * comes from the history, at or after the replay point
+ */
+static void test_replay(audio_rec_handle_t recorder, audio_rec_replay_from_t from, int offset_ms, uint32_t anchor)
+{
+    recorder_frame_reader_handle_t reader = audio_recorder_frame_reader_open(recorder);
+    TEST_ASSERT_NOT_NULL(reader);
+    const recorder_frame_t *frame = NULL;
+    vTaskDelay(pdMS_TO_TICKS(500));
+    uint32_t live_seq = 0;
+    while (audio_recorder_frame_acquire(recorder, reader, &frame, 0) > 0) {
+        live_seq = frame->seq;
+        TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(reader, frame));
+    }
+    TEST_ASSERT_GREATER_THAN(0, live_seq);
+
+    if (from == AUDIO_REC_REPLAY_FROM_NOW) {
+        anchor = (uint32_t)(esp_timer_get_time() / 1000);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, audio_recorder_replay(recorder, from, offset_ms));
+    TEST_ASSERT_GREATER_THAN(0, audio_recorder_frame_acquire(recorder, reader, &frame, pdMS_TO_TICKS(1000)));
+    ESP_LOGI(TAG, "Replay from %u, frame %u at %u, live frame %u", anchor + offset_ms, frame->seq, frame->time, live_seq);
+    TEST_ASSERT(frame->seq <= live_seq);
+    TEST_ASSERT((int32_t)(frame->time - (anchor + offset_ms)) >= 0);
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(reader, frame));
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_close_reader(reader));
+}
+
 static void test_init(void *recorder)
 {
     read_cnt = 0;
@@ -277,6 +310,8 @@ TEST_CASE("All function bypass, create and destroy", "[audio][timeout=100][test_
 
     audio_rec_handle_t recorder = audio_recorder_create(&cfg);
     TEST_ASSERT_NOT_NULL(recorder);
+    // Without SR there is no history to replay
+    TEST_ASSERT(audio_recorder_replay(recorder, AUDIO_REC_REPLAY_FROM_NOW, 0) == ESP_ERR_NOT_SUPPORTED);
 
     vTaskDelay(pdMS_TO_TICKS(500));
     TEST_ASSERT(audio_recorder_destroy(recorder) == ESP_OK);
@@ -606,11 +641,15 @@ TEST_CASE("Use [sr - wwe disable, vad enabled, mn disabled]", "[audio][timeout=1
     EventBits_t bits = 0;
     EventBits_t expect = 0;
 
+    uint32_t wakeup_ms = (uint32_t)(esp_timer_get_time() / 1000);
     TEST_ASSERT(audio_recorder_trigger_start(recorder) == ESP_OK);
     expect = SR_WAKEUP | SR_VAD_START | RECORDER_GOT_DAT;
     bits = xEventGroupWaitBits(events, expect, true, true, pdMS_TO_TICKS(10000));
     TEST_ASSERT((bits & expect) == expect);
 
+    // Rewind 300 ms back, then to the trigger start, the read task is rewound along with the test reader
+    test_replay(recorder, AUDIO_REC_REPLAY_FROM_NOW, -300, 0);
+    test_replay(recorder, AUDIO_REC_REPLAY_FROM_WAKEUP_END, 0, wakeup_ms);
     vTaskDelay(pdMS_TO_TICKS(5000));
 
     TEST_ASSERT(audio_recorder_trigger_stop(recorder) == ESP_OK);
@@ -767,3 +806,97 @@ TEST_CASE("Use [sr - all enable, resample, encoder]", "[audio][timeout=100][test
 
     test_deinit();
 }
+
+TEST_CASE("ch_sort matches the legacy sorter and works in place", "[audio][timeout=100][test_env=UT_T1_AUDIO]")
+{
+    const int frames = 256;
+    int8_t order[DAT_CH_MAX] = {DAT_CH_2, DAT_CH_0, DAT_CH_IDLE, DAT_CH_1};
+    int16_t *i_buf = audio_calloc(frames * 4, sizeof(int16_t));
+    int16_t *o_ref = audio_calloc(frames * 4, sizeof(int16_t));
+    TEST_ASSERT_NOT_NULL(i_buf);
+    TEST_ASSERT_NOT_NULL(o_ref);
+    for (int i = 0; i < frames * 4; i++) {
+        i_buf[i] = (int16_t)(i * 7 - 1000);
+    }
+
+    ch_sort_t ch_sort;
+    TEST_ASSERT_EQUAL(ESP_OK, ch_sort_init(&ch_sort, order, 4, 16));
+    ch_sort_16bit_4ch(i_buf, o_ref, frames * 4 * sizeof(int16_t), order);
+    // Two mics and the reference are kept, the idle channel is dropped
+    TEST_ASSERT_EQUAL(frames * 3 * sizeof(int16_t), ch_sort_process(&ch_sort, i_buf, i_buf, frames * 4 * sizeof(int16_t)));
+    TEST_ASSERT_EQUAL_MEMORY(o_ref, i_buf, frames * 3 * sizeof(int16_t));
+
+    int8_t bad_order[DAT_CH_MAX] = {DAT_CH_0, DAT_CH_0, DAT_CH_IDLE, DAT_CH_IDLE};
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, ch_sort_init(&ch_sort, bad_order, 4, 16));
+
+    audio_free(i_buf);
+    audio_free(o_ref);
+}
+
+TEST_CASE("recorder frame pool shares frames between readers", "[audio][timeout=100][test_env=UT_T1_AUDIO]")
+{
+    const int frame_size = 64;
+    uint8_t data[frame_size];
+    recorder_frame_pool_handle_t pool = recorder_frame_pool_create(frame_size, 4);
+    TEST_ASSERT_NOT_NULL(pool);
+    recorder_frame_reader_handle_t r1 = recorder_frame_pool_open_reader(pool);
+    recorder_frame_reader_handle_t r2 = recorder_frame_pool_open_reader(pool);
+    TEST_ASSERT_NOT_NULL(r1);
+    TEST_ASSERT_NOT_NULL(r2);
+
+    const recorder_frame_t *f1 = NULL;
+    const recorder_frame_t *f2 = NULL;
+    TEST_ASSERT_EQUAL(RB_TIMEOUT, recorder_frame_pool_acquire(r1, &f1, 0));
+
+    // Both readers get the very same frame memory
+    memset(data, 0x5a, frame_size);
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_push(pool, data, frame_size));
+    TEST_ASSERT_EQUAL(frame_size, recorder_frame_pool_acquire(r1, &f1, 0));
+    TEST_ASSERT_EQUAL(frame_size, recorder_frame_pool_acquire(r2, &f2, 0));
+    TEST_ASSERT_EQUAL_PTR(f1->data, f2->data);
+    TEST_ASSERT_EQUAL_MEMORY(data, f1->data, frame_size);
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(r2, f2));
+
+    // The frame held by r1 is never overwritten, the producer drops the new frame instead
+    for (int i = 1; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_push(pool, data, frame_size));
+    }
+    TEST_ASSERT_EQUAL(ESP_FAIL, recorder_frame_pool_push(pool, data, frame_size));
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(r1, f1));
+
+    // r2 has fallen behind, the oldest frames are skipped and counted
+    for (int i = 0; i < 4; i++) {
+        data[0] = i;
+        TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_push(pool, data, frame_size));
+    }
+    TEST_ASSERT_EQUAL(frame_size, recorder_frame_pool_acquire(r2, &f2, 0));
+    TEST_ASSERT_EQUAL(0, ((uint8_t *)f2->data)[0]);
+    TEST_ASSERT_EQUAL(3, recorder_frame_pool_reader_dropped(r2));
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(r2, f2));
+
+    recorder_frame_pool_stats_t stats = { 0 };
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_get_stats(pool, &stats));
+    TEST_ASSERT_EQUAL(8, stats.pushed);
+    TEST_ASSERT_EQUAL(1, stats.overrun);
+
+    // A replay point rewinds every reader to the oldest frame kept from that time on
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_set_replay_point(pool, 0));
+    TEST_ASSERT_EQUAL(frame_size, recorder_frame_pool_acquire(r1, &f1, 0));
+    TEST_ASSERT_EQUAL(4, f1->seq);
+    TEST_ASSERT_EQUAL(ESP_OK, recorder_frame_pool_release(r1, f1));
+
+    // The copying path splits frames across reads, and returns RB_DONE once drained
+    uint8_t buf[frame_size / 2];
+    recorder_frame_pool_done(pool);
+    int total = 0;
+    int ret = 0;
+    while ((ret = recorder_frame_pool_read(r2, buf, sizeof(buf), 0)) > 0) {
+        total += ret;
+    }
+    TEST_ASSERT_EQUAL(4 * frame_size, total);
+    TEST_ASSERT_EQUAL(RB_DONE, ret);
+
+    recorder_frame_pool_close_reader(r1);
+    recorder_frame_pool_close_reader(r2);
+    recorder_frame_pool_destroy(pool);
+}
@@ -37,6 +37,8 @@
 #include "audio_mem.h"
 #include "audio_element.h"
 #include "wav_head.h"
+#include "write_behind.h"
+#include "read_ahead.h"
 #include "esp_log.h"
 #include "unistd.h"
 #include "fcntl.h"
@@ -63,6 +65,9 @@ typedef struct fatfs_stream {
     int file;
     wr_stream_type_t w_type;
     bool write_header;
+    write_behind_handle_t wb;
+    int prealloc_size;
+    read_ahead_handle_t ra;
 } fatfs_stream_t;
 
 
@@ -88,6 +93,18 @@ static wr_stream_type_t get_type(const char *str)
     }
 }
 
+static uint32_t get_file_id(const char *path, const struct stat *st)
+{
+    /* FNV-1a over the path, the size and the modification time tell whether the cached blocks are still valid */
+    uint32_t id = 2166136261u;
+    while (*path) {
+        id = (id ^ (uint8_t)*path++) * 16777619u;
+    }
+    id = (id ^ (uint32_t)st->st_size) * 16777619u;
+    id = (id ^ (uint32_t)st->st_mtime) * 16777619u;
+    return id;
+}
+
 
 static esp_err_t _fatfs_open(audio_element_handle_t self)
 {
@@ -126,6 +143,10 @@ static esp_err_t _fatfs_open(audio_element_handle_t self)
                 return ESP_FAIL;
             }
         }
+        if (fatfs->ra && read_ahead_attach(fatfs->ra, fatfs->file, get_file_id(path, &siz), siz.st_size, info.byte_pos) != ESP_OK) {
+            close(fatfs->file);
+            return ESP_FAIL;
+        }
     } else if (fatfs->type == AUDIO_STREAM_WRITER) {
         fatfs->file = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU);
         if (fatfs->file == -1) {
@@ -144,6 +165,10 @@ static esp_err_t _fatfs_open(audio_element_handle_t self)
             write(fatfs->file, "#!AMR-WB\n", 9);
             fsync(fatfs->file);
         }
+        if (fatfs->wb && write_behind_attach(fatfs->wb, fatfs->file, fatfs->prealloc_size) != ESP_OK) {
+            close(fatfs->file);
+            return ESP_FAIL;
+        }
     } else {
         ESP_LOGE(TAG, "FATFS must be Reader or Writer");
         return ESP_FAIL;
@@ -161,7 +186,7 @@ static int _fatfs_read(audio_element_handle_t self, char *buffer, int len, TickT
 
     ESP_LOGD(TAG, "read len=%d, pos=%d/%d", len, (int)info.byte_pos, (int)info.total_bytes);
     /* use file descriptors to access files */
-    int rlen = read(fatfs->file, buffer, len);
+    int rlen = fatfs->ra ? read_ahead_read(fatfs->ra, buffer, len) : read(fatfs->file, buffer, len);
     if (rlen == 0) {
         ESP_LOGW(TAG, "No more data, ret:%d", rlen);
     } else if (rlen == -1) {
@@ -175,10 +200,13 @@ static int _fatfs_read(audio_element_handle_t self, char *buffer, int len, TickT
 static int _fatfs_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
 {
     fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
-    int wlen =  write(fatfs->file, buffer, len);
-    fsync(fatfs->file);
+    int wlen;
+    if (fatfs->wb) {
+        wlen = write_behind_write(fatfs->wb, buffer, len);
+    } else {
+        wlen = write(fatfs->file, buffer, len);
+        fsync(fatfs->file);
+    }
     if (wlen > 0) {
         audio_element_update_byte_pos(self, wlen);
     } if (wlen == -1) {
@@ -204,6 +232,12 @@ static esp_err_t _fatfs_close(audio_element_handle_t self)
 {
     fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(self);
 
+    if (fatfs->wb && fatfs->is_open && write_behind_detach(fatfs->wb) != ESP_OK) {
+        ESP_LOGE(TAG, "The error is happened in flushing data");
+    }
+    if (fatfs->ra && fatfs->is_open) {
+        read_ahead_detach(fatfs->ra);
+    }
     if (AUDIO_STREAM_WRITER == fatfs->type
         && (-1 != fatfs->file)
         && (true == fatfs->write_header)
@@ -238,6 +272,12 @@ static esp_err_t _fatfs_close(audio_element_handle_t self)
 static esp_err_t _fatfs_destroy(audio_element_handle_t self)
 {
     fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(self);
+    if (fatfs->wb) {
+        write_behind_destroy(fatfs->wb);
+    }
+    if (fatfs->ra) {
+        read_ahead_destroy(fatfs->ra);
+    }
     audio_free(fatfs);
     return ESP_OK;
 }
@@ -269,6 +309,34 @@ audio_element_handle_t fatfs_stream_init(fatfs_stream_cfg_t *config)
     fatfs->type = config->type;
     fatfs->write_header = config->write_header;
 
+    if (config->type == AUDIO_STREAM_WRITER && config->write_behind_size > 0) {
+        write_behind_cfg_t wb_cfg = {
+            .buffer_size = config->write_behind_size,
+            .block_size = config->cluster_size > 0 ? config->cluster_size : FATFS_STREAM_CLUSTER_SIZE,
+            .sync_interval_ms = config->sync_interval_ms,
+            .sync_bytes = config->sync_bytes,
+            .task_stack = FATFS_STREAM_TASK_STACK,
+            .task_prio = config->task_prio,
+            .task_core = config->task_core,
+            .stack_in_ext = config->ext_stack,
+        };
+        fatfs->wb = write_behind_create(&wb_cfg);
+        AUDIO_MEM_CHECK(TAG, fatfs->wb, goto _fatfs_init_exit);
+        fatfs->prealloc_size = config->prealloc_size;
+    }
+    if (config->type == AUDIO_STREAM_READER && config->read_ahead_blocks > 0) {
+        read_ahead_cfg_t ra_cfg = {
+            .block_size = config->cluster_size > 0 ? config->cluster_size : FATFS_STREAM_CLUSTER_SIZE,
+            .block_num = config->read_ahead_blocks,
+            .task_stack = FATFS_STREAM_TASK_STACK,
+            .task_prio = config->task_prio,
+            .task_core = config->task_core,
+            .stack_in_ext = config->ext_stack,
+        };
+        fatfs->ra = read_ahead_create(&ra_cfg);
+        AUDIO_MEM_CHECK(TAG, fatfs->ra, goto _fatfs_init_exit);
+    }
+
     if (config->type == AUDIO_STREAM_WRITER) {
         cfg.write = _fatfs_write;
     } else {
@@ -280,7 +348,26 @@ audio_element_handle_t fatfs_stream_init(fatfs_stream_cfg_t *config)
     audio_element_setdata(el, fatfs);
     return el;
 _fatfs_init_exit:
+    if (fatfs->wb) {
+        write_behind_destroy(fatfs->wb);
+    }
+    if (fatfs->ra) {
+        read_ahead_destroy(fatfs->ra);
+    }
     audio_free(fatfs);
     return NULL;
 }
-// Example of using an audio element - END
\ No newline at end of file
+// Example of using an audio element - END
+
+esp_err_t fatfs_stream_sync(audio_element_handle_t el)
+{
+    AUDIO_NULL_CHECK(TAG, el, return ESP_FAIL);
+    fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(el);
+    if (fatfs->wb) {
+        return write_behind_sync(fatfs->wb);
+    }
+    if (fatfs->is_open && fatfs->type == AUDIO_STREAM_WRITER) {
+        return fsync(fatfs->file) == 0 ? ESP_OK : ESP_FAIL;
+    }
+    return ESP_OK;
+}
\ No newline at end of file
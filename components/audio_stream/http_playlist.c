@@ -119,6 +119,17 @@ char* http_playlist_get_next_track(http_playlist_t *playlist)
     return NULL;
 }
 
+char* http_playlist_peek_next_track(http_playlist_t *playlist)
+{
+    track_t *track;
+    STAILQ_FOREACH(track, &playlist->tracks, next) {
+        if (!track->is_played) {
+            return track->uri;
+        }
+    }
+    return NULL;
+}
+
 char* http_playlist_get_last_track(http_playlist_t *playlist)
 {
     track_t *track;
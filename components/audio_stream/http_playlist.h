@@ -67,6 +67,19 @@ void http_playlist_insert(http_playlist_t *playlist, char *track_uri);
  */
 char *http_playlist_get_next_track(http_playlist_t *playlist);
 
+/**
+ * @brief       Get next not-played track from playlist without marking it as played
+ *
+ * @param       playlist: Playlist handle
+ *
+ * @return
+ *      - NULL: If no playable track
+ *      - Others: Playable track
+ *
+ * @note        returned track must `not` be freed by application
+ */
+char *http_playlist_peek_next_track(http_playlist_t *playlist);
+
 /**
  * @brief       Get last played track from playlist
  *
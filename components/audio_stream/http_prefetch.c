@@ -0,0 +1,829 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "audio_thread.h"
+#include "audio_error.h"
+#include "audio_idf_version.h"
+#include "http_prefetch.h"
+
+static const char *TAG = "HTTP_PREFETCH";
+
+#define PF_MAX_CONN             (4)
+#define PF_BOUNCE_SIZE          (4 * 1024)
+#define PF_TIMEOUT_MS           (10 * 1000)
+#define PF_AHEAD_MARGIN_MS      (1000)
+#define PF_RATE_WINDOW_US       (1000 * 1000)
+#define PF_BACKOFF_MIN_MS       (100)
+#define PF_BACKOFF_MAX_MS       (2000)
+#define PF_MAX_REDIRECT         (3)
+
+#define PF_WORK_BIT             (BIT0)
+#define PF_DATA_BIT             (BIT1)
+#define PF_EXIT_BIT(id)         (BIT2 << (id))
+
+typedef enum {
+    PF_SLOT_FREE = 0,
+    PF_SLOT_PENDING,
+    PF_SLOT_FETCHING,
+    PF_SLOT_DONE,
+} pf_slot_state_t;
+
+typedef enum {
+    PF_SRC_NONE = 0,
+    PF_SRC_RANGE,
+    PF_SRC_SEGMENT,
+} pf_src_t;
+
+typedef enum {
+    PF_JOB_RANGE,
+    PF_JOB_SEGMENT,
+} pf_job_type_t;
+
+typedef struct {
+    int64_t          chunk;         /* Chunk index in the job, -1 if free */
+    int              len;
+    int              filled;
+    pf_slot_state_t  state;
+} pf_slot_t;
+
+/* A whole resource prefetched into its own buffer, used for the HLS segments */
+typedef struct {
+    char             *url;
+    uint8_t          *data;
+    int              len;           /* 0 until the headers are fetched */
+    int              filled;
+    int              rd;
+    pf_slot_state_t  state;
+    bool             failed;
+    uint32_t         gen;           /* 0 for an empty segment */
+} pf_segment_t;
+
+typedef struct {
+    pf_job_type_t    type;
+    uint32_t         gen;
+    int              slot;
+    int64_t          chunk;         /* Chunk index the slot held when the job was claimed */
+    int64_t          from;          /* Absolute offset of the first byte to request */
+    int64_t          to;            /* Absolute offset of the last byte, -1 for the whole resource */
+} pf_job_t;
+
+typedef struct {
+    struct http_prefetch        *pf;
+    int                         id;
+    esp_http_client_handle_t    client;
+    char                        *url;
+    char                        *bounce;
+    int                         fails;
+    audio_thread_t              thread;
+} pf_worker_t;
+
+struct http_prefetch {
+    http_prefetch_cfg_t  cfg;
+    void                 *lock;
+    EventGroupHandle_t   events;
+    bool                 running;
+    pf_worker_t          workers[PF_MAX_CONN];
+    int                  worker_num;
+
+    /* Range job */
+    uint32_t             gen;
+    char                 *url;
+    int64_t              start;
+    int64_t              end;
+    int64_t              chunk_num;
+    int                  slot_num;
+    pf_slot_t            *slots;
+    uint8_t              *cache;
+    int64_t              rd_chunk;
+    int                  rd_off;
+    int                  target_chunks;
+    bool                 read_started;
+
+    /* Segments */
+    uint32_t             seg_gen;
+    pf_segment_t         seg;
+    pf_segment_t         next;
+    pf_src_t             src;
+
+    /* Measurements */
+    int                  throughput;
+    int                  rtt_ms;
+    int                  consume_rate;
+    int                  stall_ms;
+    int64_t              rate_since_us;
+    int                  rate_bytes;
+    bool                 rate_stalled;
+    int64_t              stall_since_us;
+    uint32_t             stalls;
+    uint32_t             retries;
+};
+
+static void http_prefetch_adapt(http_prefetch_handle_t pf)
+{
+    if (pf->consume_rate == 0 || pf->throughput == 0) {
+        pf->target_chunks = pf->slot_num;
+        return;
+    }
+    /* Keep enough ahead to ride out a full chunk fetch twice, or the worst recent stall */
+    int fetch_ms = pf->rtt_ms + (int)((int64_t)pf->cfg.chunk_size * 1000 / pf->throughput);
+    int ahead_ms = (2 * fetch_ms > pf->stall_ms ? 2 * fetch_ms : pf->stall_ms) + PF_AHEAD_MARGIN_MS;
+    int64_t bytes = (int64_t)pf->consume_rate * ahead_ms / 1000 + pf->cfg.chunk_size;
+    int target = (bytes + pf->cfg.chunk_size - 1) / pf->cfg.chunk_size;
+    if (target < 2) {
+        target = 2;
+    }
+    pf->target_chunks = target > pf->slot_num ? pf->slot_num : target;
+}
+
+static int http_prefetch_buffered(http_prefetch_handle_t pf)
+{
+    if (pf->src == PF_SRC_SEGMENT) {
+        return pf->seg.filled - pf->seg.rd;
+    }
+    if (pf->src != PF_SRC_RANGE) {
+        return 0;
+    }
+    int buffered = 0;
+    for (int64_t k = pf->rd_chunk; k < pf->chunk_num && k < pf->rd_chunk + pf->slot_num; k++) {
+        pf_slot_t *s = &pf->slots[k % pf->slot_num];
+        if (s->chunk != k) {
+            break;
+        }
+        buffered += s->filled - (k == pf->rd_chunk ? pf->rd_off : 0);
+        if (s->filled < s->len) {
+            break;
+        }
+    }
+    return buffered;
+}
+
+static void http_prefetch_segment_clear(pf_segment_t *seg)
+{
+    audio_free(seg->url);
+    audio_free(seg->data);
+    memset(seg, 0, sizeof(pf_segment_t));
+}
+
+static pf_segment_t *http_prefetch_segment_find(http_prefetch_handle_t pf, uint32_t gen)
+{
+    if (gen && pf->seg.gen == gen) {
+        return &pf->seg;
+    }
+    if (gen && pf->next.gen == gen) {
+        return &pf->next;
+    }
+    return NULL;
+}
+
+/* Must be called with the lock held */
+static bool http_prefetch_claim(http_prefetch_handle_t pf, pf_job_t *job, const char **url)
+{
+    if (pf->src == PF_SRC_RANGE) {
+        int64_t limit = pf->rd_chunk + pf->target_chunks;
+        if (limit > pf->chunk_num) {
+            limit = pf->chunk_num;
+        }
+        for (int64_t k = pf->rd_chunk; k < limit; k++) {
+            int idx = k % pf->slot_num;
+            pf_slot_t *s = &pf->slots[idx];
+            if (s->chunk != k) {
+                int64_t offset = pf->start + k * pf->cfg.chunk_size;
+                s->chunk = k;
+                s->len = pf->end - offset < pf->cfg.chunk_size ? pf->end - offset : pf->cfg.chunk_size;
+                s->filled = 0;
+                s->state = PF_SLOT_PENDING;
+            }
+            if (s->state == PF_SLOT_PENDING) {
+                s->state = PF_SLOT_FETCHING;
+                job->type = PF_JOB_RANGE;
+                job->gen = pf->gen;
+                job->slot = idx;
+                job->chunk = k;
+                job->from = pf->start + k * pf->cfg.chunk_size + s->filled;
+                job->to = pf->start + k * pf->cfg.chunk_size + s->len - 1;
+                *url = pf->url;
+                return true;
+            }
+        }
+        if (limit < pf->chunk_num) {
+            return false;
+        }
+        for (int64_t k = pf->rd_chunk; k < pf->chunk_num; k++) {
+            if (pf->slots[k % pf->slot_num].state != PF_SLOT_DONE) {
+                /* Keep the connections on the current job until it is fully fetched */
+                return false;
+            }
+        }
+    }
+    /* The segment being read goes first, it only gets here again after a failure */
+    pf_segment_t *segs[] = { &pf->seg, &pf->next };
+    for (int i = 0; i < 2; i++) {
+        pf_segment_t *seg = segs[i];
+        if (seg->gen && seg->state == PF_SLOT_PENDING && !seg->failed) {
+            seg->state = PF_SLOT_FETCHING;
+            job->type = PF_JOB_SEGMENT;
+            job->gen = seg->gen;
+            job->slot = -1;
+            job->chunk = -1;
+            job->from = seg->filled;
+            job->to = -1;
+            *url = seg->url;
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t http_prefetch_request(pf_worker_t *w, pf_job_t *job, int64_t *content_len)
+{
+    http_prefetch_handle_t pf = w->pf;
+    if (w->client == NULL) {
+        esp_http_client_config_t http_cfg = {
+            .url = w->url,
+            .timeout_ms = PF_TIMEOUT_MS,
+            .buffer_size = PF_BOUNCE_SIZE,
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 1, 0)
+            .buffer_size_tx = 1024,
+#endif
+            .cert_pem = pf->cfg.cert_pem,
+#if  (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)) && defined CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+            .crt_bundle_attach = pf->cfg.crt_bundle_attach,
+#endif
+        };
+        w->client = esp_http_client_init(&http_cfg);
+        AUDIO_MEM_CHECK(TAG, w->client, return ESP_ERR_NO_MEM);
+    } else {
+        esp_http_client_set_url(w->client, w->url);
+    }
+    if (job->from > 0 || job->to >= 0) {
+        char range[48];
+        if (job->to >= 0) {
+            snprintf(range, sizeof(range), "bytes=%" PRId64 "-%" PRId64, job->from, job->to);
+        } else {
+            snprintf(range, sizeof(range), "bytes=%" PRId64 "-", job->from);
+        }
+        esp_http_client_set_header(w->client, "Range", range);
+    } else {
+        esp_http_client_delete_header(w->client, "Range");
+    }
+    for (int redirects = 0; redirects <= PF_MAX_REDIRECT; redirects++) {
+        if (pf->cfg.on_request && pf->cfg.on_request(w->client, pf->cfg.ctx) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        esp_err_t err = esp_http_client_open(w->client, 0);
+        if (err != ESP_OK) {
+            return err;
+        }
+        *content_len = esp_http_client_fetch_headers(w->client);
+        int status_code = esp_http_client_get_status_code(w->client);
+        if (status_code == 206 || (status_code == 200 && job->from == 0 && job->to < 0)) {
+            return ESP_OK;
+        }
+        if (status_code != 301 && status_code != 302) {
+            ESP_LOGW(TAG, "Unexpected status %d for range %" PRId64 "-%" PRId64, status_code, job->from, job->to);
+            return ESP_FAIL;
+        }
+        esp_http_client_set_redirection(w->client);
+        esp_http_client_close(w->client);
+    }
+    ESP_LOGW(TAG, "Too many redirects for %s", w->url);
+    return ESP_FAIL;
+}
+
+/* Must be called with the lock held, return NULL once the slot has been handed to another chunk */
+static pf_slot_t *http_prefetch_job_slot(http_prefetch_handle_t pf, pf_job_t *job)
+{
+    pf_slot_t *s = &pf->slots[job->slot];
+    if (job->gen == pf->gen && s->chunk == job->chunk && s->state == PF_SLOT_FETCHING) {
+        return s;
+    }
+    return NULL;
+}
+
+/* Copy a received block to its destination, return false if the job has been dropped meanwhile */
+static bool http_prefetch_commit(http_prefetch_handle_t pf, pf_job_t *job, const char *data, int len)
+{
+    bool alive = false;
+    mutex_lock(pf->lock);
+    if (job->type == PF_JOB_RANGE) {
+        pf_slot_t *s = http_prefetch_job_slot(pf, job);
+        if (pf->running && s) {
+            memcpy(pf->cache + job->slot * pf->cfg.chunk_size + s->filled, data, len);
+            s->filled += len;
+            /* Completed under the same lock as the copy, the reader may free the slot right after */
+            if (s->filled == s->len) {
+                s->state = PF_SLOT_DONE;
+            }
+            alive = true;
+        }
+    } else {
+        pf_segment_t *seg = http_prefetch_segment_find(pf, job->gen);
+        if (pf->running && seg && seg->state == PF_SLOT_FETCHING && seg->filled + len <= seg->len) {
+            memcpy(seg->data + seg->filled, data, len);
+            seg->filled += len;
+            alive = true;
+        }
+    }
+    xEventGroupSetBits(pf->events, PF_DATA_BIT);
+    mutex_unlock(pf->lock);
+    return alive;
+}
+
+static esp_err_t http_prefetch_fetch(pf_worker_t *w, pf_job_t *job)
+{
+    http_prefetch_handle_t pf = w->pf;
+    int64_t start_us = esp_timer_get_time();
+    int64_t content_len = 0;
+    esp_err_t err = http_prefetch_request(w, job, &content_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    int rtt_ms = (esp_timer_get_time() - start_us) / 1000;
+    int64_t remain = job->to >= 0 ? job->to - job->from + 1 : content_len;
+
+    if (job->type == PF_JOB_SEGMENT && job->from == 0) {
+        /* First request of a segment, size the buffer from the headers */
+        if (content_len <= 0 || content_len > pf->cfg.cache_size) {
+            ESP_LOGI(TAG, "Segment size %d not cacheable, skip %s", (int)content_len, w->url);
+            mutex_lock(pf->lock);
+            pf_segment_t *seg = http_prefetch_segment_find(pf, job->gen);
+            if (seg) {
+                seg->failed = true;
+            }
+            xEventGroupSetBits(pf->events, PF_DATA_BIT);
+            mutex_unlock(pf->lock);
+            esp_http_client_close(w->client);
+            return ESP_OK;
+        }
+        uint8_t *data = audio_calloc(1, content_len);
+        AUDIO_MEM_CHECK(TAG, data, return ESP_ERR_NO_MEM);
+        bool alive = false;
+        mutex_lock(pf->lock);
+        pf_segment_t *seg = http_prefetch_segment_find(pf, job->gen);
+        if (seg && seg->data == NULL) {
+            seg->data = data;
+            seg->len = content_len;
+            data = NULL;
+            alive = true;
+        } else if (seg) {
+            /* A retry before the first byte, the buffer is already there */
+            alive = seg->len == content_len;
+            seg->failed = !alive;
+        }
+        mutex_unlock(pf->lock);
+        audio_free(data);
+        if (!alive) {
+            esp_http_client_close(w->client);
+            return ESP_OK;
+        }
+    }
+
+    int received = 0;
+    while (remain > 0) {
+        int rlen = esp_http_client_read(w->client, w->bounce, remain > PF_BOUNCE_SIZE ? PF_BOUNCE_SIZE : remain);
+        if (rlen <= 0) {
+            return ESP_FAIL;
+        }
+        if (http_prefetch_commit(pf, job, w->bounce, rlen) == false) {
+            /* Dropped by a seek or a stop, the rest of the response is useless */
+            esp_http_client_close(w->client);
+            return ESP_OK;
+        }
+        remain -= rlen;
+        received += rlen;
+    }
+
+    int elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    mutex_lock(pf->lock);
+    if (job->type == PF_JOB_SEGMENT) {
+        pf_segment_t *seg = http_prefetch_segment_find(pf, job->gen);
+        if (seg) {
+            seg->state = PF_SLOT_DONE;
+        }
+    }
+    if (elapsed_ms > rtt_ms && received >= PF_BOUNCE_SIZE) {
+        int rate = (int64_t)received * 1000 / (elapsed_ms - rtt_ms);
+        pf->throughput = pf->throughput ? (pf->throughput * 7 + rate) / 8 : rate;
+    }
+    pf->rtt_ms = pf->rtt_ms ? (pf->rtt_ms * 7 + rtt_ms) / 8 : rtt_ms;
+    pf->stall_ms -= pf->stall_ms / 8;
+    http_prefetch_adapt(pf);
+    xEventGroupSetBits(pf->events, PF_DATA_BIT | PF_WORK_BIT);
+    mutex_unlock(pf->lock);
+    return ESP_OK;
+}
+
+static void http_prefetch_task(void *arg)
+{
+    pf_worker_t *w = (pf_worker_t *)arg;
+    http_prefetch_handle_t pf = w->pf;
+    const char *url = NULL;
+    pf_job_t job;
+
+    while (1) {
+        mutex_lock(pf->lock);
+        if (!pf->running) {
+            mutex_unlock(pf->lock);
+            break;
+        }
+        if (http_prefetch_claim(pf, &job, &url) == false) {
+            xEventGroupClearBits(pf->events, PF_WORK_BIT);
+            mutex_unlock(pf->lock);
+            xEventGroupWaitBits(pf->events, PF_WORK_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+            continue;
+        }
+        if (w->url == NULL || strcmp(w->url, url)) {
+            audio_free(w->url);
+            w->url = audio_strdup(url);
+        }
+        mutex_unlock(pf->lock);
+
+        esp_err_t err = w->url ? http_prefetch_fetch(w, &job) : ESP_ERR_NO_MEM;
+        if (err == ESP_OK) {
+            w->fails = 0;
+            continue;
+        }
+        /* Put the job back, the next attempt resumes from the bytes already received */
+        mutex_lock(pf->lock);
+        if (job.type == PF_JOB_RANGE) {
+            pf_slot_t *s = http_prefetch_job_slot(pf, &job);
+            if (s) {
+                s->state = PF_SLOT_PENDING;
+            }
+        } else {
+            pf_segment_t *seg = http_prefetch_segment_find(pf, job.gen);
+            if (seg && seg->state == PF_SLOT_FETCHING) {
+                seg->state = PF_SLOT_PENDING;
+            }
+        }
+        pf->retries++;
+        mutex_unlock(pf->lock);
+        if (w->client) {
+            esp_http_client_close(w->client);
+        }
+        int backoff = PF_BACKOFF_MIN_MS << (w->fails < 5 ? w->fails : 5);
+        w->fails++;
+        ESP_LOGW(TAG, "[%d] request failed(%d), retry in %d ms", w->id, err, backoff > PF_BACKOFF_MAX_MS ? PF_BACKOFF_MAX_MS : backoff);
+        vTaskDelay((backoff > PF_BACKOFF_MAX_MS ? PF_BACKOFF_MAX_MS : backoff) / portTICK_PERIOD_MS);
+    }
+
+    if (w->client) {
+        esp_http_client_close(w->client);
+        esp_http_client_cleanup(w->client);
+        w->client = NULL;
+    }
+    xEventGroupSetBits(pf->events, PF_EXIT_BIT(w->id));
+    audio_thread_delete_task(&w->thread);
+}
+
+static void http_prefetch_free(http_prefetch_handle_t pf)
+{
+    for (int i = 0; i < PF_MAX_CONN; i++) {
+        audio_free(pf->workers[i].bounce);
+        audio_free(pf->workers[i].url);
+    }
+    http_prefetch_segment_clear(&pf->seg);
+    http_prefetch_segment_clear(&pf->next);
+    audio_free(pf->url);
+    audio_free(pf->slots);
+    audio_free(pf->cache);
+    if (pf->events) {
+        vEventGroupDelete(pf->events);
+    }
+    if (pf->lock) {
+        mutex_destroy(pf->lock);
+    }
+    audio_free(pf);
+}
+
+http_prefetch_handle_t http_prefetch_create(http_prefetch_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_CHECK(TAG, cfg->conn_num > 0 && cfg->chunk_size > 0 && cfg->cache_size >= 2 * cfg->chunk_size,
+                return NULL, "Invalid prefetch configuration");
+    http_prefetch_handle_t pf = audio_calloc(1, sizeof(struct http_prefetch));
+    AUDIO_MEM_CHECK(TAG, pf, return NULL);
+    memcpy(&pf->cfg, cfg, sizeof(http_prefetch_cfg_t));
+    pf->worker_num = cfg->conn_num > PF_MAX_CONN ? PF_MAX_CONN : cfg->conn_num;
+    pf->slot_num = cfg->cache_size / cfg->chunk_size;
+    pf->target_chunks = pf->slot_num;
+    pf->lock = mutex_create();
+    pf->events = xEventGroupCreate();
+    pf->slots = audio_calloc(pf->slot_num, sizeof(pf_slot_t));
+    pf->cache = audio_calloc(pf->slot_num, cfg->chunk_size);
+    AUDIO_MEM_CHECK(TAG, pf->lock && pf->events && pf->slots && pf->cache, goto _failed);
+    for (int i = 0; i < pf->slot_num; i++) {
+        pf->slots[i].chunk = -1;
+    }
+
+    pf->running = true;
+    for (int i = 0; i < pf->worker_num; i++) {
+        pf_worker_t *w = &pf->workers[i];
+        w->pf = pf;
+        w->id = i;
+        w->bounce = audio_calloc(1, PF_BOUNCE_SIZE);
+        AUDIO_MEM_CHECK(TAG, w->bounce, goto _failed);
+        if (audio_thread_create(&w->thread, "http_prefetch", http_prefetch_task, w, cfg->task_stack,
+                                cfg->task_prio, cfg->stack_in_ext, cfg->task_core) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create prefetch task %d", i);
+            goto _failed;
+        }
+    }
+    ESP_LOGI(TAG, "Prefetch with %d connections, %d x %d bytes cache", pf->worker_num, pf->slot_num, cfg->chunk_size);
+    return pf;
+
+_failed:
+    if (pf->running) {
+        mutex_lock(pf->lock);
+        pf->running = false;
+        xEventGroupSetBits(pf->events, PF_WORK_BIT);
+        mutex_unlock(pf->lock);
+        for (int i = 0; i < pf->worker_num && pf->workers[i].thread; i++) {
+            xEventGroupWaitBits(pf->events, PF_EXIT_BIT(i), pdFALSE, pdTRUE, portMAX_DELAY);
+            audio_thread_cleanup(&pf->workers[i].thread);
+        }
+    }
+    http_prefetch_free(pf);
+    return NULL;
+}
+
+esp_err_t http_prefetch_destroy(http_prefetch_handle_t pf)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    EventBits_t exit_bits = 0;
+    mutex_lock(pf->lock);
+    pf->running = false;
+    pf->gen++;
+    xEventGroupSetBits(pf->events, PF_WORK_BIT);
+    mutex_unlock(pf->lock);
+    for (int i = 0; i < pf->worker_num; i++) {
+        exit_bits |= PF_EXIT_BIT(i);
+    }
+    xEventGroupWaitBits(pf->events, exit_bits, pdFALSE, pdTRUE, portMAX_DELAY);
+    for (int i = 0; i < pf->worker_num; i++) {
+        audio_thread_cleanup(&pf->workers[i].thread);
+    }
+    http_prefetch_free(pf);
+    return ESP_OK;
+}
+
+/* Must be called with the lock held */
+static void http_prefetch_reset(http_prefetch_handle_t pf)
+{
+    pf->gen++;
+    for (int i = 0; i < pf->slot_num; i++) {
+        pf->slots[i].chunk = -1;
+        pf->slots[i].state = PF_SLOT_FREE;
+    }
+    pf->rd_chunk = 0;
+    pf->rd_off = 0;
+    pf->chunk_num = 0;
+    pf->read_started = false;
+    pf->stall_since_us = 0;
+    pf->rate_since_us = 0;
+    pf->rate_bytes = 0;
+    http_prefetch_segment_clear(&pf->seg);
+    pf->src = PF_SRC_NONE;
+}
+
+esp_err_t http_prefetch_start(http_prefetch_handle_t pf, const char *url, int64_t start, int64_t end)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, url, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, start >= 0 && end > start, return ESP_ERR_INVALID_ARG, "Invalid range");
+    char *new_url = audio_strdup(url);
+    AUDIO_MEM_CHECK(TAG, new_url, return ESP_ERR_NO_MEM);
+
+    mutex_lock(pf->lock);
+    http_prefetch_reset(pf);
+    audio_free(pf->url);
+    pf->url = new_url;
+    pf->start = start;
+    pf->end = end;
+    pf->chunk_num = (end - start + pf->cfg.chunk_size - 1) / pf->cfg.chunk_size;
+    pf->src = PF_SRC_RANGE;
+    http_prefetch_adapt(pf);
+    xEventGroupSetBits(pf->events, PF_WORK_BIT);
+    mutex_unlock(pf->lock);
+    ESP_LOGD(TAG, "Start %s, %" PRId64 "-%" PRId64 " in %d chunks", url, start, end, (int)pf->chunk_num);
+    return ESP_OK;
+}
+
+esp_err_t http_prefetch_stop(http_prefetch_handle_t pf)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    mutex_lock(pf->lock);
+    http_prefetch_reset(pf);
+    http_prefetch_segment_clear(&pf->next);
+    mutex_unlock(pf->lock);
+    return ESP_OK;
+}
+
+esp_err_t http_prefetch_set_next(http_prefetch_handle_t pf, const char *url)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, url, return ESP_ERR_INVALID_ARG);
+    mutex_lock(pf->lock);
+    if (pf->next.url && strcmp(pf->next.url, url) == 0) {
+        mutex_unlock(pf->lock);
+        return ESP_OK;
+    }
+    http_prefetch_segment_clear(&pf->next);
+    pf->next.url = audio_strdup(url);
+    if (pf->next.url == NULL) {
+        mutex_unlock(pf->lock);
+        return ESP_ERR_NO_MEM;
+    }
+    pf->next.gen = ++pf->seg_gen ? pf->seg_gen : ++pf->seg_gen;
+    pf->next.state = PF_SLOT_PENDING;
+    xEventGroupSetBits(pf->events, PF_WORK_BIT);
+    mutex_unlock(pf->lock);
+    ESP_LOGD(TAG, "Next segment %s", url);
+    return ESP_OK;
+}
+
+esp_err_t http_prefetch_open_next(http_prefetch_handle_t pf, const char *url, int64_t *total)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, url, return ESP_ERR_INVALID_ARG);
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    mutex_lock(pf->lock);
+    if (pf->next.url && strcmp(pf->next.url, url) == 0 && pf->next.data && !pf->next.failed) {
+        http_prefetch_reset(pf);
+        pf->seg = pf->next;
+        memset(&pf->next, 0, sizeof(pf_segment_t));
+        pf->src = PF_SRC_SEGMENT;
+        if (total) {
+            *total = pf->seg.len;
+        }
+        xEventGroupSetBits(pf->events, PF_WORK_BIT);
+        ret = ESP_OK;
+        ESP_LOGI(TAG, "Play prefetched segment, %d/%d bytes ready", pf->seg.filled, pf->seg.len);
+    }
+    mutex_unlock(pf->lock);
+    return ret;
+}
+
+/* Must be called with the lock held, returns the readable span at the read position */
+static int http_prefetch_readable(http_prefetch_handle_t pf, uint8_t **ptr, bool *eof, bool *failed)
+{
+    *eof = false;
+    *failed = false;
+    if (pf->src == PF_SRC_SEGMENT) {
+        pf_segment_t *seg = &pf->seg;
+        *eof = seg->rd >= seg->len;
+        *failed = seg->failed;
+        *ptr = seg->data + seg->rd;
+        return seg->filled - seg->rd;
+    }
+    if (pf->src != PF_SRC_RANGE) {
+        *failed = true;
+        return 0;
+    }
+    if (pf->rd_chunk >= pf->chunk_num) {
+        *eof = true;
+        return 0;
+    }
+    int idx = pf->rd_chunk % pf->slot_num;
+    pf_slot_t *s = &pf->slots[idx];
+    if (s->chunk != pf->rd_chunk) {
+        return 0;
+    }
+    *ptr = pf->cache + idx * pf->cfg.chunk_size + pf->rd_off;
+    return s->filled - pf->rd_off;
+}
+
+/* Must be called with the lock held */
+static void http_prefetch_consume(http_prefetch_handle_t pf, int len)
+{
+    if (pf->src == PF_SRC_SEGMENT) {
+        pf->seg.rd += len;
+    } else {
+        pf->rd_off += len;
+        pf_slot_t *s = &pf->slots[pf->rd_chunk % pf->slot_num];
+        if (pf->rd_off == s->len) {
+            s->chunk = -1;
+            s->state = PF_SLOT_FREE;
+            pf->rd_chunk++;
+            pf->rd_off = 0;
+            xEventGroupSetBits(pf->events, PF_WORK_BIT);
+        }
+    }
+    int64_t now = esp_timer_get_time();
+    if (pf->stall_since_us) {
+        int stall_ms = (now - pf->stall_since_us) / 1000;
+        if (stall_ms > pf->stall_ms) {
+            pf->stall_ms = stall_ms;
+        }
+        pf->stall_since_us = 0;
+        pf->rate_stalled = true;
+    }
+    if (pf->rate_since_us == 0) {
+        pf->rate_since_us = now;
+        pf->rate_bytes = 0;
+        pf->rate_stalled = false;
+    }
+    pf->rate_bytes += len;
+    if (now - pf->rate_since_us >= PF_RATE_WINDOW_US) {
+        /* A window with a stall measures the network, not the consumer */
+        if (pf->rate_stalled == false) {
+            int rate = (int64_t)pf->rate_bytes * 1000000 / (now - pf->rate_since_us);
+            pf->consume_rate = pf->consume_rate ? (pf->consume_rate * 3 + rate) / 4 : rate;
+            http_prefetch_adapt(pf);
+        }
+        pf->rate_since_us = now;
+        pf->rate_bytes = 0;
+        pf->rate_stalled = false;
+    }
+    pf->read_started = true;
+}
+
+int http_prefetch_read(http_prefetch_handle_t pf, char *buf, int len, int timeout_ms)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return HTTP_PREFETCH_FAIL);
+    uint8_t *ptr = NULL;
+    bool eof = false;
+    bool failed = false;
+    mutex_lock(pf->lock);
+    int avail = http_prefetch_readable(pf, &ptr, &eof, &failed);
+    if (avail <= 0 && !eof && !failed) {
+        xEventGroupClearBits(pf->events, PF_DATA_BIT);
+        mutex_unlock(pf->lock);
+        xEventGroupWaitBits(pf->events, PF_DATA_BIT, pdFALSE, pdFALSE, timeout_ms / portTICK_PERIOD_MS);
+        mutex_lock(pf->lock);
+        avail = http_prefetch_readable(pf, &ptr, &eof, &failed);
+    }
+    if (avail <= 0) {
+        int ret = eof ? HTTP_PREFETCH_EOF : failed ? HTTP_PREFETCH_FAIL : HTTP_PREFETCH_TIMEOUT;
+        if (ret == HTTP_PREFETCH_TIMEOUT && pf->read_started && pf->stall_since_us == 0) {
+            pf->stall_since_us = esp_timer_get_time();
+            pf->stalls++;
+        }
+        mutex_unlock(pf->lock);
+        return ret;
+    }
+    mutex_unlock(pf->lock);
+
+    /* The span below `filled` is never written again until it is consumed, copy it unlocked */
+    int rlen = avail < len ? avail : len;
+    memcpy(buf, ptr, rlen);
+
+    mutex_lock(pf->lock);
+    http_prefetch_consume(pf, rlen);
+    mutex_unlock(pf->lock);
+    return rlen;
+}
+
+esp_err_t http_prefetch_get_stat(http_prefetch_handle_t pf, http_stream_prefetch_stat_t *stat)
+{
+    AUDIO_NULL_CHECK(TAG, pf, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, stat, return ESP_ERR_INVALID_ARG);
+    mutex_lock(pf->lock);
+    stat->buffered = http_prefetch_buffered(pf);
+    stat->target = pf->src == PF_SRC_SEGMENT ? pf->seg.len - pf->seg.rd : pf->target_chunks * pf->cfg.chunk_size;
+    if (pf->src == PF_SRC_RANGE) {
+        int64_t remain = pf->end - (pf->start + pf->rd_chunk * pf->cfg.chunk_size + pf->rd_off);
+        if (stat->target > remain) {
+            stat->target = remain > 0 ? remain : 0;
+        }
+    }
+    stat->throughput = pf->throughput;
+    stat->rtt_ms = pf->rtt_ms;
+    stat->consume_rate = pf->consume_rate;
+    stat->stalls = pf->stalls;
+    stat->retries = pf->retries;
+    mutex_unlock(pf->lock);
+    return ESP_OK;
+}
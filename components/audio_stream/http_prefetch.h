@@ -0,0 +1,172 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _HTTP_PREFETCH_H_
+#define _HTTP_PREFETCH_H_
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "http_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_PREFETCH_EOF      (0)
+#define HTTP_PREFETCH_FAIL     (-1)
+#define HTTP_PREFETCH_TIMEOUT  (-2)
+
+typedef struct http_prefetch *http_prefetch_handle_t;
+
+/**
+ * @brief      Called before each request issued by a prefetch connection, to add the user headers
+ */
+typedef esp_err_t (*http_prefetch_request_cb_t)(esp_http_client_handle_t client, void *ctx);
+
+/**
+ * @brief      HTTP prefetch configurations
+ */
+typedef struct {
+    int                         conn_num;           /*!< Number of parallel connections */
+    int                         chunk_size;         /*!< Size of each range request */
+    int                         cache_size;         /*!< Size of the cache, also the largest segment prefetched by `http_prefetch_set_next` */
+    int                         task_stack;         /*!< Stack size of each connection task */
+    int                         task_prio;          /*!< Priority of the connection tasks */
+    int                         task_core;          /*!< Core of the connection tasks */
+    bool                        stack_in_ext;       /*!< Try to allocate the stacks in external memory */
+    const char                  *cert_pem;          /*!< SSL server certification */
+    esp_err_t (*crt_bundle_attach)(void *conf);     /*!< Function pointer to esp_crt_bundle_attach */
+    http_prefetch_request_cb_t  on_request;         /*!< Request hook, may be NULL */
+    void                        *ctx;               /*!< Context of the request hook */
+} http_prefetch_cfg_t;
+
+/**
+ * @brief      Create the prefetch engine and its connection tasks, the connections stay idle until a job is started
+ *
+ * @param      cfg   The configuration
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The prefetch handle
+ */
+http_prefetch_handle_t http_prefetch_create(http_prefetch_cfg_t *cfg);
+
+/**
+ * @brief      Stop all jobs, wait for the connection tasks to exit and free the cache
+ *
+ * @param      pf    The prefetch handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t http_prefetch_destroy(http_prefetch_handle_t pf);
+
+/**
+ * @brief      Prefetch [start, end) of `url` with range requests, the reads are served from this job from now on
+ *
+ * @note       The server must support range requests. Data of the previous job and of the current segment are dropped.
+ *
+ * @param      pf     The prefetch handle
+ * @param      url    URL of the resource
+ * @param      start  First byte to read
+ * @param      end    Total size of the resource
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t http_prefetch_start(http_prefetch_handle_t pf, const char *url, int64_t start, int64_t end);
+
+/**
+ * @brief      Drop all jobs, including the next segment, the connections stay open for the next job
+ *
+ * @param      pf    The prefetch handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t http_prefetch_stop(http_prefetch_handle_t pf);
+
+/**
+ * @brief      Hint the URL played after the current one, it is fetched as a whole once the current job is fully requested
+ *
+ * @param      pf    The prefetch handle
+ * @param      url   URL of the next segment
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t http_prefetch_set_next(http_prefetch_handle_t pf, const char *url);
+
+/**
+ * @brief      Switch the reads to the next segment if it is the prefetched one
+ *
+ * @param      pf     The prefetch handle
+ * @param      url    URL about to be played
+ * @param[out] total  Size of the segment
+ *
+ * @return
+ *     - ESP_OK             The reads are served from the prefetched segment
+ *     - ESP_ERR_NOT_FOUND  The URL is not prefetched or its size is not known yet, open it normally
+ */
+esp_err_t http_prefetch_open_next(http_prefetch_handle_t pf, const char *url, int64_t *total);
+
+/**
+ * @brief      Read from the current job in order
+ *
+ * @param      pf          The prefetch handle
+ * @param      buf         The buffer to read out data
+ * @param      len         The length request
+ * @param      timeout_ms  Time to wait for data
+ *
+ * @return
+ *     - > 0                    Number of bytes read
+ *     - HTTP_PREFETCH_EOF      All the bytes of the job are read
+ *     - HTTP_PREFETCH_TIMEOUT  No data within `timeout_ms`
+ *     - HTTP_PREFETCH_FAIL     No job or the segment can't be fetched
+ */
+int http_prefetch_read(http_prefetch_handle_t pf, char *buf, int len, int timeout_ms);
+
+/**
+ * @brief      Get the buffer health and the measurements of the prefetch
+ *
+ * @param      pf    The prefetch handle
+ * @param[out] stat  The statistics
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t http_prefetch_get_stat(http_prefetch_handle_t pf, http_stream_prefetch_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,6 +36,7 @@
 #include "esp_log.h"
 #include "http_stream.h"
 #include "http_playlist.h"
+#include "http_prefetch.h"
 #include "audio_mem.h"
 #include "audio_element.h"
 #include "esp_system.h"
@@ -60,6 +61,8 @@ static const char *TAG = "HTTP_STREAM";
 #define MAX_PLAYLIST_LINE_SIZE (512)
 #define HTTP_STREAM_BUFFER_SIZE (2048)
 #define HTTP_MAX_CONNECT_TIMES  (5)
+#define HTTP_PREFETCH_WAIT_MS   (100)
+#define HTTP_PREFETCH_TIMEOUT_MS (30 * 1000)
 
 #define HLS_PREFER_BITRATE      (200*1024)
 #define HLS_KEY_CACHE_SIZE      (32)
@@ -97,6 +100,13 @@ typedef struct http_stream {
     gzip_miniz_handle_t             gzip;             /* GZIP instance */
     http_stream_hls_key_t           *hls_key;
     hls_handle_t                    *hls_media;
+    bool                            accept_ranges;     /* Server advertised `Accept-Ranges: bytes` */
+    uint32_t                        etag_id;           /* Digest of the `ETag` of the last response, 0 if none */
+    uint32_t                        modified_id;       /* Digest of the `Last-Modified` of the last response, 0 if none */
+    http_prefetch_cfg_t             prefetch_cfg;
+    http_prefetch_handle_t          prefetch;          /* Created on the first stream that can be prefetched */
+    bool                            prefetching;       /* Data comes from the prefetch cache, `client` is closed */
+    bool                            prefetch_low;
 } http_stream_t;
 
 static esp_err_t http_stream_auto_connect_next_track(audio_element_handle_t el);
@@ -148,6 +158,15 @@ static int _gzip_read_data(uint8_t *data, int size, void *ctx)
     return esp_http_client_read(http->client, (char *)data, size);
 }
 
+static uint32_t _http_header_digest(const char *value)
+{
+    uint32_t hash = 2166136261u;
+    while (*value) {
+        hash = (hash ^ (uint8_t)*value++) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
 static esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 {
     audio_element_handle_t el = (audio_element_handle_t)evt->user_data;
@@ -158,6 +177,18 @@ static esp_err_t _http_event_handle(esp_http_client_event_t *evt)
         ESP_LOGD(TAG, "%s = %s", evt->header_key, evt->header_value);
         audio_element_set_codec_fmt(el, get_audio_type(evt->header_value));
     }
+    else if (strcasecmp(evt->header_key, "Accept-Ranges") == 0) {
+        http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
+        http->accept_ranges = strcasecmp(evt->header_value, "bytes") == 0;
+    }
+    else if (strcasecmp(evt->header_key, "ETag") == 0) {
+        http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
+        http->etag_id = _http_header_digest(evt->header_value);
+    }
+    else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+        http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
+        http->modified_id = _http_header_digest(evt->header_value);
+    }
     else if (strcasecmp(evt->header_key, "Content-Encoding") == 0) {
         http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
         http->gzip_encoding = true;
@@ -194,6 +225,119 @@ static int dispatch_hook(audio_element_handle_t self, http_stream_event_id_t typ
     return ESP_OK;
 }
 
+static esp_err_t _http_prefetch_request(esp_http_client_handle_t client, void *ctx)
+{
+    audio_element_handle_t self = (audio_element_handle_t)ctx;
+    http_stream_t *http_stream = (http_stream_t *)audio_element_getdata(self);
+    http_stream_event_msg_t msg = {
+        .event_id = HTTP_STREAM_PRE_REQUEST,
+        .http_client = client,
+        .user_data = http_stream->user_data,
+        .el = self,
+    };
+    if (http_stream->hook) {
+        return http_stream->hook(&msg);
+    }
+    return ESP_OK;
+}
+
+static void _http_prefetch_next(http_stream_t *http)
+{
+    if (http->enable_playlist_parser && http->is_playlist_resolved) {
+        char *next = http_playlist_peek_next_track(http->playlist);
+        if (next) {
+            http_prefetch_set_next(http->prefetch, next);
+        }
+    }
+}
+
+static void _http_prefetch_stop(http_stream_t *http)
+{
+    if (http->prefetching) {
+        http_prefetch_stop(http->prefetch);
+        http->prefetching = false;
+    }
+}
+
+static bool _http_prefetch_open_next(audio_element_handle_t self, const char *uri)
+{
+    http_stream_t *http = (http_stream_t *)audio_element_getdata(self);
+    int64_t total_bytes = 0;
+    if (http->prefetch == NULL || http->hls_key) {
+        return false;
+    }
+    if (http_prefetch_open_next(http->prefetch, uri, &total_bytes) != ESP_OK) {
+        _http_prefetch_stop(http);
+        return false;
+    }
+    audio_element_set_total_bytes(self, total_bytes);
+    http->prefetching = true;
+    http->prefetch_low = true;
+    _http_prefetch_next(http);
+    return true;
+}
+
+static void _http_prefetch_start(audio_element_handle_t self, const char *uri, int64_t start, int64_t end)
+{
+    http_stream_t *http = (http_stream_t *)audio_element_getdata(self);
+    if (http->prefetch == NULL) {
+        http->prefetch_cfg.cert_pem = http->cert_pem;
+        http->prefetch = http_prefetch_create(&http->prefetch_cfg);
+        if (http->prefetch == NULL) {
+            ESP_LOGW(TAG, "Prefetch unavailable, keep the single connection");
+            http->prefetch_cfg.conn_num = 0;
+            return;
+        }
+    }
+    if (http_prefetch_start(http->prefetch, uri, start, end) != ESP_OK) {
+        return;
+    }
+    // The prefetch connections take over from here, release the socket
+    esp_http_client_close(http->client);
+    http->prefetching = true;
+    http->prefetch_low = true;
+    _http_prefetch_next(http);
+}
+
+static void _http_prefetch_report(audio_element_handle_t self, http_stream_t *http, bool stalled)
+{
+    http_stream_prefetch_stat_t stat;
+    if (http->hook == NULL || http_prefetch_get_stat(http->prefetch, &stat) != ESP_OK) {
+        return;
+    }
+    if (http->prefetch_low == false && (stalled || stat.buffered < stat.target / 4)) {
+        http->prefetch_low = true;
+        dispatch_hook(self, HTTP_STREAM_PREFETCH_LOW, &stat, sizeof(stat));
+    } else if (http->prefetch_low && !stalled && stat.buffered >= stat.target * 3 / 4) {
+        http->prefetch_low = false;
+        dispatch_hook(self, HTTP_STREAM_PREFETCH_HEALTHY, &stat, sizeof(stat));
+    }
+}
+
+static int _http_prefetch_read(audio_element_handle_t self, http_stream_t *http, char *buffer, int len)
+{
+    int waited_ms = 0;
+    while (1) {
+        int rlen = http_prefetch_read(http->prefetch, buffer, len, HTTP_PREFETCH_WAIT_MS);
+        _http_prefetch_report(self, http, rlen == HTTP_PREFETCH_TIMEOUT);
+        if (rlen == HTTP_PREFETCH_FAIL) {
+            http->_errno = EIO;
+        }
+        if (rlen != HTTP_PREFETCH_TIMEOUT) {
+            return rlen;
+        }
+        if (audio_element_is_stopping(self) == true) {
+            return AEL_IO_ABORT;
+        }
+        waited_ms += HTTP_PREFETCH_WAIT_MS;
+        if (waited_ms >= HTTP_PREFETCH_TIMEOUT_MS) {
+            ESP_LOGW(TAG, "Prefetch timeout");
+            http->_errno = ETIMEDOUT;
+            return ESP_FAIL;
+        }
+    }
+}
+
 static bool _is_playlist(audio_element_info_t *info, const char *uri)
 {
     if (info->codec_fmt == ESP_AUDIO_TYPE_M3U8 || info->codec_fmt == ESP_AUDIO_TYPE_PLS) {
@@ -426,6 +570,8 @@ static esp_err_t _http_open(audio_element_handle_t self)
         return ESP_OK;
     }
     http->_errno = 0;
+    http->etag_id = 0;
+    http->modified_id = 0;
     audio_element_getinfo(self, &info);
 _stream_open_begin:
     if (http->hls_key && http->hls_key->key_loaded == false) {
@@ -452,6 +598,11 @@ _stream_open_begin:
     }
     audio_element_getinfo(self, &info);
     ESP_LOGD(TAG, "URI=%s", uri);
+    if (info.byte_pos == 0 && http->stream_type == AUDIO_STREAM_READER && _http_prefetch_open_next(self, uri)) {
+        http->is_open = true;
+        audio_element_report_codec_fmt(self);
+        return ESP_OK;
+    }
     // if not initialize http client, initial it
     if (http->client == NULL) {
         esp_http_client_config_t http_cfg = {
@@ -498,6 +649,7 @@ _stream_open_begin:
     char *buffer = NULL;
     int post_len = esp_http_client_get_post_field(http->client, &buffer);
 _stream_redirect:
+    http->accept_ranges = false;
     if (http->gzip_encoding) {
         gzip_miniz_deinit(http->gzip);
         http->gzip = NULL;
@@ -585,6 +737,11 @@ _stream_redirect:
             }
         }
     }
+    // Encrypted and compressed streams are decoded in order, keep them on the single connection
+    if (http->prefetch_cfg.conn_num > 0 && http->hls_key == NULL && http->gzip_encoding == false
+        && info.total_bytes > info.byte_pos && (status_code == 206 || (status_code == 200 && info.byte_pos == 0 && http->accept_ranges))) {
+        _http_prefetch_start(self, uri, info.byte_pos, info.total_bytes);
+    }
     http->is_open = true;
     audio_element_report_codec_fmt(self);
     return ESP_OK;
@@ -616,6 +773,7 @@ static esp_err_t _http_close(audio_element_handle_t self)
         audio_element_report_pos(self);
         audio_element_set_byte_pos(self, 0);
     }
+    _http_prefetch_stop(http);
     _free_hls_key(http);
     if (http->hls_media) {
         hls_playlist_close(http->hls_media);
@@ -653,15 +811,20 @@ static int _http_read(audio_element_handle_t self, char *buffer, int len, TickTy
     int wrlen = dispatch_hook(self, HTTP_STREAM_ON_RESPONSE, buffer, len);
     int rlen = wrlen;
     if (rlen == 0) {
-        rlen = _http_read_data(http, buffer, len);
+        rlen = http->prefetching ? _http_prefetch_read(self, http, buffer, len) : _http_read_data(http, buffer, len);
+    }
+    if (rlen == AEL_IO_ABORT && http->prefetching) {
+        return rlen;
     }
     if (rlen <= 0 && http->auto_connect_next_track) {
         if (http_stream_auto_connect_next_track(self) == ESP_OK) {
-            rlen = _http_read_data(http, buffer, len);
+            rlen = http->prefetching ? _http_prefetch_read(self, http, buffer, len) : _http_read_data(http, buffer, len);
         }
     }
     if (rlen <= 0) {
-        http->_errno = esp_http_client_get_errno(http->client);
+        if (http->prefetching == false) {
+            http->_errno = esp_http_client_get_errno(http->client);
+        }
         ESP_LOGW(TAG, "No more data,errno:%d, total_bytes:%llu, rlen = %d", http->_errno, info.byte_pos, rlen);
         if (http->_errno != 0) {  // Error occuered, reset connection
             ESP_LOGW(TAG, "Got %d errno(%s)", http->_errno, strerror(http->_errno));
@@ -773,6 +936,9 @@ static int _http_process(audio_element_handle_t self, char *in_buffer, int in_le
 static esp_err_t _http_destroy(audio_element_handle_t self)
 {
     http_stream_t *http = (http_stream_t *)audio_element_getdata(self);
+    if (http->prefetch) {
+        http_prefetch_destroy(http->prefetch);
+    }
     if (http->playlist) {
         audio_free(http->playlist->data);
         audio_free(http->playlist);
@@ -836,6 +1002,20 @@ audio_element_handle_t http_stream_init(http_stream_cfg_t *config)
         STAILQ_INIT(&http->playlist->tracks);
     }
 
+    if (config->type == AUDIO_STREAM_READER && config->prefetch_conn_num > 0) {
+        http->prefetch_cfg.conn_num = config->prefetch_conn_num;
+        http->prefetch_cfg.chunk_size = config->prefetch_chunk_size > 0 ? config->prefetch_chunk_size : HTTP_STREAM_PREFETCH_CHUNK_SIZE;
+        http->prefetch_cfg.cache_size = config->prefetch_cache_size > 0 ? config->prefetch_cache_size : HTTP_STREAM_PREFETCH_CACHE_SIZE;
+        http->prefetch_cfg.task_stack = config->task_stack > 0 ? config->task_stack : HTTP_STREAM_TASK_STACK;
+        http->prefetch_cfg.task_prio = config->task_prio;
+        http->prefetch_cfg.task_core = config->task_core;
+        http->prefetch_cfg.stack_in_ext = config->stack_in_ext;
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
+        http->prefetch_cfg.crt_bundle_attach = http->crt_bundle_attach;
+#endif
+        http->prefetch_cfg.on_request = _http_prefetch_request;
+    }
+
     if (config->type == AUDIO_STREAM_READER) {
         cfg.read = _http_read;
     } else if (config->type == AUDIO_STREAM_WRITER) {
@@ -849,6 +1029,7 @@ audio_element_handle_t http_stream_init(http_stream_cfg_t *config)
         return NULL;
     });
     audio_element_setdata(el, http);
+    http->prefetch_cfg.ctx = el;
     return el;
 }
 
@@ -878,6 +1059,9 @@ esp_err_t http_stream_auto_connect_next_track(audio_element_handle_t el)
     http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
     char *track = _playlist_get_next_track(el);
     if (track) {
+        if (_http_prefetch_open_next(el, track)) {
+            return ESP_OK;
+        }
         esp_http_client_set_url(http->client, track);
         char *buffer = NULL;
         int post_len = esp_http_client_get_post_field(http->client, &buffer);
@@ -929,3 +1113,21 @@ esp_err_t http_stream_set_server_cert(audio_element_handle_t el, const char *cer
     http->cert_pem = cert;
     return ESP_OK;
 }
+
+esp_err_t http_stream_get_prefetch_stat(audio_element_handle_t el, http_stream_prefetch_stat_t *stat)
+{
+    AUDIO_NULL_CHECK(TAG, el, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, stat, return ESP_ERR_INVALID_ARG);
+    http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
+    if (http->prefetch == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return http_prefetch_get_stat(http->prefetch, stat);
+}
+
+uint32_t http_stream_get_content_id(audio_element_handle_t el)
+{
+    AUDIO_NULL_CHECK(TAG, el, return 0);
+    http_stream_t *http = (http_stream_t *)audio_element_getdata(el);
+    return http->etag_id ? http->etag_id : http->modified_id;
+}
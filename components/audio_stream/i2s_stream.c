@@ -226,12 +226,12 @@ static int _i2s_read(audio_element_handle_t self, char *buffer, int len, TickTyp
     i2s_stream_t *i2s = (i2s_stream_t *)audio_element_getdata(self);
     size_t bytes_read = 0;
     i2s_read(i2s->config.i2s_port, buffer, len, &bytes_read, ticks_to_wait);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
+    audio_element_format_t fmt;
+    audio_element_get_format(self, &fmt);
     if (bytes_read > 0) {
 #ifdef CONFIG_IDF_TARGET_ESP32
-        if (info.channels == 1) {
-            i2s_mono_fix(info.bits, (uint8_t *)buffer, bytes_read);
+        if (fmt.channels == 1) {
+            i2s_mono_fix(fmt.bits, (uint8_t *)buffer, bytes_read);
         }
 #endif
     }
@@ -242,19 +242,19 @@ static int _i2s_write(audio_element_handle_t self, char *buffer, int len, TickTy
 {
     i2s_stream_t *i2s = (i2s_stream_t *)audio_element_getdata(self);
     size_t bytes_written = 0;
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
-    int target_bits = info.bits;
+    audio_element_format_t fmt;
+    audio_element_get_format(self, &fmt);
+    int target_bits = fmt.bits;
     if (len > 0) {
 #ifdef CONFIG_IDF_TARGET_ESP32
         target_bits = I2S_BITS_PER_SAMPLE_32BIT;
-        if (info.channels == 1) {
-            i2s_mono_fix(info.bits, (uint8_t *)buffer, len);
+        if (fmt.channels == 1) {
+            i2s_mono_fix(fmt.bits, (uint8_t *)buffer, len);
         }
 #endif
 #if SOC_I2S_SUPPORTS_ADC_DAC
         if ((i2s->config.i2s_config.mode & I2S_MODE_DAC_BUILT_IN) != 0) {
-            i2s_dac_data_scale(info.bits, (uint8_t *)buffer, len);
+            i2s_dac_data_scale(fmt.bits, (uint8_t *)buffer, len);
         }
 #endif
     }
@@ -281,7 +281,6 @@ static int _i2s_process(audio_element_handle_t self, char *in_buffer, int in_len
     int r_size = audio_element_input(self, in_buffer, in_len);
     int w_size = 0;
     i2s_stream_t *i2s = (i2s_stream_t *)audio_element_getdata(self);
-    audio_element_info_t i2s_info = {0};
     if (r_size == AEL_IO_TIMEOUT) {
 #if SOC_I2S_SUPPORTS_ADC_DAC
         if ((i2s->config.i2s_config.mode & I2S_MODE_DAC_BUILT_IN) != 0) {
@@ -296,8 +295,9 @@ static int _i2s_process(audio_element_handle_t self, char *in_buffer, int in_len
         w_size = audio_element_output(self, in_buffer, r_size);
     } else if (r_size > 0) {
         if (i2s->use_alc) {
-            audio_element_getinfo(self, &i2s_info);
-            alc_volume_setup_process(in_buffer, r_size, i2s_info.channels, i2s->volume_handle, i2s->volume);
+            audio_element_format_t fmt;
+            audio_element_get_format(self, &fmt);
+            alc_volume_setup_process(in_buffer, r_size, fmt.channels, i2s->volume_handle, i2s->volume);
         }
         audio_element_multi_output(self, in_buffer, r_size, 0);
         w_size = audio_element_output(self, in_buffer, r_size);
@@ -45,6 +45,15 @@ typedef struct {
     int                     task_prio;      /*!< Task priority (based on freeRTOS priority) */
     bool                    ext_stack;      /*!< Allocate stack on extern ram */
     bool                    write_header;   /*!< Choose to write amrnb/amrwb header in fatfs whether or not (true or false, true means choose to write amrnb header) */
+    int                     write_behind_size;  /*!< Writer only, size of the write-behind staging buffer flushed by a background task.
+                                                     0 keeps the legacy mode that writes and fsyncs every element buffer */
+    int                     cluster_size;       /*!< Write-behind flush and read-ahead block granularity, set it to the FAT cluster size (allocation unit) of the card */
+    int                     sync_interval_ms;   /*!< Write-behind durability, longest time data may stay unsynced, 0 to only sync on close or `fatfs_stream_sync` */
+    int                     sync_bytes;         /*!< Write-behind durability, fsync after this many bytes, 0 to disable */
+    int                     prealloc_size;      /*!< Write-behind only, expected file size pre-allocated on open and trimmed on close, 0 to disable */
+    int                     read_ahead_blocks;  /*!< Reader only, number of `cluster_size` blocks cached by a background read task.
+                                                     The read-ahead depth adapts to the card latency and the consumer rate, and reopening
+                                                     the same file after a seek reuses the cached blocks. 0 keeps the legacy synchronous reads, otherwise at least 2 */
 } fatfs_stream_cfg_t;
 
 
@@ -53,6 +62,10 @@ typedef struct {
 #define FATFS_STREAM_TASK_CORE           (0)
 #define FATFS_STREAM_TASK_PRIO           (4)
 #define FATFS_STREAM_RINGBUFFER_SIZE     (8 * 1024)
+#define FATFS_STREAM_WRITE_BEHIND_SIZE   (0)
+#define FATFS_STREAM_CLUSTER_SIZE        (16 * 1024)
+#define FATFS_STREAM_SYNC_INTERVAL_MS    (1000)
+#define FATFS_STREAM_READ_AHEAD_BLOCKS   (0)
 
 #define FATFS_STREAM_CFG_DEFAULT() {             \
     .type = AUDIO_STREAM_NONE,                   \
@@ -63,6 +76,12 @@ typedef struct {
     .task_prio = FATFS_STREAM_TASK_PRIO,         \
     .ext_stack = false,                          \
     .write_header = true,                        \
+    .write_behind_size = FATFS_STREAM_WRITE_BEHIND_SIZE,    \
+    .cluster_size = FATFS_STREAM_CLUSTER_SIZE,              \
+    .sync_interval_ms = FATFS_STREAM_SYNC_INTERVAL_MS,      \
+    .sync_bytes = 0,                                        \
+    .prealloc_size = 0,                                     \
+    .read_ahead_blocks = FATFS_STREAM_READ_AHEAD_BLOCKS,    \
 }
 
 /**
@@ -76,6 +95,18 @@ typedef struct {
  */
 audio_element_handle_t fatfs_stream_init(fatfs_stream_cfg_t *config);
 
+/**
+ * @brief      Flush all the data written so far to the card and fsync, blocking until done.
+ *             Call it from a task on a power-fail warning to keep the recording up to that point.
+ *
+ * @param      el    The fatfs_stream writer handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t fatfs_stream_sync(audio_element_handle_t el);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,7 +37,9 @@ extern "C" {
  * @brief      HTTP Stream hook type
  */
 typedef enum {
-    HTTP_STREAM_PRE_REQUEST = 0x01, /*!< The event handler will be called before HTTP Client making the connection to the server */
+    HTTP_STREAM_PRE_REQUEST = 0x01, /*!< The event handler will be called before HTTP Client making the connection to the server,
+                                     * with prefetch enabled it is also called before every range request of the prefetch connections,
+                                     * `http_client` then refers to the prefetch connection */
     HTTP_STREAM_ON_REQUEST,         /*!< The event handler will be called when HTTP Client is requesting data,
                                      * If the fucntion return the value (-1: ESP_FAIL), HTTP Client will be stopped
                                      * If the fucntion return the value > 0, HTTP Stream will ignore the post_field
@@ -53,8 +55,25 @@ typedef enum {
     HTTP_STREAM_RESOLVE_ALL_TRACKS,
     HTTP_STREAM_FINISH_TRACK,
     HTTP_STREAM_FINISH_PLAYLIST,
+    HTTP_STREAM_PREFETCH_LOW,       /*!< The prefetched data dropped below a quarter of the target depth or the reader stalled,
+                                     * `buffer` points to a `http_stream_prefetch_stat_t` */
+    HTTP_STREAM_PREFETCH_HEALTHY,   /*!< The prefetched data is back above three quarters of the target depth,
+                                     * `buffer` points to a `http_stream_prefetch_stat_t` */
 } http_stream_event_id_t;
 
+/**
+ * @brief      HTTP Stream prefetch statistics
+ */
+typedef struct {
+    int                     buffered;       /*!< Bytes fetched ahead of the read position */
+    int                     target;         /*!< Current adaptive prefetch depth in bytes */
+    int                     throughput;     /*!< Smoothed download throughput of one connection, in bytes per second */
+    int                     rtt_ms;         /*!< Smoothed time to the response headers, in milliseconds */
+    int                     consume_rate;   /*!< Smoothed rate at which the element reads, in bytes per second */
+    uint32_t                stalls;         /*!< Number of times the reader had to wait for data */
+    uint32_t                retries;        /*!< Number of failed range requests that were retried */
+} http_stream_prefetch_stat_t;
+
 /**
  * @brief      Stream event message
  */
@@ -88,6 +107,9 @@ typedef struct {
     const char                  *cert_pem;              /*!< SSL server certification, PEM format as string, if the client requires to verify server */
     esp_err_t (*crt_bundle_attach)(void *conf);       /*!< Function pointer to esp_crt_bundle_attach. Enables the use of certification
                                                           bundle for server verification, must be enabled in menuconfig */
+    int                         prefetch_conn_num;      /*!< Number of parallel range connections used to prefetch a reader stream, 0 to disable (max 4) */
+    int                         prefetch_chunk_size;    /*!< Size of one range request */
+    int                         prefetch_cache_size;    /*!< Size of the prefetch cache, at least two chunks */
 } http_stream_cfg_t;
 
 
@@ -95,6 +117,9 @@ typedef struct {
 #define HTTP_STREAM_TASK_CORE           (0)
 #define HTTP_STREAM_TASK_PRIO           (4)
 #define HTTP_STREAM_RINGBUFFER_SIZE     (20 * 1024)
+#define HTTP_STREAM_PREFETCH_CONN_NUM   (0)
+#define HTTP_STREAM_PREFETCH_CHUNK_SIZE (32 * 1024)
+#define HTTP_STREAM_PREFETCH_CACHE_SIZE (256 * 1024)
 
 #define HTTP_STREAM_CFG_DEFAULT() {              \
     .type = AUDIO_STREAM_READER,                 \
@@ -110,6 +135,9 @@ typedef struct {
     .multi_out_num = 0,                          \
     .cert_pem  = NULL,                           \
     .crt_bundle_attach = NULL,                   \
+    .prefetch_conn_num = HTTP_STREAM_PREFETCH_CONN_NUM,     \
+    .prefetch_chunk_size = HTTP_STREAM_PREFETCH_CHUNK_SIZE, \
+    .prefetch_cache_size = HTTP_STREAM_PREFETCH_CACHE_SIZE, \
 }
 
 /**
@@ -163,6 +191,31 @@ esp_err_t http_stream_fetch_again(audio_element_handle_t el);
  */
 esp_err_t http_stream_set_server_cert(audio_element_handle_t el, const char *cert);
 
+/**
+ * @brief       Get the statistics of the parallel range prefetch
+ *
+ * @param       el    The http_stream element handle
+ * @param[out]  stat  The statistics
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_ARG if the arguments are invalid
+ *     - ESP_ERR_INVALID_STATE if prefetch is disabled or not yet started
+ */
+esp_err_t http_stream_get_prefetch_stat(audio_element_handle_t el, http_stream_prefetch_stat_t *stat);
+
+/**
+ * @brief       Get a digest of the validator sent with the last response, its `ETag` or else its `Last-Modified`
+ *
+ * @note        It changes when the resource is republished, e.g. to check a partial download of it can be resumed.
+ *              A stream opened through the prefetch connections has none.
+ *
+ * @param       el    The http_stream element handle
+ *
+ * @return      The digest, 0 if the server sent neither header
+ */
+uint32_t http_stream_get_content_id(audio_element_handle_t el);
+
 #ifdef __cplusplus
 }
 #endif
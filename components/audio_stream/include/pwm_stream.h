@@ -46,7 +46,7 @@ typedef struct
     ledc_channel_t      ledc_channel_right;   /*!< LEDC channel (0 - 7), Corresponding to right channel*/
     ledc_timer_t        ledc_timer_sel;       /*!< Select the timer source of channel (0 - 3) */
     ledc_timer_bit_t    duty_resolution;      /*!< ledc pwm bits */
-    uint32_t            data_len;             /*!< ringbuffer size */
+    uint32_t            data_len;             /*!< ringbuffer size in bytes, one 4-byte word per frame (rounded down to a power of two) */
 
 } audio_pwm_config_t;
 
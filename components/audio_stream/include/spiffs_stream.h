@@ -44,6 +44,10 @@ typedef struct {
     int                     task_core;      /*!< Task running in core (0 or 1) */
     int                     task_prio;      /*!< Task priority (based on freeRTOS priority) */
     bool                    write_header;   /*!< Choose to write amrnb/armwb header in spiffs whether or not (true or false, true means choose to write amrnb header) */
+    int                     write_behind_size;  /*!< Writer only, size of the write-behind staging buffer flushed by a background task.
+                                                     0 keeps the legacy mode that writes and fsyncs every element buffer */
+    int                     sync_interval_ms;   /*!< Write-behind durability, longest time data may stay unsynced, 0 to only sync on close or `spiffs_stream_sync` */
+    int                     sync_bytes;         /*!< Write-behind durability, fsync after this many bytes, 0 to disable */
 } spiffs_stream_cfg_t;
 
 #define SPIFFS_STREAM_BUF_SIZE            (4096)
@@ -51,6 +55,8 @@ typedef struct {
 #define SPIFFS_STREAM_TASK_CORE           (0)
 #define SPIFFS_STREAM_TASK_PRIO           (4)
 #define SPIFFS_STREAM_RINGBUFFER_SIZE     (8 * 1024)
+#define SPIFFS_STREAM_WRITE_BEHIND_SIZE   (0)
+#define SPIFFS_STREAM_SYNC_INTERVAL_MS    (1000)
 
 #define SPIFFS_STREAM_CFG_DEFAULT() {             \
     .type = AUDIO_STREAM_NONE,                    \
@@ -60,6 +66,9 @@ typedef struct {
     .task_core = SPIFFS_STREAM_TASK_CORE,         \
     .task_prio = SPIFFS_STREAM_TASK_PRIO,         \
     .write_header = true,                         \
+    .write_behind_size = SPIFFS_STREAM_WRITE_BEHIND_SIZE, \
+    .sync_interval_ms = SPIFFS_STREAM_SYNC_INTERVAL_MS,   \
+    .sync_bytes = 0,                                      \
 }
 
 /**
@@ -73,6 +82,18 @@ typedef struct {
  */
 audio_element_handle_t spiffs_stream_init(spiffs_stream_cfg_t *config);
 
+/**
+ * @brief      Flush all the data written so far to the flash and fsync, blocking until done.
+ *             Call it from a task on a power-fail warning to keep the recording up to that point.
+ *
+ * @param      el    The spiffs_stream writer handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t spiffs_stream_sync(audio_element_handle_t el);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,9 @@ typedef struct
     const char *label;        /*!< Label of tone stored in flash. The default value is `flash_tone`*/
     bool extern_stack;        /*!< Task stack allocate on the extern ram */
     bool use_delegate;        /*!< Read tone partition with esp_delegate. If task stack is on extern ram, this MUST be TRUE */
+    bool use_mmap;            /*!< Map tone partition once and read tones from the mapping, falls back to esp_delegate reads if mapping fails.
+                                   It goes through the esp_delegate task even if `use_delegate` is false, creating that task on first use,
+                                   and the whole partition stays mapped into the MMU data space until the stream is destroyed */
 } tone_stream_cfg_t;
 
 #define TONE_STREAM_BUF_SIZE        (4096)
@@ -55,6 +58,7 @@ typedef struct
 #define TONE_STREAM_RINGBUFFER_SIZE (2 * 1024)
 #define TONE_STREAM_EXT_STACK       (false)
 #define TONE_STREAM_USE_DELEGATE    (false)
+#define TONE_STREAM_USE_MMAP        (false)
 
 #define TONE_STREAM_CFG_DEFAULT()               \
 {                                               \
@@ -67,6 +71,7 @@ typedef struct
     .label        = "flash_tone",               \
     .extern_stack = TONE_STREAM_EXT_STACK,      \
     .use_delegate = TONE_STREAM_USE_DELEGATE,   \
+    .use_mmap     = TONE_STREAM_USE_MMAP,       \
 }
 
 /**
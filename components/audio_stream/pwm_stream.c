@@ -49,11 +49,16 @@ static const char *TAG = "PWM_STREAM";
 #define CHANNEL_RIGHT_MASK  (0x02)
 #define AUDIO_PWM_CH_MAX (2)
 
+/*
+ * Ring of ready-to-use frames, one word each: left duty in the low half, right duty in the high half.
+ * The writer converts whole blocks into it, so the timer ISR only loads one word per sample period.
+ */
 typedef struct {
-    char *buf;                         /**< Original pointer */
+    uint32_t *buf;                     /**< Original pointer */
     uint32_t volatile head;            /**< ending pointer */
     uint32_t volatile tail;            /**< Read pointer */
-    uint32_t size;                     /**< Buffer size */
+    uint32_t mask;                     /**< Number of frames minus one, the size is a power of two */
+    uint32_t wakeup;                   /**< Free frames at which the writer is woken up */
     uint32_t is_give;                  /**< semaphore give flag */
     SemaphoreHandle_t semaphore;       /**< Semaphore for data */
 } data_list_t;
@@ -116,11 +121,15 @@ static pwm_data_handle_t pwm_data_list_create(int size)
         ESP_LOGE(TAG, "Invalid buffer size, Minimum = %d", (int32_t)(BUFFER_MIN_SIZE << 2));
         return NULL;
     }
+    uint32_t frames = BUFFER_MIN_SIZE;
+    while ((frames << 1) * sizeof(uint32_t) <= (uint32_t)size) {
+        frames <<= 1;
+    }
 
     pwm_data_handle_t data = heap_caps_calloc(1, sizeof(data_list_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     AUDIO_NULL_CHECK(TAG, data, goto data_error);
 
-    data->buf = heap_caps_calloc(1, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    data->buf = heap_caps_calloc(frames, sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     AUDIO_NULL_CHECK(TAG, data->buf, goto data_error);
 
     data->semaphore = xSemaphoreCreateBinary();
@@ -128,10 +137,14 @@ static pwm_data_handle_t pwm_data_list_create(int size)
 
     data->is_give = 0;
     data->head = data->tail = 0;
-    data->size = size;
+    data->mask = frames - 1;
+    data->wakeup = frames >> 2;
     return data;
 
 data_error:
+    if (data == NULL) {
+        return NULL;
+    }
     if (data->semaphore != NULL) {
         vSemaphoreDelete(data->semaphore);
         data->semaphore = NULL;
@@ -140,25 +153,18 @@ data_error:
         audio_free(data->buf);
         data->buf = NULL;
     }
-    if (data) {
-        audio_free(data);
-        data = NULL;
-    }
+    audio_free(data);
     return NULL;
 }
 
-static uint32_t IRAM_ATTR pwm_data_list_get_count(pwm_data_handle_t data)
+static inline uint32_t IRAM_ATTR pwm_data_list_get_count(pwm_data_handle_t data)
 {
-    uint32_t tail = data->tail;
-    if (data->head >= tail) {
-        return (data->head - tail);
-    }
-    return (data->size - (tail - data->head));
+    return (data->head - data->tail) & data->mask;
 }
 
-static uint32_t IRAM_ATTR pwm_data_list_get_free(pwm_data_handle_t data)
+static inline uint32_t IRAM_ATTR pwm_data_list_get_free(pwm_data_handle_t data)
 {
-    return (data->size - pwm_data_list_get_count(data) - 1);
+    return data->mask - pwm_data_list_get_count(data);
 }
 
 static esp_err_t pwm_data_list_flush(pwm_data_handle_t data)
@@ -167,36 +173,6 @@ static esp_err_t pwm_data_list_flush(pwm_data_handle_t data)
     return ESP_OK;
 }
 
-static esp_err_t IRAM_ATTR pwm_data_list_read_byte(pwm_data_handle_t data, uint8_t *outdata)
-{
-    uint32_t tail = data->tail;
-    if ((tail == data->head) || (tail == (data->head + 1))) {
-        return ESP_FAIL;
-    }
-    *outdata = data->buf[tail];
-    tail++;
-    if (tail == data->size) {
-        tail = 0;
-    }
-
-    data->tail = tail;
-    return ESP_OK;
-}
-
-static esp_err_t pwm_data_list_write_byte(pwm_data_handle_t data, const uint8_t indata)
-{
-    uint32_t next_head = data->head + 1;
-    if (next_head == data->size) {
-        next_head = 0;
-    }
-    if (next_head == data->tail) {
-        return ESP_FAIL;
-    }
-    data->buf[data->head] = indata;
-    data->head = next_head;
-    return ESP_OK;
-}
-
 static esp_err_t pwm_data_list_wait_semaphore(pwm_data_handle_t data, TickType_t ticks_to_wait)
 {
     data->is_give = 0;
@@ -206,14 +182,14 @@ static esp_err_t pwm_data_list_wait_semaphore(pwm_data_handle_t data, TickType_t
     return ESP_FAIL;
 }
 
-static inline void ledc_set_left_duty_fast(uint32_t duty_val)
+static inline void IRAM_ATTR ledc_set_left_duty_fast(uint32_t duty_val)
 {
     *g_ledc_left_duty_val = (duty_val) << 4;
     *g_ledc_left_conf0_val |= 0x00000014;
     *g_ledc_left_conf1_val |= 0x80000000;
 }
 
-static inline void ledc_set_right_duty_fast(uint32_t duty_val)
+static inline void IRAM_ATTR ledc_set_right_duty_fast(uint32_t duty_val)
 {
     *g_ledc_right_duty_val = (duty_val) << 4;
     *g_ledc_right_conf0_val |= 0x00000014;
@@ -252,59 +228,23 @@ static void IRAM_ATTR timer_group_isr(void *para)
     handle->timg_dev->hw_timer[handle->config.timer_num].config.tn_alarm_en = TIMER_ALARM_EN;
 #endif
 
-    static uint8_t wave_h, wave_l;
-    static uint16_t value;
-
-    if (handle->channel_mask & CHANNEL_LEFT_MASK) {
-        if (handle->config.duty_resolution > 8) {
-            pwm_data_list_read_byte(handle->data, &wave_l);
-            if (ESP_OK == pwm_data_list_read_byte(handle->data, &wave_h)) {
-                value = ((wave_h << 8) | wave_l);
-                ledc_set_left_duty_fast(value);
-            }
-        } else {
-            if (ESP_OK == pwm_data_list_read_byte(handle->data, &wave_h)) {
-                ledc_set_left_duty_fast(wave_h);
-            }
-        }
-    }
-
-    if (handle->channel_mask & CHANNEL_RIGHT_MASK) {
-        if (handle->channel_set_num == 1) {
-            if (handle->config.duty_resolution > 8) {
-                ledc_set_right_duty_fast(value);
-            } else {
-                ledc_set_right_duty_fast(wave_h);
-            }
-        } else {
-            if (handle->config.duty_resolution > 8) {
-                pwm_data_list_read_byte(handle->data, &wave_l);
-                if (ESP_OK == pwm_data_list_read_byte(handle->data, &wave_h)) {
-                    value = ((wave_h << 8) | wave_l);
-                    ledc_set_right_duty_fast(value);
-                }
-            } else {
-                if (ESP_OK == pwm_data_list_read_byte(handle->data, &wave_h)) {
-                    ledc_set_right_duty_fast(wave_h);
-                }
-            }
+    pwm_data_handle_t data = handle->data;
+    uint32_t tail = data->tail;
+    if (tail != data->head) {
+        uint32_t frame = data->buf[tail];
+        data->tail = (tail + 1) & data->mask;
+        if (handle->channel_mask & CHANNEL_LEFT_MASK) {
+            ledc_set_left_duty_fast(frame & 0xffff);
         }
-    } else {
-        if (handle->channel_set_num == 2) {
-            if (handle->config.duty_resolution > 8) {
-                pwm_data_list_read_byte(handle->data, &wave_h);
-                pwm_data_list_read_byte(handle->data, &wave_h);
-            } else {
-                pwm_data_list_read_byte(handle->data, &wave_h);
-            }
-            pwm_data_list_read_byte(handle->data, &wave_l);
+        if (handle->channel_mask & CHANNEL_RIGHT_MASK) {
+            ledc_set_right_duty_fast(frame >> 16);
         }
     }
 
-    if (0 == handle->data->is_give && pwm_data_list_get_free(handle->data) > BUFFER_MIN_SIZE) {
-        handle->data->is_give = 1;
-        BaseType_t xHigherPriorityTaskWoken;
-        xSemaphoreGiveFromISR(handle->data->semaphore, &xHigherPriorityTaskWoken);
+    if (0 == data->is_give && pwm_data_list_get_free(data) >= data->wakeup) {
+        data->is_give = 1;
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xSemaphoreGiveFromISR(data->semaphore, &xHigherPriorityTaskWoken);
         if (pdFALSE != xHigherPriorityTaskWoken) {
             portYIELD_FROM_ISR();
         }
@@ -466,89 +406,109 @@ esp_err_t audio_pwm_set_sample_rate(int rate)
     return res;
 }
 
-static esp_err_t pwm_data_convert(pwm_data_handle_t data, uint8_t *inbuf, int32_t bits_per, int32_t duty, uint32_t bytes)
+/*
+ * Sample to duty conversion for one block: the signed sample is turned into offset binary by
+ * flipping its sign bit and the top `duty` bits are kept. 16-bit stereo frames are converted
+ * as one word, both lanes at once (the right lane shifts into place, the left lane is masked).
+ */
+static void pwm_data_convert(uint32_t *dst, const uint8_t *src, uint32_t frames, int32_t bits_per, int32_t ch, int32_t duty)
 {
-    int8_t shift = bits_per - duty;
-    uint32_t len = bytes;
-
-    if (bits_per == 16) {
-        len >>= 1;
-        uint16_t *buf_16b = (uint16_t *)inbuf;
-        uint16_t value;
-        int16_t temp;
-        if (duty > 8) {
-            for (size_t i = 0; i < len; i++) {
-                temp = buf_16b[i];
-                value = temp + 0x7fff;
-                value >>= shift;
-                pwm_data_list_write_byte(data, value);
-                pwm_data_list_write_byte(data, value >> 8);
+    uint32_t shift = bits_per - duty;
+    uint32_t lane = 0xffffUL >> shift;
+
+    if (bits_per == 16 && ch == 2 && ((uintptr_t)src & 3) == 0) {
+        const uint32_t *in = (const uint32_t *)src;
+        uint32_t keep = 0xffff0000UL | lane;
+        uint32_t i = 0;
+        for (; i + 4 <= frames; i += 4) {
+            uint32_t w0 = in[i] ^ 0x80008000UL;
+            uint32_t w1 = in[i + 1] ^ 0x80008000UL;
+            uint32_t w2 = in[i + 2] ^ 0x80008000UL;
+            uint32_t w3 = in[i + 3] ^ 0x80008000UL;
+            dst[i] = (w0 >> shift) & keep;
+            dst[i + 1] = (w1 >> shift) & keep;
+            dst[i + 2] = (w2 >> shift) & keep;
+            dst[i + 3] = (w3 >> shift) & keep;
+        }
+        for (; i < frames; i++) {
+            dst[i] = ((in[i] ^ 0x80008000UL) >> shift) & keep;
+        }
+    } else if (bits_per == 16) {
+        const uint16_t *in = (const uint16_t *)src;
+        if (ch == 2) {
+            for (uint32_t i = 0; i < frames; i++) {
+                uint32_t left = (uint16_t)(in[2 * i] ^ 0x8000) >> shift;
+                uint32_t right = (uint16_t)(in[2 * i + 1] ^ 0x8000) >> shift;
+                dst[i] = left | (right << 16);
             }
         } else {
-            for (size_t i = 0; i < len; i++) {
-                temp = buf_16b[i];
-                value = temp + 0x7fff;
-                value >>= shift;
-                pwm_data_list_write_byte(data, value);
+            for (uint32_t i = 0; i < frames; i++) {
+                dst[i] = ((uint16_t)(in[i] ^ 0x8000) >> shift) * 0x10001UL;
             }
         }
-    } else if (bits_per == 32) {
-        len >>= 2;
-        uint32_t *buf_32b = (uint32_t *)inbuf;
-        uint32_t value;
-        int32_t temp;
-        if (duty > 8) {
-            for (size_t i = 0; i < len; i++) {
-                temp = buf_32b[i];
-                value = temp + 0x7fffffff;
-                value >>= shift;
-                pwm_data_list_write_byte(data, value);
-                pwm_data_list_write_byte(data, value >> 8);
+    } else {
+        const uint32_t *in = (const uint32_t *)src;
+        shift = 32 - duty;
+        if (ch == 2) {
+            for (uint32_t i = 0; i < frames; i++) {
+                uint32_t left = (in[2 * i] ^ 0x80000000UL) >> shift;
+                uint32_t right = (in[2 * i + 1] ^ 0x80000000UL) >> shift;
+                dst[i] = left | (right << 16);
             }
         } else {
-            for (size_t i = 0; i < len; i++) {
-                temp = buf_32b[i];
-                value = temp + 0x7fffffff;
-                value >>= shift;
-                pwm_data_list_write_byte(data, value);
+            for (uint32_t i = 0; i < frames; i++) {
+                dst[i] = ((in[i] ^ 0x80000000UL) >> shift) * 0x10001UL;
             }
         }
-    } else {
-        ESP_LOGE(TAG, "Only support bits (16 or 32), now bits_per is %d", bits_per);
     }
-    return ESP_OK;
 }
 
-
 esp_err_t audio_pwm_write(uint8_t *inbuf, size_t inbuf_len, size_t *bytes_written, TickType_t ticks_to_wait)
 {
-    esp_err_t res = ESP_OK;
     audio_pwm_handle_t handle = g_audio_pwm_handle;
     AUDIO_NULL_CHECK(TAG, inbuf, return ESP_FAIL);
 
     *bytes_written = 0;
+    if ((handle->bits_per_sample != 16 && handle->bits_per_sample != 32)
+        || (handle->channel_set_num != 1 && handle->channel_set_num != 2)) {
+        ESP_LOGE(TAG, "Only support bits (16 or 32) and 1 or 2 channels, now bits_per is %d, ch is %d",
+                 handle->bits_per_sample, handle->channel_set_num);
+        *bytes_written = inbuf_len;
+        return ESP_OK;
+    }
     pwm_data_handle_t data = handle->data;
-    while (inbuf_len) {
-        if (ESP_OK == pwm_data_list_wait_semaphore(data, ticks_to_wait)) {
-            uint32_t free = pwm_data_list_get_free(data);
-            uint32_t bytes_can_write = inbuf_len;
-            if (inbuf_len > free) {
-                bytes_can_write = free;
-            }
-            bytes_can_write &= 0xfffffffc;
-            if (0 == bytes_can_write) {
-                *bytes_written += inbuf_len;
-                return ESP_OK;
+    uint32_t frame_bytes = (handle->bits_per_sample >> 3) * handle->channel_set_num;
+    while (inbuf_len >= frame_bytes) {
+        uint32_t frames = pwm_data_list_get_free(data);
+        if (frames == 0) {
+            if (ESP_OK != pwm_data_list_wait_semaphore(data, ticks_to_wait)) {
+                return ESP_FAIL;
             }
-            pwm_data_convert(data, inbuf, handle->bits_per_sample, handle->config.duty_resolution, bytes_can_write);
-            inbuf += bytes_can_write;
-            inbuf_len -= bytes_can_write;
-            *bytes_written += bytes_can_write;
-        } else {
-            res = ESP_FAIL;
+            continue;
         }
-    }
-    return res;
+        if (frames > inbuf_len / frame_bytes) {
+            frames = inbuf_len / frame_bytes;
+        }
+        uint32_t head = data->head;
+        uint32_t span = data->mask + 1 - head;
+        if (span > frames) {
+            span = frames;
+        }
+        pwm_data_convert(data->buf + head, inbuf, span, handle->bits_per_sample, handle->channel_set_num, handle->config.duty_resolution);
+        if (frames > span) {
+            pwm_data_convert(data->buf, inbuf + span * frame_bytes, frames - span, handle->bits_per_sample,
+                             handle->channel_set_num, handle->config.duty_resolution);
+        }
+        /* Publish the frames to the ISR only once they are in place */
+        __sync_synchronize();
+        data->head = (head + frames) & data->mask;
+        inbuf += frames * frame_bytes;
+        inbuf_len -= frames * frame_bytes;
+        *bytes_written += frames * frame_bytes;
+    }
+    /* A trailing partial frame can not be played, drop it like the old byte ring did */
+    *bytes_written += inbuf_len;
+    return ESP_OK;
 }
 
 static esp_err_t audio_pwm_start(void)
@@ -0,0 +1,403 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "audio_thread.h"
+#include "audio_error.h"
+#include "read_ahead.h"
+
+static const char *TAG = "READ_AHEAD";
+
+#define RA_MIN_DEPTH            (2)
+#define RA_MARGIN_MS            (100)
+#define RA_RATE_WINDOW_US       (1000 * 1000)
+
+#define RA_WORK_BIT             (BIT0)
+#define RA_DATA_BIT             (BIT1)
+#define RA_IDLE_BIT             (BIT2)
+#define RA_EXIT_BIT             (BIT3)
+
+typedef enum {
+    RA_BLOCK_FREE = 0,
+    RA_BLOCK_LOADING,
+    RA_BLOCK_VALID,
+} ra_block_state_t;
+
+typedef struct {
+    int64_t             block;
+    int                 len;
+    ra_block_state_t    state;
+    uint32_t            used;           /* Last use, for the LRU eviction */
+} ra_block_t;
+
+struct read_ahead {
+    read_ahead_cfg_t    cfg;
+    void                *lock;
+    EventGroupHandle_t  events;
+    audio_thread_t      thread;
+    bool                running;
+    char                *cache;
+    ra_block_t          *blocks;
+
+    int                 fd;
+    bool                attached;
+    bool                busy;           /* The read task is using `fd` */
+    bool                error;
+    uint32_t            gen;
+    uint32_t            file_id;
+    int64_t             size;
+    int64_t             pos;
+    int                 depth;
+    uint32_t            clock;
+
+    /* Measurements */
+    int                 read_ms;        /* Smoothed time to load a block */
+    int                 peak_ms;        /* Slowly decaying worst block load time */
+    int                 consume_rate;
+    int64_t             rate_since_us;
+    int                 rate_bytes;
+    bool                rate_waited;
+};
+
+static void read_ahead_adapt(read_ahead_handle_t ra)
+{
+    if (ra->consume_rate == 0 || ra->read_ms == 0) {
+        ra->depth = RA_MIN_DEPTH;
+        return;
+    }
+    /* Cover two average block loads, or the recent worst spike, at the current consumption rate */
+    int ahead_ms = (2 * ra->read_ms > ra->peak_ms ? 2 * ra->read_ms : ra->peak_ms) + RA_MARGIN_MS;
+    int64_t bytes = (int64_t)ra->consume_rate * ahead_ms / 1000 + ra->cfg.block_size;
+    int depth = (bytes + ra->cfg.block_size - 1) / ra->cfg.block_size;
+    if (depth < RA_MIN_DEPTH) {
+        depth = RA_MIN_DEPTH;
+    }
+    ra->depth = depth > ra->cfg.block_num ? ra->cfg.block_num : depth;
+}
+
+/* Must be called with the lock held */
+static int read_ahead_find(read_ahead_handle_t ra, int64_t block)
+{
+    for (int i = 0; i < ra->cfg.block_num; i++) {
+        if (ra->blocks[i].state != RA_BLOCK_FREE && ra->blocks[i].block == block) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Must be called with the lock held, evict the least recently used block outside the read-ahead window */
+static int read_ahead_victim(read_ahead_handle_t ra, int64_t first, int64_t last)
+{
+    int victim = -1;
+    for (int i = 0; i < ra->cfg.block_num; i++) {
+        ra_block_t *b = &ra->blocks[i];
+        if (b->state == RA_BLOCK_FREE) {
+            return i;
+        }
+        if (b->state != RA_BLOCK_VALID || (b->block >= first && b->block < last)) {
+            continue;
+        }
+        if (victim < 0 || (int32_t)(b->used - ra->blocks[victim].used) < 0) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* Must be called with the lock held */
+static bool read_ahead_claim(read_ahead_handle_t ra, int *idx, int64_t *block)
+{
+    int64_t first = ra->pos / ra->cfg.block_size;
+    int64_t last = first + ra->depth;
+    int64_t block_cnt = (ra->size + ra->cfg.block_size - 1) / ra->cfg.block_size;
+    if (last > block_cnt) {
+        last = block_cnt;
+    }
+    for (int64_t k = first; k < last; k++) {
+        if (read_ahead_find(ra, k) >= 0) {
+            continue;
+        }
+        int victim = read_ahead_victim(ra, first, last);
+        if (victim < 0) {
+            return false;
+        }
+        ra->blocks[victim].block = k;
+        ra->blocks[victim].len = 0;
+        ra->blocks[victim].state = RA_BLOCK_LOADING;
+        ra->blocks[victim].used = ++ra->clock;
+        *idx = victim;
+        *block = k;
+        return true;
+    }
+    return false;
+}
+
+static int read_ahead_load(int fd, int64_t offset, char *buf, int len)
+{
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        return -1;
+    }
+    int done = 0;
+    while (done < len) {
+        int ret = read(fd, buf + done, len - done);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+static void read_ahead_task(void *arg)
+{
+    read_ahead_handle_t ra = (read_ahead_handle_t)arg;
+    int idx = 0;
+    int64_t block = 0;
+
+    mutex_lock(ra->lock);
+    while (ra->running) {
+        if (!ra->attached || ra->error || !read_ahead_claim(ra, &idx, &block)) {
+            xEventGroupClearBits(ra->events, RA_WORK_BIT);
+            mutex_unlock(ra->lock);
+            xEventGroupWaitBits(ra->events, RA_WORK_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+            mutex_lock(ra->lock);
+            continue;
+        }
+        uint32_t gen = ra->gen;
+        int fd = ra->fd;
+        ra->busy = true;
+        mutex_unlock(ra->lock);
+
+        int64_t start_us = esp_timer_get_time();
+        int ret = read_ahead_load(fd, block * ra->cfg.block_size, ra->cache + idx * ra->cfg.block_size, ra->cfg.block_size);
+        int ms = (esp_timer_get_time() - start_us) / 1000;
+
+        mutex_lock(ra->lock);
+        ra->busy = false;
+        ra_block_t *b = &ra->blocks[idx];
+        if (gen != ra->gen || ret < 0) {
+            if (gen == ra->gen) {
+                ESP_LOGE(TAG, "Failed to read block %lld", (long long)block);
+                ra->error = true;
+            }
+            b->state = RA_BLOCK_FREE;
+        } else {
+            b->len = ret;
+            b->state = RA_BLOCK_VALID;
+            ra->read_ms = ra->read_ms ? (ra->read_ms * 7 + ms) / 8 : ms + 1;
+            ra->peak_ms = ms > ra->peak_ms ? ms : ra->peak_ms - ra->peak_ms / 8;
+            read_ahead_adapt(ra);
+        }
+        xEventGroupSetBits(ra->events, RA_DATA_BIT | RA_IDLE_BIT);
+    }
+    xEventGroupSetBits(ra->events, RA_EXIT_BIT);
+    mutex_unlock(ra->lock);
+    audio_thread_delete_task(&ra->thread);
+}
+
+static void read_ahead_free(read_ahead_handle_t ra)
+{
+    audio_free(ra->cache);
+    audio_free(ra->blocks);
+    if (ra->events) {
+        vEventGroupDelete(ra->events);
+    }
+    if (ra->lock) {
+        mutex_destroy(ra->lock);
+    }
+    audio_free(ra);
+}
+
+read_ahead_handle_t read_ahead_create(const read_ahead_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_CHECK(TAG, cfg->block_size > 0 && cfg->block_num >= RA_MIN_DEPTH, return NULL, "Invalid read-ahead configuration");
+    read_ahead_handle_t ra = audio_calloc(1, sizeof(struct read_ahead));
+    AUDIO_MEM_CHECK(TAG, ra, return NULL);
+    memcpy(&ra->cfg, cfg, sizeof(read_ahead_cfg_t));
+    ra->fd = -1;
+    ra->depth = RA_MIN_DEPTH;
+    ra->lock = mutex_create();
+    ra->events = xEventGroupCreate();
+    ra->blocks = audio_calloc(cfg->block_num, sizeof(ra_block_t));
+    ra->cache = audio_malloc(cfg->block_num * cfg->block_size);
+    AUDIO_MEM_CHECK(TAG, ra->lock && ra->events && ra->blocks && ra->cache, {
+        read_ahead_free(ra);
+        return NULL;
+    });
+    ra->running = true;
+    if (audio_thread_create(&ra->thread, "read_ahead", read_ahead_task, ra, cfg->task_stack,
+                            cfg->task_prio, cfg->stack_in_ext, cfg->task_core) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the read task");
+        read_ahead_free(ra);
+        return NULL;
+    }
+    return ra;
+}
+
+esp_err_t read_ahead_destroy(read_ahead_handle_t ra)
+{
+    AUDIO_NULL_CHECK(TAG, ra, return ESP_ERR_INVALID_ARG);
+    read_ahead_detach(ra);
+    mutex_lock(ra->lock);
+    ra->running = false;
+    xEventGroupSetBits(ra->events, RA_WORK_BIT);
+    mutex_unlock(ra->lock);
+    xEventGroupWaitBits(ra->events, RA_EXIT_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    audio_thread_cleanup(&ra->thread);
+    read_ahead_free(ra);
+    return ESP_OK;
+}
+
+esp_err_t read_ahead_attach(read_ahead_handle_t ra, int fd, uint32_t file_id, int64_t size, int64_t pos)
+{
+    AUDIO_NULL_CHECK(TAG, ra, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, fd >= 0 && size >= 0 && pos >= 0, return ESP_ERR_INVALID_ARG, "Invalid file");
+    mutex_lock(ra->lock);
+    if (ra->attached) {
+        mutex_unlock(ra->lock);
+        read_ahead_detach(ra);
+        mutex_lock(ra->lock);
+    }
+    if (file_id != ra->file_id || size != ra->size) {
+        for (int i = 0; i < ra->cfg.block_num; i++) {
+            ra->blocks[i].state = RA_BLOCK_FREE;
+        }
+    } else {
+        ESP_LOGD(TAG, "Same file, reuse the cached blocks");
+    }
+    ra->fd = fd;
+    ra->file_id = file_id;
+    ra->size = size;
+    ra->pos = pos;
+    ra->error = false;
+    ra->rate_since_us = 0;
+    ra->attached = true;
+    xEventGroupSetBits(ra->events, RA_WORK_BIT);
+    mutex_unlock(ra->lock);
+    return ESP_OK;
+}
+
+/* Must be called with the lock held */
+static void read_ahead_consume(read_ahead_handle_t ra, int len)
+{
+    int64_t now = esp_timer_get_time();
+    if (ra->rate_since_us == 0) {
+        ra->rate_since_us = now;
+        ra->rate_bytes = 0;
+        ra->rate_waited = false;
+    }
+    ra->rate_bytes += len;
+    if (now - ra->rate_since_us >= RA_RATE_WINDOW_US) {
+        /* A window with a wait measures the card, not the consumer */
+        if (ra->rate_waited == false) {
+            int rate = (int64_t)ra->rate_bytes * 1000000 / (now - ra->rate_since_us);
+            ra->consume_rate = ra->consume_rate ? (ra->consume_rate * 3 + rate) / 4 : rate;
+            read_ahead_adapt(ra);
+        }
+        ra->rate_since_us = now;
+        ra->rate_bytes = 0;
+        ra->rate_waited = false;
+    }
+}
+
+int read_ahead_read(read_ahead_handle_t ra, char *buf, int len)
+{
+    AUDIO_NULL_CHECK(TAG, ra, return -1);
+    mutex_lock(ra->lock);
+    while (1) {
+        if (ra->attached == false) {
+            mutex_unlock(ra->lock);
+            return -1;
+        }
+        if (ra->pos >= ra->size) {
+            mutex_unlock(ra->lock);
+            return 0;
+        }
+        int off = ra->pos % ra->cfg.block_size;
+        int idx = read_ahead_find(ra, ra->pos / ra->cfg.block_size);
+        if (idx >= 0 && ra->blocks[idx].state == RA_BLOCK_VALID) {
+            int avail = ra->blocks[idx].len - off;
+            if (avail <= 0) {
+                /* The file is shorter than when it was opened */
+                mutex_unlock(ra->lock);
+                return 0;
+            }
+            int n = avail < len ? avail : len;
+            /* The block at the read position is never evicted, copy it unlocked */
+            mutex_unlock(ra->lock);
+            memcpy(buf, ra->cache + idx * ra->cfg.block_size + off, n);
+            mutex_lock(ra->lock);
+            ra->pos += n;
+            ra->blocks[idx].used = ++ra->clock;
+            read_ahead_consume(ra, n);
+            if (off + n == ra->blocks[idx].len) {
+                xEventGroupSetBits(ra->events, RA_WORK_BIT);
+            }
+            mutex_unlock(ra->lock);
+            return n;
+        }
+        if (ra->error) {
+            mutex_unlock(ra->lock);
+            return -1;
+        }
+        ra->rate_waited = true;
+        xEventGroupClearBits(ra->events, RA_DATA_BIT);
+        xEventGroupSetBits(ra->events, RA_WORK_BIT);
+        mutex_unlock(ra->lock);
+        xEventGroupWaitBits(ra->events, RA_DATA_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+        mutex_lock(ra->lock);
+    }
+}
+
+esp_err_t read_ahead_detach(read_ahead_handle_t ra)
+{
+    AUDIO_NULL_CHECK(TAG, ra, return ESP_ERR_INVALID_ARG);
+    mutex_lock(ra->lock);
+    ra->attached = false;
+    ra->gen++;
+    while (ra->busy) {
+        xEventGroupClearBits(ra->events, RA_IDLE_BIT);
+        mutex_unlock(ra->lock);
+        xEventGroupWaitBits(ra->events, RA_IDLE_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+        mutex_lock(ra->lock);
+    }
+    ra->fd = -1;
+    mutex_unlock(ra->lock);
+    return ESP_OK;
+}
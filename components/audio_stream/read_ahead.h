@@ -0,0 +1,118 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct read_ahead *read_ahead_handle_t;
+
+/**
+ * @brief      Read-ahead configurations
+ */
+typedef struct {
+    int     block_size;         /*!< Size of a cached block, reads are issued on `block_size` aligned file offsets */
+    int     block_num;          /*!< Number of cached blocks, at least 2 */
+    int     task_stack;         /*!< Stack size of the read task */
+    int     task_prio;          /*!< Priority of the read task */
+    int     task_core;          /*!< Core of the read task */
+    bool    stack_in_ext;       /*!< Try to allocate the stack in external memory */
+} read_ahead_cfg_t;
+
+/**
+ * @brief      Create the read-ahead cache and its read task
+ *
+ * @param      cfg   The configuration
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The read-ahead handle
+ */
+read_ahead_handle_t read_ahead_create(const read_ahead_cfg_t *cfg);
+
+/**
+ * @brief      Stop the read task and free the cache
+ *
+ * @param      ra    The read-ahead handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t read_ahead_destroy(read_ahead_handle_t ra);
+
+/**
+ * @brief      Start reading ahead of `pos` in an open file.
+ *             The cached blocks are kept when `file_id` matches the previously attached file,
+ *             so reopening the same file after a seek is served from the cache right away.
+ *
+ * @param      ra       The read-ahead handle
+ * @param      fd       File descriptor, must stay open until `read_ahead_detach`
+ * @param      file_id  Identifies the file content, e.g. a hash of the path, size and modification time
+ * @param      size     File size
+ * @param      pos      Offset of the first read
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t read_ahead_attach(read_ahead_handle_t ra, int fd, uint32_t file_id, int64_t size, int64_t pos);
+
+/**
+ * @brief      Read from the cache, wait for the read task if the block at the read position is not loaded yet
+ *
+ * @param      ra    The read-ahead handle
+ * @param      buf   The buffer to fill
+ * @param      len   The buffer size
+ *
+ * @return
+ *     - > 0  Number of bytes read
+ *     - 0    End of file
+ *     - -1   Read error or not attached
+ */
+int read_ahead_read(read_ahead_handle_t ra, char *buf, int len);
+
+/**
+ * @brief      Stop using the file descriptor, wait for an ongoing block read to finish
+ *
+ * @param      ra    The read-ahead handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t read_ahead_detach(read_ahead_handle_t ra);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
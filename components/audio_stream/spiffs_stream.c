@@ -37,6 +37,7 @@
 #include "audio_mem.h"
 #include "audio_element.h"
 #include "wav_head.h"
+#include "write_behind.h"
 #include "esp_log.h"
 
 #define FILE_WAV_SUFFIX_TYPE  "wav"
@@ -44,6 +45,9 @@
 #define FILE_AMR_SUFFIX_TYPE "amr"
 #define FILE_AMRWB_SUFFIX_TYPE "Wamr"
 
+/* SPIFFS erase block, the write-behind flushes are aligned on it */
+#define SPIFFS_STREAM_BLOCK_SIZE (4096)
+
 static const char *TAG = "SPIFFS_STREAM";
 
 typedef enum {
@@ -61,6 +65,7 @@ typedef struct spiffs_stream {
     FILE *file;
     wr_stream_type_t w_type;
     bool write_header;
+    write_behind_handle_t wb;
 } spiffs_stream_t;
 
 static wr_stream_type_t get_type(const char *str)
@@ -136,6 +141,15 @@ static esp_err_t _spiffs_open(audio_element_handle_t self)
         ESP_LOGE(TAG, "Failed to open file %s", path);
         return ESP_FAIL;
     }
+    if (spiffs->wb && spiffs->type == AUDIO_STREAM_WRITER) {
+        // The stdio buffer must be empty before the flush task writes to the descriptor
+        fflush(spiffs->file);
+        if (write_behind_attach(spiffs->wb, fileno(spiffs->file), 0) != ESP_OK) {
+            fclose(spiffs->file);
+            spiffs->file = NULL;
+            return ESP_FAIL;
+        }
+    }
     spiffs->is_open = true;
     if (info.byte_pos && fseek(spiffs->file, info.byte_pos, SEEK_SET) != 0) {
         ESP_LOGE(TAG, "Failed to seek to %d/%d", (int)info.byte_pos, (int)info.total_bytes);
@@ -166,8 +180,13 @@ static int _spiffs_write(audio_element_handle_t self, char *buffer, int len, Tic
     spiffs_stream_t *spiffs = (spiffs_stream_t *)audio_element_getdata(self);
     audio_element_info_t info;
     audio_element_getinfo(self, &info);
-    int wlen = fwrite(buffer, 1, len, spiffs->file);
-    fsync(fileno(spiffs->file));
+    int wlen;
+    if (spiffs->wb) {
+        wlen = write_behind_write(spiffs->wb, buffer, len);
+    } else {
+        wlen = fwrite(buffer, 1, len, spiffs->file);
+        fsync(fileno(spiffs->file));
+    }
     ESP_LOGD(TAG, "write:%d, errno:%d, pos:%d", wlen, errno, (int)info.byte_pos);
     if (wlen > 0) {
         audio_element_update_byte_pos(self, wlen);
@@ -191,6 +210,9 @@ static esp_err_t _spiffs_close(audio_element_handle_t self)
 {
     spiffs_stream_t *spiffs = (spiffs_stream_t *)audio_element_getdata(self);
 
+    if (spiffs->wb && spiffs->is_open && write_behind_detach(spiffs->wb) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to flush data");
+    }
     if (AUDIO_STREAM_WRITER == spiffs->type
         && spiffs->file
         && STREAM_TYPE_WAV == spiffs->w_type) {
@@ -224,6 +246,9 @@ static esp_err_t _spiffs_close(audio_element_handle_t self)
 static esp_err_t _spiffs_destroy(audio_element_handle_t self)
 {
     spiffs_stream_t *spiffs = (spiffs_stream_t *)audio_element_getdata(self);
+    if (spiffs->wb) {
+        write_behind_destroy(spiffs->wb);
+    }
     audio_free(spiffs);
     return ESP_OK;
 }
@@ -254,6 +279,20 @@ audio_element_handle_t spiffs_stream_init(spiffs_stream_cfg_t *config)
     spiffs->type = config->type;
     spiffs->write_header = config->write_header;
 
+    if (config->type == AUDIO_STREAM_WRITER && config->write_behind_size > 0) {
+        write_behind_cfg_t wb_cfg = {
+            .buffer_size = config->write_behind_size,
+            .block_size = SPIFFS_STREAM_BLOCK_SIZE,
+            .sync_interval_ms = config->sync_interval_ms,
+            .sync_bytes = config->sync_bytes,
+            .task_stack = SPIFFS_STREAM_TASK_STACK,
+            .task_prio = config->task_prio,
+            .task_core = config->task_core,
+        };
+        spiffs->wb = write_behind_create(&wb_cfg);
+        AUDIO_MEM_CHECK(TAG, spiffs->wb, goto _spiffs_init_exit);
+    }
+
     if (config->type == AUDIO_STREAM_WRITER) {
         cfg.write = _spiffs_write;
     } else {
@@ -266,6 +305,23 @@ audio_element_handle_t spiffs_stream_init(spiffs_stream_cfg_t *config)
 
     return el;
 _spiffs_init_exit:
+    if (spiffs->wb) {
+        write_behind_destroy(spiffs->wb);
+    }
     audio_free(spiffs);
     return NULL;
 }
+
+esp_err_t spiffs_stream_sync(audio_element_handle_t el)
+{
+    AUDIO_NULL_CHECK(TAG, el, return ESP_FAIL);
+    spiffs_stream_t *spiffs = (spiffs_stream_t *)audio_element_getdata(el);
+    if (spiffs->wb) {
+        return write_behind_sync(spiffs->wb);
+    }
+    if (spiffs->is_open && spiffs->type == AUDIO_STREAM_WRITER) {
+        fflush(spiffs->file);
+        return fsync(fileno(spiffs->file)) == 0 ? ESP_OK : ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -32,6 +32,7 @@
 #include "audio_pipeline.h"
 #include "audio_mem.h"
 #include "fatfs_stream.h"
+#include "raw_stream.h"
 
 #include "esp_peripherals.h"
 #include "board.h"
@@ -40,6 +41,11 @@ static const char *TAG = "FATFS_STREAM_TEST";
 
 #define TEST_FATFS_READER  "/sdcard/test.mp3"
 #define TEST_FATFS_WRITER  "/sdcard/WRITER.MP3"
+#define TEST_FATFS_PATTERN "/sdcard/PATTERN.BIN"
+
+// Not a multiple of the cluster size, so the last partial cluster is covered
+#define TEST_FATFS_PATTERN_SIZE (5 * FATFS_STREAM_CLUSTER_SIZE + 1234)
+#define TEST_FATFS_CHUNK_SIZE   (1000)
 
 
 static uint64_t get_file_size(const char *name)
@@ -69,6 +75,56 @@ static void file_size_comparison(const char *file1, const char *file2)
     }
 }
 
+static char test_pattern_byte(int pos)
+{
+    return (char)(pos * 31 + (pos >> 9));
+}
+
+static void test_pattern_fill(char *buf, int pos, int len)
+{
+    for (int i = 0; i < len; i++) {
+        buf[i] = test_pattern_byte(pos + i);
+    }
+}
+
+static void test_pattern_write(const char *name)
+{
+    FILE *f = fopen(name, "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    char *buf = audio_calloc(1, TEST_FATFS_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(buf);
+    for (int pos = 0; pos < TEST_FATFS_PATTERN_SIZE; pos += TEST_FATFS_CHUNK_SIZE) {
+        int len = TEST_FATFS_PATTERN_SIZE - pos;
+        if (len > TEST_FATFS_CHUNK_SIZE) {
+            len = TEST_FATFS_CHUNK_SIZE;
+        }
+        test_pattern_fill(buf, pos, len);
+        TEST_ASSERT_EQUAL(len, fwrite(buf, 1, len, f));
+    }
+    audio_free(buf);
+    fclose(f);
+}
+
+static void test_pattern_verify(const char *name)
+{
+    TEST_ASSERT_EQUAL(TEST_FATFS_PATTERN_SIZE, (int)get_file_size(name));
+    FILE *f = fopen(name, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    char *buf = audio_calloc(1, TEST_FATFS_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(buf);
+    int pos = 0;
+    int len = 0;
+    while ((len = fread(buf, 1, TEST_FATFS_CHUNK_SIZE, f)) > 0) {
+        for (int i = 0; i < len; i++) {
+            TEST_ASSERT_EQUAL_HEX8(test_pattern_byte(pos + i), buf[i]);
+        }
+        pos += len;
+    }
+    TEST_ASSERT_EQUAL(TEST_FATFS_PATTERN_SIZE, pos);
+    audio_free(buf);
+    fclose(f);
+}
+
 TEST_CASE("fatfs stream init memory", "[esp-adf-stream]")
 {
     esp_log_level_set("AUDIO_ELEMENT", ESP_LOG_DEBUG);
@@ -84,6 +140,168 @@ TEST_CASE("fatfs stream init memory", "[esp-adf-stream]")
     AUDIO_MEM_SHOW("AFTER FATFS_STREAM_INIT MEMORY TEST");
 }
 
+TEST_CASE("fatfs stream write-behind round trip", "[esp-adf-stream]")
+{
+    audio_pipeline_handle_t pipeline;
+    audio_element_handle_t raw_writer, fatfs_stream_writer;
+
+    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
+    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
+    TEST_ASSERT_NOT_NULL(set);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_board_sdcard_init(set, SD_MODE_1_LINE));
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    pipeline = audio_pipeline_init(&pipeline_cfg);
+    TEST_ASSERT_NOT_NULL(pipeline);
+
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    raw_cfg.type = AUDIO_STREAM_WRITER;
+    raw_writer = raw_stream_init(&raw_cfg);
+    TEST_ASSERT_NOT_NULL(raw_writer);
+
+    fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
+    fatfs_cfg.type = AUDIO_STREAM_WRITER;
+    fatfs_cfg.write_behind_size = 4 * FATFS_STREAM_CLUSTER_SIZE;
+    fatfs_stream_writer = fatfs_stream_init(&fatfs_cfg);
+    TEST_ASSERT_NOT_NULL(fatfs_stream_writer);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, raw_writer, "raw"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, fatfs_stream_writer, "file_writer"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_link(pipeline, (const char *[]) {"raw", "file_writer"}, 2));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_uri(fatfs_stream_writer, TEST_FATFS_PATTERN));
+
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    audio_event_iface_handle_t evt = audio_event_iface_init(&evt_cfg);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_set_listener(pipeline, evt));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pipeline));
+
+    char *buf = audio_calloc(1, TEST_FATFS_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(buf);
+    bool synced = false;
+    for (int pos = 0; pos < TEST_FATFS_PATTERN_SIZE; pos += TEST_FATFS_CHUNK_SIZE) {
+        int len = TEST_FATFS_PATTERN_SIZE - pos;
+        if (len > TEST_FATFS_CHUNK_SIZE) {
+            len = TEST_FATFS_CHUNK_SIZE;
+        }
+        test_pattern_fill(buf, pos, len);
+        TEST_ASSERT_EQUAL(len, raw_stream_write(raw_writer, buf, len));
+        if (!synced && pos >= 2 * FATFS_STREAM_CLUSTER_SIZE) {
+            // A sync in the middle must not lose or reorder buffered data
+            TEST_ASSERT_EQUAL(ESP_OK, fatfs_stream_sync(fatfs_stream_writer));
+            synced = true;
+        }
+    }
+    audio_free(buf);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_ringbuf_done(raw_writer));
+
+    while (1) {
+        audio_event_iface_msg_t msg;
+        esp_err_t ret = audio_event_iface_listen(evt, &msg, portMAX_DELAY);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "[ * ] Event interface error : %d", ret);
+            continue;
+        }
+
+        if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) fatfs_stream_writer
+            && msg.cmd == AEL_MSG_CMD_REPORT_STATUS
+            && (((int)msg.data == AEL_STATUS_STATE_STOPPED) || ((int)msg.data == AEL_STATUS_STATE_FINISHED))) {
+            ESP_LOGW(TAG, "[ * ] Stop event received");
+            break;
+        }
+    }
+
+    // Terminating closes the file, which flushes whatever is still behind
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_terminate(pipeline));
+    test_pattern_verify(TEST_FATFS_PATTERN);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, raw_writer));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, fatfs_stream_writer));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_remove_listener(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_stop_all(set));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_event_iface_destroy(evt));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(raw_writer));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(fatfs_stream_writer));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_destroy(set));
+}
+
+TEST_CASE("fatfs stream read-ahead round trip", "[esp-adf-stream]")
+{
+    audio_pipeline_handle_t pipeline;
+    audio_element_handle_t fatfs_stream_reader, raw_reader;
+
+    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
+    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
+    TEST_ASSERT_NOT_NULL(set);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_board_sdcard_init(set, SD_MODE_1_LINE));
+    test_pattern_write(TEST_FATFS_PATTERN);
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    pipeline = audio_pipeline_init(&pipeline_cfg);
+    TEST_ASSERT_NOT_NULL(pipeline);
+
+    fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
+    fatfs_cfg.type = AUDIO_STREAM_READER;
+    fatfs_cfg.read_ahead_blocks = 4;
+    fatfs_stream_reader = fatfs_stream_init(&fatfs_cfg);
+    TEST_ASSERT_NOT_NULL(fatfs_stream_reader);
+
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    raw_cfg.type = AUDIO_STREAM_READER;
+    raw_reader = raw_stream_init(&raw_cfg);
+    TEST_ASSERT_NOT_NULL(raw_reader);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_input_timeout(raw_reader, portMAX_DELAY));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, fatfs_stream_reader, "file_reader"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, raw_reader, "raw"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_link(pipeline, (const char *[]) {"file_reader", "raw"}, 2));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_uri(fatfs_stream_reader, TEST_FATFS_PATTERN));
+
+    char *buf = audio_calloc(1, TEST_FATFS_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(buf);
+
+    // The second pass reopens the same file at an unaligned offset, so it runs on a reattached cache
+    int offsets[] = {0, 2 * FATFS_STREAM_CLUSTER_SIZE + 777};
+    for (int n = 0; n < sizeof(offsets) / sizeof(offsets[0]); n++) {
+        TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_byte_pos(fatfs_stream_reader, offsets[n]));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pipeline));
+
+        int pos = offsets[n];
+        int len = 0;
+        while ((len = raw_stream_read(raw_reader, buf, TEST_FATFS_CHUNK_SIZE)) > 0) {
+            for (int i = 0; i < len; i++) {
+                TEST_ASSERT_EQUAL_HEX8(test_pattern_byte(pos + i), buf[i]);
+            }
+            pos += len;
+        }
+        ESP_LOGI(TAG, "Read from %d to %d", offsets[n], pos);
+        TEST_ASSERT_EQUAL(TEST_FATFS_PATTERN_SIZE, pos);
+
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_wait_for_stop(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_ringbuffer(pipeline));
+        TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_elements(pipeline));
+    }
+    audio_free(buf);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_terminate(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, fatfs_stream_reader));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, raw_reader));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_stop_all(set));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(fatfs_stream_reader));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(raw_reader));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_destroy(set));
+}
+
 TEST_CASE("fatfs stream read write loop", "[esp-adf-stream]")
 {
     audio_pipeline_handle_t pipeline;
@@ -40,6 +40,7 @@
 #include "http_stream.h"
 #include "i2s_stream.h"
 #include "fatfs_stream.h"
+#include "raw_stream.h"
 #include "aac_decoder.h"
 
 #include "esp_peripherals.h"
@@ -51,6 +52,9 @@ static const char *TAG = "HTTP STREAM UNITEST";
 static const char URL_RANDOM[] = "0123456789abcdefghijklmnopqrstuvwxyuzABCDEFGHIJKLMNOPQRSTUVWXYUZ-_.!@#$&*()=:/,;?+~";
 #define AAC_STREAM_URI "http://open.ls.qingting.fm/live/274/64k.m3u8?format=aac"
 #define UNITEST_HTTP_SERVRE_URI  "http://192.168.199.168:8000/upload"
+#define UNITEST_HTTP_STREAM_MP3_URI "https://dl.espressif.com/dl/audio/ff-16b-2c-44100hz.mp3"
+#define UNITEST_HTTP_STREAM_SPAN_SIZE   (96 * 1024)
+#define UNITEST_HTTP_STREAM_CHUNK_SIZE  (1000)
 
 #define UNITETS_HTTP_STREAM_WIFI_SSID    "ESPRESSIF"   
 #define UNITETS_HTTP_STREAM_WIFI_PASSWD    "espressif"   
@@ -169,6 +173,133 @@ static esp_err_t _http_stream_event_handle(http_stream_event_msg_t *msg)
     return ESP_OK;
 }
 
+static audio_pipeline_handle_t http_raw_pipeline_init(http_stream_cfg_t *http_cfg, audio_element_handle_t *http, audio_element_handle_t *raw)
+{
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    TEST_ASSERT_NOT_NULL(pipeline);
+
+    *http = http_stream_init(http_cfg);
+    TEST_ASSERT_NOT_NULL(*http);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_uri(*http, UNITEST_HTTP_STREAM_MP3_URI));
+
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    raw_cfg.type = AUDIO_STREAM_READER;
+    *raw = raw_stream_init(&raw_cfg);
+    TEST_ASSERT_NOT_NULL(*raw);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_input_timeout(*raw, portMAX_DELAY));
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, *http, "http"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_register(pipeline, *raw, "raw"));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_link(pipeline, (const char *[]) {"http", "raw"}, 2));
+    return pipeline;
+}
+
+static void http_raw_pipeline_deinit(audio_pipeline_handle_t pipeline, audio_element_handle_t http, audio_element_handle_t raw)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_terminate(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, http));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_unregister(pipeline, raw));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(http));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(raw));
+}
+
+static void http_raw_pipeline_restart(audio_pipeline_handle_t pipeline, audio_element_handle_t http, int byte_pos)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_stop(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_wait_for_stop(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_ringbuffer(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_reset_elements(pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_element_set_byte_pos(http, byte_pos));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pipeline));
+}
+
+static int http_raw_read_full(audio_element_handle_t raw, char *buf, int len)
+{
+    int total = 0;
+    while (total < len) {
+        int ret = raw_stream_read(raw, buf + total, len - total);
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+TEST_CASE("http stream prefetch seek read", "[esp-adf-stream]")
+{
+    audio_pipeline_handle_t ref_pipeline, pf_pipeline;
+    audio_element_handle_t ref_http, ref_raw, pf_http, pf_raw;
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    tcpip_adapter_init();
+
+    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
+    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
+    TEST_ASSERT_NOT_NULL(set);
+
+    periph_wifi_cfg_t wifi_cfg = {
+        .ssid = UNITETS_HTTP_STREAM_WIFI_SSID,
+        .password = UNITETS_HTTP_STREAM_WIFI_PASSWD,
+    };
+    esp_periph_handle_t wifi_handle = periph_wifi_init(&wifi_cfg);
+    TEST_ASSERT_NOT_NULL(wifi_handle);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_start(set, wifi_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, periph_wifi_wait_for_connected(wifi_handle, portMAX_DELAY));
+
+    // The reference reader fetches the same file over a single plain connection
+    http_stream_cfg_t ref_cfg = HTTP_STREAM_CFG_DEFAULT();
+    ref_cfg.type = AUDIO_STREAM_READER;
+    ref_pipeline = http_raw_pipeline_init(&ref_cfg, &ref_http, &ref_raw);
+
+    http_stream_cfg_t pf_cfg = HTTP_STREAM_CFG_DEFAULT();
+    pf_cfg.type = AUDIO_STREAM_READER;
+    pf_cfg.prefetch_conn_num = 2;
+    pf_cfg.prefetch_chunk_size = 16 * 1024;
+    pf_cfg.prefetch_cache_size = 64 * 1024;
+    pf_pipeline = http_raw_pipeline_init(&pf_cfg, &pf_http, &pf_raw);
+
+    char *ref_buf = audio_calloc(1, UNITEST_HTTP_STREAM_CHUNK_SIZE);
+    char *pf_buf = audio_calloc(1, UNITEST_HTTP_STREAM_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(ref_buf);
+    TEST_ASSERT_NOT_NULL(pf_buf);
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(ref_pipeline));
+    TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_run(pf_pipeline));
+
+    // Start from the head, then seek forward past the cache and back into it, each span crossing several chunks
+    int offsets[] = {0, 300 * 1024 + 123, 50 * 1024 + 1};
+    for (int n = 0; n < sizeof(offsets) / sizeof(offsets[0]); n++) {
+        if (n > 0) {
+            http_raw_pipeline_restart(ref_pipeline, ref_http, offsets[n]);
+            http_raw_pipeline_restart(pf_pipeline, pf_http, offsets[n]);
+        }
+        for (int pos = 0; pos < UNITEST_HTTP_STREAM_SPAN_SIZE; pos += UNITEST_HTTP_STREAM_CHUNK_SIZE) {
+            TEST_ASSERT_EQUAL(UNITEST_HTTP_STREAM_CHUNK_SIZE, http_raw_read_full(ref_raw, ref_buf, UNITEST_HTTP_STREAM_CHUNK_SIZE));
+            TEST_ASSERT_EQUAL(UNITEST_HTTP_STREAM_CHUNK_SIZE, http_raw_read_full(pf_raw, pf_buf, UNITEST_HTTP_STREAM_CHUNK_SIZE));
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(ref_buf, pf_buf, UNITEST_HTTP_STREAM_CHUNK_SIZE);
+        }
+        http_stream_prefetch_stat_t stat;
+        TEST_ASSERT_EQUAL(ESP_OK, http_stream_get_prefetch_stat(pf_http, &stat));
+        ESP_LOGI(TAG, "Span at %d matched, buffered %d, target %d, stalls %u, retries %u",
+                 offsets[n], stat.buffered, stat.target, stat.stalls, stat.retries);
+    }
+    audio_free(ref_buf);
+    audio_free(pf_buf);
+
+    http_raw_pipeline_deinit(ref_pipeline, ref_http, ref_raw);
+    http_raw_pipeline_deinit(pf_pipeline, pf_http, pf_raw);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_stop_all(set));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_periph_set_destroy(set));
+}
+
 TEST_CASE("http stream read", "[esp-adf-stream]")
 {
     audio_pipeline_handle_t pipeline;
@@ -36,6 +36,7 @@
 #include "audio_element.h"
 #include "audio_event_iface.h"
 #include "tone_stream.h"
+#include "tone_partition.h"
 #include "fatfs_stream.h"
 
 #include "esp_peripherals.h"
@@ -143,4 +144,34 @@ TEST_CASE("tone stream read test", "esp-adf-stream")
     TEST_ASSERT_EQUAL(ESP_OK, audio_pipeline_deinit(pipeline));
     TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(tone_stream_reader));
     TEST_ASSERT_EQUAL(ESP_OK, audio_element_deinit(fatfs_stream_writer));
-}
\ No newline at end of file
+}
+TEST_CASE("tone partition mmap matches flash read", "esp-adf-stream")
+{
+    tone_partition_handle_t read_handle = tone_partition_init_with_access("flash_tone", TONE_PARTITION_ACCESS_READ);
+    TEST_ASSERT_NOT_NULL(read_handle);
+    tone_partition_handle_t map_handle = tone_partition_init_with_access("flash_tone", TONE_PARTITION_ACCESS_MMAP);
+    TEST_ASSERT_NOT_NULL(map_handle);
+
+    char *buf = audio_calloc(1, 512);
+    TEST_ASSERT_NOT_NULL(buf);
+    for (int i = 0; i < TONE_URL_MAX; i++) {
+        tone_file_info_t read_info = { 0 };
+        tone_file_info_t map_info = { 0 };
+        TEST_ASSERT_EQUAL(ESP_OK, tone_partition_get_file_info(read_handle, i, &read_info));
+        TEST_ASSERT_EQUAL(ESP_OK, tone_partition_get_file_info(map_handle, i, &map_info));
+        TEST_ASSERT_EQUAL_MEMORY(&read_info, &map_info, sizeof(tone_file_info_t));
+
+        const uint8_t *data = NULL;
+        TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, tone_partition_file_get_data(read_handle, &read_info, &data));
+        TEST_ASSERT_EQUAL(ESP_OK, tone_partition_file_get_data(map_handle, &map_info, &data));
+        int len = read_info.song_len < 512 ? read_info.song_len : 512;
+        TEST_ASSERT_EQUAL(ESP_OK, tone_partition_file_read(read_handle, &read_info, 0, buf, len));
+        TEST_ASSERT_EQUAL_MEMORY(buf, data, len);
+    }
+    tone_file_info_t info = { 0 };
+    TEST_ASSERT_EQUAL(ESP_FAIL, tone_partition_get_file_info(map_handle, TONE_URL_MAX, &info));
+
+    audio_free(buf);
+    TEST_ASSERT_EQUAL(ESP_OK, tone_partition_deinit(read_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, tone_partition_deinit(map_handle));
+}
@@ -42,8 +42,10 @@ typedef struct tone_stream {
     audio_stream_type_t type;            /*!< File operation type */
     bool is_open;                        /*!< Tone stream status */
     bool use_delegate;                   /*!< Tone read with delegate*/
-    tone_partition_handle_t tone_handle; /*!< Tone partition's operation handle*/
+    bool use_mmap;                       /*!< Tone read through the mapped partition */
+    tone_partition_handle_t tone_handle; /*!< Tone partition's operation handle, checked on open and kept until destroy */
     tone_file_info_t cur_file;           /*!< Address to read tone file */
+    const uint8_t *cur_data;             /*!< Mapped data of current tone file, NULL if not mapped */
     const char *partition_label;         /*!< Label of tone stored in flash */
 } tone_stream_t;
 
@@ -54,9 +56,22 @@ static esp_err_t _tone_open(audio_element_handle_t self)
         ESP_LOGE(TAG, "already opened");
         return ESP_FAIL;
     }
-    stream->tone_handle = tone_partition_init(stream->partition_label, stream->use_delegate);
+    if (stream->tone_handle && tone_partition_check_header(stream->tone_handle) != ESP_OK) {
+        // The partition was rewritten, e.g. by a tone OTA, the cached file table is stale
+        tone_partition_deinit(stream->tone_handle);
+        stream->tone_handle = NULL;
+    }
     if (stream->tone_handle == NULL) {
-        return ESP_FAIL;
+        tone_partition_access_t access = TONE_PARTITION_ACCESS_READ;
+        if (stream->use_mmap) {
+            access = TONE_PARTITION_ACCESS_MMAP;
+        } else if (stream->use_delegate) {
+            access = TONE_PARTITION_ACCESS_DELEGATE;
+        }
+        stream->tone_handle = tone_partition_init_with_access(stream->partition_label, access);
+        if (stream->tone_handle == NULL) {
+            return ESP_FAIL;
+        }
     }
 
     char *flash_url = audio_element_get_uri(self);
@@ -74,12 +89,17 @@ static esp_err_t _tone_open(audio_element_handle_t self)
         return ESP_FAIL;
     }
 
+    memset(&stream->cur_file, 0, sizeof(tone_file_info_t));
     tone_partition_get_file_info(stream->tone_handle, file_index, &stream->cur_file);
     ESP_LOGI(TAG, "Tone offset:%08x, Tone length:%d, pos:%d\n", stream->cur_file.song_adr, stream->cur_file.song_len, file_index);
     if (stream->cur_file.song_len <= 0) {
         ESP_LOGE(TAG, "Mayebe the flash tone is empty, please ensure the flash's contex");
         return ESP_FAIL;
     }
+    stream->cur_data = NULL;
+    if (stream->use_mmap) {
+        tone_partition_file_get_data(stream->tone_handle, &stream->cur_file, &stream->cur_data);
+    }
 
     audio_element_info_t info = { 0 };
     info.total_bytes = stream->cur_file.song_len;
@@ -116,6 +136,23 @@ static int _tone_read(audio_element_handle_t self, char *buffer, int len, TickTy
 
 static int _tone_process(audio_element_handle_t self, char *in_buffer, int in_len)
 {
+    tone_stream_t *stream = (tone_stream_t *)audio_element_getdata(self);
+    if (stream->cur_data) {
+        audio_element_info_t info = { 0 };
+        audio_element_getinfo(self, &info);
+        int len = in_len;
+        if (info.byte_pos + len > info.total_bytes) {
+            len = info.total_bytes - info.byte_pos;
+        }
+        // Write straight from the mapped flash, the end of file still goes through `_tone_read`
+        if (len > 0) {
+            int w_size = audio_element_output(self, (char *)stream->cur_data + info.byte_pos, len);
+            if (w_size > 0) {
+                audio_element_update_byte_pos(self, w_size);
+            }
+            return w_size;
+        }
+    }
     int r_size = audio_element_input(self, in_buffer, in_len);
     int w_size = 0;
     if (r_size > 0) {
@@ -132,8 +169,7 @@ static esp_err_t _tone_close(audio_element_handle_t self)
     if (stream->is_open) {
         stream->is_open = false;
     }
-    tone_partition_deinit(stream->tone_handle);
-    stream->tone_handle = NULL;
+    stream->cur_data = NULL;
     if (AEL_STATE_PAUSED != audio_element_get_state(self)) {
         audio_element_set_byte_pos(self, 0);
     }
@@ -143,6 +179,9 @@ static esp_err_t _tone_close(audio_element_handle_t self)
 static esp_err_t _tone_destroy(audio_element_handle_t self)
 {
     tone_stream_t *stream = (tone_stream_t *)audio_element_getdata(self);
+    if (stream->tone_handle) {
+        tone_partition_deinit(stream->tone_handle);
+    }
     audio_free(stream);
     return ESP_OK;
 }
@@ -165,8 +204,8 @@ audio_element_handle_t tone_stream_init(tone_stream_cfg_t *config)
     cfg.out_rb_size = config->out_rb_size;
     cfg.buffer_len = config->buf_sz;
     cfg.stack_in_ext = config->extern_stack;
-    if (cfg.stack_in_ext == true && config->use_delegate == false) {
-        ESP_LOGE(TAG, "Tone stream must read flash with delegate when stack is allocate in external ram");
+    if (cfg.stack_in_ext == true && config->use_delegate == false && config->use_mmap == false) {
+        ESP_LOGE(TAG, "Tone stream must read flash with delegate or mmap when stack is allocate in external ram");
         goto _tone_init_exit;
     }
     if (cfg.buffer_len == 0) {
@@ -175,6 +214,7 @@ audio_element_handle_t tone_stream_init(tone_stream_cfg_t *config)
     cfg.tag = "flash";
     stream->type = config->type;
     stream->use_delegate = config->use_delegate;
+    stream->use_mmap = config->use_mmap;
 
     if (config->label == NULL) {
         ESP_LOGE(TAG, "Please set your tone label");
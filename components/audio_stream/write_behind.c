@@ -0,0 +1,337 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "audio_thread.h"
+#include "audio_error.h"
+#include "audio_idf_version.h"
+#include "write_behind.h"
+
+static const char *TAG = "WRITE_BEHIND";
+
+/* FatFs only gained ftruncate in the IDF 5.0 VFS, without it a pre-allocation could not be trimmed */
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+#define WRITE_BEHIND_PREALLOC   (1)
+#else
+#define WRITE_BEHIND_PREALLOC   (0)
+#endif
+
+#define WB_DATA_BIT             (BIT0)
+#define WB_SPACE_BIT            (BIT1)
+#define WB_SYNCED_BIT           (BIT2)
+#define WB_EXIT_BIT             (BIT3)
+
+struct write_behind {
+    write_behind_cfg_t  cfg;
+    void                *lock;
+    EventGroupHandle_t  events;
+    audio_thread_t      thread;
+    char                *buf;
+    int                 cap;
+    int                 fd;
+    bool                attached;
+    bool                running;
+    bool                error;
+    int64_t             wr_off;         /* File offset after the last staged byte */
+    int64_t             fl_off;         /* File offset after the last flushed byte */
+    int64_t             prealloc_end;
+    int64_t             dirty_since_us; /* When the oldest byte not yet synced was staged, 0 if none */
+    int                 unsynced;       /* Flushed bytes not yet covered by a fsync */
+    uint32_t            sync_req;
+    uint32_t            sync_done;
+};
+
+static int write_behind_flush(int fd, const char *data, int len)
+{
+    int done = 0;
+    while (done < len) {
+        int ret = write(fd, data + done, len - done);
+        if (ret <= 0) {
+            return -1;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+static void write_behind_task(void *arg)
+{
+    write_behind_handle_t wb = (write_behind_handle_t)arg;
+    int64_t interval_us = (int64_t)wb->cfg.sync_interval_ms * 1000;
+
+    mutex_lock(wb->lock);
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        int64_t pending = wb->error ? 0 : wb->wr_off - wb->fl_off;
+        int boundary = wb->cfg.block_size - wb->fl_off % wb->cfg.block_size;
+        bool expired = interval_us && wb->dirty_since_us && now - wb->dirty_since_us >= interval_us;
+        bool urgent = !wb->running || wb->sync_req != wb->sync_done || expired;
+
+        /* Full aligned blocks go out as soon as they are complete, the partial tail only when it has to */
+        if (pending >= boundary || (pending > 0 && urgent)) {
+            int n = pending < boundary ? pending : boundary;
+            const char *data = wb->buf + wb->fl_off % wb->cap;
+            bool sync = wb->cfg.sync_bytes && wb->unsynced + n >= wb->cfg.sync_bytes;
+            mutex_unlock(wb->lock);
+            int ret = write_behind_flush(wb->fd, data, n);
+            if (ret == n && sync && fsync(wb->fd) != 0) {
+                ret = -1;
+            }
+            mutex_lock(wb->lock);
+            if (ret != n) {
+                ESP_LOGE(TAG, "Failed to flush %d bytes at %lld", n, (long long)wb->fl_off);
+                wb->error = true;
+                xEventGroupSetBits(wb->events, WB_SPACE_BIT | WB_SYNCED_BIT);
+                continue;
+            }
+            wb->fl_off += n;
+            wb->unsynced = sync ? 0 : wb->unsynced + n;
+            xEventGroupSetBits(wb->events, WB_SPACE_BIT);
+            continue;
+        }
+        if (urgent) {
+            uint32_t target = wb->sync_req;
+            if (wb->unsynced > 0 && wb->error == false) {
+                mutex_unlock(wb->lock);
+                int ret = fsync(wb->fd);
+                mutex_lock(wb->lock);
+                if (ret != 0) {
+                    ESP_LOGE(TAG, "Failed to sync");
+                    wb->error = true;
+                }
+                wb->unsynced = 0;
+            }
+            /* Anything staged meanwhile is younger than this round */
+            wb->dirty_since_us = (wb->wr_off == wb->fl_off || wb->error) ? 0 : now;
+            wb->sync_done = target;
+            xEventGroupSetBits(wb->events, WB_SYNCED_BIT);
+            if (wb->running == false && wb->dirty_since_us == 0) {
+                break;
+            }
+            continue;
+        }
+        TickType_t ticks = portMAX_DELAY;
+        if (interval_us && wb->dirty_since_us) {
+            ticks = (interval_us - (now - wb->dirty_since_us)) / 1000 / portTICK_PERIOD_MS + 1;
+        }
+        xEventGroupClearBits(wb->events, WB_DATA_BIT);
+        mutex_unlock(wb->lock);
+        xEventGroupWaitBits(wb->events, WB_DATA_BIT, pdFALSE, pdFALSE, ticks);
+        mutex_lock(wb->lock);
+    }
+    xEventGroupSetBits(wb->events, WB_EXIT_BIT);
+    mutex_unlock(wb->lock);
+    audio_thread_delete_task(&wb->thread);
+}
+
+write_behind_handle_t write_behind_create(const write_behind_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_CHECK(TAG, cfg->block_size > 0 && cfg->buffer_size >= cfg->block_size, return NULL, "Invalid write-behind buffer");
+    write_behind_handle_t wb = audio_calloc(1, sizeof(struct write_behind));
+    AUDIO_MEM_CHECK(TAG, wb, return NULL);
+    memcpy(&wb->cfg, cfg, sizeof(write_behind_cfg_t));
+    wb->cap = cfg->buffer_size - cfg->buffer_size % cfg->block_size;
+    wb->fd = -1;
+    wb->lock = mutex_create();
+    wb->events = xEventGroupCreate();
+    AUDIO_MEM_CHECK(TAG, wb->lock && wb->events, {
+        write_behind_destroy(wb);
+        return NULL;
+    });
+    return wb;
+}
+
+esp_err_t write_behind_destroy(write_behind_handle_t wb)
+{
+    AUDIO_NULL_CHECK(TAG, wb, return ESP_ERR_INVALID_ARG);
+    if (wb->attached) {
+        write_behind_detach(wb);
+    }
+    if (wb->events) {
+        vEventGroupDelete(wb->events);
+    }
+    if (wb->lock) {
+        mutex_destroy(wb->lock);
+    }
+    audio_free(wb);
+    return ESP_OK;
+}
+
+esp_err_t write_behind_attach(write_behind_handle_t wb, int fd, int64_t prealloc_size)
+{
+    AUDIO_NULL_CHECK(TAG, wb, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, wb->attached == false, return ESP_ERR_INVALID_STATE, "Already attached");
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    AUDIO_CHECK(TAG, offset >= 0, return ESP_FAIL, "Failed to get the file offset");
+    wb->buf = audio_malloc(wb->cap);
+    AUDIO_MEM_CHECK(TAG, wb->buf, return ESP_ERR_NO_MEM);
+
+    wb->prealloc_end = 0;
+#if WRITE_BEHIND_PREALLOC
+    /* Seeking past the end of a file opened for writing makes FatFs allocate the cluster chain up front */
+    if (prealloc_size > offset) {
+        if (lseek(fd, prealloc_size, SEEK_SET) == prealloc_size) {
+            wb->prealloc_end = prealloc_size;
+        } else {
+            ESP_LOGW(TAG, "Failed to pre-allocate %lld bytes", (long long)prealloc_size);
+        }
+        lseek(fd, offset, SEEK_SET);
+    }
+#else
+    if (prealloc_size > offset) {
+        ESP_LOGW(TAG, "Pre-allocation needs ftruncate, skipped");
+    }
+#endif
+    wb->fd = fd;
+    wb->wr_off = offset;
+    wb->fl_off = offset;
+    wb->dirty_since_us = 0;
+    wb->unsynced = 0;
+    wb->sync_req = 0;
+    wb->sync_done = 0;
+    wb->error = false;
+    wb->running = true;
+    wb->attached = true;
+    xEventGroupClearBits(wb->events, WB_DATA_BIT | WB_SPACE_BIT | WB_SYNCED_BIT | WB_EXIT_BIT);
+    if (audio_thread_create(&wb->thread, "write_behind", write_behind_task, wb, wb->cfg.task_stack,
+                            wb->cfg.task_prio, wb->cfg.stack_in_ext, wb->cfg.task_core) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the flush task");
+        wb->attached = false;
+        audio_free(wb->buf);
+        wb->buf = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int write_behind_write(write_behind_handle_t wb, const char *buf, int len)
+{
+    AUDIO_NULL_CHECK(TAG, wb, return -1);
+    int done = 0;
+    mutex_lock(wb->lock);
+    while (done < len) {
+        if (wb->attached == false || wb->error) {
+            mutex_unlock(wb->lock);
+            return -1;
+        }
+        int space = wb->cap - (int)(wb->wr_off - wb->fl_off);
+        if (space == 0) {
+            xEventGroupClearBits(wb->events, WB_SPACE_BIT);
+            mutex_unlock(wb->lock);
+            xEventGroupWaitBits(wb->events, WB_SPACE_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+            mutex_lock(wb->lock);
+            continue;
+        }
+        int idx = wb->wr_off % wb->cap;
+        int n = len - done;
+        if (n > space) {
+            n = space;
+        }
+        if (n > wb->cap - idx) {
+            n = wb->cap - idx;
+        }
+        /* The span past `wr_off` is never read by the flush task, fill it unlocked */
+        mutex_unlock(wb->lock);
+        memcpy(wb->buf + idx, buf + done, n);
+        mutex_lock(wb->lock);
+        int64_t boundary = wb->fl_off + wb->cfg.block_size - wb->fl_off % wb->cfg.block_size;
+        bool wake = wb->dirty_since_us == 0 || (wb->wr_off < boundary && wb->wr_off + n >= boundary);
+        if (wb->dirty_since_us == 0) {
+            wb->dirty_since_us = esp_timer_get_time();
+        }
+        wb->wr_off += n;
+        done += n;
+        if (wake) {
+            xEventGroupSetBits(wb->events, WB_DATA_BIT);
+        }
+    }
+    mutex_unlock(wb->lock);
+    return len;
+}
+
+esp_err_t write_behind_sync(write_behind_handle_t wb)
+{
+    AUDIO_NULL_CHECK(TAG, wb, return ESP_ERR_INVALID_ARG);
+    mutex_lock(wb->lock);
+    if (wb->attached == false) {
+        mutex_unlock(wb->lock);
+        return ESP_OK;
+    }
+    uint32_t target = ++wb->sync_req;
+    xEventGroupSetBits(wb->events, WB_DATA_BIT);
+    while ((int32_t)(wb->sync_done - target) < 0 && wb->error == false && wb->running) {
+        xEventGroupClearBits(wb->events, WB_SYNCED_BIT);
+        mutex_unlock(wb->lock);
+        xEventGroupWaitBits(wb->events, WB_SYNCED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+        mutex_lock(wb->lock);
+    }
+    esp_err_t ret = wb->error ? ESP_FAIL : ESP_OK;
+    mutex_unlock(wb->lock);
+    return ret;
+}
+
+esp_err_t write_behind_detach(write_behind_handle_t wb)
+{
+    AUDIO_NULL_CHECK(TAG, wb, return ESP_ERR_INVALID_ARG);
+    mutex_lock(wb->lock);
+    if (wb->attached == false) {
+        mutex_unlock(wb->lock);
+        return ESP_OK;
+    }
+    wb->running = false;
+    xEventGroupSetBits(wb->events, WB_DATA_BIT);
+    mutex_unlock(wb->lock);
+    xEventGroupWaitBits(wb->events, WB_EXIT_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    audio_thread_cleanup(&wb->thread);
+
+    mutex_lock(wb->lock);
+#if WRITE_BEHIND_PREALLOC
+    if (wb->prealloc_end > wb->fl_off && ftruncate(wb->fd, wb->fl_off) != 0) {
+        ESP_LOGE(TAG, "Failed to trim the pre-allocation at %lld", (long long)wb->fl_off);
+        wb->error = true;
+    }
+#endif
+    if (wb->error) {
+        ESP_LOGE(TAG, "%lld bytes lost", (long long)(wb->wr_off - wb->fl_off));
+    }
+    esp_err_t ret = wb->error ? ESP_FAIL : ESP_OK;
+    audio_free(wb->buf);
+    wb->buf = NULL;
+    wb->fd = -1;
+    wb->attached = false;
+    mutex_unlock(wb->lock);
+    return ret;
+}
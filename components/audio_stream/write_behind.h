@@ -0,0 +1,131 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2022 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _WRITE_BEHIND_H_
+#define _WRITE_BEHIND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct write_behind *write_behind_handle_t;
+
+/**
+ * @brief      Write-behind configurations
+ */
+typedef struct {
+    int     buffer_size;        /*!< Size of the staging buffer, rounded down to a multiple of `block_size` */
+    int     block_size;         /*!< Flush granularity, writes are issued on `block_size` aligned file offsets */
+    int     sync_interval_ms;   /*!< Longest time a written byte may stay out of the file, 0 for no limit */
+    int     sync_bytes;         /*!< fsync after this many bytes have been flushed, 0 to disable */
+    int     task_stack;         /*!< Stack size of the flush task */
+    int     task_prio;          /*!< Priority of the flush task */
+    int     task_core;          /*!< Core of the flush task */
+    bool    stack_in_ext;       /*!< Try to allocate the stack in external memory */
+} write_behind_cfg_t;
+
+/**
+ * @brief      Create a write-behind handle, the staging buffer and the flush task are only allocated by `write_behind_attach`
+ *
+ * @param      cfg   The configuration
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The write-behind handle
+ */
+write_behind_handle_t write_behind_create(const write_behind_cfg_t *cfg);
+
+/**
+ * @brief      Detach if needed and free the handle
+ *
+ * @param      wb    The write-behind handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t write_behind_destroy(write_behind_handle_t wb);
+
+/**
+ * @brief      Start staging the writes of an open file, from its current offset
+ *
+ * @param      wb             The write-behind handle
+ * @param      fd             File descriptor, must stay open until `write_behind_detach`
+ * @param      prealloc_size  Expected final file size to pre-allocate, 0 to disable.
+ *                            The unused tail is trimmed by `write_behind_detach`
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE  Already attached
+ *     - ESP_ERR_NO_MEM
+ *     - ESP_FAIL
+ */
+esp_err_t write_behind_attach(write_behind_handle_t wb, int fd, int64_t prealloc_size);
+
+/**
+ * @brief      Copy data into the staging buffer, block only while the buffer is full
+ *
+ * @param      wb    The write-behind handle
+ * @param      buf   The data
+ * @param      len   The data length
+ *
+ * @return
+ *     - `len` on success
+ *     - -1 if not attached or a previous flush failed
+ */
+int write_behind_write(write_behind_handle_t wb, const char *buf, int len);
+
+/**
+ * @brief      Flush everything written so far and fsync, block until done.
+ *             Safe to call from any task, e.g. on a power-fail warning.
+ *
+ * @param      wb    The write-behind handle
+ *
+ * @return
+ *     - ESP_OK  Done, or not attached
+ *     - ESP_FAIL
+ */
+esp_err_t write_behind_sync(write_behind_handle_t wb);
+
+/**
+ * @brief      Flush, fsync, trim the pre-allocation and stop the flush task.
+ *             The file offset is left at the end of the written data.
+ *
+ * @param      wb    The write-behind handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL  Some data could not be written
+ */
+esp_err_t write_behind_detach(write_behind_handle_t wb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
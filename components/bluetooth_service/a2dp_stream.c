@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
@@ -68,7 +69,25 @@ typedef struct {
     size_t size;
 } a2dp_data_t;
 
+/*
+ * Sink packets come from a pool allocated once, the data callback only copies into a free packet.
+ * The packets held back while rebuilding the jitter depth are only touched by the data callback.
+ */
+typedef struct {
+    uint8_t *buf;
+    QueueHandle_t free_pkts;
+    atomic_int pending;                         /* Packets sent to `audio_a2dp_stream_thread` not written yet */
+    int pkt_num;
+    a2dp_data_t *hold;
+    int hold_cnt;
+    int depth;
+    int stable_cnt;
+    bool prebuffering;
+    uint32_t drop_cnt;
+} a2dp_sink_pool_t;
+
 static aadp_info_t s_aadp_handler = { 0 };
+static a2dp_sink_pool_t *s_sink_pool;
 
 int16_t default_volume = 50;
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 0, 0))
@@ -78,6 +97,89 @@ static void bt_avrc_tg_cb(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *
 static const char *audio_state_str[] = { "Suspended", "Stopped", "Started" };
 static void bt_avrc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param);
 
+static void a2dp_sink_pool_destroy(void)
+{
+    a2dp_sink_pool_t *pool = s_sink_pool;
+    s_sink_pool = NULL;
+    if (pool == NULL) {
+        return;
+    }
+    if (pool->free_pkts) {
+        vQueueDelete(pool->free_pkts);
+    }
+    audio_free(pool->hold);
+    audio_free(pool->buf);
+    audio_free(pool);
+}
+
+static esp_err_t a2dp_sink_pool_create(int pkt_num)
+{
+    a2dp_sink_pool_t *pool = audio_calloc(1, sizeof(a2dp_sink_pool_t));
+    AUDIO_MEM_CHECK(TAG, pool, return ESP_ERR_NO_MEM);
+    s_sink_pool = pool;
+    pool->pkt_num = pkt_num;
+    // audio_calloc places the packets in PSRAM when there is any
+    pool->buf = audio_calloc(pkt_num, A2DP_STREAM_PKT_SIZE);
+    pool->hold = audio_calloc(pkt_num, sizeof(a2dp_data_t));
+    pool->free_pkts = xQueueCreate(pkt_num, sizeof(uint8_t *));
+    AUDIO_MEM_CHECK(TAG, (pool->buf && pool->hold && pool->free_pkts), {
+        a2dp_sink_pool_destroy();
+        return ESP_ERR_NO_MEM;
+    });
+    for (int i = 0; i < pkt_num; i++) {
+        uint8_t *pkt = pool->buf + i * A2DP_STREAM_PKT_SIZE;
+        xQueueSend(pool->free_pkts, &pkt, 0);
+    }
+    atomic_init(&pool->pending, 0);
+    pool->depth = A2DP_STREAM_JITTER_MIN_DEPTH;
+    pool->prebuffering = true;
+    return ESP_OK;
+}
+
+static void a2dp_sink_pool_release(a2dp_sink_pool_t *pool)
+{
+    for (int i = 0; i < pool->hold_cnt; i++) {
+        atomic_fetch_add(&pool->pending, 1);
+        xQueueSend(s_aadp_handler.a2dp_queue, &pool->hold[i], 0);
+    }
+    pool->hold_cnt = 0;
+    pool->prebuffering = false;
+}
+
+static void a2dp_sink_pool_reset(a2dp_sink_pool_t *pool)
+{
+    for (int i = 0; i < pool->hold_cnt; i++) {
+        xQueueSend(pool->free_pkts, &pool->hold[i].data, 0);
+    }
+    pool->hold_cnt = 0;
+    pool->stable_cnt = 0;
+    pool->prebuffering = true;
+}
+
+/*
+ * Called for each sink data callback: the output ringbuffer found empty with nothing in flight means
+ * the playback starved since the last packet, so the next ones are held back to a deeper level.
+ */
+static void a2dp_sink_jitter_update(a2dp_sink_pool_t *pool, ringbuf_handle_t rb)
+{
+    if (pool->prebuffering || rb == NULL) {
+        return;
+    }
+    if (rb_bytes_filled(rb) == 0 && atomic_load(&pool->pending) == 0) {
+        if (pool->depth < pool->pkt_num / 2) {
+            pool->depth++;
+        }
+        ESP_LOGD(TAG, "a2dp sink underrun, jitter depth %d", pool->depth);
+        pool->stable_cnt = 0;
+        pool->prebuffering = true;
+    } else if (++pool->stable_cnt >= A2DP_STREAM_JITTER_STABLE_CNT) {
+        pool->stable_cnt = 0;
+        if (pool->depth > A2DP_STREAM_JITTER_MIN_DEPTH) {
+            pool->depth--;
+        }
+    }
+}
+
 static void audio_a2dp_stream_thread(void *pvParameters)
 {
     (void) pvParameters;
@@ -89,7 +191,8 @@ static void audio_a2dp_stream_thread(void *pvParameters)
             switch (recv_msg.type) {
             case A2DP_TYPE_SINK:
                     audio_element_output(s_aadp_handler.sink_stream, (char *)recv_msg.data, recv_msg.size);
-                    audio_free(recv_msg.data);
+                    atomic_fetch_sub(&s_sink_pool->pending, 1);
+                    xQueueSend(s_sink_pool->free_pkts, &recv_msg.data, 0);
                     recv_msg.data = NULL;
                 break;
             case A2DP_TYPE_DESTORY:
@@ -103,6 +206,7 @@ static void audio_a2dp_stream_thread(void *pvParameters)
     ESP_LOGI(TAG, "Delete the audio_a2dp_stream_thread");
     vQueueDelete(s_aadp_handler.a2dp_queue);
     s_aadp_handler.a2dp_queue = NULL;
+    a2dp_sink_pool_destroy();
     vTaskDelete(NULL);
 }
 
@@ -181,24 +285,46 @@ static void bt_a2d_sink_data_cb(const uint8_t *data, uint32_t len)
     if (s_aadp_handler.user_callback.user_a2d_sink_data_cb) {
         s_aadp_handler.user_callback.user_a2d_sink_data_cb(data, len);
     }
-    if (s_aadp_handler.sink_stream) {
-        if (audio_element_get_state(s_aadp_handler.sink_stream) == AEL_STATE_RUNNING) {
-            a2dp_data_t send_msg = {0};
-            send_msg.data = (uint8_t *) audio_calloc(1, len);
-            if (!send_msg.data) {
-                ESP_LOGE(TAG, "No ineffecitive memory to allocate(%d)", __LINE__);
-                return;
+    a2dp_sink_pool_t *pool = s_sink_pool;
+    if (s_aadp_handler.sink_stream == NULL || pool == NULL || s_aadp_handler.a2dp_queue == NULL) {
+        return;
+    }
+    if (audio_element_get_state(s_aadp_handler.sink_stream) != AEL_STATE_RUNNING) {
+        if (!pool->prebuffering || pool->hold_cnt) {
+            a2dp_sink_pool_reset(pool);
+        }
+        return;
+    }
+    ringbuf_handle_t rb = audio_element_get_output_ringbuf(s_aadp_handler.sink_stream);
+    a2dp_sink_jitter_update(pool, rb);
+    // Nothing in flight and room enough, the write can't block the bluetooth task nor pass older data
+    if (!pool->prebuffering && rb && atomic_load(&pool->pending) == 0 && rb_bytes_available(rb) >= len) {
+        audio_element_output(s_aadp_handler.sink_stream, (char *)data, len);
+        return;
+    }
+    while (len) {
+        a2dp_data_t send_msg = {0};
+        if (xQueueReceive(pool->free_pkts, &send_msg.data, 0) != pdTRUE) {
+            if ((pool->drop_cnt++ % 32) == 0) {
+                ESP_LOGW(TAG, "discard a2dp sink pkt(%d), sink_pool_pkt_num value needs to be expanded", (int)pool->drop_cnt);
             }
-            memcpy(send_msg.data, data, len);
-            send_msg.size = len;
-            send_msg.type = A2DP_TYPE_SINK;
-            if ((!s_aadp_handler.a2dp_queue) || xQueueSend( s_aadp_handler.a2dp_queue, &send_msg, 0)  != pdPASS ) {
-                ESP_LOGW(TAG, "discard a2dp(%p) sink pkt, A2DP_STREAM_QUEUE_SIZE value needs to be expanded", s_aadp_handler.a2dp_queue);
-                audio_free(send_msg.data);
-                send_msg.data = NULL;
-            } 
+            break;
+        }
+        send_msg.size = len < A2DP_STREAM_PKT_SIZE ? len : A2DP_STREAM_PKT_SIZE;
+        send_msg.type = A2DP_TYPE_SINK;
+        memcpy(send_msg.data, data, send_msg.size);
+        data += send_msg.size;
+        len -= send_msg.size;
+        if (pool->prebuffering) {
+            pool->hold[pool->hold_cnt++] = send_msg;
+        } else {
+            atomic_fetch_add(&pool->pending, 1);
+            xQueueSend(s_aadp_handler.a2dp_queue, &send_msg, 0);
         }
     }
+    if (pool->prebuffering && (pool->hold_cnt >= pool->depth || uxQueueMessagesWaiting(pool->free_pkts) == 0)) {
+        a2dp_sink_pool_release(pool);
+    }
 }
 
 static void bt_a2d_source_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
@@ -286,6 +412,8 @@ audio_element_handle_t a2dp_stream_init(a2dp_stream_config_t *config)
         ESP_LOGE(TAG, "a2dp stream already created. please terminate before create.");
         return NULL;
     }
+    AUDIO_CHECK(TAG, config->sink_pool_pkt_num <= 0 || config->sink_pool_pkt_num >= 2 * A2DP_STREAM_JITTER_MIN_DEPTH,
+                return NULL, "a2dp sink pool is too small");
 
     cfg.task_stack = -1; // No need task
     cfg.tag = "aadp";    
@@ -329,15 +457,25 @@ audio_element_handle_t a2dp_stream_init(a2dp_stream_config_t *config)
     memcpy(&s_aadp_handler.user_callback, &config->user_callback, sizeof(a2dp_stream_user_callback_t));
 
     if ( config->type == AUDIO_STREAM_READER ) {
-        s_aadp_handler.a2dp_queue = xQueueCreate(A2DP_STREAM_QUEUE_SIZE, sizeof(a2dp_data_t));
+        int pkt_num = config->sink_pool_pkt_num > 0 ? config->sink_pool_pkt_num : A2DP_STREAM_QUEUE_SIZE;
+        if (a2dp_sink_pool_create(pkt_num) != ESP_OK) {
+            ESP_LOGE(TAG, "Create a2dp sink pool failed(%d)", __LINE__);
+            return NULL;
+        }
+        // Room for every packet of the pool and the destroy message
+        s_aadp_handler.a2dp_queue = xQueueCreate(pkt_num + 1, sizeof(a2dp_data_t));
         if (s_aadp_handler.a2dp_queue == 0) {
             ESP_LOGE(TAG, "Create a2dp queue failed(%d)", __LINE__);
+            a2dp_sink_pool_destroy();
             return NULL;
         }
         esp_err_t err = audio_thread_create(&s_aadp_handler.a2dp_thread, "audio_a2dp_stream_thread", audio_a2dp_stream_thread, NULL,
                                 A2DP_STREAM_TASK_STACK, A2DP_STREAM_TASK_PRIO, A2DP_STREAM_TASK_IN_EXT, A2DP_STREAM_TASK_CORE);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Create audio_a2dp_stream_thread failed(%d)", __LINE__);
+            vQueueDelete(s_aadp_handler.a2dp_queue);
+            s_aadp_handler.a2dp_queue = NULL;
+            a2dp_sink_pool_destroy();
             return NULL;
         }
     }
@@ -53,6 +53,8 @@ typedef struct {
 typedef struct {
     audio_stream_type_t         type;
     a2dp_stream_user_callback_t user_callback;
+    int                         sink_pool_pkt_num;  /*!< Packets of `A2DP_STREAM_PKT_SIZE` bytes in the sink pool, 0 for `A2DP_STREAM_QUEUE_SIZE`.
+                                                         At least twice `A2DP_STREAM_JITTER_MIN_DEPTH` */
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 0, 0))
     audio_hal_handle_t          audio_hal;
 #endif
@@ -65,7 +67,24 @@ typedef struct {
 #define A2DP_STREAM_TASK_CORE           ( 0 )
 #define A2DP_STREAM_TASK_PRIO           ( 22 )
 #define A2DP_STREAM_TASK_IN_EXT         ( true )
+/**
+ * Default packets of the sink pool, allocated once when the stream is created. The pool prefers PSRAM,
+ * without it the whole pool takes internal RAM, so the default is kept close to the former queue depth.
+ */
+#if CONFIG_SPIRAM_BOOT_INIT
+#define A2DP_STREAM_QUEUE_SIZE          ( 64 )
+#else
 #define A2DP_STREAM_QUEUE_SIZE          ( 20 )
+#endif
+#define A2DP_STREAM_PKT_SIZE            ( 1024 )   /* Bytes of a pool packet, larger A2DP data spans several of them */
+
+/**
+ * Jitter depth of the a2dp sink, in pool packets held back before the data is released again after
+ * the output ringbuffer ran dry. It grows by one on each underrun, up to half of the pool, and shrinks
+ * by one after `A2DP_STREAM_JITTER_STABLE_CNT` data callbacks without any.
+ */
+#define A2DP_STREAM_JITTER_MIN_DEPTH    ( 4 )
+#define A2DP_STREAM_JITTER_STABLE_CNT   ( 512 )
 
 /**
  * @brief      Create a handle to an Audio Element to stream data from A2DP to another Element
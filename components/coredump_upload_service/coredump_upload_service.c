@@ -21,6 +21,7 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  */
+#include <stdio.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
@@ -33,6 +34,13 @@
 #include "esp_log.h"
 #include "esp_spi_flash.h"
 #include "esp_system.h"
+#include "esp_idf_version.h"
+#include "nvs.h"
+#if (ESP_IDF_VERSION_MAJOR == 4) && (ESP_IDF_VERSION_MINOR < 3)
+#include "esp32/rom/miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
 
 #include "audio_error.h"
 #include "audio_mem.h"
@@ -42,6 +50,10 @@ typedef struct {
     xQueueHandle cmd_q;
     EventGroupHandle_t sync_evt;
     bool (*do_post)(char *url, uint8_t *data, size_t len);
+    int chunk_size;
+    int segment_size;
+    bool compress;
+    bool resume;
 } coredump_upload_t;
 
 typedef struct {
@@ -52,10 +64,35 @@ typedef struct {
     void *pdata;
 } coredump_msg_t;
 
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t tail;
+    uint32_t offset;
+} coredump_progress_t;
+
+typedef struct {
+    esp_http_client_handle_t client;
+    tdefl_compressor        *deflator;
+    uint8_t                 *buf;
+    uint8_t                 *zbuf;
+    int                      chunk_size;
+} coredump_stream_t;
+
 #define COREDUMP_UPLOAD_SUCCESS (BIT0)
 #define COREDUMP_UPLOAD_FAIL    (BIT1)
 #define COREDUMP_UPLOAD_DESTROY (BIT2)
 
+#define COREDUMP_CHUNK_SIZE_DEFAULT (2048)
+#define COREDUMP_CHUNK_SIZE_MIN     (256)
+
+#define COREDUMP_PROGRESS_NAMESPACE "coredump"
+#define COREDUMP_PROGRESS_KEY       "upload"
+#define COREDUMP_PROGRESS_MAGIC     (0x43445550) /* 'CDUP' */
+
+/* zlib framed, greedy parsing with few probes: core dumps are mostly zero runs and stack words */
+#define COREDUMP_DEFLATE_FLAGS      (TDEFL_WRITE_ZLIB_HEADER | TDEFL_GREEDY_PARSING_FLAG | 16)
+
 static char *TAG = "COREDUMP_UPLOAD";
 
 static bool coredump_read(uint8_t **des, size_t *len)
@@ -82,42 +119,226 @@ static bool coredump_read(uint8_t **des, size_t *len)
     return true;
 }
 
-static bool coredump_do_http_post(char *url, uint8_t *data, size_t len)
+static bool coredump_progress_load(nvs_handle nvs, const coredump_progress_t *dump, uint32_t *offset)
+{
+    coredump_progress_t saved = { 0 };
+    size_t len = sizeof(saved);
+    if (nvs_get_blob(nvs, COREDUMP_PROGRESS_KEY, &saved, &len) != ESP_OK || len != sizeof(saved)) {
+        return false;
+    }
+    if (saved.magic != COREDUMP_PROGRESS_MAGIC || saved.size != dump->size || saved.tail != dump->tail
+        || saved.offset == 0 || saved.offset >= dump->size) {
+        return false;
+    }
+    *offset = saved.offset;
+    return true;
+}
+
+static void coredump_progress_save(nvs_handle nvs, coredump_progress_t *dump, uint32_t offset)
+{
+    dump->offset = offset;
+    if (nvs_set_blob(nvs, COREDUMP_PROGRESS_KEY, dump, sizeof(coredump_progress_t)) != ESP_OK
+        || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save the upload offset %u", offset);
+    }
+}
+
+static void coredump_progress_clear(nvs_handle nvs)
+{
+    if (nvs_erase_key(nvs, COREDUMP_PROGRESS_KEY) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+}
+
+static bool coredump_http_write(coredump_stream_t *stream, const uint8_t *data, int len)
+{
+    if (len <= 0) {
+        return true;
+    }
+    char head[12];
+    int head_len = snprintf(head, sizeof(head), "%x\r\n", len);
+    if (esp_http_client_write(stream->client, head, head_len) <= 0
+        || esp_http_client_write(stream->client, (const char *)data, len) <= 0
+        || esp_http_client_write(stream->client, "\r\n", 2) <= 0) {
+        ESP_LOGE(TAG, "Failed to write %d bytes", len);
+        return false;
+    }
+    return true;
+}
+
+static bool coredump_stream_write(coredump_stream_t *stream, const uint8_t *data, int len, bool finish)
+{
+    if (stream->deflator == NULL) {
+        return coredump_http_write(stream, data, len);
+    }
+    tdefl_flush flush = finish ? TDEFL_FINISH : TDEFL_NO_FLUSH;
+    while (1) {
+        size_t in_size = len;
+        size_t out_size = stream->chunk_size;
+        tdefl_status status = tdefl_compress(stream->deflator, data, &in_size, stream->zbuf, &out_size, flush);
+        if (status < TDEFL_STATUS_OKAY) {
+            ESP_LOGE(TAG, "Deflate failed, status %d", status);
+            return false;
+        }
+        if (coredump_http_write(stream, stream->zbuf, out_size) == false) {
+            return false;
+        }
+        data += in_size;
+        len -= in_size;
+        if (status == TDEFL_STATUS_DONE) {
+            return true;
+        }
+        if (flush == TDEFL_NO_FLUSH && len == 0 && out_size < (size_t)stream->chunk_size) {
+            return true;
+        }
+    }
+}
+
+static bool coredump_post_segment(coredump_stream_t *stream, char *url, size_t addr, uint32_t total, uint32_t offset, uint32_t len, bool ranged)
 {
     esp_http_client_config_t config = {
         .url = url,
         .method = HTTP_METHOD_POST,
     };
-    esp_http_client_handle_t http_client = esp_http_client_init(&config);
-    esp_http_client_set_header(http_client, "Content-Type", "application/octet-stream");
-    esp_http_client_set_post_field(http_client, (const char *)data, (int)len);
+    stream->client = esp_http_client_init(&config);
+    AUDIO_NULL_CHECK(TAG, stream->client, return false);
+    esp_http_client_set_header(stream->client, "Content-Type", "application/octet-stream");
+    if (stream->deflator) {
+        esp_http_client_set_header(stream->client, "Content-Encoding", "deflate");
+        tdefl_init(stream->deflator, NULL, NULL, COREDUMP_DEFLATE_FLAGS);
+    }
+    if (ranged) {
+        char range[48];
+        snprintf(range, sizeof(range), "bytes %u-%u/%u", offset, offset + len - 1, total);
+        esp_http_client_set_header(stream->client, "Content-Range", range);
+    }
     int response = 0;
-    if (esp_http_client_perform(http_client) == ESP_OK) {
-        response = esp_http_client_get_status_code(http_client);
-        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %d", response, esp_http_client_get_content_length(http_client));
-    } else {
+    /* A negative length makes the client send 'Transfer-Encoding: chunked', the framing is ours */
+    if (esp_http_client_open(stream->client, -1) != ESP_OK) {
         ESP_LOGE(TAG, "Post failed");
+        goto _exit;
+    }
+    uint32_t end = offset + len;
+    while (offset < end) {
+        int rlen = end - offset > (uint32_t)stream->chunk_size ? stream->chunk_size : (int)(end - offset);
+        if (spi_flash_read(addr + offset, stream->buf, rlen) != ESP_OK) {
+            ESP_LOGE(TAG, "Core dump read ERROR at %u", offset);
+            goto _exit;
+        }
+        offset += rlen;
+        if (coredump_stream_write(stream, stream->buf, rlen, offset == end) == false) {
+            goto _exit;
+        }
+    }
+    if (esp_http_client_write(stream->client, "0\r\n\r\n", 5) <= 0) {
+        goto _exit;
+    }
+    if (esp_http_client_fetch_headers(stream->client) < 0) {
+        ESP_LOGE(TAG, "Failed to get the response");
+        goto _exit;
+    }
+    response = esp_http_client_get_status_code(stream->client);
+    ESP_LOGI(TAG, "HTTP POST Status = %d, bytes %u/%u", response, end, total);
+_exit:
+    esp_http_client_close(stream->client);
+    esp_http_client_cleanup(stream->client);
+    stream->client = NULL;
+    return response >= 200 && response < 300;
+}
+
+static bool coredump_stream_upload(coredump_upload_t *uploader, char *url)
+{
+    size_t addr = 0;
+    size_t len = 0;
+    if (esp_core_dump_image_get(&addr, &len) != ESP_OK || len < sizeof(uint32_t)) {
+        ESP_LOGW(TAG, "No dump info to upload");
+        return false;
+    }
+    /* The dump ends with its own checksum, which together with the size tells two dumps apart */
+    coredump_progress_t dump = {
+        .magic = COREDUMP_PROGRESS_MAGIC,
+        .size = len,
+    };
+    if (spi_flash_read(addr + len - sizeof(uint32_t), &dump.tail, sizeof(uint32_t)) != ESP_OK) {
+        ESP_LOGE(TAG, "Core dump read ERROR");
+        return false;
+    }
+    uint32_t offset = 0;
+    nvs_handle nvs = 0;
+    bool has_nvs = false;
+    if (uploader->resume) {
+        if (nvs_open(COREDUMP_PROGRESS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+            has_nvs = true;
+            if (coredump_progress_load(nvs, &dump, &offset)) {
+                ESP_LOGI(TAG, "Resume the upload from %u/%u", offset, dump.size);
+            }
+        } else {
+            ESP_LOGW(TAG, "Failed to open NVS, upload from the beginning");
+        }
     }
-    esp_http_client_cleanup(http_client);
 
-    return response == 200 ? true : false;
+    bool ret = false;
+    coredump_stream_t stream = {
+        .chunk_size = uploader->chunk_size,
+    };
+    stream.buf = audio_calloc(1, stream.chunk_size);
+    AUDIO_MEM_CHECK(TAG, stream.buf, goto _exit);
+    if (uploader->compress) {
+        stream.deflator = audio_calloc(1, sizeof(tdefl_compressor));
+        stream.zbuf = audio_calloc(1, stream.chunk_size);
+        if (stream.deflator == NULL || stream.zbuf == NULL) {
+            ESP_LOGW(TAG, "No memory for deflate (%d bytes), upload uncompressed", (int)sizeof(tdefl_compressor));
+            audio_free(stream.deflator);
+            audio_free(stream.zbuf);
+            stream.deflator = NULL;
+            stream.zbuf = NULL;
+        }
+    }
+    bool ranged = uploader->segment_size > 0;
+    uint32_t segment = ranged ? (uint32_t)uploader->segment_size : dump.size;
+    while (offset < dump.size) {
+        uint32_t seg_len = dump.size - offset > segment ? segment : dump.size - offset;
+        if (coredump_post_segment(&stream, url, addr, dump.size, offset, seg_len, ranged) == false) {
+            goto _exit;
+        }
+        offset += seg_len;
+        if (has_nvs && offset < dump.size) {
+            coredump_progress_save(nvs, &dump, offset);
+        }
+    }
+    if (has_nvs) {
+        coredump_progress_clear(nvs);
+    }
+    ret = true;
+_exit:
+    audio_free(stream.buf);
+    audio_free(stream.zbuf);
+    audio_free(stream.deflator);
+    if (has_nvs) {
+        nvs_close(nvs);
+    }
+    return ret;
 }
 
 static bool coredump_upload_partition(coredump_upload_t *uploader, char *url)
 {
-    uint8_t *buf = NULL;
-    size_t len = 0;
     bool ret = false;
-    if (coredump_read(&buf, &len) == true) {
-        if (uploader->do_post(url, buf, len) == true) {
-            ESP_LOGI(TAG, "core dump upload success");
-            ret = true;
-        } else {
-            ESP_LOGE(TAG, "core dump upload failed");
+    if (uploader->do_post == NULL) {
+        ret = coredump_stream_upload(uploader, url);
+    } else {
+        uint8_t *buf = NULL;
+        size_t len = 0;
+        if (coredump_read(&buf, &len) == true) {
+            ret = uploader->do_post(url, buf, len);
+        }
+        if (buf != NULL) {
+            free(buf);
         }
     }
-    if (buf != NULL) {
-        free(buf);
+    if (ret) {
+        ESP_LOGI(TAG, "core dump upload success");
+    } else {
+        ESP_LOGE(TAG, "core dump upload failed");
     }
     return ret;
 }
@@ -222,7 +443,14 @@ periph_service_handle_t coredump_upload_service_create(coredump_upload_service_c
         free(uploader);
         return NULL;
     });
-    uploader->do_post = config->do_post != NULL ? config->do_post : coredump_do_http_post;
+    uploader->do_post = config->do_post;
+    uploader->chunk_size = config->chunk_size > 0 ? config->chunk_size : COREDUMP_CHUNK_SIZE_DEFAULT;
+    if (uploader->chunk_size < COREDUMP_CHUNK_SIZE_MIN) {
+        uploader->chunk_size = COREDUMP_CHUNK_SIZE_MIN;
+    }
+    uploader->segment_size = config->segment_size > 0 ? config->segment_size : 0;
+    uploader->compress = config->compress;
+    uploader->resume = config->resume;
     periph_service_config_t cfg = {
         .task_stack = config->task_stack,
         .task_prio = config->task_prio,
@@ -43,7 +43,17 @@ typedef struct {
     periph_service_cb evt_cb; /*!< Service callback function */
     void *cb_ctx;             /*!< Callback context */
     bool (*do_post)(char *url, uint8_t *data, size_t len); /*!< POST interface, users can override this to customize the http client.
-                                                                if left NULL, the service will use the default one */
+                                                                Note that it gets the whole image copied to RAM.
+                                                                if left NULL, the service streams the image from flash */
+    int chunk_size;           /*!< Flash read and HTTP chunk size of the streaming upload, 2048 if set to 0 */
+    int segment_size;         /*!< >0: split the image into POST requests of this many bytes, each tagged with
+                                   'Content-Range: bytes <first>-<last>/<total>' in image offsets;
+                                   0: post the whole image in one request */
+    bool compress;            /*!< Deflate every request body (zlib, 'Content-Encoding: deflate') with the ROM miniz.
+                                   The compressor needs about 300 KB, so this is meant for boards with PSRAM,
+                                   the upload goes uncompressed if it can not be allocated */
+    bool resume;              /*!< Save the offset of the last accepted segment to NVS and continue from it on the
+                                   next upload of the same image, requires `segment_size` and an initialized NVS */
 } coredump_upload_service_config_t;
 
 #define COREDUMP_UPLOAD_SERVICE_DEFAULT_CONFIG() \
@@ -54,6 +64,10 @@ typedef struct {
         .evt_cb = NULL,              \
         .cb_ctx = NULL,              \
         .do_post = NULL,             \
+        .chunk_size = 2048,          \
+        .segment_size = 0,           \
+        .compress = false,           \
+        .resume = false,             \
     }
 
 /**
@@ -67,6 +81,8 @@ bool coredump_need_upload();
 /**
  * @brief      Upload the core dump image to the url.
  *             This function will block the current task until the upload process finished.
+ *             Unless `do_post` is set, the image is read from flash and sent with chunked
+ *             transfer encoding, using two `chunk_size` buffers at most (plus the compressor).
  *
  * @param[in]  handle   the 'periph_service_handle_t'
  * @param[in]  url      server addr
@@ -39,13 +39,26 @@
 static const char *TAG = "DISPATCHER";
 
 #define  ESP_DISPATCHER_EVENT_SIZE  (3)
+#define  ESP_DISPATCHER_HASH_BITS   (4)
+#define  ESP_DISPATCHER_HASH_SIZE   (1 << ESP_DISPATCHER_HASH_BITS)
+#define  ESP_DISPATCHER_SEND_TIMEOUT_MS   (5000)
 
 typedef enum {
     ESP_DISPCH_EVENT_TYPE_UNKNOWN,
     ESP_DISPCH_EVENT_TYPE_CMD,
     ESP_DISPCH_EVENT_TYPE_EXE,
+    ESP_DISPCH_EVENT_TYPE_BATCH,
 } esp_dispatcher_event_type_t;
 
+/**
+ * Completion of one synchronous call, handed out from a per-dispatcher pool
+ */
+typedef struct dispatcher_done {
+    STAILQ_ENTRY(dispatcher_done)   entries;
+    SemaphoreHandle_t               sem;
+    action_result_t                 result;
+} esp_dispatcher_done_t;
+
 typedef struct {
     esp_dispatcher_event_type_t     type;
     int                             sub_index;
@@ -54,6 +67,9 @@ typedef struct {
     action_arg_t                    arg;
     func_ret_cb_t                   ret_cb;
     void                            *user_data;
+    esp_dispatcher_done_t           *done;
+    esp_dispatcher_job_t            *jobs;
+    int                             job_num;
 } esp_dispatcher_info_t;
 
 typedef struct evt_exe_item {
@@ -65,31 +81,25 @@ typedef struct evt_exe_item {
 
 typedef struct esp_dispatcher {
     audio_thread_t                                 thread;
-    QueueHandle_t                                  exe_que;
-    QueueHandle_t                                  result_que;
+    QueueHandle_t                                  exe_que[ESP_DISPATCHER_PRIO_MAX];
+    SemaphoreHandle_t                              pending;
     SemaphoreHandle_t                              mutex;
     TaskHandle_t                                   task_handle;
-    STAILQ_HEAD(action_exe_list, evt_exe_item)     exe_list;
+    volatile uint32_t                              served;
+    STAILQ_HEAD(action_exe_list, evt_exe_item)     exe_list[ESP_DISPATCHER_HASH_SIZE];
+    STAILQ_HEAD(done_list, dispatcher_done)        done_pool;
 } esp_dispatcher_t;
 
-
-static esp_err_t execute_index_exist(esp_dispatcher_handle_t h, int idx)
+static inline int exe_hash(int idx)
 {
-    esp_dispatcher_t *impl = (esp_dispatcher_t *)h;
-    esp_action_exe_item_t *item;
-    STAILQ_FOREACH(item, &impl->exe_list, entries) {
-        if (idx == item->sub_index) {
-            return ESP_OK;
-        }
-    }
-    return ESP_FAIL;
+    return (uint32_t)((uint32_t)idx * 2654435761U) >> (32 - ESP_DISPATCHER_HASH_BITS);
 }
 
 static esp_action_exe_item_t *found_exe_func(esp_dispatcher_handle_t h, int idx)
 {
     esp_dispatcher_t *impl = (esp_dispatcher_t *)h;
     esp_action_exe_item_t *item;
-    STAILQ_FOREACH(item, &impl->exe_list, entries) {
+    STAILQ_FOREACH(item, &impl->exe_list[exe_hash(idx)], entries) {
         if (idx == item->sub_index) {
             return item;
         }
@@ -97,78 +107,199 @@ static esp_action_exe_item_t *found_exe_func(esp_dispatcher_handle_t h, int idx)
     return NULL;
 }
 
+static esp_dispatcher_done_t *done_get(esp_dispatcher_t *impl)
+{
+    mutex_lock(impl->mutex);
+    esp_dispatcher_done_t *done = STAILQ_FIRST(&impl->done_pool);
+    if (done) {
+        STAILQ_REMOVE_HEAD(&impl->done_pool, entries);
+    }
+    mutex_unlock(impl->mutex);
+    if (done == NULL) {
+        done = audio_calloc(1, sizeof(esp_dispatcher_done_t));
+        AUDIO_MEM_CHECK(TAG, done, return NULL);
+        done->sem = xSemaphoreCreateBinary();
+        AUDIO_MEM_CHECK(TAG, done->sem, {
+            audio_free(done);
+            return NULL;
+        });
+    }
+    return done;
+}
+
+static void done_put(esp_dispatcher_t *impl, esp_dispatcher_done_t *done)
+{
+    mutex_lock(impl->mutex);
+    STAILQ_INSERT_HEAD(&impl->done_pool, done, entries);
+    mutex_unlock(impl->mutex);
+}
+
+static void dispatcher_complete(esp_dispatcher_info_t *msg, action_result_t *result)
+{
+    if (msg->ret_cb) {
+        msg->ret_cb(*result, msg->user_data);
+    } else if (msg->done) {
+        msg->done->result = *result;
+        xSemaphoreGive(msg->done->sem);
+    }
+}
+
+static void dispatcher_run_exe(esp_dispatcher_t *dispch, esp_dispatcher_info_t *msg)
+{
+    action_result_t result = {0};
+    esp_action_exe exe_func = NULL;
+    void *exe_handle = NULL;
+    ESP_LOGD(TAG, "EXE type:%d, index:%x, pfunc:%p, %p, %d",
+            msg->type, msg->sub_index, msg->pfunc, msg->arg.data, msg->arg.len);
+    if (msg->sub_index != -1) {
+        mutex_lock(dispch->mutex);
+        esp_action_exe_item_t *exe_item = found_exe_func(dispch, msg->sub_index);
+        if (exe_item) {
+            exe_func = exe_item->exe_func;
+            exe_handle = exe_item->exe_instance;
+        }
+        mutex_unlock(dispch->mutex);
+        if (exe_func == NULL) {
+            result.err = ESP_ERR_ADF_NOT_SUPPORT;
+            ESP_LOGW(TAG, "Not found index:%x", msg->sub_index);
+        }
+    } else if (msg->pfunc != NULL) {
+        exe_func = msg->pfunc;
+        exe_handle = msg->instance;
+    } else {
+        result.err = ESP_ERR_ADF_NOT_SUPPORT;
+        ESP_LOGW(TAG, "Unsupported type index:%x, pfunc:%p", msg->sub_index, msg->pfunc);
+    }
+    if (exe_func) {
+        result.err = exe_func(exe_handle, &msg->arg, &result);
+    }
+    dispatcher_complete(msg, &result);
+}
+
+static void dispatcher_run_batch(esp_dispatcher_info_t *msg)
+{
+    action_result_t result = {0};
+    for (int i = 0; i < msg->job_num; i++) {
+        esp_dispatcher_job_t *job = &msg->jobs[i];
+        memset(&job->result, 0, sizeof(action_result_t));
+        job->result.err = job->func(job->instance, &job->arg, &job->result);
+        if (job->result.err != ESP_OK && result.err == ESP_OK) {
+            result.err = job->result.err;
+        }
+    }
+    dispatcher_complete(msg, &result);
+}
+
+static bool dispatcher_receive(esp_dispatcher_t *dispch, esp_dispatcher_info_t *msg)
+{
+    if (xSemaphoreTake(dispch->pending, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    /* Every token stands for exactly one queued message, so some lane always has it */
+    for (int prio = ESP_DISPATCHER_PRIO_MAX - 1; prio >= 0; prio--) {
+        if (xQueueReceive(dispch->exe_que[prio], msg, 0) == pdTRUE) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void dispatcher_event_task(void *parameters)
 {
     esp_dispatcher_t *dispch = (esp_dispatcher_t *)parameters;
     esp_dispatcher_info_t msg = {0};
-    action_result_t result = {0};
-    esp_action_exe_item_t *exe_item = NULL;
     bool task_run = true;
     ESP_LOGI(TAG, "%s is running...", __func__);
     while (task_run) {
-        if (xQueueReceive(dispch->exe_que, &msg, portMAX_DELAY) == pdTRUE) {
+        if (dispatcher_receive(dispch, &msg)) {
             if (msg.type == ESP_DISPCH_EVENT_TYPE_EXE) {
-                esp_action_exe exe_func = NULL;
-                void *exe_handle = NULL;
-                result.err = ESP_OK;
-                result.data = 0;
-                result.len = 0;
-                ESP_LOGD(TAG, "EXE type:%d, index:%x, pfunc:%p, %p, %d",
-                        msg.type, msg.sub_index, msg.pfunc, msg.arg.data, msg.arg.len);
-                if (msg.sub_index != -1) {
-                    exe_item = found_exe_func(dispch, msg.sub_index);
-                    if (exe_item) {
-                        exe_func = exe_item->exe_func;
-                        exe_handle = exe_item->exe_instance;
-                    } else {
-                        result.err = ESP_ERR_ADF_NOT_SUPPORT;
-                        ESP_LOGW(TAG, "Not found index:%x", msg.sub_index);
-                    }
-                } else if (msg.sub_index == -1 && msg.pfunc != NULL) {
-                    exe_func = msg.pfunc;
-                    exe_handle = msg.instance;
-                } else {
-                    result.err = ESP_ERR_ADF_NOT_SUPPORT;
-                    ESP_LOGW(TAG, "Unsupported type index:%x, pfunc:%p", msg.sub_index, msg.pfunc);
-                }
-                if (exe_func) {
-                    result.err = exe_func(exe_handle, &msg.arg, &result);
-                }
-                if (msg.ret_cb) {
-                    msg.ret_cb(result, msg.user_data);
-                } else {
-                    if (xQueueSend(dispch->result_que, &result, pdMS_TO_TICKS(0)) == pdFALSE) {
-                        ESP_LOGW(TAG, "Send result failed, pfunc: %p, index:%x", msg.pfunc, msg.sub_index);
-                    }
-                }
+                dispatcher_run_exe(dispch, &msg);
+            } else if (msg.type == ESP_DISPCH_EVENT_TYPE_BATCH) {
+                dispatcher_run_batch(&msg);
             } else if (msg.type == ESP_DISPCH_EVENT_TYPE_CMD) {
                 task_run = false;
             }
+            dispch->served++;
         } else {
             ESP_LOGE(TAG, "Unknown queue or receive error");
         }
     }
-    result.err = ESP_OK;
-    result.data = 0;
-    result.len = 0;
-    xQueueSend(dispch->result_que, &result, 0 / portTICK_PERIOD_MS);
+    action_result_t result = {0};
+    dispatcher_complete(&msg, &result);
     vTaskDelete(NULL);
 }
 
+/*
+ * Queue a message in its lane. Senders no longer take turns on a lock, so a long backlog
+ * is not a failure by itself: the send only times out when the dispatcher has not finished
+ * any message for ESP_DISPATCHER_SEND_TIMEOUT_MS.
+ */
+static esp_err_t dispatcher_send(esp_dispatcher_t *impl, esp_dispatcher_prio_t prio, esp_dispatcher_info_t *info)
+{
+    uint32_t served = impl->served;
+    while (xQueueSend(impl->exe_que[prio], info, pdMS_TO_TICKS(ESP_DISPATCHER_SEND_TIMEOUT_MS)) != pdPASS) {
+        if (served == impl->served) {
+            ESP_LOGE(TAG, "Send timeout type:%d, index:%x", info->type, info->sub_index);
+            return ESP_ERR_ADF_TIMEOUT;
+        }
+        served = impl->served;
+    }
+    xSemaphoreGive(impl->pending);
+    return ESP_OK;
+}
+
+static esp_err_t dispatcher_call(esp_dispatcher_t *impl, esp_dispatcher_prio_t prio, esp_dispatcher_info_t *info, action_result_t *ret)
+{
+    info->done = done_get(impl);
+    AUDIO_MEM_CHECK(TAG, info->done, {
+        ret->err = ESP_ERR_NO_MEM;
+        return ESP_ERR_NO_MEM;
+    });
+    esp_err_t err = dispatcher_send(impl, prio, info);
+    if (err == ESP_OK) {
+        xSemaphoreTake(info->done->sem, portMAX_DELAY);
+        memcpy(ret, &info->done->result, sizeof(action_result_t));
+    } else {
+        memset(ret, 0, sizeof(action_result_t));
+        ret->err = ESP_FAIL;
+    }
+    done_put(impl, info->done);
+    return err;
+}
+
+static esp_err_t dispatcher_post(esp_dispatcher_t *impl, esp_dispatcher_prio_t prio, esp_dispatcher_info_t *info)
+{
+    esp_err_t err = dispatcher_send(impl, prio, info);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Message send timeout");
+        action_result_t result = {0};
+        result.err = ESP_FAIL;
+        if (info->ret_cb) {
+            info->ret_cb(result, info->user_data);
+        }
+    }
+    return err;
+}
+
 esp_err_t esp_dispatcher_reg_exe_func(esp_dispatcher_handle_t dh, void *exe_inst, int sub_event_index, esp_action_exe func)
 {
     esp_dispatcher_t *impl = (esp_dispatcher_t *)dh;
     AUDIO_NULL_CHECK(TAG, impl, return ESP_ERR_INVALID_ARG);
-    if (execute_index_exist(dh, sub_event_index) == ESP_OK) {
-        ESP_LOGW(TAG, "The %x index of function already exists", sub_event_index);
-        return ESP_ERR_ADF_ALREADY_EXISTS;
-    }
     esp_action_exe_item_t *item = audio_calloc(1, sizeof(esp_action_exe_item_t));
+    AUDIO_MEM_CHECK(TAG, item, return ESP_ERR_NO_MEM);
     item->sub_index = sub_event_index;
     item->exe_func = func;
     item->exe_instance = exe_inst;
 
-    STAILQ_INSERT_TAIL(&impl->exe_list, item, entries);
+    mutex_lock(impl->mutex);
+    if (found_exe_func(dh, sub_event_index)) {
+        mutex_unlock(impl->mutex);
+        audio_free(item);
+        ESP_LOGW(TAG, "The %x index of function already exists", sub_event_index);
+        return ESP_ERR_ADF_ALREADY_EXISTS;
+    }
+    STAILQ_INSERT_TAIL(&impl->exe_list[exe_hash(sub_event_index)], item, entries);
+    mutex_unlock(impl->mutex);
     return ESP_OK;
 }
 
@@ -186,15 +317,11 @@ esp_err_t esp_dispatcher_execute(esp_dispatcher_handle_t dh, int sub_event_index
     ESP_LOGI(TAG, "EXE IN, cmd type:%d, index:%x, data:%p, len:%d",
              info.type, info.sub_index, info.arg.data, info.arg.len);
 
-    mutex_lock(impl->mutex);
-    if (xQueueSend(impl->exe_que, &info, 5000 / portTICK_PERIOD_MS) == pdFALSE) {
-        ESP_LOGE(TAG, "Send timeout type:%d, index:%x", info.type, info.sub_index);
-        mutex_unlock(impl->mutex);
-        return ESP_ERR_ADF_TIMEOUT;
-    }
     action_result_t ret = {0};
-    xQueueReceive(impl->result_que, &ret, portMAX_DELAY);
-    mutex_unlock(impl->mutex);
+    esp_err_t err = dispatcher_call(impl, ESP_DISPATCHER_PRIO_NORMAL, &info, &ret);
+    if (err != ESP_OK) {
+        return err;
+    }
     if (out_result) {
         memcpy(out_result, &ret, sizeof(action_result_t));
     }
@@ -218,21 +345,11 @@ esp_err_t esp_dispatcher_execute_async(esp_dispatcher_handle_t dh, int sub_event
     }
     ESP_LOGI(TAG, "EXE IN, cmd type:%d, index:%x, data:%p, len:%d",
              info.type, info.sub_index, info.arg.data, info.arg.len);
-
-    mutex_lock(impl->mutex);
-    if (xQueueSend(impl->exe_que, &info, pdMS_TO_TICKS(5000)) != pdPASS) {
-        ESP_LOGE(TAG, "Message send timeout");
-        action_result_t result = {0};
-        result.err = ESP_FAIL;
-        ret_cb(result, user_data);
-        mutex_unlock(impl->mutex);
-        return ESP_ERR_ADF_TIMEOUT;
-    }
-    mutex_unlock(impl->mutex);
-    return ESP_OK;
+    return dispatcher_post(impl, ESP_DISPATCHER_PRIO_NORMAL, &info);
 }
 
-esp_err_t esp_dispatcher_execute_with_func(esp_dispatcher_handle_t dh,
+esp_err_t esp_dispatcher_execute_with_func_prio(esp_dispatcher_handle_t dh,
+                                        esp_dispatcher_prio_t prio,
                                         esp_action_exe func,
                                         void *instance,
                                         action_arg_t *arg,
@@ -241,27 +358,27 @@ esp_err_t esp_dispatcher_execute_with_func(esp_dispatcher_handle_t dh,
     esp_dispatcher_t *impl = (esp_dispatcher_t *)dh;
     AUDIO_NULL_CHECK(TAG, impl, return ESP_ERR_INVALID_ARG);
     AUDIO_NULL_CHECK(TAG, ret, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, prio >= ESP_DISPATCHER_PRIO_LOW && prio < ESP_DISPATCHER_PRIO_MAX, return ESP_ERR_INVALID_ARG, "Invalid prio");
 
     esp_dispatcher_info_t delegate = { 0 };
     delegate.type = ESP_DISPCH_EVENT_TYPE_EXE;
     delegate.sub_index = -1;
     delegate.pfunc = func;
     delegate.instance = instance;
-    delegate.ret_cb = NULL;
-    delegate.user_data = NULL;
     if (arg) {
         memcpy(&delegate.arg, arg, sizeof(action_arg_t));
     }
-    mutex_lock(impl->mutex);
-    if (xQueueSend(impl->exe_que, &delegate, pdMS_TO_TICKS(5000)) != pdPASS) {
-        ret->err = ESP_FAIL;
-        ESP_LOGE(TAG, "Message send timeout");
-        mutex_unlock(impl->mutex);
-        return ESP_ERR_ADF_TIMEOUT;
-    }
-    xQueueReceive(impl->result_que, ret, portMAX_DELAY);
-    mutex_unlock(impl->mutex);
-    return ret->err;
+    esp_err_t err = dispatcher_call(impl, prio, &delegate, ret);
+    return err == ESP_OK ? ret->err : err;
+}
+
+esp_err_t esp_dispatcher_execute_with_func(esp_dispatcher_handle_t dh,
+                                        esp_action_exe func,
+                                        void *instance,
+                                        action_arg_t *arg,
+                                        action_result_t *ret)
+{
+    return esp_dispatcher_execute_with_func_prio(dh, ESP_DISPATCHER_PRIO_NORMAL, func, instance, arg, ret);
 }
 
 esp_err_t esp_dispatcher_execute_with_func_async(esp_dispatcher_handle_t dh,
@@ -285,18 +402,31 @@ esp_err_t esp_dispatcher_execute_with_func_async(esp_dispatcher_handle_t dh,
     if (arg) {
         memcpy(&delegate.arg, arg, sizeof(action_arg_t));
     }
+    return dispatcher_post(impl, ESP_DISPATCHER_PRIO_NORMAL, &delegate);
+}
 
-    mutex_lock(impl->mutex);
-    if (xQueueSend(impl->exe_que, &delegate, pdMS_TO_TICKS(5000)) != pdPASS) {
-        ESP_LOGE(TAG, "Message send timeout");
-        action_result_t result = {0};
-        result.err = ESP_FAIL;
-        ret_cb(result, user_data);
-        mutex_unlock(impl->mutex);
-        return ESP_ERR_ADF_TIMEOUT;
+esp_err_t esp_dispatcher_execute_batch(esp_dispatcher_handle_t dh,
+                                        esp_dispatcher_prio_t prio,
+                                        esp_dispatcher_job_t *jobs,
+                                        int job_num)
+{
+    esp_dispatcher_t *impl = (esp_dispatcher_t *)dh;
+    AUDIO_NULL_CHECK(TAG, impl, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, jobs, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, job_num > 0, return ESP_ERR_INVALID_ARG, "Invalid job number");
+    AUDIO_CHECK(TAG, prio >= ESP_DISPATCHER_PRIO_LOW && prio < ESP_DISPATCHER_PRIO_MAX, return ESP_ERR_INVALID_ARG, "Invalid prio");
+    for (int i = 0; i < job_num; i++) {
+        AUDIO_NULL_CHECK(TAG, jobs[i].func, return ESP_ERR_INVALID_ARG);
     }
-    mutex_unlock(impl->mutex);
-    return ESP_OK;
+
+    esp_dispatcher_info_t batch = { 0 };
+    batch.type = ESP_DISPCH_EVENT_TYPE_BATCH;
+    batch.sub_index = -1;
+    batch.jobs = jobs;
+    batch.job_num = job_num;
+    action_result_t ret = { 0 };
+    esp_err_t err = dispatcher_call(impl, prio, &batch, &ret);
+    return err == ESP_OK ? ret.err : err;
 }
 
 esp_dispatcher_handle_t esp_dispatcher_create(esp_dispatcher_config_t *cfg)
@@ -304,14 +434,18 @@ esp_dispatcher_handle_t esp_dispatcher_create(esp_dispatcher_config_t *cfg)
     AUDIO_NULL_CHECK(TAG, cfg, return NULL);
     esp_dispatcher_handle_t impl = audio_calloc(1, sizeof(esp_dispatcher_t));
     AUDIO_MEM_CHECK(TAG, impl, return NULL);
-    impl->result_que = xQueueCreate(1, sizeof(action_result_t));
-    AUDIO_MEM_CHECK(TAG, impl->result_que, goto _failed;);
-    impl->exe_que = xQueueCreate(ESP_DISPATCHER_EVENT_SIZE, sizeof(esp_dispatcher_info_t));
-    AUDIO_MEM_CHECK(TAG, impl->exe_que, goto _failed;);
+    for (int i = 0; i < ESP_DISPATCHER_PRIO_MAX; i++) {
+        impl->exe_que[i] = xQueueCreate(ESP_DISPATCHER_EVENT_SIZE, sizeof(esp_dispatcher_info_t));
+        AUDIO_MEM_CHECK(TAG, impl->exe_que[i], goto _failed;);
+    }
+    impl->pending = xSemaphoreCreateCounting(ESP_DISPATCHER_EVENT_SIZE * ESP_DISPATCHER_PRIO_MAX, 0);
+    AUDIO_MEM_CHECK(TAG, impl->pending, goto _failed;);
     impl->mutex = mutex_create();
     AUDIO_MEM_CHECK(TAG, impl->mutex, goto _failed;);
-    STAILQ_INIT(&impl->exe_list);
-    ESP_LOGE(TAG, "exe first list: %p", STAILQ_FIRST(&impl->exe_list));
+    for (int i = 0; i < ESP_DISPATCHER_HASH_SIZE; i++) {
+        STAILQ_INIT(&impl->exe_list[i]);
+    }
+    STAILQ_INIT(&impl->done_pool);
 
     if (ESP_OK != audio_thread_create(&impl->thread,
                                           "esp_dispatcher",
@@ -326,13 +460,15 @@ esp_dispatcher_handle_t esp_dispatcher_create(esp_dispatcher_config_t *cfg)
     }
     return impl;
 _failed:
-    if (impl->result_que) {
-        vQueueDelete(impl->result_que);
-        impl->result_que = NULL;
+    for (int i = 0; i < ESP_DISPATCHER_PRIO_MAX; i++) {
+        if (impl->exe_que[i]) {
+            vQueueDelete(impl->exe_que[i]);
+            impl->exe_que[i] = NULL;
+        }
     }
-    if (impl->exe_que) {
-        vQueueDelete(impl->exe_que);
-        impl->exe_que = NULL;
+    if (impl->pending) {
+        vSemaphoreDelete(impl->pending);
+        impl->pending = NULL;
     }
     if (impl->mutex) {
         mutex_destroy(impl->mutex);
@@ -350,21 +486,31 @@ esp_err_t esp_dispatcher_destroy(esp_dispatcher_handle_t dh)
     esp_dispatcher_info_t info = {0};
     action_result_t ret = {0};
     info.type = ESP_DISPCH_EVENT_TYPE_CMD;
-    xQueueSend(impl->exe_que, &info, portMAX_DELAY);
-    xQueueReceive(impl->result_que, &ret, portMAX_DELAY);
-    esp_action_exe_item_t *item;
-    STAILQ_FOREACH(item, &impl->exe_list, entries) {
-        STAILQ_REMOVE(&impl->exe_list, item, evt_exe_item, entries);
-        audio_free(item);
+    /* The lowest lane is drained last, so everything queued before this still runs */
+    dispatcher_call(impl, ESP_DISPATCHER_PRIO_LOW, &info, &ret);
+    for (int i = 0; i < ESP_DISPATCHER_HASH_SIZE; i++) {
+        esp_action_exe_item_t *item;
+        while ((item = STAILQ_FIRST(&impl->exe_list[i])) != NULL) {
+            STAILQ_REMOVE_HEAD(&impl->exe_list[i], entries);
+            audio_free(item);
+        }
+    }
+    esp_dispatcher_done_t *done;
+    while ((done = STAILQ_FIRST(&impl->done_pool)) != NULL) {
+        STAILQ_REMOVE_HEAD(&impl->done_pool, entries);
+        vSemaphoreDelete(done->sem);
+        audio_free(done);
     }
 
-    if (impl->result_que) {
-        vQueueDelete(impl->result_que);
-        impl->result_que = NULL;
+    for (int i = 0; i < ESP_DISPATCHER_PRIO_MAX; i++) {
+        if (impl->exe_que[i]) {
+            vQueueDelete(impl->exe_que[i]);
+            impl->exe_que[i] = NULL;
+        }
     }
-    if (impl->exe_que) {
-        vQueueDelete(impl->exe_que);
-        impl->exe_que = NULL;
+    if (impl->pending) {
+        vSemaphoreDelete(impl->pending);
+        impl->pending = NULL;
     }
     if (impl->mutex) {
         mutex_destroy(impl->mutex);
@@ -50,6 +50,26 @@ typedef struct {
 
 typedef struct esp_dispatcher *esp_dispatcher_handle_t;
 
+/**
+ * @brief The dispatcher lanes, a pending request in a higher lane always runs first
+ */
+typedef enum {
+    ESP_DISPATCHER_PRIO_LOW = 0,    /*!< Background work, e.g. bulk NVS writes */
+    ESP_DISPATCHER_PRIO_NORMAL,     /*!< Default lane of all the calls without a priority */
+    ESP_DISPATCHER_PRIO_HIGH,       /*!< Latency sensitive work, e.g. flash tone reads */
+    ESP_DISPATCHER_PRIO_MAX,
+} esp_dispatcher_prio_t;
+
+/**
+ * @brief One function call of a batch, see `esp_dispatcher_execute_batch`
+ */
+typedef struct {
+    esp_action_exe              func;                   /*!< The function to invoke */
+    void                        *instance;              /*!< The execution instance */
+    action_arg_t                arg;                    /*!< The arguments of execution function */
+    action_result_t             result;                 /*!< The result of execution function, filled by the dispatcher */
+} esp_dispatcher_job_t;
+
 /**
  * @brief the delegate result callback type
  */
@@ -155,6 +175,52 @@ esp_err_t esp_dispatcher_execute_with_func(esp_dispatcher_handle_t handle,
                                         void *exe_inst,
                                         action_arg_t *arg,
                                         action_result_t *ret);
+/**
+ * @brief      Synchronize invoke functions in ESP dispatcher through the given lane
+ *
+ * @note       Synchronous callers do not wait for each other, each call owns its completion
+ *
+ * @param handle            The ESP dispatcher instance
+ * @param prio              The lane to queue the call in
+ * @param func              The function to invoke
+ * @param exe_inst          The execution instance
+ * @param arg               The arguments of execution function
+ * @param result            The result of execution function
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_ADF_TIMEOUT, the dispatcher did not make progress while the lane was full.
+ *     - Others, execute function result.
+ */
+esp_err_t esp_dispatcher_execute_with_func_prio(esp_dispatcher_handle_t handle,
+                                        esp_dispatcher_prio_t prio,
+                                        esp_action_exe func,
+                                        void *exe_inst,
+                                        action_arg_t *arg,
+                                        action_result_t *ret);
+
+/**
+ * @brief      Synchronize invoke a list of functions in ESP dispatcher as one request.
+ *             The jobs run back to back in order, with no other request in between,
+ *             and each job's result is stored in `jobs[i].result`.
+ *
+ * @param handle            The ESP dispatcher instance
+ * @param prio              The lane to queue the batch in
+ * @param jobs              The functions to invoke
+ * @param job_num           Number of jobs
+ *
+ * @return
+ *     - ESP_OK, all the jobs succeeded
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_ADF_TIMEOUT, the dispatcher did not make progress while the lane was full.
+ *     - Others, the first failed job's result.
+ */
+esp_err_t esp_dispatcher_execute_batch(esp_dispatcher_handle_t handle,
+                                        esp_dispatcher_prio_t prio,
+                                        esp_dispatcher_job_t *jobs,
+                                        int job_num);
+
 /**
  * @brief      Asynchronous invoke functions in ESP dispatcher
  *
@@ -111,3 +111,53 @@ TEST_CASE("esp_dispatcher stress test async", "esp-adf")
     vQueueDelete(que);
     esp_dispatcher_destroy(dispatcher);
 }
+
+static int exe_order[4];
+static int exe_count;
+
+static esp_err_t record(void *instance, action_arg_t *arg, action_result_t *result)
+{
+    exe_order[exe_count++] = (int)(intptr_t)instance;
+    result->len = (int)(intptr_t)instance;
+    return ESP_OK;
+}
+
+static void delegate_high_task(void *args)
+{
+    esp_dispatcher_handle_t dispatcher = (esp_dispatcher_handle_t)args;
+    action_result_t result = { 0 };
+    TEST_ASSERT_EQUAL(ESP_OK, esp_dispatcher_execute_with_func_prio(dispatcher, ESP_DISPATCHER_PRIO_HIGH, record, (void *)3, NULL, &result));
+    int cmd = 0;
+    xQueueSend(que, &cmd, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("esp_dispatcher priority lanes and batch", "esp-adf")
+{
+    audio_thread_t thread = NULL;
+    esp_dispatcher_config_t d_cfg = ESP_DISPATCHER_CONFIG_DEFAULT();
+    d_cfg.stack_in_ext = false;
+    void *dispatcher = esp_dispatcher_create(&d_cfg);
+    que = xQueueCreate(10, sizeof(uint8_t));
+    exe_count = 0;
+
+    // Keep the dispatcher busy, then queue low, normal and high requests behind it
+    TEST_ASSERT_EQUAL(ESP_OK, esp_dispatcher_execute_with_func_async(dispatcher, delay, NULL, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_dispatcher_execute_with_func_async(dispatcher, record, (void *)1, NULL, NULL, NULL));
+    esp_dispatcher_job_t low = {
+        .func = record,
+        .instance = (void *)2,
+    };
+    audio_thread_create(&thread, "high", delegate_high_task, dispatcher, 3 * 1024, 5, false, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_dispatcher_execute_batch(dispatcher, ESP_DISPATCHER_PRIO_LOW, &low, 1));
+    int cmd;
+    xQueueReceive(que, &cmd, portMAX_DELAY);
+    TEST_ASSERT_EQUAL(3, exe_count);
+    TEST_ASSERT_EQUAL(3, exe_order[0]);
+    TEST_ASSERT_EQUAL(1, exe_order[1]);
+    TEST_ASSERT_EQUAL(2, exe_order[2]);
+    TEST_ASSERT_EQUAL(2, low.result.len);
+
+    vQueueDelete(que);
+    esp_dispatcher_destroy(dispatcher);
+}
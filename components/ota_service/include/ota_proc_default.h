@@ -55,6 +55,21 @@ void ota_app_get_default_proc(ota_upgrade_ops_t *ops);
   */
 void ota_data_get_default_proc(ota_upgrade_ops_t *ops);
 
+/**
+  * @brief     get the delta process of `data partition` upgrade
+  *            The uri points to a patch generated by `tools/ota_delta/mk_ota_delta.py` from the image in the partition,
+  *            the partition is patched in place and verified against the digest of the new image.
+  *            The default `need_upgrade` refuses a patch made from another image, fall back to a full image upgrade then.
+  *
+  * @note      An interrupted patch leaves the partition neither old nor new, only a full image upgrade can restore it
+  *
+  * @param[in]  ops          pointer to `ota_upgrade_ops_t` structure
+  *
+  * @return
+  *    - void
+  */
+void ota_data_get_delta_proc(ota_upgrade_ops_t *ops);
+
 /**
   * @brief     read from the stream of upgrading
   *
@@ -70,6 +85,9 @@ ota_service_err_reason_t ota_data_image_stream_read(void *handle, char *buf, int
 
 /**
   * @brief     write to the data partition under upgrading
+  *            The partition is erased just ahead of the written data, no need to erase it before.
+  *            The data read by `ota_data_image_stream_read` is expected to be written back in order,
+  *            as the stream position is taken as the partition offset.
   *
   * @param[in]  handle          pointer to upgrade handle
   * @param[in]  buf             pointer to data buffer
@@ -81,6 +99,18 @@ ota_service_err_reason_t ota_data_image_stream_read(void *handle, char *buf, int
   */
 ota_service_err_reason_t ota_data_partition_write(void *handle, char *buf, int size);
 
+/**
+  * @brief     get the offset an interrupted upgrade of the same image reached
+  *            `need_upgrade` may skip the version check when resuming, as the partition already holds the incoming header
+  *
+  * @param[in]  handle          pointer to upgrade handle
+  *
+  * @return
+  *    - 0:       Start from scratch
+  *    - Others:  The upgrade goes on from this offset
+  */
+int ota_data_partition_get_resume_offset(void *handle);
+
 /**
   * @brief     Convert string of version to integer
   *            The version should be (V0.0.0 - V255.255.255)
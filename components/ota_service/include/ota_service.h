@@ -70,6 +70,8 @@ typedef enum {
     OTA_SERV_ERR_REASON_STREAM_INIT_FAIL      = OTA_SERVICE_ERR_REASON_BASE + 11,
     OTA_SERV_ERR_REASON_STREAM_RD_FAIL        = OTA_SERVICE_ERR_REASON_BASE + 12,
     OTA_SERV_ERR_REASON_GET_NEW_APP_DESC_FAIL = OTA_SERVICE_ERR_REASON_BASE + 13,
+    OTA_SERV_ERR_REASON_DELTA_BASE_MISMATCH   = OTA_SERVICE_ERR_REASON_BASE + 14,
+    OTA_SERV_ERR_REASON_VERIFY_FAIL           = OTA_SERVICE_ERR_REASON_BASE + 15,
 } ota_service_err_reason_t;
 
 /**
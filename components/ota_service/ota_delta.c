@@ -0,0 +1,367 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2020 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "ota_delta.h"
+
+static const char *TAG = "OTA_DELTA";
+
+#define OTA_DELTA_OP_DATA       (0x00)
+#define OTA_DELTA_OP_COPY       (0x01)
+
+typedef enum {
+    OTA_DELTA_ST_TAG,
+    OTA_DELTA_ST_LEN,
+    OTA_DELTA_ST_OFF,
+    OTA_DELTA_ST_DATA,
+} ota_delta_state_t;
+
+struct ota_delta {
+    const esp_partition_t   *partition;
+    ota_delta_header_t      header;
+    bool                    begun;
+    bool                    reverse;
+    char                    *sector;        /* The new content of the sector being built */
+    bool                    same;           /* Only copied in place so far, the sector needs no rewrite */
+    uint32_t                out_pos;        /* Next byte to build, or one past it when reverse */
+    char                    *window;        /* Old content of the last overwritten sectors, indexed by sector modulo */
+    int                     window_sectors;
+    ota_delta_state_t       state;
+    uint8_t                 op;
+    uint32_t                var;
+    int                     shift;
+    uint32_t                len;
+    int32_t                 rel;
+};
+
+static esp_err_t ota_delta_digest(ota_delta_handle_t delta, uint32_t size, uint8_t *sha256)
+{
+    esp_err_t ret = ESP_OK;
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0); /* SHA-256, not 224 */
+    for (uint32_t off = 0; off < size; off += OTA_DELTA_SECTOR_SIZE) {
+        uint32_t n = size - off < OTA_DELTA_SECTOR_SIZE ? size - off : OTA_DELTA_SECTOR_SIZE;
+        if ((ret = esp_partition_read(delta->partition, off, delta->sector, n)) != ESP_OK) {
+            break;
+        }
+        mbedtls_sha256_update(&ctx, (const unsigned char *)delta->sector, n);
+    }
+    mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+    return ret;
+}
+
+static inline uint32_t ota_delta_remaining(ota_delta_handle_t delta)
+{
+    return delta->reverse ? delta->out_pos : delta->header.new_size - delta->out_pos;
+}
+
+static inline uint32_t ota_delta_building(ota_delta_handle_t delta)
+{
+    return (delta->reverse ? delta->out_pos - 1 : delta->out_pos) / OTA_DELTA_SECTOR_SIZE;
+}
+
+/* Old content at `src`, from the flash when its sector is not overwritten yet, from the window otherwise */
+static esp_err_t ota_delta_read_old(ota_delta_handle_t delta, uint32_t building, uint32_t src, char *dst, uint32_t len)
+{
+    while (len > 0) {
+        uint32_t sector = src / OTA_DELTA_SECTOR_SIZE;
+        uint32_t in_sector = src % OTA_DELTA_SECTOR_SIZE;
+        uint32_t n = OTA_DELTA_SECTOR_SIZE - in_sector;
+        n = n < len ? n : len;
+        /* Sectors past the new content are never rewritten */
+        bool intact = delta->reverse ? sector <= building || sector > (delta->header.new_size - 1) / OTA_DELTA_SECTOR_SIZE
+                      : sector >= building;
+        if (intact) {
+            esp_err_t ret = esp_partition_read(delta->partition, src, dst, n);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        } else if ((delta->reverse ? sector - building : building - sector) <= (uint32_t)delta->window_sectors) {
+            memcpy(dst, delta->window + (sector % delta->window_sectors) * OTA_DELTA_SECTOR_SIZE + in_sector, n);
+        } else {
+            ESP_LOGE(TAG, "Copy from %u is out of the window when building sector %u", (unsigned int)src, (unsigned int)building);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        src += n;
+        dst += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_flush(ota_delta_handle_t delta, uint32_t sector)
+{
+    uint32_t start = sector * OTA_DELTA_SECTOR_SIZE;
+    uint32_t len = delta->header.new_size - start;
+    len = len < OTA_DELTA_SECTOR_SIZE ? len : OTA_DELTA_SECTOR_SIZE;
+    esp_err_t ret = ESP_OK;
+    /* Keep the old content, the next sectors may still copy from it */
+    if (delta->window_sectors > 0 && start < delta->header.old_size) {
+        char *slot = delta->window + (sector % delta->window_sectors) * OTA_DELTA_SECTOR_SIZE;
+        uint32_t n = delta->header.old_size - start;
+        n = n < OTA_DELTA_SECTOR_SIZE ? n : OTA_DELTA_SECTOR_SIZE;
+        if (delta->same && n <= len) {
+            memcpy(slot, delta->sector, n);
+        } else if ((ret = esp_partition_read(delta->partition, start, slot, n)) != ESP_OK) {
+            return ret;
+        }
+    }
+    if (delta->same == false) {
+        if ((ret = esp_partition_erase_range(delta->partition, start, OTA_DELTA_SECTOR_SIZE)) != ESP_OK
+            || (ret = esp_partition_write(delta->partition, start, delta->sector, len)) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to rewrite the sector at %u, ret %d", (unsigned int)start, ret);
+            return ret;
+        }
+    }
+    delta->same = true;
+    return ESP_OK;
+}
+
+/*
+ * Build up to `len` bytes of the current op within the sector being built, from `data` for DATA or the old content for COPY.
+ * Returns the number of bytes built.
+ */
+static int ota_delta_build(ota_delta_handle_t delta, const uint8_t *data, uint32_t len, esp_err_t *ret)
+{
+    uint32_t building = ota_delta_building(delta);
+    uint32_t start = building * OTA_DELTA_SECTOR_SIZE;
+    uint32_t room = delta->reverse ? delta->out_pos - start : start + OTA_DELTA_SECTOR_SIZE - delta->out_pos;
+    uint32_t n = len < room ? len : room;
+    uint32_t dst = delta->reverse ? delta->out_pos - n : delta->out_pos;
+    char *out = delta->sector + (dst - start);
+
+    if (data == NULL) {
+        /* `rel` is relative to the first byte of the op, the same for all the bytes */
+        *ret = ota_delta_read_old(delta, building, dst + delta->rel, out, n);
+        if (*ret != ESP_OK) {
+            return 0;
+        }
+        delta->same &= delta->rel == 0;
+    } else if (delta->reverse) {
+        for (uint32_t i = 0; i < n; i++) {
+            out[n - 1 - i] = data[i];
+        }
+        delta->same = false;
+    } else {
+        memcpy(out, data, n);
+        delta->same = false;
+    }
+    delta->out_pos = delta->reverse ? dst : dst + n;
+    bool done = delta->reverse ? dst == start : delta->out_pos == start + OTA_DELTA_SECTOR_SIZE;
+    if (done && (*ret = ota_delta_flush(delta, building)) != ESP_OK) {
+        return 0;
+    }
+    *ret = ESP_OK;
+    return n;
+}
+
+static esp_err_t ota_delta_copy(ota_delta_handle_t delta, uint32_t len)
+{
+    /* Bounds of the whole op, the reverse op ends at the cursor */
+    int64_t dst = delta->reverse ? (int64_t)delta->out_pos - len : delta->out_pos;
+    int64_t src = dst + delta->rel;
+    if (src < 0 || src + len > delta->header.old_size) {
+        ESP_LOGE(TAG, "Invalid copy of %u bytes from %lld", (unsigned int)len, (long long)src);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t ret = ESP_OK;
+    while (len > 0) {
+        int n = ota_delta_build(delta, NULL, len, &ret);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+ota_delta_handle_t ota_delta_create(const esp_partition_t *partition)
+{
+    AUDIO_NULL_CHECK(TAG, partition, return NULL);
+    ota_delta_handle_t delta = audio_calloc(1, sizeof(struct ota_delta));
+    AUDIO_MEM_CHECK(TAG, delta, return NULL);
+    delta->partition = partition;
+    delta->sector = audio_malloc(OTA_DELTA_SECTOR_SIZE);
+    AUDIO_MEM_CHECK(TAG, delta->sector, {
+        audio_free(delta);
+        return NULL;
+    });
+    return delta;
+}
+
+esp_err_t ota_delta_begin(ota_delta_handle_t delta, const ota_delta_header_t *header)
+{
+    AUDIO_NULL_CHECK(TAG, delta, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, header, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, header->magic == OTA_DELTA_MAGIC && header->version == OTA_DELTA_VERSION
+                && header->header_size == sizeof(ota_delta_header_t), return ESP_ERR_INVALID_ARG, "Not a delta patch");
+    AUDIO_CHECK(TAG, header->old_size <= delta->partition->size && header->new_size <= delta->partition->size,
+                return ESP_ERR_INVALID_ARG, "The patch doesn't fit the partition");
+    AUDIO_CHECK(TAG, header->window_size % OTA_DELTA_SECTOR_SIZE == 0 && header->window_size <= OTA_DELTA_WINDOW_MAX,
+                return ESP_ERR_INVALID_ARG, "Unsupported patch window");
+    memcpy(&delta->header, header, sizeof(ota_delta_header_t));
+
+    uint8_t sha256[32];
+    esp_err_t ret = ota_delta_digest(delta, header->old_size, sha256);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (memcmp(sha256, header->old_sha256, sizeof(sha256))) {
+        ESP_LOGW(TAG, "[%s] is not the base of the patch", delta->partition->label);
+        return ESP_ERR_INVALID_STATE;
+    }
+    audio_free(delta->window);
+    delta->window = NULL;
+    delta->window_sectors = header->window_size / OTA_DELTA_SECTOR_SIZE;
+    if (delta->window_sectors > 0) {
+        delta->window = audio_malloc(header->window_size);
+        AUDIO_MEM_CHECK(TAG, delta->window, return ESP_ERR_NO_MEM);
+    }
+    delta->reverse = header->flags & OTA_DELTA_FLAG_REVERSE;
+    delta->same = true;
+    delta->out_pos = delta->reverse ? header->new_size : 0;
+    delta->state = OTA_DELTA_ST_TAG;
+    delta->begun = true;
+    ESP_LOGI(TAG, "Patch [%s] %u -> %u bytes, window %u", delta->partition->label, (unsigned int)header->old_size,
+             (unsigned int)header->new_size, (unsigned int)header->window_size);
+    return ESP_OK;
+}
+
+esp_err_t ota_delta_write(ota_delta_handle_t delta, const char *buf, int len)
+{
+    AUDIO_NULL_CHECK(TAG, delta, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, delta->begun, return ESP_ERR_INVALID_STATE, "Run ota_delta_begin first");
+    esp_err_t ret = ESP_OK;
+    const uint8_t *data = (const uint8_t *)buf;
+    while (len > 0) {
+        switch (delta->state) {
+            case OTA_DELTA_ST_TAG:
+                delta->op = *data++;
+                len--;
+                if ((delta->op != OTA_DELTA_OP_DATA && delta->op != OTA_DELTA_OP_COPY) || ota_delta_remaining(delta) == 0) {
+                    ESP_LOGE(TAG, "Unexpected op 0x%02x at %u", delta->op, (unsigned int)delta->out_pos);
+                    return ESP_ERR_INVALID_SIZE;
+                }
+                delta->var = 0;
+                delta->shift = 0;
+                delta->state = OTA_DELTA_ST_LEN;
+                break;
+            case OTA_DELTA_ST_LEN:
+            case OTA_DELTA_ST_OFF: {
+                uint8_t byte = *data++;
+                len--;
+                if (delta->shift > 28) {
+                    ESP_LOGE(TAG, "Varint overflow");
+                    return ESP_ERR_INVALID_SIZE;
+                }
+                delta->var |= (uint32_t)(byte & 0x7F) << delta->shift;
+                delta->shift += 7;
+                if (byte & 0x80) {
+                    break;
+                }
+                if (delta->state == OTA_DELTA_ST_LEN) {
+                    delta->len = delta->var;
+                    if (delta->len == 0 || delta->len > ota_delta_remaining(delta)) {
+                        ESP_LOGE(TAG, "Invalid op length %u at %u", (unsigned int)delta->len, (unsigned int)delta->out_pos);
+                        return ESP_ERR_INVALID_SIZE;
+                    }
+                    delta->var = 0;
+                    delta->shift = 0;
+                    delta->state = delta->op == OTA_DELTA_OP_DATA ? OTA_DELTA_ST_DATA : OTA_DELTA_ST_OFF;
+                    break;
+                }
+                delta->rel = (int32_t)(delta->var >> 1) ^ -(int32_t)(delta->var & 1);
+                if ((ret = ota_delta_copy(delta, delta->len)) != ESP_OK) {
+                    return ret;
+                }
+                delta->state = OTA_DELTA_ST_TAG;
+                break;
+            }
+            case OTA_DELTA_ST_DATA: {
+                int n = ota_delta_build(delta, data, delta->len < (uint32_t)len ? delta->len : (uint32_t)len, &ret);
+                if (ret != ESP_OK) {
+                    return ret;
+                }
+                data += n;
+                len -= n;
+                delta->len -= n;
+                if (delta->len == 0) {
+                    delta->state = OTA_DELTA_ST_TAG;
+                }
+                break;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_delta_finish(ota_delta_handle_t delta)
+{
+    AUDIO_NULL_CHECK(TAG, delta, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, delta->begun, return ESP_ERR_INVALID_STATE, "Run ota_delta_begin first");
+    if (delta->state != OTA_DELTA_ST_TAG || ota_delta_remaining(delta) > 0) {
+        ESP_LOGE(TAG, "Patch truncated, %u bytes left", (unsigned int)ota_delta_remaining(delta));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* Only the last sector of a forward patch may be left partial */
+    esp_err_t ret = ESP_OK;
+    if (delta->reverse == false && delta->out_pos % OTA_DELTA_SECTOR_SIZE
+        && (ret = ota_delta_flush(delta, delta->out_pos / OTA_DELTA_SECTOR_SIZE)) != ESP_OK) {
+        return ret;
+    }
+    delta->begun = false;
+    return ota_delta_verify(delta);
+}
+
+esp_err_t ota_delta_verify(ota_delta_handle_t delta)
+{
+    AUDIO_NULL_CHECK(TAG, delta, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, delta->header.magic == OTA_DELTA_MAGIC, return ESP_ERR_INVALID_STATE, "No patch header");
+    uint8_t sha256[32];
+    esp_err_t ret = ota_delta_digest(delta, delta->header.new_size, sha256);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (memcmp(sha256, delta->header.new_sha256, sizeof(sha256))) {
+        ESP_LOGE(TAG, "[%s] doesn't match the patched content", delta->partition->label);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_delta_destroy(ota_delta_handle_t delta)
+{
+    AUDIO_NULL_CHECK(TAG, delta, return ESP_ERR_INVALID_ARG);
+    audio_free(delta->window);
+    audio_free(delta->sector);
+    audio_free(delta);
+    return ESP_OK;
+}
@@ -0,0 +1,147 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2020 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _OTA_DELTA_H_
+#define _OTA_DELTA_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_DELTA_MAGIC         (0x544c444f) /* 'ODLT' */
+#define OTA_DELTA_VERSION       (1)
+#define OTA_DELTA_SECTOR_SIZE   (4096)
+#define OTA_DELTA_WINDOW_MAX    (64 * 1024)
+#define OTA_DELTA_FLAG_REVERSE  (1 << 0)
+
+/**
+ * @brief      Delta patch header, generated by `tools/ota_delta/mk_ota_delta.py`, all fields are little endian
+ *
+ *             The header is followed by the operations rebuilding the new content in order:
+ *             - DATA (0x00), varint `len`, `len` literal bytes
+ *             - COPY (0x01), varint `len`, zigzag varint `src - dst`, copy `len` bytes of the old content
+ *
+ *             The partition is patched in place sector by sector, the old content of the last `window_size` bytes
+ *             of overwritten sectors is kept in RAM, so a COPY may read at most that far behind the sector being built.
+ *             With OTA_DELTA_FLAG_REVERSE the sectors are rebuilt from the last one down, so content moved to a higher
+ *             address can be copied. The operations then come from the end of the new content, with DATA bytes reversed.
+ */
+typedef struct {
+    uint32_t    magic;              /*!< OTA_DELTA_MAGIC */
+    uint16_t    version;            /*!< OTA_DELTA_VERSION */
+    uint16_t    header_size;        /*!< sizeof(ota_delta_header_t) */
+    uint32_t    window_size;        /*!< RAM window needed to apply the patch, a multiple of the sector size */
+    uint32_t    old_size;           /*!< Size of the content the patch applies to */
+    uint32_t    new_size;           /*!< Size of the patched content */
+    uint32_t    flags;              /*!< OTA_DELTA_FLAG_xxx */
+    uint8_t     old_sha256[32];     /*!< SHA-256 of the old content */
+    uint8_t     new_sha256[32];     /*!< SHA-256 of the new content */
+} ota_delta_header_t;
+
+typedef struct ota_delta *ota_delta_handle_t;
+
+/**
+ * @brief      Create a delta patch applier
+ *
+ * @param      partition  The partition to patch
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The applier handle
+ */
+ota_delta_handle_t ota_delta_create(const esp_partition_t *partition);
+
+/**
+ * @brief      Check the patch header and that the partition holds the content the patch was made from
+ *
+ * @param      delta   The applier handle
+ * @param      header  The patch header
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG    Not a supported patch, or it doesn't fit the partition
+ *     - ESP_ERR_INVALID_STATE  The partition content differs from the patch base
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t ota_delta_begin(ota_delta_handle_t delta, const ota_delta_header_t *header);
+
+/**
+ * @brief      Apply the next bytes of the patch operations, the partition is rewritten as the sectors are completed
+ *
+ * @param      delta  The applier handle
+ * @param      buf    The patch data
+ * @param      len    The data length
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_SIZE  Malformed patch
+ *     - Others                Flash error
+ */
+esp_err_t ota_delta_write(ota_delta_handle_t delta, const char *buf, int len);
+
+/**
+ * @brief      Write the last sector and verify the partition against the new content digest
+ *
+ * @param      delta  The applier handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_SIZE   The patch is truncated
+ *     - ESP_ERR_INVALID_CRC    Verification failed
+ *     - Others                 Flash error
+ */
+esp_err_t ota_delta_finish(ota_delta_handle_t delta);
+
+/**
+ * @brief      Check whether the partition already holds the new content of the patch given to `ota_delta_begin`
+ *
+ * @param      delta  The applier handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_CRC  Digest mismatch
+ *     - Others               Flash error
+ */
+esp_err_t ota_delta_verify(ota_delta_handle_t delta);
+
+/**
+ * @brief      Free the applier
+ *
+ * @param      delta  The applier handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t ota_delta_destroy(ota_delta_handle_t delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
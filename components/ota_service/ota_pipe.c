@@ -0,0 +1,465 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2020 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "audio_thread.h"
+#include "audio_error.h"
+#include "ota_pipe.h"
+
+static const char *TAG = "OTA_PIPE";
+
+#define OTA_PIPE_SECTOR_SIZE    (4096)
+#define OTA_PIPE_BLOCK_SIZE     (65536)
+#define OTA_PIPE_VERIFY_SIZE    (256)
+
+#define OTA_JOURNAL_NAMESPACE   "ota_journal"
+#define OTA_JOURNAL_MAGIC       (0x4f54414a) /* 'OTAJ' */
+
+#define OTA_PIPE_WORK_BIT       (BIT0)
+#define OTA_PIPE_IDLE_BIT       (BIT1)
+#define OTA_PIPE_EXIT_BIT       (BIT2)
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    source_id;
+    uint32_t    content_id;
+    int32_t     total_size;
+    int32_t     offset;
+} ota_journal_t;
+
+struct ota_pipe {
+    ota_pipe_cfg_t      cfg;
+    void                *lock;
+    EventGroupHandle_t  events;
+    audio_thread_t      thread;
+    nvs_handle          nvs;
+    bool                has_nvs;
+    char                key[9];
+    char                *buf[2];
+    int                 cur;            /* Index of the buffer being filled */
+    int                 fill;
+    int                 buf_off;        /* Image offset of the first byte of the buffer being filled */
+    int                 pending;        /* Index of the buffer handed to the flash task, -1 if none */
+    int                 pend_off;
+    int                 pend_len;
+    bool                running;
+    esp_err_t           err;
+    int                 resume;         /* Sector aligned offset committed by an interrupted upgrade */
+    int                 limit;          /* End of the range that may be erased */
+    int                 erased_to;      /* Owned by the flash task */
+    int                 journal_off;    /* Owned by the flash task */
+};
+
+static uint32_t ota_pipe_digest(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    }
+    return hash;
+}
+
+static esp_err_t ota_pipe_save_journal(ota_pipe_handle_t pipe, int offset)
+{
+    if (pipe->has_nvs == false) {
+        return ESP_OK;
+    }
+    ota_journal_t journal = {
+        .magic = OTA_JOURNAL_MAGIC,
+        .source_id = pipe->cfg.source_id,
+        .content_id = pipe->cfg.content_id,
+        .total_size = pipe->cfg.total_size,
+        .offset = offset,
+    };
+    esp_err_t ret = nvs_set_blob(pipe->nvs, pipe->key, &journal, sizeof(journal));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(pipe->nvs);
+    }
+    return ret;
+}
+
+static void ota_pipe_load_journal(ota_pipe_handle_t pipe)
+{
+    snprintf(pipe->key, sizeof(pipe->key), "%08x", (unsigned int)ota_pipe_digest(pipe->cfg.partition->label));
+    if (nvs_open(OTA_JOURNAL_NAMESPACE, NVS_READWRITE, &pipe->nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open the journal, resume disabled");
+        return;
+    }
+    pipe->has_nvs = true;
+    ota_journal_t journal = { 0 };
+    size_t len = sizeof(journal);
+    if (nvs_get_blob(pipe->nvs, pipe->key, &journal, &len) != ESP_OK) {
+        return;
+    }
+    if (len == sizeof(journal) && journal.magic == OTA_JOURNAL_MAGIC
+        && journal.source_id == pipe->cfg.source_id
+        && journal.content_id == pipe->cfg.content_id && pipe->cfg.content_id != 0
+        && journal.total_size == pipe->cfg.total_size && pipe->cfg.total_size > 0
+        && journal.offset > 0 && journal.offset <= pipe->cfg.total_size
+        && journal.offset % OTA_PIPE_SECTOR_SIZE == 0) {
+        pipe->resume = journal.offset;
+        ESP_LOGI(TAG, "Resume [%s] from %d/%d", pipe->cfg.partition->label, journal.offset, journal.total_size);
+        return;
+    }
+    /* The partition is about to be overwritten by another image, the old progress means nothing now */
+    ota_pipe_clear_journal(pipe);
+}
+
+/* Erase whole 64 KB blocks when aligned, they are erased much faster than 16 sectors */
+static esp_err_t ota_pipe_erase_to(ota_pipe_handle_t pipe, int end)
+{
+    int target = end + pipe->cfg.erase_ahead;
+    if (target > pipe->limit) {
+        target = pipe->limit;
+    }
+    if (target < end) {
+        target = (end + OTA_PIPE_SECTOR_SIZE - 1) & ~(OTA_PIPE_SECTOR_SIZE - 1);
+    }
+    while (pipe->erased_to < target) {
+        int size = OTA_PIPE_SECTOR_SIZE;
+        if (pipe->erased_to % OTA_PIPE_BLOCK_SIZE == 0 && pipe->erased_to + OTA_PIPE_BLOCK_SIZE <= pipe->limit) {
+            size = OTA_PIPE_BLOCK_SIZE;
+        }
+        esp_err_t ret = esp_partition_erase_range(pipe->cfg.partition, pipe->erased_to, size);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase %d bytes at %d, ret %d", size, pipe->erased_to, ret);
+            return ret;
+        }
+        pipe->erased_to += size;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_pipe_verify(ota_pipe_handle_t pipe, const char *data, int offset, int len)
+{
+    char flash[OTA_PIPE_VERIFY_SIZE];
+    while (len > 0) {
+        int n = len < (int)sizeof(flash) ? len : (int)sizeof(flash);
+        esp_err_t ret = esp_partition_read(pipe->cfg.partition, offset, flash, n);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (memcmp(flash, data, n)) {
+            ESP_LOGE(TAG, "The resumed image differs from the flash at %d", offset);
+            return ESP_ERR_INVALID_STATE;
+        }
+        data += n;
+        offset += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_pipe_flash(ota_pipe_handle_t pipe, const char *data, int offset, int len)
+{
+    esp_err_t ret = ESP_OK;
+    if (offset + len > (int)pipe->cfg.partition->size) {
+        ESP_LOGE(TAG, "Image exceeds the partition size %d", (int)pipe->cfg.partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset + len > pipe->limit) {
+        pipe->limit = pipe->cfg.partition->size;
+    }
+    if (offset < pipe->resume) {
+        int n = pipe->resume - offset < len ? pipe->resume - offset : len;
+        if ((ret = ota_pipe_verify(pipe, data, offset, n)) != ESP_OK) {
+            return ret;
+        }
+        data += n;
+        offset += n;
+        len -= n;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    if ((ret = ota_pipe_erase_to(pipe, offset + len)) != ESP_OK) {
+        return ret;
+    }
+    if ((ret = esp_partition_write(pipe->cfg.partition, offset, data, len)) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write %d bytes at %d, ret %d", len, offset, ret);
+        return ret;
+    }
+    /* Only whole sectors are journaled, a resume erases the sector it restarts in again */
+    int committed = (offset + len) & ~(OTA_PIPE_SECTOR_SIZE - 1);
+    if (pipe->cfg.journal_interval > 0 && committed >= pipe->journal_off + pipe->cfg.journal_interval) {
+        if (ota_pipe_save_journal(pipe, committed) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save the journal");
+        }
+        pipe->journal_off = committed;
+        ESP_LOGI(TAG, "[%s] %d/%d bytes written", pipe->cfg.partition->label, committed, pipe->cfg.total_size);
+    }
+    return ESP_OK;
+}
+
+static void ota_pipe_task(void *arg)
+{
+    ota_pipe_handle_t pipe = (ota_pipe_handle_t)arg;
+    mutex_lock(pipe->lock);
+    while (1) {
+        if (pipe->pending >= 0) {
+            const char *data = pipe->buf[pipe->pending];
+            int offset = pipe->pend_off;
+            int len = pipe->pend_len;
+            bool skip = pipe->err != ESP_OK;
+            mutex_unlock(pipe->lock);
+            esp_err_t ret = skip ? ESP_OK : ota_pipe_flash(pipe, data, offset, len);
+            mutex_lock(pipe->lock);
+            if (ret != ESP_OK) {
+                pipe->err = ret;
+            }
+            pipe->pending = -1;
+            xEventGroupSetBits(pipe->events, OTA_PIPE_IDLE_BIT);
+            continue;
+        }
+        if (pipe->running == false) {
+            break;
+        }
+        xEventGroupClearBits(pipe->events, OTA_PIPE_WORK_BIT);
+        mutex_unlock(pipe->lock);
+        xEventGroupWaitBits(pipe->events, OTA_PIPE_WORK_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+        mutex_lock(pipe->lock);
+    }
+    xEventGroupSetBits(pipe->events, OTA_PIPE_EXIT_BIT);
+    mutex_unlock(pipe->lock);
+    audio_thread_delete_task(&pipe->thread);
+}
+
+/* Called with the lock held */
+static void ota_pipe_wait_idle(ota_pipe_handle_t pipe)
+{
+    while (pipe->pending >= 0) {
+        xEventGroupClearBits(pipe->events, OTA_PIPE_IDLE_BIT);
+        mutex_unlock(pipe->lock);
+        xEventGroupWaitBits(pipe->events, OTA_PIPE_IDLE_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+        mutex_lock(pipe->lock);
+    }
+}
+
+/* Hand the filled buffer over to the flash task and go on with the other one */
+static esp_err_t ota_pipe_submit(ota_pipe_handle_t pipe)
+{
+    mutex_lock(pipe->lock);
+    ota_pipe_wait_idle(pipe);
+    esp_err_t ret = pipe->err;
+    if (ret == ESP_OK && pipe->fill > 0) {
+        pipe->pending = pipe->cur;
+        pipe->pend_off = pipe->buf_off;
+        pipe->pend_len = pipe->fill;
+        xEventGroupSetBits(pipe->events, OTA_PIPE_WORK_BIT);
+        pipe->cur ^= 1;
+        pipe->buf_off += pipe->fill;
+        pipe->fill = 0;
+    }
+    mutex_unlock(pipe->lock);
+    return ret;
+}
+
+ota_pipe_handle_t ota_pipe_create(const ota_pipe_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_NULL_CHECK(TAG, cfg->partition, return NULL);
+    AUDIO_CHECK(TAG, cfg->buffer_size >= OTA_PIPE_SECTOR_SIZE, return NULL, "The buffer must hold at least a sector");
+    AUDIO_CHECK(TAG, cfg->total_size >= 0 && cfg->total_size <= (int)cfg->partition->size, return NULL, "Invalid image size");
+    ota_pipe_handle_t pipe = audio_calloc(1, sizeof(struct ota_pipe));
+    AUDIO_MEM_CHECK(TAG, pipe, return NULL);
+    memcpy(&pipe->cfg, cfg, sizeof(ota_pipe_cfg_t));
+    pipe->cfg.buffer_size -= cfg->buffer_size % OTA_PIPE_SECTOR_SIZE;
+    pipe->pending = -1;
+    pipe->lock = mutex_create();
+    pipe->events = xEventGroupCreate();
+    pipe->buf[0] = audio_malloc(pipe->cfg.buffer_size);
+    pipe->buf[1] = audio_malloc(pipe->cfg.buffer_size);
+    AUDIO_MEM_CHECK(TAG, pipe->lock && pipe->events && pipe->buf[0] && pipe->buf[1], goto _failed);
+
+    if (cfg->journal_interval > 0) {
+        ota_pipe_load_journal(pipe);
+    }
+    pipe->limit = pipe->cfg.partition->size;
+    if (cfg->total_size > 0) {
+        int end = (cfg->total_size + OTA_PIPE_SECTOR_SIZE - 1) & ~(OTA_PIPE_SECTOR_SIZE - 1);
+        pipe->limit = end < pipe->limit ? end : pipe->limit;
+    }
+    pipe->erased_to = pipe->resume;
+    pipe->journal_off = pipe->resume;
+    pipe->running = true;
+    if (audio_thread_create(&pipe->thread, "ota_pipe", ota_pipe_task, pipe, cfg->task_stack,
+                            cfg->task_prio, cfg->stack_in_ext, cfg->task_core) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the flash task");
+        goto _failed;
+    }
+    return pipe;
+_failed:
+    pipe->running = false;
+    if (pipe->has_nvs) {
+        nvs_close(pipe->nvs);
+    }
+    if (pipe->events) {
+        vEventGroupDelete(pipe->events);
+    }
+    if (pipe->lock) {
+        mutex_destroy(pipe->lock);
+    }
+    audio_free(pipe->buf[0]);
+    audio_free(pipe->buf[1]);
+    audio_free(pipe);
+    return NULL;
+}
+
+int ota_pipe_get_resume_offset(ota_pipe_handle_t pipe)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return 0);
+    return pipe->resume;
+}
+
+int ota_pipe_get_offset(ota_pipe_handle_t pipe)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return 0);
+    return pipe->buf_off + pipe->fill;
+}
+
+esp_err_t ota_pipe_seek(ota_pipe_handle_t pipe, int offset)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_ERR_INVALID_ARG);
+    int cur = pipe->buf_off + pipe->fill;
+    /* Everything skipped must already be in the flash */
+    AUDIO_CHECK(TAG, offset >= cur && offset <= (pipe->resume > cur ? pipe->resume : cur), return ESP_ERR_INVALID_ARG, "Invalid seek offset");
+    esp_err_t ret = ota_pipe_submit(pipe);
+    if (ret == ESP_OK) {
+        pipe->buf_off = offset;
+    }
+    return ret;
+}
+
+int ota_pipe_acquire(ota_pipe_handle_t pipe, char **buf)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, buf, return ESP_FAIL);
+    if (pipe->fill == pipe->cfg.buffer_size) {
+        esp_err_t ret = ota_pipe_submit(pipe);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    *buf = pipe->buf[pipe->cur] + pipe->fill;
+    return pipe->cfg.buffer_size - pipe->fill;
+}
+
+esp_err_t ota_pipe_commit(ota_pipe_handle_t pipe, int len)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_ERR_INVALID_ARG);
+    AUDIO_CHECK(TAG, len >= 0 && pipe->fill + len <= pipe->cfg.buffer_size, return ESP_ERR_INVALID_ARG, "Commit exceeds the buffer");
+    pipe->fill += len;
+    if (pipe->fill == pipe->cfg.buffer_size) {
+        return ota_pipe_submit(pipe);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_pipe_write(ota_pipe_handle_t pipe, const char *buf, int len)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_ERR_INVALID_ARG);
+    while (len > 0) {
+        char *space = NULL;
+        int n = ota_pipe_acquire(pipe, &space);
+        if (n <= 0) {
+            return n < 0 ? n : ESP_FAIL;
+        }
+        n = n < len ? n : len;
+        memcpy(space, buf, n);
+        esp_err_t ret = ota_pipe_commit(pipe, n);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_pipe_finish(ota_pipe_handle_t pipe)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_ERR_INVALID_ARG);
+    /* Encrypted writes go by 16 bytes, pad the tail as esp_ota_write does */
+    if (pipe->cfg.partition->encrypted && pipe->fill % 16) {
+        int pad = 16 - pipe->fill % 16;
+        memset(pipe->buf[pipe->cur] + pipe->fill, 0xFF, pad);
+        pipe->fill += pad;
+    }
+    esp_err_t ret = ota_pipe_submit(pipe);
+    mutex_lock(pipe->lock);
+    ota_pipe_wait_idle(pipe);
+    ret = ret == ESP_OK ? pipe->err : ret;
+    mutex_unlock(pipe->lock);
+    if (ret == ESP_OK && pipe->buf_off < pipe->resume) {
+        ESP_LOGE(TAG, "Image ended at %d, before the resume offset %d", pipe->buf_off, pipe->resume);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK || ret == ESP_ERR_INVALID_STATE || ret == ESP_ERR_INVALID_SIZE) {
+        /* Done, or the journaled progress can't be trusted */
+        ota_pipe_clear_journal(pipe);
+    }
+    return ret;
+}
+
+esp_err_t ota_pipe_clear_journal(ota_pipe_handle_t pipe)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_FAIL);
+    if (pipe->has_nvs == false) {
+        return ESP_OK;
+    }
+    esp_err_t ret = nvs_erase_key(pipe->nvs, pipe->key);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(pipe->nvs);
+    }
+    return (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t ota_pipe_destroy(ota_pipe_handle_t pipe)
+{
+    AUDIO_NULL_CHECK(TAG, pipe, return ESP_ERR_INVALID_ARG);
+    mutex_lock(pipe->lock);
+    pipe->running = false;
+    xEventGroupSetBits(pipe->events, OTA_PIPE_WORK_BIT);
+    mutex_unlock(pipe->lock);
+    xEventGroupWaitBits(pipe->events, OTA_PIPE_EXIT_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    audio_thread_cleanup(&pipe->thread);
+    if (pipe->has_nvs) {
+        nvs_close(pipe->nvs);
+    }
+    vEventGroupDelete(pipe->events);
+    mutex_destroy(pipe->lock);
+    audio_free(pipe->buf[0]);
+    audio_free(pipe->buf[1]);
+    audio_free(pipe);
+    return ESP_OK;
+}
@@ -0,0 +1,196 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2020 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _OTA_PIPE_H_
+#define _OTA_PIPE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ota_pipe *ota_pipe_handle_t;
+
+/**
+ * @brief      OTA pipe configurations
+ */
+typedef struct {
+    const esp_partition_t   *partition;         /*!< Target partition */
+    uint32_t                source_id;          /*!< Identifies the image source, e.g. a digest of the URI, a journal of another source is dropped */
+    uint32_t                content_id;         /*!< Identifies the image content, e.g. a digest of the http `ETag`, 0 if unknown, resume needs it.
+                                                     A journal of other content is dropped, so a republished image is never spliced onto the old one */
+    int                     total_size;         /*!< Image size, 0 if unknown, resume needs it */
+    int                     buffer_size;        /*!< Size of each of the two buffers, a multiple of the flash sector size */
+    int                     erase_ahead;        /*!< Bytes erased ahead of the write cursor */
+    int                     journal_interval;   /*!< Save the progress journal every `journal_interval` bytes written, 0 to disable resume */
+    int                     task_stack;         /*!< Stack size of the flash task */
+    int                     task_prio;          /*!< Priority of the flash task */
+    int                     task_core;          /*!< Core of the flash task */
+    bool                    stack_in_ext;       /*!< Try to allocate the stack in external memory */
+} ota_pipe_cfg_t;
+
+#define OTA_PIPE_BUFFER_SIZE        (16 * 1024)
+#define OTA_PIPE_ERASE_AHEAD        (64 * 1024)
+#define OTA_PIPE_JOURNAL_INTERVAL   (64 * 1024)
+#define OTA_PIPE_TASK_STACK         (3 * 1024)
+#define OTA_PIPE_TASK_PRIO          (6)
+#define OTA_PIPE_TASK_CORE          (0)
+
+#define OTA_PIPE_CFG_DEFAULT() {                        \
+    .partition = NULL,                                  \
+    .source_id = 0,                                     \
+    .content_id = 0,                                    \
+    .total_size = 0,                                    \
+    .buffer_size = OTA_PIPE_BUFFER_SIZE,                \
+    .erase_ahead = OTA_PIPE_ERASE_AHEAD,                \
+    .journal_interval = OTA_PIPE_JOURNAL_INTERVAL,      \
+    .task_stack = OTA_PIPE_TASK_STACK,                  \
+    .task_prio = OTA_PIPE_TASK_PRIO,                    \
+    .task_core = OTA_PIPE_TASK_CORE,                    \
+    .stack_in_ext = false,                              \
+}
+
+/**
+ * @brief      Create the pipe and its flash task, load the progress journal of the partition
+ *
+ * @param      cfg   The configuration
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The pipe handle
+ */
+ota_pipe_handle_t ota_pipe_create(const ota_pipe_cfg_t *cfg);
+
+/**
+ * @brief      Get the offset committed to flash by an interrupted upgrade of the same source.
+ *             The bytes written again below this offset are compared with the flash content instead of written.
+ *
+ * @param      pipe  The pipe handle
+ *
+ * @return     The resume offset, 0 to start from scratch
+ */
+int ota_pipe_get_resume_offset(ota_pipe_handle_t pipe);
+
+/**
+ * @brief      Get the image offset of the next byte written to the pipe
+ *
+ * @param      pipe  The pipe handle
+ *
+ * @return     The write cursor
+ */
+int ota_pipe_get_offset(ota_pipe_handle_t pipe);
+
+/**
+ * @brief      Move the write cursor forward, up to the resume offset
+ *
+ * @param      pipe    The pipe handle
+ * @param      offset  The new write cursor
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - Others  Error of a previous flash operation
+ */
+esp_err_t ota_pipe_seek(ota_pipe_handle_t pipe, int offset);
+
+/**
+ * @brief      Get free space in the buffer being filled, to read data into it without copying.
+ *             The buffer is handed over to the flash task when it is full.
+ *
+ * @param      pipe  The pipe handle
+ * @param[out] buf   The free space
+ *
+ * @return
+ *     - > 0     Free space length
+ *     - ESP_FAIL or the error of a previous flash operation
+ */
+int ota_pipe_acquire(ota_pipe_handle_t pipe, char **buf);
+
+/**
+ * @brief      Commit `len` bytes filled in the space got by `ota_pipe_acquire`
+ *
+ * @param      pipe  The pipe handle
+ * @param      len   Number of bytes filled
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t ota_pipe_commit(ota_pipe_handle_t pipe, int len);
+
+/**
+ * @brief      Copy data to the pipe
+ *
+ * @param      pipe  The pipe handle
+ * @param      buf   The data
+ * @param      len   The data length
+ *
+ * @return
+ *     - ESP_OK
+ *     - Others  Error of a flash operation
+ */
+esp_err_t ota_pipe_write(ota_pipe_handle_t pipe, const char *buf, int len);
+
+/**
+ * @brief      Write the buffered data and wait for the flash task, the journal is dropped on success
+ *
+ * @param      pipe  The pipe handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - Others  Error of a flash operation
+ */
+esp_err_t ota_pipe_finish(ota_pipe_handle_t pipe);
+
+/**
+ * @brief      Drop the progress journal, the next upgrade starts from scratch
+ *
+ * @param      pipe  The pipe handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t ota_pipe_clear_journal(ota_pipe_handle_t pipe);
+
+/**
+ * @brief      Stop the flash task and free the pipe, the journal of an unfinished upgrade is kept to resume it later
+ *
+ * @param      pipe  The pipe handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t ota_pipe_destroy(ota_pipe_handle_t pipe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,34 +22,30 @@
  *
  */
 #include <string.h>
+#include <sys/stat.h>
 
 #include "audio_mem.h"
-#include "esp_https_ota.h"
-#include "esp_fs_ota.h"
+#include "esp_image_format.h"
 #include "esp_log.h"
 #include "fatfs_stream.h"
 #include "http_stream.h"
 
 #include "ota_proc_default.h"
+#include "ota_pipe.h"
+#include "ota_delta.h"
 
-#define READER_BUF_LEN (1024 * 2)
+/* Bytes below the resume offset downloaded again, to check the source still serves the journaled image */
+#define OTA_RESUME_OVERLAP      (512)
+#define OTA_IMAGE_HEADER_SIZE   (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+#define OTA_DELTA_READ_SIZE     (1024 * 2)
 
 typedef struct {
     audio_element_handle_t r_stream;
     const esp_partition_t *partition;
-
-    int write_offset;
-    char read_buf[READER_BUF_LEN];
-} ota_data_upgrade_ctx_t;
-
-typedef struct {
-    void *ota_handle;
-    esp_err_t (*get_img_desc)(void *handle, esp_app_desc_t *new_app_info);
-    esp_err_t (*perform)(void *handle);
-    int (*get_image_len_read)(void *handle);
-    bool (*all_read)(void *handle);
-    esp_err_t (*finish)(void *handle);
-} ota_app_upgrade_ctx_t;
+    ota_pipe_handle_t pipe;
+    ota_delta_handle_t delta;
+    char *read_buf;
+} ota_stream_upgrade_ctx_t;
 
 static const char *TAG = "OTA_DEFAULT";
 
@@ -80,101 +76,234 @@ static ota_service_err_reason_t validate_image_header(esp_app_desc_t *new_app_in
     return OTA_SERV_ERR_REASON_SUCCESS;
 }
 
-static ota_service_err_reason_t ota_app_partition_prepare(void **handle, ota_node_attr_t *node)
+static uint32_t ota_stream_source_id(const char *uri)
+{
+    uint32_t hash = 2166136261u;
+    while (*uri) {
+        hash = (hash ^ (uint8_t)*uri++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Changes when the image is republished, the journal of an older image must not be resumed */
+static uint32_t ota_stream_content_id(ota_stream_upgrade_ctx_t *context, const char *uri)
 {
-    ota_app_upgrade_ctx_t *context = audio_calloc(1, sizeof(ota_app_upgrade_ctx_t));
+    if (strstr(uri, "file://")) {
+        struct stat st;
+        const char *path = strstr(uri, "/sdcard");
+        if (path && stat(path, &st) == 0) {
+            return (uint32_t)st.st_mtime;
+        }
+        return 0;
+    }
+    return http_stream_get_content_id(context->r_stream);
+}
+
+static void ota_stream_close(ota_stream_upgrade_ctx_t *context)
+{
+    if (context->pipe) {
+        ota_pipe_destroy(context->pipe);
+    }
+    if (context->delta) {
+        ota_delta_destroy(context->delta);
+    }
+    audio_free(context->read_buf);
+    if (context->r_stream) {
+        audio_element_process_deinit(context->r_stream);
+        audio_element_deinit(context->r_stream);
+    }
+    audio_free(context);
+}
+
+static ota_service_err_reason_t ota_stream_open(void **handle, ota_node_attr_t *node, const esp_partition_t *partition, bool is_delta)
+{
+    ota_stream_upgrade_ctx_t *context = audio_calloc(1, sizeof(ota_stream_upgrade_ctx_t));
     AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    *handle = NULL;
+    context->partition = partition;
 
-    AUDIO_NULL_CHECK(TAG, node->uri, {
-                    audio_free(context);
-                    return OTA_SERV_ERR_REASON_NULL_POINTER;
-                    });
+    ESP_LOGI(TAG, "[%s] upgrade uri %s", partition->label, node->uri);
     if (strstr(node->uri, "file://")) {
-        context->get_img_desc = esp_fs_ota_get_img_desc;
-        context->perform = esp_fs_ota_perform;
-        context->get_image_len_read = esp_fs_ota_get_image_len_read;
-        context->all_read = NULL;
-        context->finish = esp_fs_ota_finish;
-
-        esp_fs_ota_config_t ota_config = {
-            .path = node->uri,
-            .buffer_size = 5 * 1024,
-        };
-        esp_err_t err = esp_fs_ota_begin(&ota_config, &context->ota_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "ESP FS OTA Begin failed");
-            audio_free(context);
-            return OTA_SERV_ERR_REASON_UNKNOWN;
-        }
+        fatfs_stream_cfg_t fs_cfg = FATFS_STREAM_CFG_DEFAULT();
+        fs_cfg.type = AUDIO_STREAM_READER;
+
+        context->r_stream = fatfs_stream_init(&fs_cfg);
     } else if (strstr(node->uri, "https://") || strstr(node->uri, "http://")) {
-        context->get_img_desc = esp_https_ota_get_img_desc;
-        context->perform = esp_https_ota_perform;
-        context->get_image_len_read = esp_https_ota_get_image_len_read;
-        context->all_read = esp_https_ota_is_complete_data_received;
-        context->finish = esp_https_ota_finish;
-
-        esp_http_client_config_t config = {
-            .url = node->uri,
-            .cert_pem = node->cert_pem,
-            .timeout_ms = 5000,
-        };
-        esp_https_ota_config_t ota_config = {
-            .http_config = &config,
-        };
-        esp_err_t err = esp_https_ota_begin(&ota_config, &context->ota_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "ESP HTTPS OTA Begin failed");
-            audio_free(context);
-            return OTA_SERV_ERR_REASON_UNKNOWN;
-        }
+        http_stream_cfg_t http_cfg = HTTP_STREAM_CFG_DEFAULT();
+        http_cfg.type = AUDIO_STREAM_READER;
+        http_cfg.cert_pem = node->cert_pem;
+
+        context->r_stream = http_stream_init(&http_cfg);
     } else {
+        ESP_LOGE(TAG, "not support uri");
         audio_free(context);
         return OTA_SERV_ERR_REASON_URL_PARSE_FAIL;
     }
+    AUDIO_NULL_CHECK(TAG, context->r_stream, {
+                    audio_free(context);
+                    return OTA_SERV_ERR_REASON_STREAM_INIT_FAIL;
+                    });
+    audio_element_set_uri(context->r_stream, node->uri);
+    if (audio_element_process_init(context->r_stream) != ESP_OK) {
+        ESP_LOGE(TAG, "reader stream init failed");
+        ota_stream_close(context);
+        return OTA_SERV_ERR_REASON_STREAM_INIT_FAIL;
+    }
+
+    if (is_delta) {
+        /* The patch is applied in place, it goes to the applier instead of the pipe */
+        context->delta = ota_delta_create(partition);
+        context->read_buf = audio_malloc(OTA_DELTA_READ_SIZE);
+        AUDIO_NULL_CHECK(TAG, context->delta && context->read_buf, {
+                        ota_stream_close(context);
+                        return OTA_SERV_ERR_REASON_NULL_POINTER;
+                        });
+        *handle = context;
+        return OTA_SERV_ERR_REASON_SUCCESS;
+    }
+    audio_element_info_t info = { 0 };
+    audio_element_getinfo(context->r_stream, &info);
+    if (info.total_bytes > partition->size) {
+        ESP_LOGE(TAG, "Image size %d exceeds the partition [%s] size %d", (int)info.total_bytes, partition->label, (int)partition->size);
+        ota_stream_close(context);
+        return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+    }
+    /*
+     * Without the image size, e.g. a chunked http response, or without a validator of the content,
+     * e.g. a server sending neither `ETag` nor `Last-Modified`, the upgrade can't be resumed
+     */
+    ota_pipe_cfg_t pipe_cfg = OTA_PIPE_CFG_DEFAULT();
+    pipe_cfg.partition = partition;
+    pipe_cfg.source_id = ota_stream_source_id(node->uri);
+    pipe_cfg.content_id = ota_stream_content_id(context, node->uri);
+    pipe_cfg.total_size = info.total_bytes > 0 ? info.total_bytes : 0;
+    context->pipe = ota_pipe_create(&pipe_cfg);
+    AUDIO_NULL_CHECK(TAG, context->pipe, {
+                    ota_stream_close(context);
+                    return OTA_SERV_ERR_REASON_NULL_POINTER;
+                    });
     *handle = context;
     return OTA_SERV_ERR_REASON_SUCCESS;
 }
 
-static ota_service_err_reason_t ota_app_partition_need_upgrade(void *handle, ota_node_attr_t *node)
+static ota_service_err_reason_t ota_delta_exec_upgrade(ota_stream_upgrade_ctx_t *context)
 {
-    ota_app_upgrade_ctx_t *context = (ota_app_upgrade_ctx_t *)handle;
-    AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    AUDIO_NULL_CHECK(TAG, context->ota_handle, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    esp_app_desc_t app_desc;
-    esp_err_t err = context->get_img_desc(context->ota_handle, &app_desc);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "get_img_desc failed");
-        return OTA_SERV_ERR_REASON_GET_NEW_APP_DESC_FAIL;
+    int r_size = 0;
+    while ((r_size = audio_element_input(context->r_stream, context->read_buf, OTA_DELTA_READ_SIZE)) > 0) {
+        if (ota_delta_write(context->delta, context->read_buf, r_size) != ESP_OK) {
+            return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+        }
     }
-    return validate_image_header(&app_desc);
+    if (r_size != AEL_IO_OK && r_size != AEL_IO_DONE) {
+        return OTA_SERV_ERR_REASON_STREAM_RD_FAIL;
+    }
+    esp_err_t ret = ota_delta_finish(context->delta);
+    if (ret == ESP_ERR_INVALID_CRC) {
+        return OTA_SERV_ERR_REASON_VERIFY_FAIL;
+    } else if (ret != ESP_OK) {
+        return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+    }
+    ESP_LOGI(TAG, "partition %s patched and verified", context->partition->label);
+    return OTA_SERV_ERR_REASON_SUCCESS;
 }
 
-static esp_err_t ota_app_partition_exec_upgrade(void *handle, ota_node_attr_t *node)
+static ota_service_err_reason_t ota_stream_exec_upgrade(void *handle, ota_node_attr_t *node)
 {
-    ota_app_upgrade_ctx_t *context = (ota_app_upgrade_ctx_t *)handle;
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
     AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    AUDIO_NULL_CHECK(TAG, context->ota_handle, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    esp_err_t err = ESP_FAIL;
+    AUDIO_NULL_CHECK(TAG, context->r_stream, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    if (context->delta) {
+        return ota_delta_exec_upgrade(context);
+    }
+    AUDIO_NULL_CHECK(TAG, context->pipe, return OTA_SERV_ERR_REASON_NULL_POINTER);
+
+    /* The stream position follows the pipe cursor, as long as what `need_upgrade` read was written back */
+    int offset = ota_pipe_get_offset(context->pipe);
+    int resume = ota_pipe_get_resume_offset(context->pipe);
+    if (resume > offset + OTA_RESUME_OVERLAP) {
+        offset = resume - OTA_RESUME_OVERLAP;
+        ESP_LOGI(TAG, "Resume [%s] upgrade, skip to %d", context->partition->label, offset);
+        audio_element_process_deinit(context->r_stream);
+        audio_element_set_byte_pos(context->r_stream, offset);
+        if (audio_element_process_init(context->r_stream) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to reopen the stream at %d", offset);
+            return OTA_SERV_ERR_REASON_STREAM_RD_FAIL;
+        }
+        if (ota_pipe_seek(context->pipe, offset) != ESP_OK) {
+            return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+        }
+    }
 
+    /* Read straight into the pipe, the flash task writes one buffer while the other one is being downloaded */
+    int r_size = 0;
     while (1) {
-        err = context->perform(context->ota_handle);
-        if (err != ESP_ERR_HTTPS_OTA_IN_PROGRESS && err != ESP_ERR_FS_OTA_IN_PROGRESS ) {
+        char *buf = NULL;
+        int space = ota_pipe_acquire(context->pipe, &buf);
+        if (space <= 0) {
+            return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+        }
+        r_size = audio_element_input(context->r_stream, buf, space);
+        if (r_size <= 0) {
             break;
         }
-        ESP_LOGI(TAG, "Image bytes read: %d", context->get_image_len_read(context->ota_handle));
+        if (ota_pipe_commit(context->pipe, r_size) != ESP_OK) {
+            return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+        }
     }
+    if (r_size != AEL_IO_OK && r_size != AEL_IO_DONE) {
+        return OTA_SERV_ERR_REASON_STREAM_RD_FAIL;
+    }
+    audio_element_info_t info = { 0 };
+    audio_element_getinfo(context->r_stream, &info);
+    if (info.total_bytes > 0 && ota_pipe_get_offset(context->pipe) != info.total_bytes) {
+        ESP_LOGE(TAG, "Stream ended at %d/%d", ota_pipe_get_offset(context->pipe), (int)info.total_bytes);
+        return OTA_SERV_ERR_REASON_STREAM_RD_FAIL;
+    }
+    if (ota_pipe_finish(context->pipe) != ESP_OK) {
+        return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
+    }
+    ESP_LOGI(TAG, "partition %s upgrade successes, %d bytes", context->partition->label, ota_pipe_get_offset(context->pipe));
+    return OTA_SERV_ERR_REASON_SUCCESS;
+}
 
-    return err;
+static ota_service_err_reason_t ota_app_partition_prepare(void **handle, ota_node_attr_t *node)
+{
+    *handle = NULL;
+    AUDIO_NULL_CHECK(TAG, node->uri, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No app partition to upgrade");
+        return OTA_SERV_ERR_REASON_PARTITION_NOT_FOUND;
+    }
+    return ota_stream_open(handle, node, partition, false);
+}
+
+static ota_service_err_reason_t ota_app_partition_need_upgrade(void *handle, ota_node_attr_t *node)
+{
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
+    AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    char header[OTA_IMAGE_HEADER_SIZE];
+    if (ota_data_image_stream_read(handle, header, sizeof(header)) != OTA_SERV_ERR_REASON_SUCCESS
+        || (uint8_t)header[0] != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "get_img_desc failed");
+        return OTA_SERV_ERR_REASON_GET_NEW_APP_DESC_FAIL;
+    }
+    esp_app_desc_t app_desc;
+    memcpy(&app_desc, header + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+    ota_service_err_reason_t ret = validate_image_header(&app_desc);
+    if (ret != OTA_SERV_ERR_REASON_SUCCESS) {
+        return ret;
+    }
+    return ota_data_partition_write(handle, header, sizeof(header));
 }
 
 static esp_err_t ota_app_partition_finish(void *handle, ota_node_attr_t *node, ota_service_err_reason_t result)
 {
-    ota_app_upgrade_ctx_t *context = (ota_app_upgrade_ctx_t *)handle;
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
     AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    esp_err_t err = ESP_OK;
-    if (context->ota_handle) {
-        err = context->finish(context->ota_handle);
+    esp_err_t err = result;
+    if (result == OTA_SERV_ERR_REASON_SUCCESS) {
+        /* The image is verified before the boot partition is switched */
+        err = esp_ota_set_boot_partition(context->partition);
         if (err != ESP_OK) {
             if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
                 ESP_LOGE(TAG, "Image validation failed, image is corrupted");
@@ -182,7 +311,7 @@ static esp_err_t ota_app_partition_finish(void *handle, ota_node_attr_t *node, o
             ESP_LOGE(TAG, "upgrade failed %d", err);
         }
     }
-    audio_free(handle);
+    ota_stream_close(context);
     return err;
 }
 
@@ -190,112 +319,87 @@ void ota_app_get_default_proc(ota_upgrade_ops_t *ops)
 {
     ops->prepare = ota_app_partition_prepare;
     ops->need_upgrade = ota_app_partition_need_upgrade;
-    ops->execute_upgrade = ota_app_partition_exec_upgrade;
+    ops->execute_upgrade = ota_stream_exec_upgrade;
     ops->finished_check = ota_app_partition_finish;
 }
 
 static ota_service_err_reason_t ota_data_partition_prepare(void **handle, ota_node_attr_t *node)
 {
-    ota_data_upgrade_ctx_t *context = audio_calloc(1, sizeof(ota_data_upgrade_ctx_t));
-    AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
     *handle = NULL;
-
-    AUDIO_NULL_CHECK(TAG, node->label, {
-                    audio_free(context);
-                    return OTA_SERV_ERR_REASON_NULL_POINTER;
-                    });
-    context->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, node->label);
-    if (context->partition == NULL) {
+    AUDIO_NULL_CHECK(TAG, node->label, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, node->label);
+    if (partition == NULL) {
         ESP_LOGE(TAG, "partition [%s] not found", node->label);
-        audio_free(context);
         return OTA_SERV_ERR_REASON_PARTITION_NOT_FOUND;
     }
+    AUDIO_NULL_CHECK(TAG, node->uri, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    return ota_stream_open(handle, node, partition, false);
+}
 
-    AUDIO_NULL_CHECK(TAG, node->uri, {
-                    audio_free(context);
-                    return OTA_SERV_ERR_REASON_NULL_POINTER;
-                    });
-    ESP_LOGI(TAG, "data upgrade uri %s", node->uri);
-    if (strstr(node->uri, "file://")) {
-        fatfs_stream_cfg_t fs_cfg = FATFS_STREAM_CFG_DEFAULT();
-        fs_cfg.type = AUDIO_STREAM_READER;
+static ota_service_err_reason_t ota_data_partition_finish(void *handle, ota_node_attr_t *node, ota_service_err_reason_t result)
+{
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
+    AUDIO_NULL_CHECK(TAG, context, return ESP_FAIL);
+    ota_stream_close(context);
+    return result;
+}
 
-        context->r_stream = fatfs_stream_init(&fs_cfg);
-    } else if (strstr(node->uri, "https://") || strstr(node->uri, "http://")) {
-        http_stream_cfg_t http_cfg = HTTP_STREAM_CFG_DEFAULT();
-        http_cfg.type = AUDIO_STREAM_READER;
+void ota_data_get_default_proc(ota_upgrade_ops_t *ops)
+{
+    ops->prepare = ota_data_partition_prepare;
+    ops->need_upgrade = NULL;
+    ops->execute_upgrade = ota_stream_exec_upgrade;
+    ops->finished_check = ota_data_partition_finish;
+}
 
-        context->r_stream = http_stream_init(&http_cfg);
-    } else {
-        ESP_LOGE(TAG, "not support uri");
-        audio_free(context);
-        return OTA_SERV_ERR_REASON_URL_PARSE_FAIL;
-    }
-    audio_element_set_uri(context->r_stream, node->uri);
-    if (audio_element_process_init(context->r_stream) != ESP_OK) {
-        ESP_LOGE(TAG, "reader stream init failed");
-        audio_element_deinit(context->r_stream);
-        audio_free(context);
-        return OTA_SERV_ERR_REASON_STREAM_INIT_FAIL;
+static ota_service_err_reason_t ota_data_delta_prepare(void **handle, ota_node_attr_t *node)
+{
+    *handle = NULL;
+    AUDIO_NULL_CHECK(TAG, node->label, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, node->label);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "partition [%s] not found", node->label);
+        return OTA_SERV_ERR_REASON_PARTITION_NOT_FOUND;
     }
-
-    *handle = context;
-    return OTA_SERV_ERR_REASON_SUCCESS;
+    AUDIO_NULL_CHECK(TAG, node->uri, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    return ota_stream_open(handle, node, partition, true);
 }
 
-static ota_service_err_reason_t ota_data_partition_exec_upgrade(void *handle, ota_node_attr_t *node)
+static ota_service_err_reason_t ota_data_delta_need_upgrade(void *handle, ota_node_attr_t *node)
 {
-    int r_size = 0;
-    ota_data_upgrade_ctx_t *context = (ota_data_upgrade_ctx_t *)handle;
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
     AUDIO_NULL_CHECK(TAG, context, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    AUDIO_NULL_CHECK(TAG, context->r_stream, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    AUDIO_NULL_CHECK(TAG, context->partition, return OTA_SERV_ERR_REASON_NULL_POINTER);
-    esp_err_t ret = ESP_OK;
-
-    if ((ret = esp_partition_erase_range(context->partition, 0, context->partition->size)) != ESP_OK) {
-        ESP_LOGE(TAG, "Erase [%s] partition failed, return value: %d", node->label, ret);
-        return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
-    }
-
-    while ((r_size = audio_element_input(context->r_stream, context->read_buf, READER_BUF_LEN)) > 0) {
-        ESP_LOGI(TAG, "write_offset %d, r_size %d", context->write_offset, r_size);
-        if (esp_partition_write(context->partition, context->write_offset, context->read_buf, r_size) == ESP_OK) {
-            context->write_offset += r_size;
-        } else {
-            return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
-        }
-    }
-    if (r_size == AEL_IO_OK || r_size == AEL_IO_DONE) {
-        ESP_LOGI(TAG, "partition %s upgrade successes", node->label);
-        return OTA_SERV_ERR_REASON_SUCCESS;
-    } else {
+    AUDIO_NULL_CHECK(TAG, context->delta, return OTA_SERV_ERR_REASON_NULL_POINTER);
+    ota_delta_header_t header;
+    if (ota_data_image_stream_read(handle, (char *)&header, sizeof(header)) != OTA_SERV_ERR_REASON_SUCCESS) {
         return OTA_SERV_ERR_REASON_STREAM_RD_FAIL;
     }
-}
-
-static ota_service_err_reason_t ota_data_partition_finish(void *handle, ota_node_attr_t *node, ota_service_err_reason_t result)
-{
-    ota_data_upgrade_ctx_t *context = (ota_data_upgrade_ctx_t *)handle;
-    AUDIO_NULL_CHECK(TAG, context, return ESP_FAIL);
-    if (context->r_stream) {
-        audio_element_process_deinit(context->r_stream);
-        audio_element_deinit(context->r_stream);
+    esp_err_t ret = ota_delta_begin(context->delta, &header);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        if (ota_delta_verify(context->delta) == ESP_OK) {
+            ESP_LOGW(TAG, "[%s] is already patched", context->partition->label);
+            return OTA_SERV_ERR_REASON_NO_HIGHER_VERSION;
+        }
+        return OTA_SERV_ERR_REASON_DELTA_BASE_MISMATCH;
+    } else if (ret == ESP_ERR_INVALID_ARG) {
+        return OTA_SERV_ERR_REASON_ERROR_MAGIC_WORD;
+    } else if (ret != ESP_OK) {
+        return OTA_SERV_ERR_REASON_PARTITION_RD_FAIL;
     }
-    audio_free(handle);
-    return result;
+    return OTA_SERV_ERR_REASON_SUCCESS;
 }
 
-void ota_data_get_default_proc(ota_upgrade_ops_t *ops)
+void ota_data_get_delta_proc(ota_upgrade_ops_t *ops)
 {
-    ops->prepare = ota_data_partition_prepare;
-    ops->need_upgrade = NULL;
-    ops->execute_upgrade = ota_data_partition_exec_upgrade;
+    ops->prepare = ota_data_delta_prepare;
+    ops->need_upgrade = ota_data_delta_need_upgrade;
+    ops->execute_upgrade = ota_stream_exec_upgrade;
     ops->finished_check = ota_data_partition_finish;
 }
 
 ota_service_err_reason_t ota_data_image_stream_read(void *handle, char *buf, int wanted_size)
 {
-    ota_data_upgrade_ctx_t *context = (ota_data_upgrade_ctx_t *)handle;
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
 
     if (context == NULL) {
         ESP_LOGE(TAG, "run prepare first");
@@ -321,22 +425,28 @@ ota_service_err_reason_t ota_data_image_stream_read(void *handle, char *buf, int
 
 ota_service_err_reason_t ota_data_partition_write(void *handle, char *buf, int size)
 {
-    ota_data_upgrade_ctx_t *context = (ota_data_upgrade_ctx_t *)handle;
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
 
     if (context == NULL) {
         ESP_LOGE(TAG, "run prepare first");
         return OTA_SERV_ERR_REASON_NULL_POINTER;
     }
+    AUDIO_CHECK(TAG, context->pipe, return OTA_SERV_ERR_REASON_NULL_POINTER, "A patch is not written as is");
 
-    ESP_LOGI(TAG, "write_offset %d, size %d", context->write_offset, size);
-    if (esp_partition_write(context->partition, context->write_offset, buf, size) == ESP_OK) {
-        context->write_offset += size;
+    if (ota_pipe_write(context->pipe, buf, size) == ESP_OK) {
         return OTA_SERV_ERR_REASON_SUCCESS;
     } else {
         return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
     }
 }
 
+int ota_data_partition_get_resume_offset(void *handle)
+{
+    ota_stream_upgrade_ctx_t *context = (ota_stream_upgrade_ctx_t *)handle;
+    AUDIO_NULL_CHECK(TAG, context, return 0);
+    return context->pipe ? ota_pipe_get_resume_offset(context->pipe) : 0;
+}
+
 int ota_get_version_number(char *version)
 {
     AUDIO_NULL_CHECK(TAG, version, return -1);
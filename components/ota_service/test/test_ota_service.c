@@ -30,6 +30,7 @@
 #include "freertos/task.h"
 
 #include "esp_log.h"
+#include "esp_partition.h"
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
 #include "ota_service.h"
@@ -40,6 +41,8 @@
 #include "sdmmc_cmd.h"
 #include "ff.h"
 #include "board.h"
+#include "mbedtls/sha256.h"
+#include "ota_delta.h"
 
 #include "unity.h"
 
@@ -440,3 +443,188 @@ TEST_CASE("(app) ota process", "[audio][timeout=100][test_env=UT_T1_AUDIO]")
     TEST_ASSERT(test_ota_proc(upgrade_list, sizeof(upgrade_list) / sizeof(ota_upgrade_ops_t)) == ESP_OK);
     sdcard_teardown();
 }
+
+#define DELTA_TEST_PARTITION    "flash_test"
+#define DELTA_TEST_OLD_SIZE     (5 * OTA_DELTA_SECTOR_SIZE + 300)
+#define DELTA_TEST_NEW_SIZE     (5 * OTA_DELTA_SECTOR_SIZE + 1000)
+#define DELTA_TEST_WINDOW       (2 * OTA_DELTA_SECTOR_SIZE)
+#define DELTA_TEST_CHUNK        (97)
+
+/* One op of a test patch, `rel` is `src - dst` of a COPY, a DATA op takes its bytes from a pseudo random sequence */
+typedef struct {
+    uint8_t     op;
+    uint32_t    len;
+    int32_t     rel;
+} delta_test_op_t;
+
+/* Content moved down, rewritten, kept in place, and copied from sectors already overwritten */
+static const delta_test_op_t delta_forward_ops[] = {
+    { 0x01, 4096, 8192 },
+    { 0x00, 1500, 0 },
+    { 0x01, 2596, 0 },
+    { 0x01, 4096, -4096 },
+    { 0x01, 4096, 0 },
+    { 0x00, 777, 0 },
+    { 0x01, 4319, 10000 - 17161 },
+};
+
+/* Content moved up, which needs the sectors rebuilt from the last one down */
+static const delta_test_op_t delta_reverse_ops[] = {
+    { 0x01, 4096, 0 },
+    { 0x00, 500, 0 },
+    { 0x01, 7692, -4596 },
+    { 0x01, 4096, 2000 },
+    { 0x00, 616, 0 },
+    { 0x01, 4480, -6000 },
+};
+
+static uint8_t delta_test_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void delta_test_sha256(const uint8_t *data, uint32_t len, uint8_t *sha256)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, data, len);
+    mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+}
+
+static int delta_test_varint(uint8_t *out, uint32_t val)
+{
+    int n = 0;
+    do {
+        out[n] = val & 0x7F;
+        val >>= 7;
+        if (val) {
+            out[n] |= 0x80;
+        }
+    } while (out[n++] & 0x80);
+    return n;
+}
+
+/*
+ * Render the new content from the old one as the applier must, and serialize the ops the way
+ * mk_ota_delta.py does. Returns the patch length.
+ */
+static int delta_test_make_patch(const delta_test_op_t *ops, int op_num, bool reverse, const uint8_t *old_data,
+                                 uint8_t *new_data, uint8_t *patch, ota_delta_header_t *header)
+{
+    uint32_t seed = 0x5EED;
+    uint32_t dst[op_num];
+    uint32_t pos = 0;
+    for (int i = 0; i < op_num; i++) {
+        dst[i] = pos;
+        for (uint32_t j = 0; j < ops[i].len; j++) {
+            new_data[pos + j] = ops[i].op == 0x00 ? delta_test_random(&seed) : old_data[pos + ops[i].rel + j];
+        }
+        pos += ops[i].len;
+    }
+    TEST_ASSERT_EQUAL(DELTA_TEST_NEW_SIZE, pos);
+
+    int len = 0;
+    for (int k = 0; k < op_num; k++) {
+        int i = reverse ? op_num - 1 - k : k;
+        patch[len++] = ops[i].op;
+        len += delta_test_varint(patch + len, ops[i].len);
+        if (ops[i].op == 0x01) {
+            len += delta_test_varint(patch + len, ((uint32_t)ops[i].rel << 1) ^ (uint32_t)(ops[i].rel >> 31));
+            continue;
+        }
+        for (uint32_t j = 0; j < ops[i].len; j++) {
+            patch[len++] = new_data[reverse ? dst[i] + ops[i].len - 1 - j : dst[i] + j];
+        }
+    }
+
+    memset(header, 0, sizeof(ota_delta_header_t));
+    header->magic = OTA_DELTA_MAGIC;
+    header->version = OTA_DELTA_VERSION;
+    header->header_size = sizeof(ota_delta_header_t);
+    header->window_size = DELTA_TEST_WINDOW;
+    header->old_size = DELTA_TEST_OLD_SIZE;
+    header->new_size = DELTA_TEST_NEW_SIZE;
+    header->flags = reverse ? OTA_DELTA_FLAG_REVERSE : 0;
+    delta_test_sha256(old_data, DELTA_TEST_OLD_SIZE, header->old_sha256);
+    delta_test_sha256(new_data, DELTA_TEST_NEW_SIZE, header->new_sha256);
+    return len;
+}
+
+static void delta_test_flash(const esp_partition_t *partition, const uint8_t *data, uint32_t len)
+{
+    uint32_t erase = (DELTA_TEST_NEW_SIZE + OTA_DELTA_SECTOR_SIZE - 1) & ~(OTA_DELTA_SECTOR_SIZE - 1);
+    TEST_ESP_OK(esp_partition_erase_range(partition, 0, erase));
+    TEST_ESP_OK(esp_partition_write(partition, 0, data, len));
+}
+
+static void delta_test_apply(const delta_test_op_t *ops, int op_num, bool reverse)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, DELTA_TEST_PARTITION);
+    TEST_ASSERT_NOT_NULL(partition);
+    TEST_ASSERT_TRUE(partition->size >= DELTA_TEST_NEW_SIZE + OTA_DELTA_SECTOR_SIZE);
+
+    uint8_t *old_data = malloc(DELTA_TEST_OLD_SIZE);
+    uint8_t *new_data = malloc(DELTA_TEST_NEW_SIZE);
+    uint8_t *patch = malloc(DELTA_TEST_NEW_SIZE);
+    uint8_t *flash = malloc(DELTA_TEST_NEW_SIZE);
+    TEST_ASSERT_NOT_NULL(old_data);
+    TEST_ASSERT_NOT_NULL(new_data);
+    TEST_ASSERT_NOT_NULL(patch);
+    TEST_ASSERT_NOT_NULL(flash);
+    uint32_t seed = reverse ? 0xDA7A : 0x0DA7;
+    for (int i = 0; i < DELTA_TEST_OLD_SIZE; i++) {
+        old_data[i] = delta_test_random(&seed);
+    }
+    ota_delta_header_t header;
+    int patch_len = delta_test_make_patch(ops, op_num, reverse, old_data, new_data, patch, &header);
+    ESP_LOGI(TAG, "%s patch of %d bytes", reverse ? "Reverse" : "Forward", patch_len);
+
+    ota_delta_handle_t delta = ota_delta_create(partition);
+    TEST_ASSERT_NOT_NULL(delta);
+
+    // A partition holding something else is not the base
+    old_data[DELTA_TEST_OLD_SIZE / 2] ^= 0xFF;
+    delta_test_flash(partition, old_data, DELTA_TEST_OLD_SIZE);
+    old_data[DELTA_TEST_OLD_SIZE / 2] ^= 0xFF;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_begin(delta, &header));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, ota_delta_verify(delta));
+
+    delta_test_flash(partition, old_data, DELTA_TEST_OLD_SIZE);
+    TEST_ESP_OK(ota_delta_begin(delta, &header));
+    for (int pos = 0; pos < patch_len; pos += DELTA_TEST_CHUNK) {
+        int len = patch_len - pos < DELTA_TEST_CHUNK ? patch_len - pos : DELTA_TEST_CHUNK;
+        TEST_ESP_OK(ota_delta_write(delta, (const char *)patch + pos, len));
+    }
+    TEST_ESP_OK(ota_delta_finish(delta));
+
+    uint8_t sha256[32];
+    TEST_ESP_OK(esp_partition_read(partition, 0, flash, DELTA_TEST_NEW_SIZE));
+    delta_test_sha256(flash, DELTA_TEST_NEW_SIZE, sha256);
+    TEST_ASSERT_EQUAL_MEMORY(header.new_sha256, sha256, sizeof(sha256));
+    TEST_ASSERT_EQUAL_MEMORY(new_data, flash, DELTA_TEST_NEW_SIZE);
+
+    // Running the same patch again finds the partition already patched, as after a reboot mid-upgrade
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_begin(delta, &header));
+    TEST_ESP_OK(ota_delta_verify(delta));
+    TEST_ESP_OK(esp_partition_read(partition, 0, flash, DELTA_TEST_NEW_SIZE));
+    TEST_ASSERT_EQUAL_MEMORY(new_data, flash, DELTA_TEST_NEW_SIZE);
+
+    TEST_ESP_OK(ota_delta_destroy(delta));
+    free(old_data);
+    free(new_data);
+    free(patch);
+    free(flash);
+}
+
+TEST_CASE("(delta) apply a forward patch in place", "[audio][timeout=100][test_env=UT_T1_AUDIO]")
+{
+    delta_test_apply(delta_forward_ops, sizeof(delta_forward_ops) / sizeof(delta_forward_ops[0]), false);
+}
+
+TEST_CASE("(delta) apply a reverse patch in place", "[audio][timeout=100][test_env=UT_T1_AUDIO]")
+{
+    delta_test_apply(delta_reverse_ops, sizeof(delta_reverse_ops) / sizeof(delta_reverse_ops[0]), true);
+}
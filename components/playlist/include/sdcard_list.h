@@ -42,6 +42,23 @@ extern "C" {
  */
 esp_err_t sdcard_list_create(playlist_operator_handle_t *handle);
 
+/**
+ * @brief Create a playlist in sdcard that persists across reboots
+ *
+ * @note   The list saved by a previous boot is reloaded if its content version matches `content_version`,
+ *         otherwise the list starts empty. Saving a URL that already exists in the list is a no-op,
+ *         so a rescan only appends the new files. The list files are kept by `sdcard_list_destroy`.
+ *
+ * @param[out]  handle            The playlist handle from application layer
+ * @param       list_id           Identifies the list files on sdcard, use a different id for each persistent list
+ * @param       content_version   Application defined version of the list content, e.g. a digest of the scan settings
+ *
+ * @return
+ *     - ESP_OK   success
+ *     - ESP_FAIL failed
+ */
+esp_err_t sdcard_list_create_persistent(playlist_operator_handle_t *handle, uint8_t list_id, uint32_t content_version);
+
 /**
  * @brief Show all the URLs in sdcard playlist
  *
@@ -172,6 +189,20 @@ esp_err_t sdcard_list_destroy(playlist_operator_handle_t handle);
  */
 esp_err_t sdcard_list_save(playlist_operator_handle_t handle, const char *url);
 
+/**
+ * @brief Commit the saved URLs to sdcard
+ *
+ * @note   `sdcard_list_save` batches the URLs in memory and writes them with a single sync per batch,
+ *         the batch is also committed when it is full and on destroy.
+ *
+ * @param handle     Playlist handle
+ *
+ * @return
+ *     - ESP_OK   success
+ *     - ESP_FAIL failed
+ */
+esp_err_t sdcard_list_commit(playlist_operator_handle_t handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,12 +25,63 @@
 #ifndef _SDCARD_SCAN_H_
 #define _SDCARD_SCAN_H_
 
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef void (*sdcard_scan_cb_t)(void *user_data, char *url);
 
+typedef esp_err_t (*sdcard_scan_done_cb_t)(void *user_data);
+
+typedef struct sdcard_scan_service *sdcard_scan_service_handle_t;
+
+/**
+ * @brief Background sdcard scan configurations
+ */
+typedef struct {
+    sdcard_scan_cb_t    cb;                 /*!< Called from the scan task for every file found */
+    sdcard_scan_done_cb_t done_cb;          /*!< Called from the scan task when the scan completes, before the cache file is saved.
+                                                 Must commit what `cb` saved, e.g. `sdcard_list_commit`, the cache is not saved if it fails.
+                                                 Required with `cache_file` */
+    void                *user_data;         /*!< The data to be used by callback function */
+    const char          *path;              /*!< The path to be scanned */
+    int                 depth;              /*!< The depth of file scanning, see `sdcard_scan` */
+    const char          **file_extension;   /*!< File extension of files that are supposed to be saved, NULL for all files */
+    int                 filter_num;         /*!< Number of filters */
+    const char          *cache_file;        /*!< File to save the signature (mtime, entry count and names) of every scanned directory.
+                                                 The files of a directory unchanged since the previous scan are not reported again,
+                                                 so the callback must save to a list that persists, e.g. `sdcard_list_create_persistent`.
+                                                 NULL to report all the files */
+    bool                rescan_all;         /*!< Ignore the saved directory cache, e.g. when the persistent list has been dropped */
+    int                 task_stack;         /*!< Scan task stack size */
+    int                 task_prio;          /*!< Scan task priority */
+    int                 task_core;          /*!< Scan task running in core */
+    bool                stack_in_ext;       /*!< Try to allocate the stack in external memory */
+} sdcard_scan_service_cfg_t;
+
+#define SDCARD_SCAN_SERVICE_TASK_STACK      (4 * 1024)
+#define SDCARD_SCAN_SERVICE_TASK_PRIO       (3)
+#define SDCARD_SCAN_SERVICE_TASK_CORE       (0)
+
+#define SDCARD_SCAN_SERVICE_CFG_DEFAULT() {                 \
+    .cb = NULL,                                             \
+    .done_cb = NULL,                                        \
+    .user_data = NULL,                                      \
+    .path = "/sdcard",                                      \
+    .depth = 0,                                             \
+    .file_extension = NULL,                                 \
+    .filter_num = 0,                                        \
+    .cache_file = NULL,                                     \
+    .rescan_all = false,                                    \
+    .task_stack = SDCARD_SCAN_SERVICE_TASK_STACK,           \
+    .task_prio = SDCARD_SCAN_SERVICE_TASK_PRIO,             \
+    .task_core = SDCARD_SCAN_SERVICE_TASK_CORE,             \
+    .stack_in_ext = false,                                  \
+}
+
 /**
  * @brief Scan files in SD card and use callback function to save files that meet filtering conditions.
  *
@@ -51,6 +102,44 @@ typedef void (*sdcard_scan_cb_t)(void *user_data, char *url);
  */
 esp_err_t sdcard_scan(sdcard_scan_cb_t cb, const char *path, int depth, const char *file_extension[], int filter_num, void *user_data);
 
+/**
+ * @brief Start scanning the SD card in a background task, the files are reported to the callback as soon as they are found
+ *
+ * @param cfg   The configuration
+ *
+ * @return
+ *     - NULL    Failed
+ *     - Others  The scan service handle
+ */
+sdcard_scan_service_handle_t sdcard_scan_service_start(const sdcard_scan_service_cfg_t *cfg);
+
+/**
+ * @brief Wait for the background scan to finish
+ *
+ * @param service         The scan service handle
+ * @param ticks_to_wait   The ticks to wait
+ *
+ * @return
+ *     - ESP_OK               The scan finished and the directory cache is saved
+ *     - ESP_ERR_TIMEOUT      The scan is still running
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_FAIL             The scan finished but the directory cache could not be saved
+ */
+esp_err_t sdcard_scan_service_wait(sdcard_scan_service_handle_t service, TickType_t ticks_to_wait);
+
+/**
+ * @brief Stop the background scan if it is still running and free the service
+ *
+ * @note  The directory cache is only saved by a complete scan
+ *
+ * @param service   The scan service handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t sdcard_scan_service_destroy(sdcard_scan_service_handle_t service);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,8 @@
  *
  */
 
+#include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -30,6 +32,7 @@
 
 #include "audio_error.h"
 #include "audio_mem.h"
+#include "audio_mutex.h"
 #include "sdcard_list.h"
 
 #define SDCARD_DEFAULT_DIR_NAME         "/sdcard/__playlist"
@@ -40,6 +43,11 @@
 #define SDCARD_OFFSET_FILE_NAME_LENGTH  (strlen(SDCARD_DEFAULT_OFFSET_FILE_NAME) + 10)
 
 #define SDCARD_LIST_URL_MAX_LENGTH      (1024 * 2)
+#define SDCARD_LIST_BATCH_SIZE          (1024 * 4)
+#define SDCARD_LIST_MAGIC               (0x4c504453) /* "SDPL" */
+#define SDCARD_LIST_FORMAT_VERSION      (2)
+#define SDCARD_LIST_INDEX_MIN_SIZE      (64)
+#define SDCARD_LIST_CMP_CHUNK           (64)
 
 #define CHECK_ERROR(TAG, para, action)  {\
     if ((para) == false) {\
@@ -50,6 +58,29 @@
 
 static const char *TAG = "PLAYLIST_SDCARD";
 
+/**
+ * @brief Header at the beginning of the offset file, rewritten last by every commit
+ */
+typedef struct {
+    uint32_t magic;                      /*!< SDCARD_LIST_MAGIC */
+    uint16_t format_version;             /*!< SDCARD_LIST_FORMAT_VERSION */
+    uint16_t entry_size;                 /*!< sizeof(sdcard_list_entry_t) */
+    uint32_t content_version;            /*!< Set by `sdcard_list_create_persistent`, a mismatch drops the saved list */
+    uint32_t url_num;                    /*!< Number of committed URLs */
+    uint32_t url_bytes;                  /*!< Committed size of the URL file */
+    uint32_t check;                      /*!< Digest of the fields above */
+} sdcard_list_header_t;
+
+/**
+ * @brief Offset table entry, same layout in the offset file and in memory
+ */
+typedef struct {
+    uint32_t offset;                     /*!< Position of the URL in the URL file */
+    uint32_t digest;                     /*!< Digest of the URL, used by the hash index */
+    uint16_t len;                        /*!< URL length */
+    uint16_t reserved;
+} sdcard_list_entry_t;
+
 /**
  * @brief Sdcard list management unit
  */
@@ -59,14 +90,133 @@ typedef struct sdcard_list {
     FILE *save_file;                     /*!< File to save urls */
     FILE *offset_file;                   /*!< File to save offset of urls */
     char *cur_url;                       /*!< Point to current URL */
-    uint16_t url_num;                    /*!< Number of URLs */
-    uint16_t cur_url_id;                 /*!< Current url ID */
-    uint32_t total_size_save_file;       /*!< Size of file to save URLs */
-    uint32_t total_size_offset_file;     /*!< Size of file to save offset */
+    int url_num;                         /*!< Number of URLs, including the ones not committed yet */
+    int saved_num;                       /*!< Number of URLs committed to the sdcard */
+    int cur_url_id;                      /*!< Current url ID */
+    uint32_t total_size_save_file;       /*!< Committed size of file to save URLs */
+    sdcard_list_entry_t *entries;        /*!< Cached offset table */
+    uint32_t entry_cap;                  /*!< Capacity of `entries` */
+    uint32_t *index;                     /*!< Hash index of URL digests, slots hold `id + 1`, 0 for empty */
+    uint32_t index_cap;                  /*!< Number of slots of `index`, a power of 2 */
+    char *batch;                         /*!< URLs saved since the last commit */
+    int batch_len;                       /*!< Bytes used in `batch` */
+    uint32_t content_version;            /*!< Content version of a persistent list */
+    bool persistent;                     /*!< Keep the files on destroy and reload them on create */
+    void *lock;                          /*!< Lets a background scan save URLs while the player reads them */
 } sdcard_list_t;
 
 esp_err_t sdcard_list_get_operation(playlist_operation_t *operation);
 
+static uint32_t sdcard_list_digest(const void *data, int len, uint32_t hash)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static esp_err_t sdcard_list_index_rebuild(sdcard_list_t *playlist, uint32_t cap)
+{
+    uint32_t *index = audio_calloc(cap, sizeof(uint32_t));
+    AUDIO_MEM_CHECK(TAG, index, return ESP_ERR_NO_MEM);
+    for (int id = 0; id < playlist->url_num; id++) {
+        uint32_t slot = playlist->entries[id].digest & (cap - 1);
+        while (index[slot]) {
+            slot = (slot + 1) & (cap - 1);
+        }
+        index[slot] = id + 1;
+    }
+    audio_free(playlist->index);
+    playlist->index = index;
+    playlist->index_cap = cap;
+    return ESP_OK;
+}
+
+static bool sdcard_list_url_equal(sdcard_list_t *playlist, int id, const char *url)
+{
+    sdcard_list_entry_t *entry = &playlist->entries[id];
+    if (id >= playlist->saved_num) {
+        return memcmp(playlist->batch + (entry->offset - playlist->total_size_save_file), url, entry->len) == 0;
+    }
+    char chunk[SDCARD_LIST_CMP_CHUNK];
+    CHECK_ERROR(TAG, (fseek(playlist->save_file, entry->offset, SEEK_SET) == 0), return false);
+    for (int pos = 0; pos < entry->len; pos += SDCARD_LIST_CMP_CHUNK) {
+        int n = entry->len - pos < SDCARD_LIST_CMP_CHUNK ? entry->len - pos : SDCARD_LIST_CMP_CHUNK;
+        CHECK_ERROR(TAG, (fread(chunk, 1, n, playlist->save_file) == n), return false);
+        if (memcmp(chunk, url + pos, n) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int sdcard_list_find(sdcard_list_t *playlist, const char *url)
+{
+    if (playlist->index_cap == 0) {
+        return -1;
+    }
+    uint16_t len = strlen(url);
+    uint32_t digest = sdcard_list_digest(url, len, 2166136261u);
+    uint32_t slot = digest & (playlist->index_cap - 1);
+    while (playlist->index[slot]) {
+        int id = playlist->index[slot] - 1;
+        sdcard_list_entry_t *entry = &playlist->entries[id];
+        if (entry->digest == digest && entry->len == len && sdcard_list_url_equal(playlist, id, url)) {
+            return id;
+        }
+        slot = (slot + 1) & (playlist->index_cap - 1);
+    }
+    return -1;
+}
+
+static esp_err_t sdcard_list_write_header(sdcard_list_t *playlist, uint32_t url_num, uint32_t url_bytes)
+{
+    sdcard_list_header_t header = {
+        .magic = SDCARD_LIST_MAGIC,
+        .format_version = SDCARD_LIST_FORMAT_VERSION,
+        .entry_size = sizeof(sdcard_list_entry_t),
+        .content_version = playlist->content_version,
+        .url_num = url_num,
+        .url_bytes = url_bytes,
+    };
+    header.check = sdcard_list_digest(&header, offsetof(sdcard_list_header_t, check), 2166136261u);
+    CHECK_ERROR(TAG, (fseek(playlist->offset_file, 0, SEEK_SET) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fwrite(&header, 1, sizeof(header), playlist->offset_file) == sizeof(header)), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fflush(playlist->offset_file) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fsync(fileno(playlist->offset_file)) == 0), return ESP_FAIL);
+    return ESP_OK;
+}
+
+/*
+ * Write the batched URLs and their offset table entries in one transaction.
+ * The header holding the URL count is rewritten only once the data is synced,
+ * so a power loss during a commit leaves the list as it was after the previous commit.
+ */
+static esp_err_t sdcard_list_commit_batch(sdcard_list_t *playlist)
+{
+    if (playlist->saved_num == playlist->url_num) {
+        return ESP_OK;
+    }
+    int entry_num = playlist->url_num - playlist->saved_num;
+    long entry_pos = sizeof(sdcard_list_header_t) + playlist->saved_num * sizeof(sdcard_list_entry_t);
+    CHECK_ERROR(TAG, (fseek(playlist->save_file, playlist->total_size_save_file, SEEK_SET) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fwrite(playlist->batch, 1, playlist->batch_len, playlist->save_file) == playlist->batch_len), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fflush(playlist->save_file) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fsync(fileno(playlist->save_file)) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fseek(playlist->offset_file, entry_pos, SEEK_SET) == 0), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fwrite(&playlist->entries[playlist->saved_num], sizeof(sdcard_list_entry_t), entry_num, playlist->offset_file) == entry_num), return ESP_FAIL);
+    CHECK_ERROR(TAG, (fflush(playlist->offset_file) == 0), return ESP_FAIL);
+    if (sdcard_list_write_header(playlist, playlist->url_num, playlist->total_size_save_file + playlist->batch_len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    ESP_LOGD(TAG, "Committed %d urls, total %d", entry_num, (int)playlist->url_num);
+    playlist->total_size_save_file += playlist->batch_len;
+    playlist->saved_num = playlist->url_num;
+    playlist->batch_len = 0;
+    return ESP_OK;
+}
+
 static esp_err_t save_url_to_sdcard(sdcard_list_t *playlist, const char *path)
 {
     if (playlist->save_file == NULL || playlist->offset_file == NULL) {
@@ -74,20 +224,102 @@ static esp_err_t save_url_to_sdcard(sdcard_list_t *playlist, const char *path)
         return ESP_FAIL;
     }
     uint16_t len = strlen(path);
-    CHECK_ERROR(TAG, ((fseek(playlist->offset_file, playlist->total_size_offset_file, SEEK_SET)) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, ((fseek(playlist->save_file, playlist->total_size_save_file, SEEK_SET)) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fwrite(path, 1, len, playlist->save_file) == len), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fwrite(&playlist->total_size_save_file, 1, sizeof(uint32_t), playlist->offset_file) == sizeof(uint32_t)), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fwrite(&len, 1, sizeof(uint16_t), playlist->offset_file)) == sizeof(uint16_t), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fsync(fileno(playlist->save_file)) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fsync(fileno(playlist->offset_file)) == 0), return ESP_FAIL);
-    playlist->total_size_save_file += len;
-    playlist->total_size_offset_file += (sizeof(uint16_t) + sizeof(uint32_t));
-    playlist->url_num++;
+    if (playlist->batch_len + len > SDCARD_LIST_BATCH_SIZE && sdcard_list_commit_batch(playlist) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (playlist->url_num == (int)playlist->entry_cap) {
+        uint32_t cap = playlist->entry_cap ? playlist->entry_cap * 2 : SDCARD_LIST_INDEX_MIN_SIZE;
+        sdcard_list_entry_t *entries = audio_realloc(playlist->entries, cap * sizeof(sdcard_list_entry_t));
+        AUDIO_MEM_CHECK(TAG, entries, return ESP_FAIL);
+        playlist->entries = entries;
+        playlist->entry_cap = cap;
+    }
+    if ((playlist->url_num + 1) * 2 > (int)playlist->index_cap) {
+        uint32_t cap = playlist->index_cap ? playlist->index_cap * 2 : SDCARD_LIST_INDEX_MIN_SIZE;
+        if (sdcard_list_index_rebuild(playlist, cap) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    sdcard_list_entry_t *entry = &playlist->entries[playlist->url_num];
+    entry->offset = playlist->total_size_save_file + playlist->batch_len;
+    entry->digest = sdcard_list_digest(path, len, 2166136261u);
+    entry->len = len;
+    entry->reserved = 0;
+    memcpy(playlist->batch + playlist->batch_len, path, len);
+    playlist->batch_len += len;
+
+    uint32_t slot = entry->digest & (playlist->index_cap - 1);
+    while (playlist->index[slot]) {
+        slot = (slot + 1) & (playlist->index_cap - 1);
+    }
+    playlist->index[slot] = ++playlist->url_num;
 
     return ESP_OK;
 }
 
+static esp_err_t sdcard_list_load(sdcard_list_t *playlist)
+{
+    sdcard_list_header_t header = { 0 };
+    if (fseek(playlist->offset_file, 0, SEEK_SET) != 0
+        || fread(&header, 1, sizeof(header), playlist->offset_file) != sizeof(header)) {
+        return ESP_FAIL;
+    }
+    if (header.magic != SDCARD_LIST_MAGIC
+        || header.format_version != SDCARD_LIST_FORMAT_VERSION
+        || header.entry_size != sizeof(sdcard_list_entry_t)
+        || header.check != sdcard_list_digest(&header, offsetof(sdcard_list_header_t, check), 2166136261u)) {
+        ESP_LOGW(TAG, "No valid playlist in %s", playlist->offset_file_name);
+        return ESP_FAIL;
+    }
+    if (header.content_version != playlist->content_version) {
+        ESP_LOGI(TAG, "Playlist content version changed %d -> %d", (int)header.content_version, (int)playlist->content_version);
+        return ESP_FAIL;
+    }
+    CHECK_ERROR(TAG, (fseek(playlist->save_file, 0, SEEK_END) == 0), return ESP_FAIL);
+    if (ftell(playlist->save_file) < (long)header.url_bytes) {
+        ESP_LOGW(TAG, "Truncated url file, drop the saved playlist");
+        return ESP_FAIL;
+    }
+    if (header.url_num) {
+        playlist->entries = audio_malloc(header.url_num * sizeof(sdcard_list_entry_t));
+        AUDIO_MEM_CHECK(TAG, playlist->entries, return ESP_FAIL);
+        playlist->entry_cap = header.url_num;
+        if (fread(playlist->entries, sizeof(sdcard_list_entry_t), header.url_num, playlist->offset_file) != header.url_num) {
+            ESP_LOGW(TAG, "Truncated offset file, drop the saved playlist");
+            return ESP_FAIL;
+        }
+        for (uint32_t id = 0; id < header.url_num; id++) {
+            if (playlist->entries[id].offset + playlist->entries[id].len > header.url_bytes) {
+                ESP_LOGW(TAG, "Corrupted offset table, drop the saved playlist");
+                return ESP_FAIL;
+            }
+        }
+    }
+    playlist->url_num = header.url_num;
+    playlist->saved_num = header.url_num;
+    playlist->total_size_save_file = header.url_bytes;
+    uint32_t cap = SDCARD_LIST_INDEX_MIN_SIZE;
+    while (cap < header.url_num * 2) {
+        cap *= 2;
+    }
+    return sdcard_list_index_rebuild(playlist, cap);
+}
+
+static void sdcard_list_drop(sdcard_list_t *playlist)
+{
+    audio_free(playlist->entries);
+    audio_free(playlist->index);
+    playlist->entries = NULL;
+    playlist->index = NULL;
+    playlist->entry_cap = 0;
+    playlist->index_cap = 0;
+    playlist->url_num = 0;
+    playlist->saved_num = 0;
+    playlist->cur_url_id = 0;
+    playlist->total_size_save_file = 0;
+    playlist->batch_len = 0;
+}
+
 static esp_err_t sdcard_list_open(sdcard_list_t *playlist, uint8_t list_id)
 {
     playlist->save_file_name = audio_calloc(1, SDCARD_URL_FILE_NAME_LENGTH);
@@ -97,19 +329,43 @@ static esp_err_t sdcard_list_open(sdcard_list_t *playlist, uint8_t list_id)
         audio_free(playlist->save_file_name);
         return ESP_FAIL;
     });
+    playlist->batch = audio_malloc(SDCARD_LIST_BATCH_SIZE);
+    AUDIO_NULL_CHECK(TAG, playlist->batch, {
+        audio_free(playlist->save_file_name);
+        audio_free(playlist->offset_file_name);
+        return ESP_FAIL;
+    });
 
-    sprintf(playlist->save_file_name, "%s%d", SDCARD_DEFAULT_URL_FILE_NAME, list_id);
-    sprintf(playlist->offset_file_name, "%s%d", SDCARD_DEFAULT_OFFSET_FILE_NAME, list_id);
+    const char *suffix = playlist->persistent ? "_p" : "";
+    sprintf(playlist->save_file_name, "%s%s%d", SDCARD_DEFAULT_URL_FILE_NAME, suffix, list_id);
+    sprintf(playlist->offset_file_name, "%s%s%d", SDCARD_DEFAULT_OFFSET_FILE_NAME, suffix, list_id);
 
     mkdir(SDCARD_DEFAULT_DIR_NAME, 0777);
 
+    if (playlist->persistent) {
+        playlist->save_file = fopen(playlist->save_file_name, "r+");
+        playlist->offset_file = fopen(playlist->offset_file_name, "r+");
+        if (playlist->save_file && playlist->offset_file && sdcard_list_load(playlist) == ESP_OK) {
+            ESP_LOGI(TAG, "Reload %d urls from %s", (int)playlist->url_num, playlist->save_file_name);
+            return ESP_OK;
+        }
+        sdcard_list_drop(playlist);
+        if (playlist->save_file) {
+            fclose(playlist->save_file);
+        }
+        if (playlist->offset_file) {
+            fclose(playlist->offset_file);
+        }
+    }
     playlist->save_file = fopen(playlist->save_file_name, "w+");
     playlist->offset_file = fopen(playlist->offset_file_name, "w+");
 
-    if (playlist->save_file == NULL || NULL == playlist->offset_file) {
+    if (playlist->save_file == NULL || NULL == playlist->offset_file
+        || sdcard_list_write_header(playlist, 0, 0) != ESP_OK) {
         ESP_LOGE(TAG, "open file error, line: %d, have you mounted sdcard, set the long file name and UTF-8 encoding configuration ?", __LINE__);
         audio_free(playlist->save_file_name);
         audio_free(playlist->offset_file_name);
+        audio_free(playlist->batch);
         if (playlist->save_file) {
             fclose(playlist->save_file);
         }
@@ -123,6 +379,7 @@ static esp_err_t sdcard_list_open(sdcard_list_t *playlist, uint8_t list_id)
 
 static esp_err_t sdcard_list_close(sdcard_list_t *playlist)
 {
+    sdcard_list_commit_batch(playlist);
     fclose(playlist->offset_file);
     fclose(playlist->save_file);
     playlist->offset_file = NULL;
@@ -130,38 +387,43 @@ static esp_err_t sdcard_list_close(sdcard_list_t *playlist)
     return ESP_OK;
 }
 
-static esp_err_t sdcard_list_choose_id(sdcard_list_t *playlist, int id, char **url_buff)
+static esp_err_t sdcard_list_read_url(sdcard_list_t *playlist, int id, char *url)
 {
-    uint32_t pos = 0;
-    uint16_t  size = 0;
-    int offset = id * (sizeof(uint32_t) + sizeof(uint16_t));
-
-    CHECK_ERROR(TAG, ((fseek(playlist->offset_file, offset, SEEK_SET)) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, ((fread(&pos, 1, sizeof(uint32_t), playlist->offset_file)) == sizeof(uint32_t)), return ESP_FAIL);
-    CHECK_ERROR(TAG, ((fread(&size, 1, sizeof(uint16_t), playlist->offset_file)) == sizeof(uint16_t)), return ESP_FAIL);
+    sdcard_list_entry_t *entry = &playlist->entries[id];
+    if (id >= playlist->saved_num) {
+        memcpy(url, playlist->batch + (entry->offset - playlist->total_size_save_file), entry->len);
+    } else {
+        CHECK_ERROR(TAG, ((fseek(playlist->save_file, entry->offset, SEEK_SET)) == 0), return ESP_FAIL);
+        CHECK_ERROR(TAG, ((fread(url, 1, entry->len, playlist->save_file)) == entry->len), return ESP_FAIL);
+    }
+    url[entry->len] = 0;
+    return ESP_OK;
+}
 
+/* Called with the lock held, `id` must have been picked under the same lock as the background scan appends URLs */
+static esp_err_t sdcard_list_choose_id(sdcard_list_t *playlist, int id, char **url_buff)
+{
+    if (id >= playlist->url_num) {
+        ESP_LOGE(TAG, "The playlist has been reset");
+        return ESP_FAIL;
+    }
     if (playlist->cur_url) {
         audio_free(playlist->cur_url);
     }
-    playlist->cur_url = (char *)audio_calloc(1, size + 1);
+    playlist->cur_url = (char *)audio_calloc(1, playlist->entries[id].len + 1);
     AUDIO_NULL_CHECK(TAG, playlist->cur_url, {
         ESP_LOGE(TAG, "Fail to allocate memory for url");
-        fclose(playlist->offset_file);
-        fclose(playlist->save_file);
         return ESP_FAIL;
     });
-
-    CHECK_ERROR(TAG, ((fseek(playlist->save_file, pos, SEEK_SET)) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, ((fread(playlist->cur_url, 1, size, playlist->save_file)) == size), return ESP_FAIL);
-
-    playlist->cur_url[size] = 0;
+    if (sdcard_list_read_url(playlist, id, playlist->cur_url) != ESP_OK) {
+        return ESP_FAIL;
+    }
     playlist->cur_url_id = id;
     *url_buff = playlist->cur_url;
-
     return ESP_OK;
 }
 
-esp_err_t sdcard_list_create(playlist_operator_handle_t *handle)
+static esp_err_t sdcard_list_create_with_id(playlist_operator_handle_t *handle, uint8_t list_id, bool persistent, uint32_t content_version)
 {
     esp_err_t ret = ESP_OK;
     AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
@@ -177,10 +439,18 @@ esp_err_t sdcard_list_create(playlist_operator_handle_t *handle)
 
     sdcard_handle->playlist = sdcard_list;
     sdcard_handle->get_operation = sdcard_list_get_operation;
+    sdcard_list->persistent = persistent;
+    sdcard_list->content_version = content_version;
+    sdcard_list->lock = mutex_create();
+    AUDIO_NULL_CHECK(TAG, sdcard_list->lock, {
+        audio_free(sdcard_handle);
+        audio_free(sdcard_list);
+        return ESP_FAIL;
+    });
 
-    static int list_id;
-    ret |= sdcard_list_open(sdcard_list, list_id++);
+    ret |= sdcard_list_open(sdcard_list, list_id);
     if (ret != ESP_OK) {
+        mutex_destroy(sdcard_list->lock);
         audio_free(sdcard_handle);
         audio_free(sdcard_list);
         return ESP_FAIL;
@@ -190,31 +460,40 @@ esp_err_t sdcard_list_create(playlist_operator_handle_t *handle)
     return ESP_OK;
 }
 
+esp_err_t sdcard_list_create(playlist_operator_handle_t *handle)
+{
+    static int list_id;
+    return sdcard_list_create_with_id(handle, list_id++, false, 0);
+}
+
+esp_err_t sdcard_list_create_persistent(playlist_operator_handle_t *handle, uint8_t list_id, uint32_t content_version)
+{
+    return sdcard_list_create_with_id(handle, list_id, true, content_version);
+}
+
 esp_err_t sdcard_list_show(playlist_operator_handle_t handle)
 {
     AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
-    uint32_t pos = 0;
-    uint16_t  size = 0;
     char *url = audio_calloc(1, SDCARD_LIST_URL_MAX_LENGTH);
+    AUDIO_MEM_CHECK(TAG, url, return ESP_FAIL);
 
-    CHECK_ERROR(TAG, (fseek(playlist->save_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fseek(playlist->offset_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-
+    esp_err_t ret = ESP_OK;
+    mutex_lock(playlist->lock);
     ESP_LOGI(TAG, "ID   URL");
     for (int i = 0; i < playlist->url_num; i++) {
-        memset(url, 0, SDCARD_LIST_URL_MAX_LENGTH);
-        CHECK_ERROR(TAG, (fread(&pos, 1, sizeof(uint32_t), playlist->offset_file) == sizeof(uint32_t)), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fread(&size, 1, sizeof(uint16_t), playlist->offset_file) == sizeof(uint16_t)), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fseek(playlist->save_file, pos, SEEK_SET) == 0), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fread(url, 1, size, playlist->save_file) == size), return ESP_FAIL);
+        CHECK_ERROR(TAG, (sdcard_list_read_url(playlist, i, url) == ESP_OK), {
+            ret = ESP_FAIL;
+            break;
+        });
         ESP_LOGI(TAG, "%d   %s", i, url);
     }
+    mutex_unlock(playlist->lock);
 
     audio_free(url);
-    return ESP_OK;
+    return ret;
 }
 
 esp_err_t sdcard_list_next(playlist_operator_handle_t handle, int step, char **url_buff)
@@ -223,24 +502,30 @@ esp_err_t sdcard_list_next(playlist_operator_handle_t handle, int step, char **u
     AUDIO_NULL_CHECK(TAG, url_buff, return ESP_FAIL);
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
-
-    if (playlist->url_num == 0) {
-        ESP_LOGE(TAG, "No url, please save urls to playlist first");
-        return ESP_FAIL;
-    }
     if (step < 0) {
         ESP_LOGE(TAG, "Step should be larger than 0");
         return ESP_FAIL;
     }
 
+    esp_err_t ret = ESP_FAIL;
+    mutex_lock(playlist->lock);
+    int url_num = playlist->url_num;
+    if (url_num == 0) {
+        ESP_LOGE(TAG, "No url, please save urls to playlist first");
+        goto _next_exit;
+    }
+
     int id = 0, total_step = 0;
     total_step = playlist->cur_url_id + step;
     id = total_step;
-    if (total_step >= playlist->url_num) {
-        id = total_step % playlist->url_num;
+    if (total_step >= url_num) {
+        id = total_step % url_num;
     }
+    ret = sdcard_list_choose_id(playlist, id, url_buff);
 
-    return sdcard_list_choose_id(playlist, id, url_buff);
+_next_exit:
+    mutex_unlock(playlist->lock);
+    return ret;
 }
 
 esp_err_t sdcard_list_prev(playlist_operator_handle_t handle, int step, char **url_buff)
@@ -249,29 +534,35 @@ esp_err_t sdcard_list_prev(playlist_operator_handle_t handle, int step, char **u
     AUDIO_NULL_CHECK(TAG, url_buff, return ESP_FAIL);
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
-
-    if (playlist->url_num == 0) {
-        ESP_LOGE(TAG, "No url, please save urls to playlist first");
-        return ESP_FAIL;
-    }
     if (step < 0) {
         ESP_LOGE(TAG, "Steps should be larger than 0");
         return ESP_FAIL;
     }
 
+    esp_err_t ret = ESP_FAIL;
+    mutex_lock(playlist->lock);
+    int url_num = playlist->url_num;
+    if (url_num == 0) {
+        ESP_LOGE(TAG, "No url, please save urls to playlist first");
+        goto _prev_exit;
+    }
+
     int id = 0, total_step = 0;
     total_step = playlist->cur_url_id - step;
     id = total_step;
 
     if (total_step < 0) {
-        if (total_step % playlist->url_num == 0) {
+        if (total_step % url_num == 0) {
             id = 0;
         } else {
-            id = playlist->url_num + total_step % playlist->url_num;
+            id = url_num + total_step % url_num;
         }
     }
+    ret = sdcard_list_choose_id(playlist, id, url_buff);
 
-    return sdcard_list_choose_id(playlist, id, url_buff);
+_prev_exit:
+    mutex_unlock(playlist->lock);
+    return ret;
 }
 
 esp_err_t sdcard_list_current(playlist_operator_handle_t handle, char **url_buff)
@@ -281,12 +572,15 @@ esp_err_t sdcard_list_current(playlist_operator_handle_t handle, char **url_buff
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
+    esp_err_t ret = ESP_FAIL;
+    mutex_lock(playlist->lock);
     if (playlist->url_num == 0) {
         ESP_LOGE(TAG, "No url, please save urls to playlist first");
-        return ESP_FAIL;
+    } else {
+        ret = sdcard_list_choose_id(playlist, playlist->cur_url_id, url_buff);
     }
-
-    return sdcard_list_choose_id(playlist, playlist->cur_url_id, url_buff);
+    mutex_unlock(playlist->lock);
+    return ret;
 }
 
 esp_err_t sdcard_list_choose(playlist_operator_handle_t handle, int url_id, char **url_buff)
@@ -296,16 +590,17 @@ esp_err_t sdcard_list_choose(playlist_operator_handle_t handle, int url_id, char
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
+    esp_err_t ret = ESP_FAIL;
+    mutex_lock(playlist->lock);
     if (playlist->url_num == 0) {
         ESP_LOGE(TAG, "No url, please save urls to playlist first");
-        return ESP_FAIL;
-    }
-    if ((url_id < 0) || (url_id >= playlist->url_num)) {
+    } else if ((url_id < 0) || (url_id >= playlist->url_num)) {
         ESP_LOGE(TAG, "Invalid url id to be choosen");
-        return ESP_FAIL;
+    } else {
+        ret = sdcard_list_choose_id(playlist, url_id, url_buff);
     }
-
-    return sdcard_list_choose_id(playlist, url_id, url_buff);
+    mutex_unlock(playlist->lock);
+    return ret;
 }
 
 esp_err_t sdcard_list_save(playlist_operator_handle_t handle, const char *url)
@@ -321,40 +616,25 @@ esp_err_t sdcard_list_save(playlist_operator_handle_t handle, const char *url)
         ESP_LOGE(TAG, "The url length is greater than MAX LENTGTH, you should change the SDCARD_LIST_URL_MAX_LENGTH value");
         return ESP_FAIL;
     }
-    ret = save_url_to_sdcard(playlist, url);
+    mutex_lock(playlist->lock);
+    if (playlist->persistent == false || sdcard_list_find(playlist, url) < 0) {
+        ret = save_url_to_sdcard(playlist, url);
+    }
+    mutex_unlock(playlist->lock);
     return ret;
 }
 
 bool sdcard_list_exist(playlist_operator_handle_t handle, const char *url)
 {
-    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, handle, return false);
+    AUDIO_NULL_CHECK(TAG, url, return false);
     sdcard_list_t *playlist = handle->playlist;
-    AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, playlist, return false);
 
-    uint32_t pos = 0;
-    uint16_t  size = 0;
-    char *url_buff = audio_calloc(1, SDCARD_LIST_URL_MAX_LENGTH);
-
-    CHECK_ERROR(TAG, (fseek(playlist->save_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-    CHECK_ERROR(TAG, (fseek(playlist->offset_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-
-    for (int i = 0; i < playlist->url_num; i++) {
-        memset(url_buff, 0, SDCARD_LIST_URL_MAX_LENGTH);
-        CHECK_ERROR(TAG, (fread(&pos, 1, sizeof(uint32_t), playlist->offset_file) == sizeof(uint32_t)), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fread(&size, 1, sizeof(uint16_t), playlist->offset_file) == sizeof(uint16_t)), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fseek(playlist->save_file, pos, SEEK_SET) == 0), return ESP_FAIL);
-        CHECK_ERROR(TAG, (fread(url_buff, 1, size, playlist->save_file) == size), return ESP_FAIL);
-        if (strlen(url_buff) != strlen(url)) {
-            continue;
-        }
-        if (strcmp(url, url_buff) == 0) {
-            audio_free(url_buff);
-            return true;
-        }
-    }
-
-    audio_free(url_buff);
-    return false;
+    mutex_lock(playlist->lock);
+    bool exist = sdcard_list_find(playlist, url) >= 0;
+    mutex_unlock(playlist->lock);
+    return exist;
 }
 
 esp_err_t sdcard_list_reset(playlist_operator_handle_t handle)
@@ -364,23 +644,30 @@ esp_err_t sdcard_list_reset(playlist_operator_handle_t handle)
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
     /**
-     * ftruncate() function is not supported now, it won't affect the operation result.
-     *
-       CHECK_ERROR(TAG, (ftruncate(playlist->save_file, 0) == ESP_OK), return ESP_FAIL);
-       CHECK_ERROR(TAG, (ftruncate(playlist->offset_file, 0) == ESP_OK), return ESP_FAIL);
-       CHECK_ERROR(TAG, (fseek(playlist->save_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-       CHECK_ERROR(TAG, (fseek(playlist->offset_file, 0, SEEK_SET) == 0), return ESP_FAIL);
-    */
+     * ftruncate() function is not supported now, the header is rewritten with no URL instead,
+     * the stale data is overwritten by the following commits.
+     */
+    mutex_lock(playlist->lock);
     if (playlist->cur_url) {
         audio_free(playlist->cur_url);
         playlist->cur_url = NULL;
     }
+    sdcard_list_drop(playlist);
+    esp_err_t ret = sdcard_list_write_header(playlist, 0, 0);
+    mutex_unlock(playlist->lock);
+    return ret;
+}
 
-    playlist->url_num = 0;
-    playlist->cur_url_id = 0;
-    playlist->total_size_offset_file = 0;
-    playlist->total_size_save_file = 0;
-    return ESP_OK;
+esp_err_t sdcard_list_commit(playlist_operator_handle_t handle)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+    sdcard_list_t *playlist = handle->playlist;
+    AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
+
+    mutex_lock(playlist->lock);
+    esp_err_t ret = sdcard_list_commit_batch(playlist);
+    mutex_unlock(playlist->lock);
+    return ret;
 }
 
 int sdcard_list_get_url_num(playlist_operator_handle_t handle)
@@ -389,7 +676,10 @@ int sdcard_list_get_url_num(playlist_operator_handle_t handle)
     sdcard_list_t *playlist = handle->playlist;
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
-    return playlist->url_num;
+    mutex_lock(playlist->lock);
+    int url_num = playlist->url_num;
+    mutex_unlock(playlist->lock);
+    return url_num;
 }
 
 int sdcard_list_get_url_id(playlist_operator_handle_t handle)
@@ -408,10 +698,15 @@ esp_err_t sdcard_list_destroy(playlist_operator_handle_t handle)
     AUDIO_NULL_CHECK(TAG, playlist, return ESP_FAIL);
 
     sdcard_list_close(playlist);
-    remove(playlist->save_file_name);
-    remove(playlist->offset_file_name);
+    if (playlist->persistent == false) {
+        remove(playlist->save_file_name);
+        remove(playlist->offset_file_name);
+    }
     audio_free(playlist->save_file_name);
     audio_free(playlist->offset_file_name);
+    audio_free(playlist->batch);
+    sdcard_list_drop(playlist);
+    mutex_destroy(playlist->lock);
     if (playlist->cur_url) {
         audio_free(playlist->cur_url);
         playlist->cur_url = NULL;
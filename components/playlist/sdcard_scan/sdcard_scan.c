@@ -26,74 +26,358 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "audio_error.h"
 #include "audio_mem.h"
+#include "audio_thread.h"
 #include "sdcard_scan.h"
 
 #define SDCARD_FILE_PREV_NAME           "file:/"
 #define SDCARD_SCAN_URL_MAX_LENGTH      (1024 * 2)
+#define SDCARD_SCAN_EXT_MAX_LENGTH      (8)
+#define SDCARD_SCAN_EXT_TABLE_SIZE      (32)
+#define SDCARD_SCAN_CACHE_MAGIC         (0x43534453) /* "SDSC" */
+#define SDCARD_SCAN_CACHE_VERSION       (1)
+#define SDCARD_SCAN_CACHE_MIN_SIZE      (32)
+#define SDCARD_SCAN_DONE_BIT            (BIT0)
 
 static const char *TAG = "SDCARD_SCAN";
 
-static void scan_dir(sdcard_scan_cb_t save_url_cb, const char *path, int cur_depth, int depth, const char *file_extension[] , int filter_num, void *user_data)
+/**
+ * @brief Lowercase file extensions, hashed by open addressing
+ */
+typedef struct {
+    char ext[SDCARD_SCAN_EXT_TABLE_SIZE][SDCARD_SCAN_EXT_MAX_LENGTH + 1];
+    bool match_all;
+} sdcard_scan_ext_table_t;
+
+/**
+ * @brief Signature of a directory saved in the directory cache
+ */
+typedef struct {
+    uint32_t path_digest;
+    uint32_t mtime;
+    uint32_t entry_num;
+    uint32_t name_digest;
+} sdcard_scan_dir_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t config_digest;                 /*!< Digest of the scan depth and the extensions */
+    uint32_t dir_num;
+} sdcard_scan_cache_header_t;
+
+/**
+ * @brief Directory cache, the signatures loaded from the cache file and the ones found by the current scan
+ */
+typedef struct {
+    sdcard_scan_dir_t *old_dirs;
+    uint32_t *old_index;                    /*!< Slots hold `position in old_dirs + 1`, 0 for empty */
+    int old_index_cap;
+    sdcard_scan_dir_t *new_dirs;
+    int new_num;
+    int new_cap;
+    uint32_t config_digest;
+} sdcard_scan_cache_t;
+
+typedef struct {
+    sdcard_scan_cb_t cb;
+    sdcard_scan_done_cb_t done_cb;
+    void *user_data;
+    int depth;
+    char *url;                              /*!< Shared by all the directory levels, holds SDCARD_FILE_PREV_NAME + path */
+    sdcard_scan_ext_table_t *exts;
+    sdcard_scan_cache_t *cache;
+    volatile bool stop;
+    int skipped_dir;
+} sdcard_scan_ctx_t;
+
+struct sdcard_scan_service {
+    sdcard_scan_ctx_t ctx;
+    char *path;
+    char *cache_file;
+    bool rescan_all;
+    audio_thread_t thread;
+    EventGroupHandle_t events;
+    esp_err_t result;
+};
+
+static uint32_t scan_digest(const void *data, int len, uint32_t hash)
 {
-    if (cur_depth > depth) {
-        ESP_LOGD(TAG, "scan depth = %d, exit", cur_depth);
+    const uint8_t *p = (const uint8_t *)data;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t ext_slot(const char *ext)
+{
+    return scan_digest(ext, strlen(ext), 2166136261u) & (SDCARD_SCAN_EXT_TABLE_SIZE - 1);
+}
+
+/* Lowercase `src` into `dst`, return false if it can't be a filtered extension */
+static bool ext_lower(char *dst, const char *src)
+{
+    int i = 0;
+    for (; src[i]; i++) {
+        if (i == SDCARD_SCAN_EXT_MAX_LENGTH) {
+            return false;
+        }
+        dst[i] = tolower((unsigned char)src[i]);
+    }
+    dst[i] = 0;
+    return i > 0;
+}
+
+static esp_err_t ext_table_build(sdcard_scan_ext_table_t *table, const char *file_extension[], int filter_num)
+{
+    memset(table, 0, sizeof(sdcard_scan_ext_table_t));
+    if (file_extension == NULL) {
+        table->match_all = true;
+        return ESP_OK;
+    }
+    AUDIO_CHECK(TAG, filter_num < SDCARD_SCAN_EXT_TABLE_SIZE / 2, return ESP_FAIL, "Too many file extensions");
+    for (int i = 0; i < filter_num; i++) {
+        char ext[SDCARD_SCAN_EXT_MAX_LENGTH + 1];
+        AUDIO_CHECK(TAG, file_extension[i] && ext_lower(ext, file_extension[i]), return ESP_FAIL, "Invalid file extension");
+        uint32_t slot = ext_slot(ext);
+        while (table->ext[slot][0] && strcmp(table->ext[slot], ext)) {
+            slot = (slot + 1) & (SDCARD_SCAN_EXT_TABLE_SIZE - 1);
+        }
+        strcpy(table->ext[slot], ext);
+    }
+    return ESP_OK;
+}
+
+static bool ext_table_match(const sdcard_scan_ext_table_t *table, const char *name)
+{
+    if (table->match_all) {
+        return true;
+    }
+    const char *detect = strrchr(name, '.');
+    char ext[SDCARD_SCAN_EXT_MAX_LENGTH + 1];
+    if (NULL == detect || ext_lower(ext, detect + 1) == false) {
+        return false;
+    }
+    uint32_t slot = ext_slot(ext);
+    while (table->ext[slot][0]) {
+        if (strcmp(table->ext[slot], ext) == 0) {
+            return true;
+        }
+        slot = (slot + 1) & (SDCARD_SCAN_EXT_TABLE_SIZE - 1);
+    }
+    return false;
+}
+
+static bool cache_unchanged(sdcard_scan_cache_t *cache, const sdcard_scan_dir_t *dir)
+{
+    if (cache == NULL || cache->old_index_cap == 0) {
+        return false;
+    }
+    uint32_t slot = dir->path_digest & (cache->old_index_cap - 1);
+    while (cache->old_index[slot]) {
+        sdcard_scan_dir_t *old = &cache->old_dirs[cache->old_index[slot] - 1];
+        if (old->path_digest == dir->path_digest) {
+            return old->mtime == dir->mtime && old->entry_num == dir->entry_num && old->name_digest == dir->name_digest;
+        }
+        slot = (slot + 1) & (cache->old_index_cap - 1);
+    }
+    return false;
+}
+
+static void cache_add(sdcard_scan_cache_t *cache, const sdcard_scan_dir_t *dir)
+{
+    if (cache == NULL) {
         return;
     }
-    char *file_url = audio_calloc(1, SDCARD_SCAN_URL_MAX_LENGTH);
-    AUDIO_NULL_CHECK(TAG, file_url, return);
+    if (cache->new_num == cache->new_cap) {
+        int cap = cache->new_cap ? cache->new_cap * 2 : SDCARD_SCAN_CACHE_MIN_SIZE;
+        sdcard_scan_dir_t *dirs = audio_realloc(cache->new_dirs, cap * sizeof(sdcard_scan_dir_t));
+        AUDIO_MEM_CHECK(TAG, dirs, return);
+        cache->new_dirs = dirs;
+        cache->new_cap = cap;
+    }
+    cache->new_dirs[cache->new_num++] = *dir;
+}
+
+static void cache_load(sdcard_scan_cache_t *cache, const char *file_name)
+{
+    sdcard_scan_cache_header_t header = { 0 };
+    FILE *f = fopen(file_name, "r");
+    if (f == NULL) {
+        return;
+    }
+    if (fread(&header, 1, sizeof(header), f) != sizeof(header)
+        || header.magic != SDCARD_SCAN_CACHE_MAGIC
+        || header.version != SDCARD_SCAN_CACHE_VERSION
+        || header.config_digest != cache->config_digest
+        || header.dir_num == 0) {
+        ESP_LOGI(TAG, "Directory cache %s not usable, scan all directories", file_name);
+        fclose(f);
+        return;
+    }
+    int cap = SDCARD_SCAN_CACHE_MIN_SIZE;
+    while (cap < header.dir_num * 2) {
+        cap *= 2;
+    }
+    cache->old_dirs = audio_malloc(header.dir_num * sizeof(sdcard_scan_dir_t));
+    cache->old_index = audio_calloc(cap, sizeof(uint32_t));
+    if (cache->old_dirs == NULL || cache->old_index == NULL
+        || fread(cache->old_dirs, sizeof(sdcard_scan_dir_t), header.dir_num, f) != header.dir_num) {
+        ESP_LOGW(TAG, "Failed to load the directory cache %s", file_name);
+        fclose(f);
+        return;
+    }
+    fclose(f);
+    for (int i = 0; i < header.dir_num; i++) {
+        uint32_t slot = cache->old_dirs[i].path_digest & (cap - 1);
+        while (cache->old_index[slot]) {
+            slot = (slot + 1) & (cap - 1);
+        }
+        cache->old_index[slot] = i + 1;
+    }
+    cache->old_index_cap = cap;
+    ESP_LOGI(TAG, "Loaded %d directories from the cache", (int)header.dir_num);
+}
+
+static esp_err_t cache_save(sdcard_scan_cache_t *cache, const char *file_name)
+{
+    sdcard_scan_cache_header_t header = {
+        .magic = SDCARD_SCAN_CACHE_MAGIC,
+        .version = SDCARD_SCAN_CACHE_VERSION,
+        .config_digest = cache->config_digest,
+        .dir_num = cache->new_num,
+    };
+    char *tmp_name = audio_calloc(1, strlen(file_name) + 5);
+    AUDIO_MEM_CHECK(TAG, tmp_name, return ESP_ERR_NO_MEM);
+    sprintf(tmp_name, "%s.tmp", file_name);
+    FILE *f = fopen(tmp_name, "w");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to create %s", tmp_name);
+        audio_free(tmp_name);
+        return ESP_FAIL;
+    }
+    bool ok = fwrite(&header, 1, sizeof(header), f) == sizeof(header)
+              && fwrite(cache->new_dirs, sizeof(sdcard_scan_dir_t), cache->new_num, f) == cache->new_num
+              && fflush(f) == 0
+              && fsync(fileno(f)) == 0;
+    fclose(f);
+    /* Rename fails on FAT if the target exists, a power loss in between only costs a full scan */
+    remove(file_name);
+    if (ok == false || rename(tmp_name, file_name) != 0) {
+        ESP_LOGE(TAG, "Failed to save the directory cache %s", file_name);
+        remove(tmp_name);
+        audio_free(tmp_name);
+        return ESP_FAIL;
+    }
+    audio_free(tmp_name);
+    return ESP_OK;
+}
+
+static void cache_free(sdcard_scan_cache_t *cache)
+{
+    audio_free(cache->old_dirs);
+    audio_free(cache->old_index);
+    audio_free(cache->new_dirs);
+    memset(cache, 0, sizeof(sdcard_scan_cache_t));
+}
 
+/*
+ * `ctx->url` holds SDCARD_FILE_PREV_NAME followed by the directory path of `len` bytes,
+ * every level appends the entry names to the same buffer and truncates it back.
+ * A first pass over the entries computes the directory signature, the files of a directory
+ * whose signature matches the cache have been reported by a previous scan and are skipped.
+ */
+static void scan_dir(sdcard_scan_ctx_t *ctx, int len, int cur_depth)
+{
+    if (cur_depth > ctx->depth) {
+        ESP_LOGD(TAG, "scan depth = %d, exit", cur_depth);
+        return;
+    }
+    const char *path = ctx->url + strlen(SDCARD_FILE_PREV_NAME);
     DIR *dir = opendir(path);
     if (dir == NULL) {
         ESP_LOGE(TAG, "Open [%s] directory failed", path);
-        audio_free(file_url);
         return;
     }
 
+    bool unchanged = false;
+    sdcard_scan_dir_t sig = { 0 };
     struct dirent *file_info = NULL;
-    while (NULL != (file_info = readdir(dir))) {
-        if ((strlen(file_info->d_name) + strlen(path)) > (SDCARD_SCAN_URL_MAX_LENGTH - strlen(SDCARD_FILE_PREV_NAME))) {
+    if (ctx->cache) {
+        struct stat st = { 0 };
+        sig.path_digest = scan_digest(path, strlen(path), 2166136261u);
+        sig.mtime = stat(path, &st) == 0 ? (uint32_t)st.st_mtime : 0;
+        sig.name_digest = 2166136261u;
+        while (NULL != (file_info = readdir(dir))) {
+            sig.entry_num++;
+            sig.name_digest = scan_digest(file_info->d_name, strlen(file_info->d_name) + 1, sig.name_digest);
+        }
+        rewinddir(dir);
+        unchanged = cache_unchanged(ctx->cache, &sig);
+        cache_add(ctx->cache, &sig);
+        ctx->skipped_dir += unchanged;
+    }
+
+    while (ctx->stop == false && NULL != (file_info = readdir(dir))) {
+        int name_len = strlen(file_info->d_name);
+        if (len + 1 + name_len >= SDCARD_SCAN_URL_MAX_LENGTH - strlen(SDCARD_FILE_PREV_NAME)) {
             ESP_LOGE(TAG, "The file name is too long, invalid url");
             continue;
         }
         if (file_info->d_name[0] == '.') {
             continue;
         }
-
+        char *name = ctx->url + strlen(SDCARD_FILE_PREV_NAME) + len;
         if (file_info->d_type == DT_DIR) {
             if (file_info->d_name[0] == '_' && file_info->d_name[1] == '_') {
                 continue;
             }
-            memset(file_url, 0, SDCARD_SCAN_URL_MAX_LENGTH);
-            sprintf(file_url, "%s/%s", path, file_info->d_name);
-            scan_dir(save_url_cb, file_url, cur_depth + 1, depth, file_extension, filter_num, user_data);
-        } else {
-            memset(file_url, 0, SDCARD_SCAN_URL_MAX_LENGTH);
-            sprintf(file_url, "%s%s/%s", SDCARD_FILE_PREV_NAME, path, file_info->d_name);
-            if (NULL == file_extension) {
-                save_url_cb(user_data, file_url);
-                continue;
-            }
-            char *detect = strrchr(file_info->d_name, '.');
-            if (NULL == detect) {
-                continue;
-            }
-            detect ++;
-            for (int i = 0; i < filter_num; i++) {
-                if (strcasecmp(detect, file_extension[i]) == 0) {
-                    save_url_cb(user_data, file_url);
-                    break;
-                }
-            }
+            sprintf(name, "/%s", file_info->d_name);
+            scan_dir(ctx, len + 1 + name_len, cur_depth + 1);
+        } else if (unchanged == false && ext_table_match(ctx->exts, file_info->d_name)) {
+            sprintf(name, "/%s", file_info->d_name);
+            ctx->cb(ctx->user_data, ctx->url);
         }
+        name[0] = 0;
     }
-    audio_free(file_url);
     closedir(dir);
 }
 
+static esp_err_t scan_ctx_init(sdcard_scan_ctx_t *ctx, const char *path, int depth, const char *file_extension[], int filter_num)
+{
+    AUDIO_CHECK(TAG, strlen(path) < SDCARD_SCAN_URL_MAX_LENGTH - strlen(SDCARD_FILE_PREV_NAME), return ESP_FAIL, "The path is too long");
+    ctx->url = audio_calloc(1, SDCARD_SCAN_URL_MAX_LENGTH);
+    AUDIO_MEM_CHECK(TAG, ctx->url, return ESP_ERR_NO_MEM);
+    ctx->exts = audio_calloc(1, sizeof(sdcard_scan_ext_table_t));
+    AUDIO_MEM_CHECK(TAG, ctx->exts, {
+        audio_free(ctx->url);
+        return ESP_ERR_NO_MEM;
+    });
+    if (ext_table_build(ctx->exts, file_extension, filter_num) != ESP_OK) {
+        audio_free(ctx->url);
+        audio_free(ctx->exts);
+        return ESP_FAIL;
+    }
+    ctx->depth = depth;
+    sprintf(ctx->url, "%s%s", SDCARD_FILE_PREV_NAME, path);
+    return ESP_OK;
+}
+
+static void scan_ctx_deinit(sdcard_scan_ctx_t *ctx)
+{
+    audio_free(ctx->url);
+    audio_free(ctx->exts);
+}
+
 esp_err_t sdcard_scan(sdcard_scan_cb_t cb, const char *path, int depth, const char *file_extension[], int filter_num, void *user_data)
 {
     AUDIO_NULL_CHECK(TAG, cb, return ESP_FAIL);
@@ -104,6 +388,118 @@ esp_err_t sdcard_scan(sdcard_scan_cb_t cb, const char *path, int depth, const ch
         return ESP_FAIL;
     }
 
-    scan_dir(cb, path, 0, depth, file_extension, filter_num, user_data);
+    sdcard_scan_ctx_t ctx = {
+        .cb = cb,
+        .user_data = user_data,
+    };
+    if (scan_ctx_init(&ctx, path, depth, file_extension, filter_num) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    scan_dir(&ctx, strlen(path), 0);
+    scan_ctx_deinit(&ctx);
+    return ESP_OK;
+}
+
+static void sdcard_scan_task(void *pv)
+{
+    sdcard_scan_service_handle_t service = (sdcard_scan_service_handle_t)pv;
+    sdcard_scan_ctx_t *ctx = &service->ctx;
+    if (ctx->cache && service->rescan_all == false) {
+        cache_load(ctx->cache, service->cache_file);
+    }
+    int64_t start = esp_timer_get_time();
+    scan_dir(ctx, strlen(service->path), 0);
+    ESP_LOGI(TAG, "Scanned %s in %d ms, %d directories unchanged", service->path,
+             (int)((esp_timer_get_time() - start) / 1000), ctx->skipped_dir);
+    if (ctx->stop) {
+        service->result = ESP_ERR_INVALID_STATE;
+    } else {
+        // The cache tells the next scan to skip these files, so they must be on the card before it
+        service->result = ctx->done_cb ? ctx->done_cb(ctx->user_data) : ESP_OK;
+        if (service->result != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit the scanned files, the cache is not saved");
+        } else if (ctx->cache) {
+            service->result = cache_save(ctx->cache, service->cache_file);
+        }
+    }
+    xEventGroupSetBits(service->events, SDCARD_SCAN_DONE_BIT);
+    audio_thread_delete_task(&service->thread);
+}
+
+sdcard_scan_service_handle_t sdcard_scan_service_start(const sdcard_scan_service_cfg_t *cfg)
+{
+    AUDIO_NULL_CHECK(TAG, cfg, return NULL);
+    AUDIO_NULL_CHECK(TAG, cfg->cb, return NULL);
+    AUDIO_NULL_CHECK(TAG, cfg->path, return NULL);
+    if (cfg->depth < 0 || cfg->filter_num < 0) {
+        ESP_LOGE(TAG, "Invalid parameters, please check");
+        return NULL;
+    }
+    AUDIO_CHECK(TAG, cfg->cache_file == NULL || cfg->done_cb, return NULL, "The cache file needs done_cb to commit the files");
+    sdcard_scan_service_handle_t service = audio_calloc(1, sizeof(struct sdcard_scan_service));
+    AUDIO_MEM_CHECK(TAG, service, return NULL);
+    service->ctx.cb = cfg->cb;
+    service->ctx.done_cb = cfg->done_cb;
+    service->ctx.user_data = cfg->user_data;
+    service->rescan_all = cfg->rescan_all;
+    if (scan_ctx_init(&service->ctx, cfg->path, cfg->depth, cfg->file_extension, cfg->filter_num) != ESP_OK) {
+        audio_free(service);
+        return NULL;
+    }
+    service->path = audio_strdup(cfg->path);
+    service->events = xEventGroupCreate();
+    AUDIO_MEM_CHECK(TAG, service->path && service->events, goto _scan_failed);
+    if (cfg->cache_file) {
+        service->cache_file = audio_strdup(cfg->cache_file);
+        service->ctx.cache = audio_calloc(1, sizeof(sdcard_scan_cache_t));
+        AUDIO_MEM_CHECK(TAG, service->cache_file && service->ctx.cache, goto _scan_failed);
+        uint32_t digest = scan_digest(&cfg->depth, sizeof(cfg->depth), 2166136261u);
+        digest = scan_digest(service->ctx.exts, sizeof(sdcard_scan_ext_table_t), digest);
+        service->ctx.cache->config_digest = scan_digest(cfg->path, strlen(cfg->path), digest);
+    }
+    if (audio_thread_create(&service->thread, "sdcard_scan", sdcard_scan_task, service, cfg->task_stack,
+                            cfg->task_prio, cfg->stack_in_ext, cfg->task_core) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the scan task");
+        goto _scan_failed;
+    }
+    return service;
+
+_scan_failed:
+    if (service->events) {
+        vEventGroupDelete(service->events);
+    }
+    audio_free(service->ctx.cache);
+    audio_free(service->cache_file);
+    audio_free(service->path);
+    scan_ctx_deinit(&service->ctx);
+    audio_free(service);
+    return NULL;
+}
+
+esp_err_t sdcard_scan_service_wait(sdcard_scan_service_handle_t service, TickType_t ticks_to_wait)
+{
+    AUDIO_NULL_CHECK(TAG, service, return ESP_ERR_INVALID_ARG);
+    EventBits_t bits = xEventGroupWaitBits(service->events, SDCARD_SCAN_DONE_BIT, pdFALSE, pdFALSE, ticks_to_wait);
+    if ((bits & SDCARD_SCAN_DONE_BIT) == 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return service->result;
+}
+
+esp_err_t sdcard_scan_service_destroy(sdcard_scan_service_handle_t service)
+{
+    AUDIO_NULL_CHECK(TAG, service, return ESP_ERR_INVALID_ARG);
+    service->ctx.stop = true;
+    xEventGroupWaitBits(service->events, SDCARD_SCAN_DONE_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    audio_thread_cleanup(&service->thread);
+    vEventGroupDelete(service->events);
+    if (service->ctx.cache) {
+        cache_free(service->ctx.cache);
+        audio_free(service->ctx.cache);
+    }
+    audio_free(service->cache_file);
+    audio_free(service->path);
+    scan_ctx_deinit(&service->ctx);
+    audio_free(service);
     return ESP_OK;
 }
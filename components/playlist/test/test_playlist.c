@@ -22,7 +22,10 @@
  *
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "esp_peripherals.h"
 #include "periph_sdcard.h"
 #include "board.h"
@@ -520,6 +523,92 @@ TEST_CASE("Create a sdcard playlist and scan sdcard then save the specified url
     TEST_ASSERT_FALSE(esp_periph_set_destroy(set));
 }
 
+#define SCAN_TEST_DIR "/sdcard/_scantest"
+
+typedef struct {
+    playlist_operator_handle_t list;
+    int reported;
+    int reported_outside;
+} scan_sdcard_list_ctx_t;
+
+static void scan_sdcard_list_cb(void *user_data, char *url)
+{
+    scan_sdcard_list_ctx_t *ctx = (scan_sdcard_list_ctx_t *)user_data;
+    ctx->reported++;
+    if (strstr(url, SCAN_TEST_DIR "/") == NULL) {
+        ctx->reported_outside++;
+    }
+    sdcard_list_save(ctx->list, url);
+}
+
+static esp_err_t scan_sdcard_list_done_cb(void *user_data)
+{
+    return sdcard_list_commit(((scan_sdcard_list_ctx_t *)user_data)->list);
+}
+
+static void scan_test_create_file(const char *name)
+{
+    FILE *f = fopen(name, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    fclose(f);
+}
+
+static void scan_test_run(sdcard_scan_service_cfg_t *scan_cfg, scan_sdcard_list_ctx_t *ctx)
+{
+    ctx->reported = 0;
+    ctx->reported_outside = 0;
+    sdcard_scan_service_handle_t scan_handle = sdcard_scan_service_start(scan_cfg);
+    TEST_ASSERT_NOT_NULL(scan_handle);
+    TEST_ASSERT_FALSE(sdcard_scan_service_wait(scan_handle, portMAX_DELAY));
+    TEST_ASSERT_FALSE(sdcard_scan_service_destroy(scan_handle));
+}
+
+TEST_CASE("Scan sdcard in background twice, the second scan skips the unchanged directories", "[playlist]")
+{
+    esp_periph_set_handle_t set;
+    TEST_ASSERT_FALSE(initialize_sdcard(&set));
+
+    mkdir(SCAN_TEST_DIR, 0775);
+    unlink(SCAN_TEST_DIR "/b.mp3");
+    scan_test_create_file(SCAN_TEST_DIR "/a.mp3");
+
+    scan_sdcard_list_ctx_t ctx = { 0 };
+    TEST_ASSERT_FALSE(sdcard_list_create_persistent(&ctx.list, 1, 1));
+    TEST_ASSERT_FALSE(sdcard_list_reset(ctx.list));
+
+    sdcard_scan_service_cfg_t scan_cfg = SDCARD_SCAN_SERVICE_CFG_DEFAULT();
+    scan_cfg.cb = scan_sdcard_list_cb;
+    scan_cfg.done_cb = scan_sdcard_list_done_cb;
+    scan_cfg.user_data = &ctx;
+    scan_cfg.depth = 2;
+    scan_cfg.file_extension = (const char *[]) {"mp3", "wav", "aac"};
+    scan_cfg.filter_num = 3;
+    scan_cfg.cache_file = "/sdcard/__playlist/_scan_cache_test";
+    scan_cfg.rescan_all = true;
+    scan_test_run(&scan_cfg, &ctx);
+    TEST_ASSERT_GREATER_THAN(0, ctx.reported);
+    int url_num = sdcard_list_get_url_num(ctx.list);
+
+    // Nothing changed, no directory is scanned again
+    scan_cfg.rescan_all = false;
+    scan_test_run(&scan_cfg, &ctx);
+    TEST_ASSERT_EQUAL(0, ctx.reported);
+    TEST_ASSERT_EQUAL(url_num, sdcard_list_get_url_num(ctx.list));
+
+    // Only the files of the changed directory are reported again, and only the new one is added
+    scan_test_create_file(SCAN_TEST_DIR "/b.mp3");
+    scan_test_run(&scan_cfg, &ctx);
+    TEST_ASSERT_EQUAL(2, ctx.reported);
+    TEST_ASSERT_EQUAL(0, ctx.reported_outside);
+    TEST_ASSERT_EQUAL(url_num + 1, sdcard_list_get_url_num(ctx.list));
+
+    TEST_ASSERT_FALSE(sdcard_list_destroy(ctx.list));
+    unlink(SCAN_TEST_DIR "/a.mp3");
+    unlink(SCAN_TEST_DIR "/b.mp3");
+    rmdir(SCAN_TEST_DIR);
+    TEST_ASSERT_FALSE(esp_periph_set_destroy(set));
+}
+
 
 /**
  * Abnormal operation and stress test
@@ -884,3 +973,34 @@ TEST_CASE("Remove fuction test in dram list", "[playlist]")
 
     TEST_ASSERT_FALSE(esp_periph_set_destroy(set));
 }
+
+TEST_CASE("Reload a persistent sdcard playlist", "[playlist]")
+{
+    esp_periph_set_handle_t set;
+    TEST_ASSERT_FALSE(initialize_sdcard(&set));
+
+    ESP_LOGI(TAG, "Create a persistent sdcard playlist and save urls to it");
+    playlist_operator_handle_t sdcard_handle = NULL;
+    TEST_ASSERT_FALSE(sdcard_list_create_persistent(&sdcard_handle, 0, 1));
+    TEST_ASSERT_FALSE(sdcard_list_reset(sdcard_handle));
+    TEST_ASSERT_FALSE(sdcard_list_save(sdcard_handle, "save a url to sdcard playlist0"));
+    TEST_ASSERT_FALSE(sdcard_list_save(sdcard_handle, "save a url to sdcard playlist1"));
+    TEST_ASSERT_FALSE(sdcard_list_save(sdcard_handle, "save a url to sdcard playlist0"));
+    TEST_ASSERT_EQUAL(2, sdcard_list_get_url_num(sdcard_handle));
+    TEST_ASSERT_FALSE(sdcard_list_destroy(sdcard_handle));
+
+    ESP_LOGI(TAG, "Reload the playlist with the same content version");
+    TEST_ASSERT_FALSE(sdcard_list_create_persistent(&sdcard_handle, 0, 1));
+    TEST_ASSERT_EQUAL(2, sdcard_list_get_url_num(sdcard_handle));
+    TEST_ASSERT_TRUE(sdcard_list_exist(sdcard_handle, "save a url to sdcard playlist1"));
+    TEST_ASSERT_FALSE(sdcard_list_exist(sdcard_handle, "save a url to sdcard playlist2"));
+    TEST_ASSERT_FALSE(sdcard_list_show(sdcard_handle));
+    TEST_ASSERT_FALSE(sdcard_list_destroy(sdcard_handle));
+
+    ESP_LOGI(TAG, "A new content version drops the saved urls");
+    TEST_ASSERT_FALSE(sdcard_list_create_persistent(&sdcard_handle, 0, 2));
+    TEST_ASSERT_EQUAL(0, sdcard_list_get_url_num(sdcard_handle));
+    TEST_ASSERT_FALSE(sdcard_list_destroy(sdcard_handle));
+
+    TEST_ASSERT_FALSE(esp_periph_set_destroy(set));
+}
@@ -75,6 +75,15 @@ typedef enum tone_format {
     TONE_VERSION_1,        // header + desc + file table + files + crc + tail
 } tone_format_t;
 
+/**
+ * @brief The way tone partition reaches the flash
+ */
+typedef enum tone_partition_access {
+    TONE_PARTITION_ACCESS_READ,     /*!< Read the flash in the calling task */
+    TONE_PARTITION_ACCESS_DELEGATE, /*!< Read the flash in the esp delegate task, for callers with stack in external ram */
+    TONE_PARTITION_ACCESS_MMAP,     /*!< Map the partition once and read it as memory, falls back to delegate reads if mapping fails */
+} tone_partition_access_t;
+
 /**
  * @brief      Initial the tone partition.
  *
@@ -87,6 +96,22 @@ typedef enum tone_format {
  */
 tone_partition_handle_t tone_partition_init(const char *partition_label, bool use_delegate);
 
+/**
+ * @brief      Initial the tone partition with the given access mode.
+ *
+ * @note       The file table is loaded into RAM here, later file info lookups do not touch the flash.
+ *             With `TONE_PARTITION_ACCESS_MMAP` the mapping is set up and released through the esp delegate,
+ *             so it is safe to call from a task with stack in external ram.
+ *
+ * @param[in]  partition_label  Label of the tone partition
+ * @param[in]  access           How to access the flash
+ *
+ * @return
+ *      - 'tone_partition_handle_t': Success
+ *      - NULL: Fail
+ */
+tone_partition_handle_t tone_partition_init_with_access(const char *partition_label, tone_partition_access_t access);
+
 /**
  * @brief      Destroy the tone partition handle.
  *
@@ -98,6 +123,22 @@ tone_partition_handle_t tone_partition_init(const char *partition_label, bool us
  */
 esp_err_t tone_partition_deinit(tone_partition_handle_t handle);
 
+/**
+ * @brief      Check that the partition header still matches the one read at init.
+ *
+ * @note       The file table is cached by `tone_partition_init`, after the partition is rewritten
+ *             (e.g. a tone OTA) the handle must be created again. This reads only the header and
+ *             the app description, so it is cheap enough to do before every tone.
+ *
+ * @param[in]  handle   Pointer to 'tone_partition_handle_t' structure
+ *
+ * @return
+ *      - ESP_OK: The header is unchanged
+ *      - ESP_ERR_INVALID_STATE: The partition has been rewritten, deinit and init the handle again
+ *      - others: Failed to read the header
+ */
+esp_err_t tone_partition_check_header(tone_partition_handle_t handle);
+
 /**
  * @brief      Get the 'esp_app_desc_t' structure in 'flash_tone' partition.
  *
@@ -138,6 +179,22 @@ esp_err_t tone_partition_get_file_info(tone_partition_handle_t handle, uint16_t
  */
 esp_err_t tone_partition_file_read(tone_partition_handle_t handle, tone_file_info_t *file, uint32_t offset, char *dst, int read_len);
 
+/**
+ * @brief      Get a pointer to the data of the given file, without copying it.
+ *
+ * @note       Only available when the partition is mapped, the pointer stays valid until `tone_partition_deinit`.
+ *
+ * @param[in]  handle   Pointer to 'tone_partition_handle_t' structure
+ * @param[in]  file     File to get
+ * @param[out] data     Start of the file data, `file->song_len` bytes long
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NOT_SUPPORTED: The partition is not mapped, use `tone_partition_file_read`
+ *      - others: Failed
+ */
+esp_err_t tone_partition_file_get_data(tone_partition_handle_t handle, const tone_file_info_t *file, const uint8_t **data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@
 #include "esp_delegate.h"
 #include "esp_log.h"
 #include "esp_partition.h"
+#include "esp_spi_flash.h"
 
 #include "partition_action.h"
 #include "tone_partition.h"
@@ -39,6 +40,12 @@
 typedef struct tone_partition_s {
     const esp_partition_t *partition;
     flash_tone_header_t header;
+    esp_app_desc_t desc;
+    tone_file_info_t *index;
+    const uint8_t *map;
+    spi_flash_mmap_handle_t map_handle;
+    tone_partition_access_t access;
+    bool use_delegate;
     const esp_partition_t *(*find)(esp_partition_type_t, esp_partition_subtype_t, const char *);
     esp_err_t (*read)(const esp_partition_t *, size_t, void *, size_t);
 } tone_partition_t;
@@ -61,7 +68,7 @@ static const esp_partition_t *partition_find_with_dispatcher(esp_partition_type_
         .len = sizeof(partition_find_args_t),
     };
     action_result_t result = { 0 };
-    esp_dispatcher_execute_with_func(dispatcher, partition_find_action, NULL, &arg, &result);
+    esp_dispatcher_execute_with_func_prio(dispatcher, ESP_DISPATCHER_PRIO_HIGH, partition_find_action, NULL, &arg, &result);
     return (const esp_partition_t *)result.data;
 }
 
@@ -82,38 +89,142 @@ static esp_err_t partition_read_with_dispatcher(const esp_partition_t *partition
         .len = sizeof(partition_read_args_t),
     };
     action_result_t result = { 0 };
-    esp_dispatcher_execute_with_func(dispatcher, partition_read_action, NULL, &arg, &result);
+    esp_dispatcher_execute_with_func_prio(dispatcher, ESP_DISPATCHER_PRIO_HIGH, partition_read_action, NULL, &arg, &result);
     return result.err;
 }
 
-esp_err_t tone_partition_get_file_info(tone_partition_handle_t handle, uint16_t index, tone_file_info_t *info)
+static esp_err_t partition_mmap_action(void *instance, action_arg_t *arg, action_result_t *result)
 {
-    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
-    AUDIO_NULL_CHECK(TAG, info, return ESP_FAIL);
+    tone_partition_t *tone = (tone_partition_t *)arg->data;
+    result->err = esp_partition_mmap(tone->partition, 0, tone->partition->size, SPI_FLASH_MMAP_DATA,
+                                     (const void **)&tone->map, &tone->map_handle);
+    if (result->err != ESP_OK) {
+        tone->map = NULL;
+    }
+    return result->err;
+}
 
-    if (handle->header.total_num < index) {
-        ESP_LOGE(TAG, "Wanted index out of range index[%d]", index);
+static esp_err_t partition_munmap_action(void *instance, action_arg_t *arg, action_result_t *result)
+{
+    tone_partition_t *tone = (tone_partition_t *)arg->data;
+    spi_flash_munmap(tone->map_handle);
+    tone->map = NULL;
+    result->err = ESP_OK;
+    return ESP_OK;
+}
+
+/*
+ * Mapping and unmapping touch the flash cache, so they always run in the delegate task,
+ * whatever stack the caller has. Reading through the mapping afterwards is plain memory access.
+ */
+static esp_err_t partition_map_with_dispatcher(tone_partition_t *tone, esp_action_exe func)
+{
+    esp_dispatcher_handle_t dispatcher = esp_dispatcher_get_delegate_handle();
+    if (!dispatcher) {
         return ESP_FAIL;
     }
-    tone_file_info_t info_tmp = { 0 };
-    int start_adr = 0;
-    if (handle->header.format == TONE_VERSION_0) {
-        start_adr = sizeof(flash_tone_header_t) + FLASH_TONE_FILE_INFO_BLOCK * index;
-    } else if (handle->header.format == TONE_VERSION_1) {
-        start_adr = sizeof(flash_tone_header_t) + sizeof(esp_app_desc_t) + FLASH_TONE_FILE_INFO_BLOCK * index;
-    } else {
+    action_arg_t arg = {
+        .data = tone,
+        .len = sizeof(tone_partition_t),
+    };
+    action_result_t result = { 0 };
+    esp_dispatcher_execute_with_func_prio(dispatcher, ESP_DISPATCHER_PRIO_HIGH, func, NULL, &arg, &result);
+    return result.err;
+}
+
+static esp_err_t tone_partition_read(tone_partition_t *tone, size_t offset, void *dst, size_t size)
+{
+    if (tone->map) {
+        if (offset > tone->partition->size || size > tone->partition->size - offset) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(dst, tone->map + offset, size);
+        return ESP_OK;
+    }
+    return tone->read(tone->partition, offset, dst, size);
+}
+
+/*
+ * The header and the app description sit next to each other and are read together,
+ * one dispatcher round trip when delegated. A format 0 partition has file info where
+ * the description would be, it is simply never used.
+ */
+static esp_err_t tone_partition_read_head(tone_partition_t *tone, flash_tone_header_t *header, esp_app_desc_t *desc)
+{
+    partition_read_args_t read_args[] = {
+        {
+            .partition = tone->partition,
+            .src_offset = 0,
+            .dst = header,
+            .size = sizeof(flash_tone_header_t),
+        },
+        {
+            .partition = tone->partition,
+            .src_offset = sizeof(flash_tone_header_t),
+            .dst = desc,
+            .size = sizeof(esp_app_desc_t),
+        },
+    };
+    if (tone->use_delegate && tone->map == NULL) {
+        esp_dispatcher_handle_t dispatcher = esp_dispatcher_get_delegate_handle();
+        if (!dispatcher) {
+            return ESP_FAIL;
+        }
+        esp_dispatcher_job_t jobs[] = {
+            {
+                .func = partition_read_action,
+                .arg = { .data = &read_args[0], .len = sizeof(partition_read_args_t) },
+            },
+            {
+                .func = partition_read_action,
+                .arg = { .data = &read_args[1], .len = sizeof(partition_read_args_t) },
+            },
+        };
+        return esp_dispatcher_execute_batch(dispatcher, ESP_DISPATCHER_PRIO_HIGH, jobs, sizeof(jobs) / sizeof(jobs[0]));
+    }
+    for (size_t i = 0; i < sizeof(read_args) / sizeof(read_args[0]); i++) {
+        esp_err_t err = tone_partition_read(tone, read_args[i].src_offset, read_args[i].dst, read_args[i].size);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+/*
+ * The whole file table is read once at init, it is only 64 bytes per tone
+ * and saves a flash round trip every time a tone starts.
+ */
+static esp_err_t tone_partition_load_index(tone_partition_t *tone)
+{
+    size_t start_adr = sizeof(flash_tone_header_t);
+    if (tone->header.format == TONE_VERSION_1) {
+        start_adr += sizeof(esp_app_desc_t);
+    } else if (tone->header.format != TONE_VERSION_0) {
         ESP_LOGE(TAG, "Tone format not support!");
         return ESP_FAIL;
     }
-    if (ESP_OK == handle->read(handle->partition, start_adr, &info_tmp, sizeof(info_tmp))) {
-        //TODO check crc
-        if (info_tmp.file_tag == FLASH_TONE_FILE_TAG) {
-            memcpy(info, &info_tmp, sizeof(info_tmp));
-        }
-    } else {
-        ESP_LOGE(TAG, "Get tone file tag error %x", info_tmp.file_tag);
+    if (tone->header.total_num == 0) {
+        return ESP_OK;
+    }
+    tone->index = audio_calloc(tone->header.total_num, FLASH_TONE_FILE_INFO_BLOCK);
+    AUDIO_MEM_CHECK(TAG, tone->index, return ESP_ERR_NO_MEM);
+    return tone_partition_read(tone, start_adr, tone->index, tone->header.total_num * FLASH_TONE_FILE_INFO_BLOCK);
+}
+
+esp_err_t tone_partition_get_file_info(tone_partition_handle_t handle, uint16_t index, tone_file_info_t *info)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, info, return ESP_FAIL);
+
+    if (index >= handle->header.total_num) {
+        ESP_LOGE(TAG, "Wanted index out of range index[%d]", index);
         return ESP_FAIL;
     }
+    //TODO check crc
+    if (handle->index[index].file_tag == FLASH_TONE_FILE_TAG) {
+        memcpy(info, &handle->index[index], sizeof(tone_file_info_t));
+    }
     return ESP_OK;
 }
 
@@ -122,23 +233,43 @@ esp_err_t tone_partition_file_read(tone_partition_handle_t handle, tone_file_inf
     AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
     AUDIO_NULL_CHECK(TAG, file, return ESP_FAIL);
 
-    esp_err_t err = handle->read(handle->partition, file->song_adr + offset, dst, read_len);
+    esp_err_t err = tone_partition_read(handle, file->song_adr + offset, dst, read_len);
     if (ESP_OK != err) {
         ESP_LOGE(TAG, "Tone file read error[0x%x]", err);
     }
     return err;
 }
 
+esp_err_t tone_partition_file_get_data(tone_partition_handle_t handle, const tone_file_info_t *file, const uint8_t **data)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, file, return ESP_FAIL);
+    AUDIO_NULL_CHECK(TAG, data, return ESP_FAIL);
+
+    if (handle->map == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (file->song_adr > handle->partition->size || file->song_len > handle->partition->size - file->song_adr) {
+        ESP_LOGE(TAG, "Tone file out of partition, addr %X, len %X", file->song_adr, file->song_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *data = handle->map + file->song_adr;
+    return ESP_OK;
+}
+
 static esp_err_t tone_partition_get_tail(tone_partition_handle_t handle, uint16_t *tail)
 {
     AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
 
     if (handle->header.format == TONE_VERSION_1) {
         tone_file_info_t last_file = { 0 };
-        tone_partition_get_file_info(handle, handle->header.total_num - 1, &last_file);
+        if (handle->header.total_num == 0 || ESP_OK != tone_partition_get_file_info(handle, handle->header.total_num - 1, &last_file)) {
+            *tail = 0;
+            return ESP_FAIL;
+        }
         int tail_addr = last_file.song_adr + last_file.song_len + ((4 - last_file.song_len % 4) % 4) + 4;
         ESP_LOGD(TAG, "addr %X, len %X, tail %X", last_file.song_adr, last_file.song_len, tail_addr);
-        return handle->read(handle->partition, tail_addr, tail, sizeof(uint16_t));
+        return tone_partition_read(handle, tail_addr, tail, sizeof(uint16_t));
     } else {
         *tail = 0;
         ESP_LOGE(TAG, "No tail");
@@ -146,23 +277,42 @@ static esp_err_t tone_partition_get_tail(tone_partition_handle_t handle, uint16_
     }
 }
 
+esp_err_t tone_partition_check_header(tone_partition_handle_t handle)
+{
+    AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
+
+    flash_tone_header_t header = { 0 };
+    esp_app_desc_t desc = { 0 };
+    esp_err_t err = tone_partition_read_head(handle, &header, &desc);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Read flash tone file header failed");
+        return err;
+    }
+    if (memcmp(&header, &handle->header, sizeof(flash_tone_header_t)) || memcmp(&desc, &handle->desc, sizeof(esp_app_desc_t))) {
+        ESP_LOGW(TAG, "Tone partition has changed since init");
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
 esp_err_t tone_partition_get_app_desc(tone_partition_handle_t handle, esp_app_desc_t *desc)
 {
-    if (handle != NULL && handle->header.format == TONE_VERSION_1) {
-        if (ESP_OK == handle->read(handle->partition, sizeof(flash_tone_header_t), desc, sizeof(esp_app_desc_t))) {
-            return ESP_OK;
-        }
+    if (handle != NULL && desc != NULL && handle->header.format == TONE_VERSION_1) {
+        memcpy(desc, &handle->desc, sizeof(esp_app_desc_t));
+        return ESP_OK;
     }
     ESP_LOGE(TAG, "Get desc failed");
     return ESP_FAIL;
 }
 
-tone_partition_handle_t tone_partition_init(const char *partition_label, bool use_delegate)
+tone_partition_handle_t tone_partition_init_with_access(const char *partition_label, tone_partition_access_t access)
 {
     AUDIO_NULL_CHECK(TAG, partition_label, return NULL);
     tone_partition_t *tone = audio_calloc(1, sizeof(tone_partition_t));
     AUDIO_NULL_CHECK(TAG, tone, return NULL);
-    if (use_delegate) {
+    tone->access = access;
+    tone->use_delegate = (access != TONE_PARTITION_ACCESS_READ);
+    if (tone->use_delegate) {
         tone->find = partition_find_with_dispatcher;
         tone->read = partition_read_with_dispatcher;
     } else {
@@ -174,7 +324,10 @@ tone_partition_handle_t tone_partition_init(const char *partition_label, bool us
         ESP_LOGE(TAG, "Can not found tone[%s] partition", partition_label);
         goto error;
     }
-    if (ESP_OK != tone->read(tone->partition, 0, &tone->header, sizeof(flash_tone_header_t))) {
+    if (access == TONE_PARTITION_ACCESS_MMAP && ESP_OK != partition_map_with_dispatcher(tone, partition_mmap_action)) {
+        ESP_LOGW(TAG, "Map tone[%s] partition failed, read it through delegate", partition_label);
+    }
+    if (ESP_OK != tone_partition_read_head(tone, &tone->header, &tone->desc)) {
         ESP_LOGE(TAG, "Read flash tone file header failed");
         goto error;
     }
@@ -182,6 +335,10 @@ tone_partition_handle_t tone_partition_init(const char *partition_label, bool us
         ESP_LOGE(TAG, "Not flash tone partition");
         goto error;
     }
+    if (ESP_OK != tone_partition_load_index(tone)) {
+        ESP_LOGE(TAG, "Read flash tone file table failed");
+        goto error;
+    }
     if (tone->header.format == TONE_VERSION_1) {
         uint16_t tail = 0;
         if (ESP_OK != tone_partition_get_tail(tone, &tail) || tail != FLASH_TONE_TAIL) {
@@ -189,19 +346,26 @@ tone_partition_handle_t tone_partition_init(const char *partition_label, bool us
             goto error;
         }
     }
-    ESP_LOGI(TAG, "tone partition format %d, total %d", tone->header.format, tone->header.total_num);
+    ESP_LOGI(TAG, "tone partition format %d, total %d%s", tone->header.format, tone->header.total_num, tone->map ? ", mapped" : "");
     return (tone_partition_handle_t)tone;
 
 error:
-    if (tone) {
-        free(tone);
-    }
+    tone_partition_deinit(tone);
     return NULL;
 }
 
+tone_partition_handle_t tone_partition_init(const char *partition_label, bool use_delegate)
+{
+    return tone_partition_init_with_access(partition_label, use_delegate ? TONE_PARTITION_ACCESS_DELEGATE : TONE_PARTITION_ACCESS_READ);
+}
+
 esp_err_t tone_partition_deinit(tone_partition_handle_t handle)
 {
     AUDIO_NULL_CHECK(TAG, handle, return ESP_FAIL);
-    free(handle);
+    if (handle->map && ESP_OK != partition_map_with_dispatcher(handle, partition_munmap_action)) {
+        ESP_LOGE(TAG, "Unmap tone partition failed");
+    }
+    audio_free(handle->index);
+    audio_free(handle);
     return ESP_OK;
 }
@@ -21,6 +21,8 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  */
+#include <stdlib.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -74,6 +76,10 @@ static SemaphoreHandle_t        s_mutex     = NULL;
 static esp_audio_handle_t       player      = NULL;
 static audio_rec_handle_t       recorder    = NULL;
 static audio_element_handle_t   raw_read    = NULL;
+static recorder_arbiter_handle_t arbiter    = NULL;
+static QueueHandle_t            arbiter_que = NULL;
+static rec_event_cb_t           rec_cb      = NULL;
+static char                     *pending_speak = NULL;
 
 static int player_pause         = 0;
 static int audio_pos            = 0;
@@ -197,6 +203,59 @@ static int input_cb_for_afe(int16_t *buffer, int buf_sz, void *user_ctx, TickTyp
     return raw_stream_read(raw_read, (char *)buffer, buf_sz);
 }
 
+static void duer_audio_play_speak(const char *url)
+{
+    esp_audio_play(player, AUDIO_CODEC_TYPE_DECODER, url, 0);
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    duer_playing_type = DUER_AUDIO_TYPE_SPEECH;
+    xSemaphoreGive(s_mutex);
+}
+
+static char *duer_audio_take_pending_speak(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    char *url = pending_speak;
+    pending_speak = NULL;
+    xSemaphoreGive(s_mutex);
+    return url;
+}
+
+typedef struct {
+    recorder_arbiter_decision_t decision;
+    int                         command_id;
+    char                        *url;
+} duer_arbiter_msg_t;
+
+static void duer_audio_arbiter_task(void *para)
+{
+    QueueHandle_t que = (QueueHandle_t) para;
+    duer_arbiter_msg_t msg = {0};
+    while (1) {
+        xQueueReceive(que, &msg, portMAX_DELAY);
+        if (msg.decision == RECORDER_ARBITER_LOCAL) {
+            rec_cb((audio_rec_evt_t)msg.command_id, NULL);
+        } else if (msg.decision == RECORDER_ARBITER_CLOUD && msg.url) {
+            duer_audio_play_speak(msg.url);
+        }
+        free(msg.url);
+    }
+    vTaskDelete(NULL);
+}
+
+static void duer_audio_arbiter_cb(recorder_arbiter_decision_t decision, int command_id, void *user_ctx)
+{
+    // The timeout and cloud hold decisions come from the esp_timer task, play and notify from the arbiter task instead
+    duer_arbiter_msg_t msg = {
+        .decision = decision,
+        .command_id = command_id,
+        .url = duer_audio_take_pending_speak(),
+    };
+    if (xQueueSend(arbiter_que, &msg, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Arbiter queue full, drop decision %d", decision);
+        free(msg.url);
+    }
+}
+
 void *duer_audio_start_recorder(rec_event_cb_t cb)
 {
     if (recorder) {
@@ -253,10 +312,18 @@ void *duer_audio_start_recorder(rec_event_cb_t cb)
     recorder_sr_cfg.afe_cfg.memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
     recorder_sr_cfg.afe_cfg.agc_mode = AFE_MN_PEAK_NO_AGC;
 
+    arbiter_que = xQueueCreate(3, sizeof(duer_arbiter_msg_t));
+    xTaskCreate(duer_audio_arbiter_task, "arbiter_task", 3 * 1024, arbiter_que, 5, NULL);
+    recorder_arbiter_cfg_t arbiter_cfg = RECORDER_ARBITER_DEFAULT_CFG();
+    arbiter_cfg.decision_cb = duer_audio_arbiter_cb;
+    arbiter = recorder_arbiter_create(&arbiter_cfg);
+    rec_cb = cb;
+
     audio_rec_cfg_t cfg = AUDIO_RECORDER_DEFAULT_CFG();
     cfg.read = (recorder_data_read_t)&input_cb_for_afe;
     cfg.sr_handle = recorder_sr_create(&recorder_sr_cfg, &cfg.sr_iface);
     cfg.event_cb = cb;
+    cfg.arbiter = arbiter;
     cfg.vad_off = 1000;
     recorder = audio_recorder_create(&cfg);
 
@@ -356,18 +423,26 @@ void duer_dcs_get_speaker_state(int *volume, duer_bool *is_mute)
     }
 }
 
-extern bool local_triger;
 void duer_dcs_speak_handler(const char *url)
 {
-    ESP_LOGI(TAG, "[%d], Playing speak: %s", local_triger, url);
-    if(false == local_triger){
-        esp_audio_play(player, AUDIO_CODEC_TYPE_DECODER, url, 0);
-        xSemaphoreTake(s_mutex, portMAX_DELAY);
-        duer_playing_type = DUER_AUDIO_TYPE_SPEECH;
-        xSemaphoreGive(s_mutex);
-    }else{
-        local_triger = false;
+    ESP_LOGI(TAG, "Playing speak: %s", url);
+    // Park the speech first, the arbiter may decide before `recorder_arbiter_cloud_result` returns
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    free(pending_speak);
+    pending_speak = strdup(url);
+    xSemaphoreGive(s_mutex);
+
+    esp_err_t ret = arbiter ? recorder_arbiter_cloud_result(arbiter) : ESP_ERR_INVALID_STATE;
+    if (ret == ESP_OK) {
+        return;
+    }
+    char *speak = duer_audio_take_pending_speak();
+    if (ret == ESP_FAIL) {
+        ESP_LOGW(TAG, "Local command already handled, drop the speak");
+    } else if (speak) {
+        duer_audio_play_speak(speak);
     }
+    free(speak);
 }
 
 void duer_dcs_audio_play_handler(const duer_dcs_audio_info_t *audio_info)
@@ -83,29 +83,32 @@ extern int duer_dcs_audio_sync_play_tone(const char *uri);
 
 static void voice_read_task(void *args)
 {
-    const int buf_len = 2 * 1024;
-    uint8_t *voiceData = audio_calloc(1, buf_len);
-    bool runing = true;
+    // Upload the AFE frames straight from the recorder frame pool, without copying them into a local buffer
+    recorder_frame_reader_handle_t reader = audio_recorder_frame_reader_open(recorder);
+    const recorder_frame_t *frame = NULL;
+    bool runing = reader != NULL;
 
     while (runing) {
         EventBits_t bits = xEventGroupWaitBits(duer_evt, DUER_REC_READING, false, true, portMAX_DELAY);
         if (bits & DUER_REC_READING) {
-            int ret = audio_recorder_data_read(recorder, voiceData, buf_len, portMAX_DELAY);
-            if (ret == 0 || ret == -1) {
+            int ret = audio_recorder_frame_acquire(recorder, reader, &frame, portMAX_DELAY);
+            if (ret <= 0) {
                 xEventGroupClearBits(duer_evt, DUER_REC_READING);
                 ESP_LOGE(TAG, "Read Finished");
             } else {
-                dueros_voice_upload(duer_serv_handle, voiceData, ret);
+                dueros_voice_upload(duer_serv_handle, frame->data, ret);
+                recorder_frame_pool_release(reader, frame);
             }
         }
     }
 
     xEventGroupClearBits(duer_evt, DUER_REC_READING);
-    free(voiceData);
+    if (reader) {
+        recorder_frame_pool_close_reader(reader);
+    }
     vTaskDelete(NULL);
 }
 
-bool local_triger = false;
 static SemaphoreHandle_t lvgl_mux;
 
 bool cb_port_lock(uint32_t timeout_ms)
@@ -166,8 +169,11 @@ static esp_err_t rec_engine_cb(audio_rec_evt_t type, void *user_data)
         // }
         // display_service_set_pattern(disp_serv, DISPLAY_PATTERN_TURN_OFF, 0);
         ESP_LOGW(TAG, "rec_engine_cb AUDIO_REC_COMMAND_DECT :[%s], type:[%d], cmd:[%d]", tone_uri[TONE_TYPE_HAODE], type, (int)user_data);
+        // The arbiter picked the local command, the speculative cloud request is no longer needed
+        if (dueros_service_state_get() == SERVICE_STATE_RUNNING) {
+            dueros_voice_cancel(duer_serv_handle);
+        }
         duer_audio_wrapper_pause();
-        local_triger = true;
         sr_anim_set_text(sr_cmd_list[type]);
         sr_anim_stop();
         duer_dcs_audio_sync_play_tone(tone_uri[TONE_TYPE_HAODE]);
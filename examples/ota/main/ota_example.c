@@ -47,7 +47,6 @@ static ota_service_err_reason_t audio_tone_need_upgrade(void *handle, ota_node_a
     flash_tone_header_t incoming_header = { 0 };
     esp_app_desc_t      current_desc    = { 0 };
     esp_app_desc_t      incoming_desc   = { 0 };
-    esp_err_t           err             = ESP_OK;
 
     /* try to get the tone partition*/
     const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, node->label);
@@ -58,7 +57,6 @@ static ota_service_err_reason_t audio_tone_need_upgrade(void *handle, ota_node_a
 
     tone_partition_handle_t tone = tone_partition_init(node->label, false);
     if (tone == NULL) {
-        esp_partition_erase_range(partition, 0, partition->size);
         return OTA_SERV_ERR_REASON_SUCCESS;
     }
 
@@ -94,8 +92,9 @@ static ota_service_err_reason_t audio_tone_need_upgrade(void *handle, ota_node_a
         return OTA_SERV_ERR_REASON_ERROR_PROJECT_NAME;
     }
 
-    /* compare current app desc with the incoming one if the current bin's format is 1*/
-    if (cur_header.format == TONE_VERSION_1) {
+    /* compare current app desc with the incoming one if the current bin's format is 1,
+       an interrupted upgrade of the same bin has already written the incoming header */
+    if (cur_header.format == TONE_VERSION_1 && ota_data_partition_get_resume_offset(handle) == 0) {
         if (tone_partition_get_app_desc(tone, &current_desc) != ESP_OK) {
             return OTA_SERV_ERR_REASON_PARTITION_RD_FAIL;
         }
@@ -113,13 +112,13 @@ static ota_service_err_reason_t audio_tone_need_upgrade(void *handle, ota_node_a
     need_write_desc = true;
 
 write_flash:
-    if ((err = esp_partition_erase_range(partition, 0, partition->size)) != ESP_OK) {
-        ESP_LOGE(TAG, "Erase [%s] failed and return %d", node->label, err);
+    /* The partition is erased just ahead of the written data */
+    if (ota_data_partition_write(handle, (char *)&incoming_header, sizeof(flash_tone_header_t)) != OTA_SERV_ERR_REASON_SUCCESS) {
         return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
     }
-    ota_data_partition_write(handle, (char *)&incoming_header, sizeof(flash_tone_header_t));
-    if (need_write_desc) {
-        ota_data_partition_write(handle, (char *)&incoming_desc, sizeof(esp_app_desc_t));
+    if (need_write_desc
+        && ota_data_partition_write(handle, (char *)&incoming_desc, sizeof(esp_app_desc_t)) != OTA_SERV_ERR_REASON_SUCCESS) {
+        return OTA_SERV_ERR_REASON_PARTITION_WT_FAIL;
     }
     return OTA_SERV_ERR_REASON_SUCCESS;
 }
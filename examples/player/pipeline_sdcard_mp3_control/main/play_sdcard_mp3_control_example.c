@@ -118,6 +118,11 @@ void sdcard_url_save_cb(void *user_data, char *url)
     }
 }
 
+esp_err_t sdcard_url_commit_cb(void *user_data)
+{
+    return sdcard_list_commit((playlist_operator_handle_t)user_data);
+}
+
 void app_main(void)
 {
     esp_log_level_set("*", ESP_LOG_WARN);
@@ -132,9 +137,21 @@ void app_main(void)
     audio_board_sdcard_init(set, SD_MODE_1_LINE);
 
     ESP_LOGI(TAG, "[1.2] Set up a sdcard playlist and scan sdcard music save to it");
-    sdcard_list_create(&sdcard_list_handle);
-    sdcard_scan(sdcard_url_save_cb, "/sdcard", 0, (const char *[]) {"mp3"}, 1, sdcard_list_handle);
-    sdcard_list_show(sdcard_list_handle);
+    // The playlist saved at the previous boot is reloaded, the background scan only adds the files of the changed folders
+    sdcard_list_create_persistent(&sdcard_list_handle, 0, 1);
+    sdcard_scan_service_cfg_t scan_cfg = SDCARD_SCAN_SERVICE_CFG_DEFAULT();
+    scan_cfg.cb = sdcard_url_save_cb;
+    // Write the last batch of urls to the card before the scan cache marks their folders as unchanged
+    scan_cfg.done_cb = sdcard_url_commit_cb;
+    scan_cfg.user_data = sdcard_list_handle;
+    scan_cfg.file_extension = (const char *[]) {"mp3"};
+    scan_cfg.filter_num = 1;
+    scan_cfg.cache_file = "/sdcard/__playlist/_scan_cache";
+    scan_cfg.rescan_all = sdcard_list_get_url_num(sdcard_list_handle) == 0;
+    sdcard_scan_service_handle_t scan_handle = sdcard_scan_service_start(&scan_cfg);
+    // Start playing as soon as the first song is found
+    while (sdcard_list_get_url_num(sdcard_list_handle) == 0
+           && sdcard_scan_service_wait(scan_handle, 100 / portTICK_PERIOD_MS) == ESP_ERR_TIMEOUT);
 
     ESP_LOGI(TAG, "[ 2 ] Start codec chip");
     audio_board_handle_t board_handle = audio_board_init();
@@ -176,6 +193,8 @@ void app_main(void)
     sdcard_list_current(sdcard_list_handle, &url);
     fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
     fatfs_cfg.type = AUDIO_STREAM_READER;
+    // Read clusters ahead in the background, so that seeks and card latency spikes don't stall the decoder
+    fatfs_cfg.read_ahead_blocks = 4;
     fatfs_stream_reader = fatfs_stream_init(&fatfs_cfg);
     audio_element_set_uri(fatfs_stream_reader, url);
 
@@ -257,6 +276,9 @@ void app_main(void)
     /* Terminate the pipeline before removing the listener */
     audio_pipeline_remove_listener(pipeline);
 
+    /* Stop scanning before the sdcard is unmounted */
+    sdcard_scan_service_destroy(scan_handle);
+
     /* Stop all peripherals before removing the listener */
     esp_periph_set_stop_all(set);
     audio_event_iface_remove_listener(esp_periph_set_get_event_iface(set), evt);
@@ -0,0 +1,231 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2023 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_g711.h"
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "audio_codec.h"
+
+static const char *TAG = "AUDIO_CODEC";
+
+struct audio_codec_frame_pool {
+    uint8_t         *buf;
+    int             frame_num;
+    int             frame_size;
+    QueueHandle_t   free_frames;
+};
+
+typedef enum {
+    G711_STATE_UNKNOWN = 0,
+    G711_STATE_FAST,
+    G711_STATE_FALLBACK,
+} g711_state_t;
+
+static int16_t s_alaw_dec[256];
+static int16_t s_ulaw_dec[256];
+static volatile g711_state_t s_alaw_enc_state;
+static volatile g711_state_t s_ulaw_enc_state;
+static volatile bool s_dec_ready;
+
+/*
+ * G.711 A-law of the 13 most significant bits, the segment is found from the highest bit set
+ * instead of a search through the segment ends.
+ */
+static inline uint8_t g711a_encode_sample(int16_t sample)
+{
+    int val = sample >> 3;
+    uint8_t mask = 0xD5;
+    if (val < 0) {
+        mask = 0x55;
+        val = -val - 1;
+    }
+    int seg = val < 32 ? 0 : 27 - __builtin_clz(val);
+    int aval = (seg << 4) | ((val >> (seg < 2 ? 1 : seg)) & 0x0F);
+    return aval ^ mask;
+}
+
+/*
+ * G.711 µ-law of the 14 most significant bits, biased and clipped as the reference.
+ */
+static inline uint8_t g711u_encode_sample(int16_t sample)
+{
+    int val = sample >> 2;
+    uint8_t mask = 0xFF;
+    if (val < 0) {
+        mask = 0x7F;
+        val = -val;
+    }
+    if (val > 8159) {
+        val = 8159;
+    }
+    val += 33;
+    int seg = val < 64 ? 0 : 26 - __builtin_clz(val);
+    if (seg >= 8) {
+        return 0x7F ^ mask;
+    }
+    int uval = (seg << 4) | ((val >> (seg + 1)) & 0x0F);
+    return uval ^ mask;
+}
+
+esp_err_t audio_codec_g711_init(void)
+{
+    if (!s_dec_ready) {
+        for (int i = 0; i < 256; i++) {
+            s_alaw_dec[i] = esp_g711a_decode(i);
+            s_ulaw_dec[i] = esp_g711u_decode(i);
+        }
+        s_dec_ready = true;
+    }
+    if (s_alaw_enc_state == G711_STATE_UNKNOWN || s_ulaw_enc_state == G711_STATE_UNKNOWN) {
+        g711_state_t alaw = G711_STATE_FAST;
+        g711_state_t ulaw = G711_STATE_FAST;
+        for (int i = INT16_MIN; i <= INT16_MAX; i++) {
+            if (g711a_encode_sample(i) != esp_g711a_encode(i)) {
+                alaw = G711_STATE_FALLBACK;
+            }
+            if (g711u_encode_sample(i) != esp_g711u_encode(i)) {
+                ulaw = G711_STATE_FALLBACK;
+            }
+        }
+        if (alaw == G711_STATE_FALLBACK || ulaw == G711_STATE_FALLBACK) {
+            ESP_LOGW(TAG, "G.711 batch encoder differs from esp_g711, A-law %s, u-law %s",
+                     alaw == G711_STATE_FAST ? "batch" : "per sample", ulaw == G711_STATE_FAST ? "batch" : "per sample");
+        }
+        s_alaw_enc_state = alaw;
+        s_ulaw_enc_state = ulaw;
+    }
+    return ESP_OK;
+}
+
+void audio_codec_g711a_encode(const int16_t *pcm, uint8_t *out, int samples)
+{
+    if (s_alaw_enc_state == G711_STATE_UNKNOWN) {
+        audio_codec_g711_init();
+    }
+    if (s_alaw_enc_state == G711_STATE_FALLBACK) {
+        for (int i = 0; i < samples; i++) {
+            out[i] = esp_g711a_encode(pcm[i]);
+        }
+        return;
+    }
+    for (int i = 0; i < samples; i++) {
+        out[i] = g711a_encode_sample(pcm[i]);
+    }
+}
+
+void audio_codec_g711u_encode(const int16_t *pcm, uint8_t *out, int samples)
+{
+    if (s_ulaw_enc_state == G711_STATE_UNKNOWN) {
+        audio_codec_g711_init();
+    }
+    if (s_ulaw_enc_state == G711_STATE_FALLBACK) {
+        for (int i = 0; i < samples; i++) {
+            out[i] = esp_g711u_encode(pcm[i]);
+        }
+        return;
+    }
+    for (int i = 0; i < samples; i++) {
+        out[i] = g711u_encode_sample(pcm[i]);
+    }
+}
+
+void audio_codec_g711a_decode(const uint8_t *in, int16_t *pcm, int samples)
+{
+    if (!s_dec_ready) {
+        audio_codec_g711_init();
+    }
+    for (int i = 0; i < samples; i++) {
+        pcm[i] = s_alaw_dec[in[i]];
+    }
+}
+
+void audio_codec_g711u_decode(const uint8_t *in, int16_t *pcm, int samples)
+{
+    if (!s_dec_ready) {
+        audio_codec_g711_init();
+    }
+    for (int i = 0; i < samples; i++) {
+        pcm[i] = s_ulaw_dec[in[i]];
+    }
+}
+
+audio_codec_frame_pool_handle_t audio_codec_frame_pool_create(int frame_num, int frame_size)
+{
+    AUDIO_CHECK(TAG, (frame_num > 0 && frame_size > 0), return NULL, "Invalid frame pool size");
+    audio_codec_frame_pool_handle_t pool = audio_calloc(1, sizeof(struct audio_codec_frame_pool));
+    AUDIO_MEM_CHECK(TAG, pool, return NULL);
+    pool->frame_num = frame_num;
+    pool->frame_size = frame_size;
+    pool->buf = audio_calloc(frame_num, frame_size);
+    pool->free_frames = xQueueCreate(frame_num, sizeof(uint8_t *));
+    AUDIO_MEM_CHECK(TAG, (pool->buf && pool->free_frames), {
+        if (pool->free_frames) {
+            vQueueDelete(pool->free_frames);
+        }
+        audio_free(pool->buf);
+        audio_free(pool);
+        return NULL;
+    });
+    for (int i = 0; i < frame_num; i++) {
+        uint8_t *frame = pool->buf + i * frame_size;
+        xQueueSend(pool->free_frames, &frame, 0);
+    }
+    return pool;
+}
+
+uint8_t *audio_codec_frame_pool_get(audio_codec_frame_pool_handle_t pool, TickType_t wait_time)
+{
+    uint8_t *frame = NULL;
+    AUDIO_NULL_CHECK(TAG, pool, return NULL);
+    if (xQueueReceive(pool->free_frames, &frame, wait_time) != pdTRUE) {
+        return NULL;
+    }
+    return frame;
+}
+
+esp_err_t audio_codec_frame_pool_put(audio_codec_frame_pool_handle_t pool, uint8_t *frame)
+{
+    AUDIO_NULL_CHECK(TAG, (pool && frame), return ESP_ERR_INVALID_ARG);
+    int offset = frame - pool->buf;
+    AUDIO_CHECK(TAG, (offset >= 0 && offset < pool->frame_num * pool->frame_size && (offset % pool->frame_size) == 0),
+                return ESP_ERR_INVALID_ARG, "The frame doesn't belong to the pool");
+    xQueueSend(pool->free_frames, &frame, 0);
+    return ESP_OK;
+}
+
+esp_err_t audio_codec_frame_pool_destroy(audio_codec_frame_pool_handle_t pool)
+{
+    AUDIO_NULL_CHECK(TAG, pool, return ESP_ERR_INVALID_ARG);
+    if (uxQueueMessagesWaiting(pool->free_frames) != pool->frame_num) {
+        ESP_LOGW(TAG, "Destroy the frame pool with %d frames in use", pool->frame_num - (int)uxQueueMessagesWaiting(pool->free_frames));
+    }
+    vQueueDelete(pool->free_frames);
+    audio_free(pool->buf);
+    audio_free(pool);
+    return ESP_OK;
+}
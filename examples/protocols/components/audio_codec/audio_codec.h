@@ -0,0 +1,137 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2023 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _AUDIO_CODEC_H
+#define _AUDIO_CODEC_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct audio_codec_frame_pool *audio_codec_frame_pool_handle_t;
+
+/**
+ * @brief      Prepare the G.711 tables, call it before starting the codec task
+ *
+ * @note       The batch encoders are checked once against `esp_g711a_encode` and `esp_g711u_encode`
+ *             for every sample value, they fall back to them if any result differs. The check takes
+ *             a while, if it's not done here the first encode or decode does it and that frame is late.
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t audio_codec_g711_init(void);
+
+/**
+ * @brief      Encode 16-bit PCM samples to G.711 A-law, bit-exact with `esp_g711a_encode`
+ *
+ * @param[in]  pcm      The samples
+ * @param[out] out      The encoded data, one byte per sample
+ * @param[in]  samples  The number of samples
+ */
+void audio_codec_g711a_encode(const int16_t *pcm, uint8_t *out, int samples);
+
+/**
+ * @brief      Encode 16-bit PCM samples to G.711 µ-law, bit-exact with `esp_g711u_encode`
+ *
+ * @param[in]  pcm      The samples
+ * @param[out] out      The encoded data, one byte per sample
+ * @param[in]  samples  The number of samples
+ */
+void audio_codec_g711u_encode(const int16_t *pcm, uint8_t *out, int samples);
+
+/**
+ * @brief      Decode G.711 A-law to 16-bit PCM samples, bit-exact with `esp_g711a_decode`
+ *
+ * @param[in]  in       The encoded data
+ * @param[out] pcm      The samples
+ * @param[in]  samples  The number of samples, same as the bytes of `in`
+ */
+void audio_codec_g711a_decode(const uint8_t *in, int16_t *pcm, int samples);
+
+/**
+ * @brief      Decode G.711 µ-law to 16-bit PCM samples, bit-exact with `esp_g711u_decode`
+ *
+ * @param[in]  in       The encoded data
+ * @param[out] pcm      The samples
+ * @param[in]  samples  The number of samples, same as the bytes of `in`
+ */
+void audio_codec_g711u_decode(const uint8_t *in, int16_t *pcm, int samples);
+
+/**
+ * @brief      Create a pool of encoded frames, all allocated at once and recycled
+ *
+ * @param[in]  frame_num   The number of frames
+ * @param[in]  frame_size  The size of each frame in bytes
+ *
+ * @return
+ *     - The pool handle
+ *     - NULL, no memory
+ */
+audio_codec_frame_pool_handle_t audio_codec_frame_pool_create(int frame_num, int frame_size);
+
+/**
+ * @brief      Take a free frame from the pool
+ *
+ * @param[in]  pool        The pool handle
+ * @param[in]  wait_time   Ticks to wait for a frame given back
+ *
+ * @return
+ *     - The frame of `frame_size` bytes
+ *     - NULL, no frame is free in time
+ */
+uint8_t *audio_codec_frame_pool_get(audio_codec_frame_pool_handle_t pool, TickType_t wait_time);
+
+/**
+ * @brief      Give a frame back to the pool
+ *
+ * @param[in]  pool    The pool handle
+ * @param[in]  frame   The frame from `audio_codec_frame_pool_get`
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG, the frame doesn't belong to the pool
+ */
+esp_err_t audio_codec_frame_pool_put(audio_codec_frame_pool_handle_t pool, uint8_t *frame);
+
+/**
+ * @brief      Destroy the pool, all the frames must have been given back
+ *
+ * @param[in]  pool   The pool handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_codec_frame_pool_destroy(audio_codec_frame_pool_handle_t pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
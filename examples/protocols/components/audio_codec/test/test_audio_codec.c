@@ -0,0 +1,134 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2023 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_g711.h"
+#include "audio_mem.h"
+#include "audio_codec.h"
+
+static const char *TAG = "AUDIO_CODEC_TEST";
+
+#define TEST_G711_BLOCK     (1024)
+#define TEST_POOL_FRAMES    (3)
+#define TEST_POOL_SIZE      (320)
+
+TEST_CASE("audio_codec g711 bit-exact with esp_g711", "[audio_codec]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, audio_codec_g711_init());
+
+    int16_t *pcm = audio_calloc(TEST_G711_BLOCK, sizeof(int16_t));
+    uint8_t *alaw = audio_calloc(TEST_G711_BLOCK, sizeof(uint8_t));
+    uint8_t *ulaw = audio_calloc(TEST_G711_BLOCK, sizeof(uint8_t));
+    TEST_ASSERT_NOT_NULL(pcm);
+    TEST_ASSERT_NOT_NULL(alaw);
+    TEST_ASSERT_NOT_NULL(ulaw);
+
+    ESP_LOGI(TAG, "Encode all the 65536 sample values");
+    for (int base = INT16_MIN; base <= INT16_MAX; base += TEST_G711_BLOCK) {
+        for (int i = 0; i < TEST_G711_BLOCK; i++) {
+            pcm[i] = base + i;
+        }
+        audio_codec_g711a_encode(pcm, alaw, TEST_G711_BLOCK);
+        audio_codec_g711u_encode(pcm, ulaw, TEST_G711_BLOCK);
+        for (int i = 0; i < TEST_G711_BLOCK; i++) {
+            if (alaw[i] != esp_g711a_encode(pcm[i]) || ulaw[i] != esp_g711u_encode(pcm[i])) {
+                ESP_LOGE(TAG, "sample %d, A-law %02x/%02x, u-law %02x/%02x", pcm[i],
+                         alaw[i], esp_g711a_encode(pcm[i]), ulaw[i], esp_g711u_encode(pcm[i]));
+            }
+            TEST_ASSERT_EQUAL_HEX8(esp_g711a_encode(pcm[i]), alaw[i]);
+            TEST_ASSERT_EQUAL_HEX8(esp_g711u_encode(pcm[i]), ulaw[i]);
+        }
+    }
+
+    ESP_LOGI(TAG, "Decode all the 256 codes");
+    for (int i = 0; i < 256; i++) {
+        alaw[i] = i;
+    }
+    audio_codec_g711a_decode(alaw, pcm, 256);
+    for (int i = 0; i < 256; i++) {
+        TEST_ASSERT_EQUAL_INT16(esp_g711a_decode(i), pcm[i]);
+    }
+    audio_codec_g711u_decode(alaw, pcm, 256);
+    for (int i = 0; i < 256; i++) {
+        TEST_ASSERT_EQUAL_INT16(esp_g711u_decode(i), pcm[i]);
+    }
+
+    audio_free(pcm);
+    audio_free(alaw);
+    audio_free(ulaw);
+}
+
+TEST_CASE("audio_codec frame pool get and put", "[audio_codec]")
+{
+    TEST_ASSERT_NULL(audio_codec_frame_pool_create(0, TEST_POOL_SIZE));
+    TEST_ASSERT_NULL(audio_codec_frame_pool_create(TEST_POOL_FRAMES, 0));
+
+    audio_codec_frame_pool_handle_t pool = audio_codec_frame_pool_create(TEST_POOL_FRAMES, TEST_POOL_SIZE);
+    TEST_ASSERT_NOT_NULL(pool);
+
+    uint8_t *frames[TEST_POOL_FRAMES];
+    for (int i = 0; i < TEST_POOL_FRAMES; i++) {
+        frames[i] = audio_codec_frame_pool_get(pool, 0);
+        TEST_ASSERT_NOT_NULL(frames[i]);
+        memset(frames[i], i + 1, TEST_POOL_SIZE);
+        for (int j = 0; j < i; j++) {
+            TEST_ASSERT_NOT_EQUAL(frames[j], frames[i]);
+        }
+    }
+    ESP_LOGI(TAG, "The frames don't overlap");
+    for (int i = 0; i < TEST_POOL_FRAMES; i++) {
+        TEST_ASSERT_EACH_EQUAL_UINT8(i + 1, frames[i], TEST_POOL_SIZE);
+    }
+
+    ESP_LOGI(TAG, "An empty pool times out");
+    TEST_ASSERT_NULL(audio_codec_frame_pool_get(pool, 10 / portTICK_PERIOD_MS));
+
+    ESP_LOGI(TAG, "Foreign pointers are refused");
+    uint8_t foreign[TEST_POOL_SIZE];
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_codec_frame_pool_put(pool, foreign));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_codec_frame_pool_put(pool, frames[0] + 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_codec_frame_pool_put(pool, frames[0] - TEST_POOL_SIZE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_codec_frame_pool_put(pool, NULL));
+    TEST_ASSERT_NULL(audio_codec_frame_pool_get(pool, 0));
+
+    ESP_LOGI(TAG, "Frames given back are recycled");
+    TEST_ASSERT_EQUAL(ESP_OK, audio_codec_frame_pool_put(pool, frames[1]));
+    TEST_ASSERT_EQUAL_PTR(frames[1], audio_codec_frame_pool_get(pool, 0));
+    for (int i = 0; i < TEST_POOL_FRAMES; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, audio_codec_frame_pool_put(pool, frames[i]));
+    }
+    for (int i = 0; i < TEST_POOL_FRAMES; i++) {
+        TEST_ASSERT_NOT_NULL(audio_codec_frame_pool_get(pool, 0));
+    }
+    TEST_ASSERT_NULL(audio_codec_frame_pool_get(pool, 0));
+    for (int i = 0; i < TEST_POOL_FRAMES; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, audio_codec_frame_pool_put(pool, frames[i]));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, audio_codec_frame_pool_destroy(pool));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, audio_codec_frame_pool_destroy(NULL));
+}
@@ -18,7 +18,7 @@
 #include "media_lib_err.h"
 #include "av_record.h"
 #include "esp_jpeg_enc.h"
-#include "esp_g711.h"
+#include "audio_codec.h"
 #include "esp_aac_enc.h"
 #include "esp_idf_version.h"
 #include "esp_h264_enc.h"
@@ -488,19 +488,11 @@ static int audio_record_encode_data(uint8_t *src, int size, uint8_t *dst, int ds
         size = (ret == 0) ? dst_size : 0;
     }
     else if (av_record.record_cfg.audio_fmt == AV_RECORD_AUDIO_FMT_G711A) {
-        int16_t *pcm_data = (int16_t *) src;
         size >>= 1;
-        uint8_t *end = dst + size;
-        while (dst < end) {
-            *(dst++) = esp_g711a_encode(*(pcm_data++));
-        }
+        audio_codec_g711a_encode((int16_t *) src, dst, size);
     } else if (av_record.record_cfg.audio_fmt == AV_RECORD_AUDIO_FMT_G711U) {
-        int16_t *pcm_data = (int16_t *) src;
         size >>= 1;
-        uint8_t *end = dst + size;
-        while (dst < end) {
-            *(dst++) = esp_g711u_encode(*(pcm_data++));
-        }
+        audio_codec_g711u_encode((int16_t *) src, dst, size);
     }
     return size;
 }
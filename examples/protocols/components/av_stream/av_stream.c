@@ -30,7 +30,7 @@
 #include "algorithm_stream.h"
 #include "fatfs_stream.h"
 #include "wav_encoder.h"
-#include "esp_g711.h"
+#include "audio_codec.h"
 #include "esp_aac_enc.h"
 // #include "esp_aac_dec.h"
 #include "esp_resample.h"
@@ -65,6 +65,7 @@ struct _av_stream_handle {
     audio_board_handle_t board_handle;
     esp_lcd_panel_handle_t panel_handle;
     QueueHandle_t aenc_queue;
+    audio_codec_frame_pool_handle_t aenc_pool;
     QueueHandle_t adec_queue;
     QueueHandle_t venc_queue;
     jpeg_dec_handle_t jpeg_dec;
@@ -213,12 +214,16 @@ static void _audio_enc(void* pv)
 
         av_stream_frame_t enc;
         enc.len = read_len;
-        enc.data = audio_calloc(1, AUDIO_MAX_SIZE);
-        AUDIO_NULL_CHECK(TAG, enc.data, break);
         av_stream->audio_pos += enc.len;
         enc.pts = (av_stream->audio_pos * 1000) / (av_stream->config.hal.audio_samplerate * 1 * 16 / 8);
+        enc.data = audio_codec_frame_pool_get(av_stream->aenc_pool, timeout);
+        if (enc.data == NULL) {
+            ESP_LOGD(TAG, "no free aenc frame, drop it");
+            continue;
+        }
         switch ((int)av_stream->config.acodec_type) {
             case AV_ACODEC_PCM:
+                memcpy(enc.data, frame_buf, enc.len);
                 break;
             case AV_ACODEC_AAC_LC:
                 esp_aac_enc_process(av_stream->aac_enc, (uint8_t *)frame_buf, enc.len, enc.data, &len);
@@ -226,21 +231,17 @@ static void _audio_enc(void* pv)
                 timeout = 0;
                 break;
             case AV_ACODEC_G711A:
-                for (int i = 0; i < enc.len; i++) {
-                    enc.data[i] = esp_g711a_encode(g711_buffer_16[i]);
-                }
                 enc.len = enc.len/2;
+                audio_codec_g711a_encode(g711_buffer_16, enc.data, enc.len);
                 break;
             case AV_ACODEC_G711U:
-                for (int i = 0; i < enc.len; i++) {
-                    enc.data[i] = esp_g711u_encode(g711_buffer_16[i]);
-                }
                 enc.len = enc.len/2;
+                audio_codec_g711u_encode(g711_buffer_16, enc.data, enc.len);
                 break;
         }
         if (xQueueSend(av_stream->aenc_queue, &enc, timeout) != pdTRUE) {
             ESP_LOGD(TAG, "send aenc buf queue timeout !");
-            free(enc.data);
+            audio_codec_frame_pool_put(av_stream->aenc_pool, enc.data);
         }
     }
     ESP_LOGI(TAG, "_audio_enc task stoped");
@@ -266,6 +267,8 @@ int av_audio_enc_start(av_stream_handle_t av_stream)
         // aac_cfg.channel = 1;
         // aac_cfg.adts_used = 1;
         // esp_aac_enc_open(&aac_cfg, &av_stream->aac_enc);
+    } else if (av_stream->config.acodec_type == AV_ACODEC_G711A || av_stream->config.acodec_type == AV_ACODEC_G711U) {
+        audio_codec_g711_init();
     }
 
     if (!_have_hardware_ref(av_stream)) {
@@ -370,6 +373,9 @@ int av_audio_enc_start(av_stream_handle_t av_stream)
     av_stream->aenc_run = true;
     av_stream->audio_pos = 0;
     av_stream->aenc_queue = xQueueCreate(1, sizeof(av_stream_frame_t));
+    // One frame queued, one being encoded and one being read
+    av_stream->aenc_pool = audio_codec_frame_pool_create(3, AUDIO_MAX_SIZE);
+    AUDIO_NULL_CHECK(TAG, av_stream->aenc_pool, return ESP_FAIL);
     av_stream->aenc_state = xEventGroupCreate();
     if (audio_thread_create(NULL, "_audio_enc", _audio_enc, av_stream, 4*1024, 21, true, 0) != ESP_OK) {
         ESP_LOGE(TAG, "Can not start _audio_enc task");
@@ -399,10 +405,12 @@ int av_audio_enc_stop(av_stream_handle_t av_stream)
 
     av_stream_frame_t enc;
     if (xQueueReceive(av_stream->aenc_queue, &enc, 0) == pdTRUE) {
-        audio_free(enc.data);
+        audio_codec_frame_pool_put(av_stream->aenc_pool, enc.data);
     }
     vQueueDelete(av_stream->aenc_queue);
     av_stream->aenc_queue = NULL;
+    audio_codec_frame_pool_destroy(av_stream->aenc_pool);
+    av_stream->aenc_pool = NULL;
 #endif
 
     if (!(av_stream->config.algo_mask & ALGORITHM_STREAM_USE_AEC)) {
@@ -506,6 +514,8 @@ int av_audio_dec_start(av_stream_handle_t av_stream)
         //     .audio_type = AUDIO_DEC_TYPE_AAC,
         // };
         // esp_aac_dec_open(&cfg, &av_stream->aac_dec);
+    } else if (av_stream->config.acodec_type == AV_ACODEC_G711A || av_stream->config.acodec_type == AV_ACODEC_G711U) {
+        audio_codec_g711_init();
     }
 
     av_stream->adec_buf = audio_calloc(1, 2*AUDIO_MAX_SIZE);
@@ -602,7 +612,7 @@ int av_audio_enc_read(av_stream_frame_t *frame, void *ctx)
         frame->len = enc.len;
         frame->pts = enc.pts;
         memcpy(frame->data, enc.data, enc.len);
-        audio_free(enc.data);
+        audio_codec_frame_pool_put(av_stream->aenc_pool, enc.data);
     }
 
     return ESP_OK;
@@ -643,15 +653,11 @@ int av_audio_dec_write(av_stream_frame_t *frame, void *ctx)
             // }
             break;
         case AV_ACODEC_G711A:
-            for (int i = 0; i < frame->len; i++) {
-                dec_buffer_16[i] = esp_g711a_decode(frame->data[i]);
-            }
+            audio_codec_g711a_decode(frame->data, dec_buffer_16, frame->len);
             len = 2*frame->len;
             break;
         case AV_ACODEC_G711U:
-            for (int i = 0; i < frame->len; i++) {
-                dec_buffer_16[i] = esp_g711u_decode(frame->data[i]);
-            }
+            audio_codec_g711u_decode(frame->data, dec_buffer_16, frame->len);
             len = 2*frame->len;
             break;
     }
@@ -67,6 +67,7 @@ void app_main()
     ESP_LOGI(TAG, "[3.3] Create fatfs stream to write data to sdcard");
     fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
     fatfs_cfg.type = AUDIO_STREAM_WRITER;
+    fatfs_cfg.write_behind_size = 4 * FATFS_STREAM_CLUSTER_SIZE;
     wav_fatfs_stream_writer = fatfs_stream_init(&fatfs_cfg);
 
     audio_element_info_t info = AUDIO_ELEMENT_INFO_DEFAULT();
@@ -106,6 +107,7 @@ void app_main()
     fatfs_stream_cfg_t amr_fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
     amr_fatfs_cfg.type = AUDIO_STREAM_WRITER;
     amr_fatfs_cfg.task_core = 1;
+    amr_fatfs_cfg.write_behind_size = 2 * FATFS_STREAM_CLUSTER_SIZE;
     amr_fatfs_stream_writer = fatfs_stream_init(&amr_fatfs_cfg);
 
     ESP_LOGI(TAG, "[4.4] Register all elements to audio amr_pipeline");
@@ -25,12 +25,12 @@
 
 #include "freertos/FreeRTOS.h"
 
-#include "esp_http_client.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_peripherals.h"
 #include "nvs_flash.h"
 #include "periph_wifi.h"
+#include "audio_error.h"
 #include "audio_mem.h"
 #include "audio_url.h"
 #include "coredump_upload_service.h"
@@ -45,12 +45,11 @@
 
 static const char *TAG = "coredump_example";
 
-#define CUSTOMIZE_POST (1)
-
-bool do_http_post(char *url, uint8_t *data, size_t len)
+static char *coredump_upload_url(const char *url)
 {
     size_t max_len = strlen(url) + 512;
     char *url_str = audio_calloc(1, max_len);
+    AUDIO_MEM_CHECK(TAG, url_str, return NULL);
     const esp_app_desc_t *app_desc = esp_ota_get_app_description();
     snprintf(url_str, max_len, "%s?app_version=%s&proj_name=%s&idf_version=%s",
                                 url,
@@ -58,25 +57,8 @@ bool do_http_post(char *url, uint8_t *data, size_t len)
                                 app_desc->project_name,
                                 app_desc->idf_ver);
     char *url_final = audio_url_encode(url_str);
-
-    esp_http_client_config_t config = {
-        .url = url_final,
-        .method = HTTP_METHOD_POST,
-    };
-    esp_http_client_handle_t http_client = esp_http_client_init(&config);
-    esp_http_client_set_header(http_client, "Content-Type", "application/octet-stream");
-    esp_http_client_set_post_field(http_client, (const char *)data, (int)len);
-    int response = 0;
-    if (esp_http_client_perform(http_client) == ESP_OK) {
-        response = esp_http_client_get_status_code(http_client);
-        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %d", response, esp_http_client_get_content_length(http_client));
-    } else {
-        ESP_LOGE(TAG, "Post failed");
-    }
-    esp_http_client_cleanup(http_client);
     free(url_str);
-    free(url_final);
-    return response == 200 ? true : false;
+    return url_final;
 }
 
 void app_main()
@@ -110,13 +92,14 @@ void app_main()
 
     if (coredump_need_upload()) {
         coredump_upload_service_config_t coredump_upload_service_cfg = COREDUMP_UPLOAD_SERVICE_DEFAULT_CONFIG();
-#if CUSTOMIZE_POST
-        coredump_upload_service_cfg.do_post = do_http_post;
-#endif
+        coredump_upload_service_cfg.segment_size = 16 * 1024;
+        coredump_upload_service_cfg.resume = true;
         periph_service_handle_t uploader = coredump_upload_service_create(&coredump_upload_service_cfg);
-        if (NULL != uploader) {
-            result = coredump_upload(uploader, CONFIG_COREDUMP_UPLOAD_URI);
+        char *url = coredump_upload_url(CONFIG_COREDUMP_UPLOAD_URI);
+        if (NULL != uploader && NULL != url) {
+            result = coredump_upload(uploader, url);
         }
+        free(url);
         periph_service_destroy(uploader);
     }
     ESP_LOGI(TAG, "result %d", result);
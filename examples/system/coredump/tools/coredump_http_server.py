@@ -43,6 +43,7 @@ import SimpleHTTPServer, BaseHTTPServer
 import sys, os
 import argparse
 import threading
+import zlib
 
 try:
     sys.path.append(os.environ['IDF_PATH'] + '/components/espcoredump')
@@ -84,14 +85,46 @@ def get_coredump_request_handler(args):
             self.args.print_mem = False
             espcoredump.info_corefile(self.args)
 
+        def __read_body(self):
+            if self.headers.get('Transfer-Encoding', '').lower() == 'chunked':
+                data = b''
+                while True:
+                    size = int(self.rfile.readline().split(b';')[0].strip(), 16)
+                    if size == 0:
+                        self.rfile.readline()
+                        break
+                    data += self.rfile.read(size)
+                    self.rfile.readline()
+            else:
+                data = self.rfile.read(int(self.headers['Content-Length']))
+            if self.headers.get('Content-Encoding', '') == 'deflate':
+                data = zlib.decompress(data)
+            return data
+
+        def __coredump_assemble(self, data):
+            # 'Content-Range: bytes <first>-<last>/<total>', segments arrive in order and may resume midway
+            content_range = self.headers.get('Content-Range')
+            if content_range is None:
+                return data
+            span, total = content_range.split(' ')[1].split('/')
+            first, last = [int(x) for x in span.split('-')]
+            total = int(total)
+            if first == 0 or len(self.server.segments) != total:
+                self.server.segments = bytearray(total)
+            self.server.segments[first:last + 1] = data
+            if last + 1 < total:
+                return None
+            return bytes(self.server.segments)
+
         def do_POST(self):
             response = 200
             request_path = urlparse.urlparse(self.path).path.strip('/')
             if request_path == 'upload':
                 if (self.headers['Content-Type'] == 'application/octet-stream'):
-                    data = self.rfile.read(int(self.headers['Content-Length']))
-                    f_name = self.__coredump_save(data)
-                    self.__coredump_parse(f_name)
+                    data = self.__coredump_assemble(self.__read_body())
+                    if data is not None:
+                        f_name = self.__coredump_save(data)
+                        self.__coredump_parse(f_name)
             else:
                 response = 404
 
@@ -108,6 +141,7 @@ class CoreDumpServer(BaseHTTPServer.HTTPServer, threading.Thread):
     def __init__(self, args):
         BaseHTTPServer.HTTPServer.__init__(self, (HOST, PORT), get_coredump_request_handler(args))
         threading.Thread.__init__(self)
+        self.segments = bytearray()
 
     def run(self):
         print("Serving HTTP on {} port {}".format(HOST, PORT))
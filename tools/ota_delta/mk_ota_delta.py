@@ -0,0 +1,319 @@
+#!/usr/bin/env python
+
+#  ESPRESSIF MIT License
+#
+#  Copyright (c) 2020 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+#
+#  Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+#  it is free of charge, to any person obtaining a copy of this software and associated
+#  documentation files (the "Software"), to deal in the Software without restriction, including
+#  without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+#  and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+#  to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all copies or
+#  substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+mk_ota_delta version 1.0:
+
+This script generates a delta patch turning the content of a data partition (audio tone bin, speech recognition model, ...)
+into a new one, to be applied in place by `ota_data_get_delta_proc` of the `ota_service` component.
+
+1. command parameters:
+    - '-h': Get help about the parameters.
+    - '-o': The old image, the one in the partition of the devices, force required.
+    - '-n': The new image, force required.
+    - '-t': Name of the patch file, default: 'ota_delta.bin'.
+    - '-w': RAM window of the device in bytes, a multiple of 4096 up to 65536, default: 16384.
+            The device keeps the old content of that many bytes of already rewritten sectors,
+            content moved to a higher address by more than the window can't be copied and is sent as literal data.
+    - '-b': Match block size, default: 32.
+
+2. Format of the patch, little endian:
+
+        |-----------------------------------------|
+        |        header (`ota_delta_header_t`)    |
+        |-----------------------------------------|
+        |               operations                |
+        |-----------------------------------------|
+
+    - Header: magic 'ODLT', version, header size, window size, old size, new size, flags,
+      SHA-256 of the old content, SHA-256 of the new content.
+    - DATA: 0x00, varint length, literal bytes.
+    - COPY: 0x01, varint length, zigzag varint (source offset - destination offset).
+
+    - Flags: bit 0 set when the sectors are rebuilt from the end, the operations are then in reverse order
+      and the literal bytes reversed. The direction giving the smaller patch is chosen.
+
+    The patch is checked by applying it the way the device does before it is saved.
+"""
+# coding=utf-8
+import sys
+import struct
+import argparse
+import hashlib
+
+__version__ = '1.0'
+
+TARGET_FILE_NAME = 'ota_delta.bin'
+DELTA_MAGIC = 0x544c444f
+DELTA_VERSION = 1
+HEADER_SIZE = 88
+SECTOR_SIZE = 4096
+WINDOW_MAX = 64 * 1024
+OP_DATA = 0
+OP_COPY = 1
+FLAG_REVERSE = 1
+MAX_CANDIDATES = 16
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+def zigzag(value):
+    return value << 1 if value >= 0 else ((-value - 1) << 1) | 1
+
+def allowed_range(rel, window, reverse):
+    """
+    A COPY must not read a sector rewritten more than `window` bytes before the sector being built,
+    returns the range of offsets in a sector where a copy at distance `rel` is allowed
+    """
+    if not reverse:
+        # source sector >= destination sector - window
+        return (min(SECTOR_SIZE, max(0, -window - rel)), SECTOR_SIZE)
+    # source sector <= destination sector + window
+    return (0, min(SECTOR_SIZE, SECTOR_SIZE + window - rel))
+
+def legalize(dst, src, length, window, reverse):
+    """
+    Split a match into (is_copy, dst, src, length) pieces the in place applier can handle
+    """
+    low, high = allowed_range(src - dst, window, reverse)
+    if low == 0 and high == SECTOR_SIZE:
+        return [(True, dst, src, length)]
+    pieces = []
+    end = dst + length
+    while dst < end:
+        base = dst - dst % SECTOR_SIZE
+        for piece_end, is_copy in ((base + low, False), (base + high, True), (base + SECTOR_SIZE, False)):
+            n = min(piece_end, end) - dst
+            if n > 0:
+                if pieces and pieces[-1][0] == is_copy:
+                    last = pieces[-1]
+                    pieces[-1] = (is_copy, last[1], last[2], last[3] + n)
+                else:
+                    pieces.append((is_copy, dst, src, n))
+                dst += n
+                src += n
+    return pieces
+
+def match_length(old, new, src, dst):
+    n = 0
+    limit = min(len(old) - src, len(new) - dst)
+    step = 256
+    while n + step <= limit and old[src + n:src + n + step] == new[dst + n:dst + n + step]:
+        n += step
+    while n < limit and old[src + n] == new[dst + n]:
+        n += 1
+    return n
+
+def build_index(old, block):
+    index = {}
+    for pos in range(0, len(old) - block + 1, block):
+        candidates = index.setdefault(old[pos:pos + block], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(pos)
+    return index
+
+def diff(old, new, index, window, block, reverse):
+    """
+    Greedy block matching, returns the list of (is_copy, dst, src, length) in the order of the new content
+    """
+    ops = []
+    literal = 0  # start of the pending literal run
+    dst = 0
+    while dst < len(new):
+        # Unchanged content in place is the cheapest, it doesn't even need a flash write
+        best = None
+        skip = 0
+        if dst < len(old) and old[dst] == new[dst]:
+            n = match_length(old, new, dst, dst)
+            if n >= block:
+                best = (dst, dst, n, n)
+        if best is None:
+            for cand in index.get(new[dst:dst + block], ()):
+                # Slide the aligned block match back to where the run really starts
+                back = 0
+                while back < dst - literal and cand - back > 0 and old[cand - back - 1] == new[dst - back - 1]:
+                    back += 1
+                start = dst - back
+                n = match_length(old, new, cand - back, start)
+                score = sum(p[3] for p in legalize(start, cand - back, n, window, reverse) if p[0])
+                if score >= block and (best is None or score > best[3]):
+                    best = (start, cand - back, n, score)
+                skip = max(skip, start + n - dst)
+        if best is None:
+            # A match that can't be copied in place is sent as literal, don't look for it again at every byte
+            dst += max(1, skip)
+            continue
+        start, src, n, _ = best
+        if start > literal:
+            ops.append((False, literal, 0, start - literal))
+        ops.extend(legalize(start, src, n, window, reverse))
+        dst = start + n
+        literal = dst
+    if literal < len(new):
+        ops.append((False, literal, 0, len(new) - literal))
+
+    merged = []
+    for op in ops:
+        if merged and not op[0] and not merged[-1][0]:
+            last = merged[-1]
+            merged[-1] = (False, last[1], 0, last[3] + op[3])
+        else:
+            merged.append(op)
+    return merged
+
+def encode(ops, old, new, window, reverse):
+    body = bytearray()
+    for is_copy, dst, src, length in (reversed(ops) if reverse else ops):
+        if is_copy:
+            body += bytes([OP_COPY]) + varint(length) + varint(zigzag(src - dst))
+        else:
+            data = new[dst:dst + length]
+            body += bytes([OP_DATA]) + varint(length) + (data[::-1] if reverse else data)
+    header = struct.pack('<IHHIIII32s32s', DELTA_MAGIC, DELTA_VERSION, HEADER_SIZE, window, len(old), len(new),
+                         FLAG_REVERSE if reverse else 0, hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    return header + bytes(body)
+
+def apply_in_place(old, patch):
+    """
+    Apply the patch the way `ota_delta.c` does: sector by sector over the old content, with a window of overwritten sectors
+    """
+    magic, version, header_size, window, old_size, new_size, flags, old_sha, new_sha = struct.unpack_from('<IHHIIII32s32s', patch)
+    assert magic == DELTA_MAGIC and old_size == len(old) and hashlib.sha256(old).digest() == old_sha
+    reverse = flags & FLAG_REVERSE
+    flash = bytearray(old) + b'\xff' * max(0, new_size + SECTOR_SIZE - len(old))
+    ring = {}
+    sector = bytearray(SECTOR_SIZE)
+    out = new_size if reverse else 0
+    pos = header_size
+
+    def read_varint():
+        nonlocal pos
+        value, shift = 0, 0
+        while True:
+            byte = patch[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def build(data, rel, length):
+        """
+        build `length` bytes of the sector being built at most, returns the count
+        """
+        nonlocal out
+        building = (out - 1 if reverse else out) // SECTOR_SIZE
+        start = building * SECTOR_SIZE
+        n = min(length, out - start if reverse else start + SECTOR_SIZE - out)
+        dst = out - n if reverse else out
+        if data is None:
+            for i in range(n):
+                src = dst + i + rel
+                index = src // SECTOR_SIZE
+                # Sectors past the new content are never rewritten
+                if (index <= building or index > (new_size - 1) // SECTOR_SIZE) if reverse else (index >= building):
+                    sector[dst + i - start] = flash[src]
+                else:
+                    assert abs(index - building) <= window // SECTOR_SIZE, 'copy out of the window'
+                    sector[dst + i - start] = ring[index][src % SECTOR_SIZE]
+        else:
+            sector[dst - start:dst - start + n] = data[:n][::-1] if reverse else data[:n]
+        out = dst if reverse else dst + n
+        if (dst == start) if reverse else (out == start + SECTOR_SIZE):
+            flush(building)
+        return n
+
+    def flush(index):
+        start = index * SECTOR_SIZE
+        length = min(SECTOR_SIZE, new_size - start)
+        ring[index] = bytes(flash[start:start + SECTOR_SIZE])
+        flash[start:start + length] = sector[:length]
+
+    while pos < len(patch):
+        op = patch[pos]
+        pos += 1
+        length = read_varint()
+        if op == OP_DATA:
+            data = patch[pos:pos + length]
+            pos += length
+            while data:
+                n = build(data, 0, len(data))
+                data = data[n:]
+        else:
+            rel = read_varint()
+            rel = (rel >> 1) ^ -(rel & 1)
+            while length:
+                length -= build(None, rel, length)
+    if not reverse and out % SECTOR_SIZE:
+        flush(out // SECTOR_SIZE)
+    result = bytes(flash[:new_size])
+    assert hashlib.sha256(result).digest() == new_sha
+    return result
+
+if __name__ == '__main__':
+
+    argparser = argparse.ArgumentParser()
+    argparser.add_argument('-o', '--old', type=str, required=True, help='the old image, currently in the partition')
+    argparser.add_argument('-n', '--new', type=str, required=True, help='the new image')
+    argparser.add_argument('-t', '--target', type=str, default=TARGET_FILE_NAME, help='patch file name')
+    argparser.add_argument('-w', '--window', type=int, default=16 * 1024, help='RAM window of the device in bytes')
+    argparser.add_argument('-b', '--block', type=int, default=32, help='match block size')
+    args = argparser.parse_args()
+
+    if args.window % SECTOR_SIZE or args.window < 0 or args.window > WINDOW_MAX:
+        print ('The window must be a multiple of %d, up to %d' % (SECTOR_SIZE, WINDOW_MAX))
+        sys.exit(1)
+
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    with open(args.new, 'rb') as f:
+        new = f.read()
+
+    # Content moved up is only copied when the sectors are rebuilt from the end, keep the direction giving the smaller patch
+    index = build_index(old, args.block)
+    results = []
+    for reverse in (False, True):
+        ops = diff(old, new, index, args.window, args.block, reverse)
+        results.append((len(encode(ops, old, new, args.window, reverse)), reverse, ops))
+    _, reverse, ops = min(results, key=lambda r: r[0])
+    patch = encode(ops, old, new, args.window, reverse)
+    if apply_in_place(old, patch) != new:
+        print ('Patch check failed')
+        sys.exit(1)
+
+    copied = sum(op[3] for op in ops if op[0])
+    print ('direction: %s' % ('reverse' if reverse else 'forward'))
+    print ('__version__: ', __version__)
+    print ('old size: %d, new size: %d, patch size: %d' % (len(old), len(new), len(patch)))
+    print ('copied: %d, literal: %d' % (copied, len(new) - copied))
+    with open(args.target, 'wb') as f:
+        f.write(patch)
+    print ('Target generated into %s\r\n' % (args.target))